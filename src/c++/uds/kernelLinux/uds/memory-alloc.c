@@ -505,6 +505,91 @@ void *uds_allocate_memory_nowait(size_t size, const char *what __maybe_unused)
 	return p;
 }
 
+int uds_allocate_arena(size_t size, int node, const char *what, void *ptr)
+{
+	/* See uds_allocate_memory() for the choice of flags. */
+	const gfp_t gfp_flags = GFP_KERNEL | __GFP_ZERO | __GFP_RETRY_MAYFAIL;
+	unsigned int noio_flags;
+	bool allocations_restricted;
+	struct vmalloc_block_info *block;
+	unsigned long start_time;
+	int result;
+	void *p;
+
+	if ((node == NUMA_NO_NODE) || (size <= PAGE_SIZE))
+		return uds_allocate_memory(size, ((size < PAGE_SIZE) ? L1_CACHE_BYTES : PAGE_SIZE),
+					   what, ptr);
+
+	if (ptr == NULL)
+		return UDS_INVALID_ARGUMENT;
+
+#if defined(TEST_INTERNAL) || defined(VDO_INTERNAL)
+	if (atomic_long_inc_return(&uds_allocate_memory_counter) ==
+	    uds_allocation_error_injection) {
+		uds_log_warning("Injecting %s error on %zu bytes for %s",
+				__func__, size, what);
+		uds_log_backtrace(UDS_LOG_WARNING);
+		return -ENOMEM;
+	}
+
+#endif /* TEST_INTERNAL or VDO_INTERNAL */
+	result = uds_allocate(1, struct vmalloc_block_info, __func__, &block);
+	if (result != UDS_SUCCESS)
+		return result;
+
+	allocations_restricted = !allocations_allowed();
+	if (allocations_restricted)
+		noio_flags = memalloc_noio_save();
+
+	/*
+	 * kvmalloc_node() prefers the given node without insisting on it. It refuses anything over
+	 * INT_MAX bytes, so such arenas go straight to vzalloc_node().
+	 */
+	start_time = jiffies;
+	if (size <= INT_MAX)
+		p = kvmalloc_node(size, gfp_flags, node);
+	else
+		p = vzalloc_node(size, node);
+
+	if (allocations_restricted)
+		memalloc_noio_restore(noio_flags);
+
+	if (unlikely(p == NULL)) {
+		uds_free(block);
+		uds_log_error("Could not allocate %zu bytes for %s on node %d in %u msecs",
+			      size, what, node, jiffies_to_msecs(jiffies - start_time));
+		return -ENOMEM;
+	}
+
+	if (is_vmalloc_addr(p)) {
+		block->ptr = p;
+		block->size = PAGE_ALIGN(size);
+		add_vmalloc_block(block);
+	} else {
+		uds_free(block);
+		add_kmalloc_block(ksize(p));
+	}
+
+#if defined(TEST_INTERNAL) || defined(VDO_INTERNAL)
+	add_tracking_block(p, (is_vmalloc_addr(p) ? PAGE_ALIGN(size) : ksize(p)), what);
+#endif /* TEST_INTERNAL or VDO_INTERNAL */
+	*((void **) ptr) = p;
+	return UDS_SUCCESS;
+}
+
+int uds_get_zone_node(unsigned int zone)
+{
+	unsigned int skip = zone % num_online_nodes();
+	int node;
+
+	for_each_online_node(node) {
+		if (skip-- == 0)
+			return node;
+	}
+
+	return first_online_node;
+}
+
 void uds_free(void *ptr)
 {
 	if (ptr != NULL) {
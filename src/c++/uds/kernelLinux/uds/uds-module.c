@@ -49,6 +49,7 @@ EXPORT_SYMBOL_GPL(uds_suspend_index_session);
 
 EXPORT_SYMBOL_GPL(__uds_log_message);
 EXPORT_SYMBOL_GPL(__uds_log_strerror);
+EXPORT_SYMBOL_GPL(uds_allocate_arena);
 EXPORT_SYMBOL_GPL(uds_allocate_memory);
 EXPORT_SYMBOL_GPL(uds_allocate_memory_nowait);
 EXPORT_SYMBOL_GPL(uds_append_to_buffer);
@@ -60,6 +61,7 @@ EXPORT_SYMBOL_GPL(uds_funnel_queue_poll);
 EXPORT_SYMBOL_GPL(uds_get_log_level);
 EXPORT_SYMBOL_GPL(uds_get_memory_stats);
 EXPORT_SYMBOL_GPL(uds_get_thread_device_id);
+EXPORT_SYMBOL_GPL(uds_get_zone_node);
 EXPORT_SYMBOL_GPL(uds_initialize_thread_registry);
 EXPORT_SYMBOL_GPL(uds_is_funnel_queue_empty);
 EXPORT_SYMBOL_GPL(uds_log_backtrace);
@@ -129,6 +131,7 @@ EXPORT_SYMBOL_GPL(map_to_physical_page);
 EXPORT_SYMBOL_GPL(min_volume_index_delta_lists);
 EXPORT_SYMBOL_GPL(move_bits);
 EXPORT_SYMBOL_GPL(murmurhash3_128);
+EXPORT_SYMBOL_GPL(murmurhash3_128_multi);
 EXPORT_SYMBOL_GPL(put_page_in_cache);
 EXPORT_SYMBOL_GPL(saves_begun);
 EXPORT_SYMBOL_GPL(search_record_page);
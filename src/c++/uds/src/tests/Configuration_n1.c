@@ -117,6 +117,42 @@ static void savedTest(void)
   uninitializeOldInterfaces();
 }
 
+/**********************************************************************/
+static void fingerprintTest(void)
+{
+  struct uds_parameters params = {
+    .memory_size = UDS_MEMORY_CONFIG_256MB,
+    .bdev = testDevice,
+  };
+  randomizeUdsNonce(&params);
+
+  // An index must refuse a client naming records with a different hash, and
+  // must say that it exists so that it is not rebuilt over.
+  struct uds_index_session *indexSession;
+  UDS_ASSERT_SUCCESS(uds_create_index_session(&indexSession));
+  UDS_ASSERT_SUCCESS(uds_open_index(UDS_CREATE, &params, indexSession));
+  UDS_ASSERT_SUCCESS(uds_close_index(indexSession));
+  params.fingerprint = 1;
+  CU_ASSERT_EQUAL(-EEXIST,
+                  uds_open_index(UDS_NO_REBUILD, &params, indexSession));
+
+  UDS_ASSERT_SUCCESS(uds_open_index(UDS_CREATE, &params, indexSession));
+  UDS_ASSERT_SUCCESS(uds_close_index(indexSession));
+  params.fingerprint = 0;
+  CU_ASSERT_EQUAL(-EEXIST,
+                  uds_open_index(UDS_NO_REBUILD, &params, indexSession));
+
+  // The fingerprint survives a save and is reported with the parameters.
+  params.fingerprint = 1;
+  UDS_ASSERT_SUCCESS(uds_open_index(UDS_NO_REBUILD, &params, indexSession));
+  struct uds_parameters *savedParams;
+  UDS_ASSERT_SUCCESS(uds_get_index_parameters(indexSession, &savedParams));
+  CU_ASSERT_EQUAL(1, savedParams->fingerprint);
+  uds_free(savedParams);
+  UDS_ASSERT_SUCCESS(uds_close_index(indexSession));
+  UDS_ASSERT_SUCCESS(uds_destroy_index_session(indexSession));
+}
+
 /**********************************************************************/
 static void testRun(TestConfig *tc)
 {
@@ -328,6 +364,7 @@ static void bigTest(void)
 
 static const CU_TestInfo tests[] = {
   { "Saved", savedTest },
+  { "Fingerprint", fingerprintTest },
   { "256MB", mb256Test },
   { "512MB", mb512Test },
   { "768MB", mb768Test },
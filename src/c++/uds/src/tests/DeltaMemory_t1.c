@@ -173,7 +173,7 @@ static void rebalanceTest(u32 nLists, int bytesPerList, int allocIncr)
 {
   int initSize = ((nLists + 2) * bytesPerList / allocIncr + 1) * allocIncr;
   UDS_ASSERT_SUCCESS(uds_initialize_delta_index(&delta_index, 1, nLists, MEAN_DELTA,
-                                                NUM_PAYLOAD_BITS, initSize, 'm'));
+                                                NUM_PAYLOAD_BITS, initSize, 'm', false));
   struct delta_zone *dm = &delta_index.delta_zones[0];
 
   // Use lists that increase in size.
@@ -216,7 +216,7 @@ static void growingTest(u32 nLists, int bytesPerList, int allocIncr)
 {
   int initSize = ((nLists + 2) * bytesPerList / allocIncr + 1) * allocIncr;
   UDS_ASSERT_SUCCESS(uds_initialize_delta_index(&delta_index, 1, nLists, MEAN_DELTA,
-                                                NUM_PAYLOAD_BITS, initSize, 'm'));
+                                                NUM_PAYLOAD_BITS, initSize, 'm', false));
   struct delta_zone *dm = &delta_index.delta_zones[0];
 
   // Use random list sizes.
@@ -257,7 +257,7 @@ static void overflowTest(void)
   enum { LIST_COUNT = 1 << 10 };
   enum { ALLOC_SIZE = 1 << 17 };
   UDS_ASSERT_SUCCESS(uds_initialize_delta_index(&delta_index, 1, LIST_COUNT, MEAN_DELTA,
-                                                NUM_PAYLOAD_BITS, ALLOC_SIZE, 'm'));
+                                                NUM_PAYLOAD_BITS, ALLOC_SIZE, 'm', false));
   struct delta_zone *dm = &delta_index.delta_zones[0];
   CU_ASSERT_EQUAL(dm->size, ALLOC_SIZE);
 
@@ -86,6 +86,33 @@ static void testSingletonQueue(void)
   uds_free_funnel_queue(queue);
 }
 
+/**********************************************************************/
+static void testChainQueue(void)
+{
+  struct funnel_queue *queue;
+  struct funnel_queue_entry entries[4];
+
+  UDS_ASSERT_SUCCESS(uds_make_funnel_queue(&queue));
+
+  // A chain of one behaves like a single put.
+  uds_funnel_queue_put_chain(queue, &entries[0], &entries[0]);
+  CU_ASSERT_PTR_EQUAL(&entries[0], uds_funnel_queue_poll(queue));
+  CU_ASSERT_PTR_NULL(uds_funnel_queue_poll(queue));
+
+  // A chain lands behind a single entry, and a single entry behind a chain.
+  uds_funnel_queue_put(queue, &entries[0]);
+  entries[1].next = &entries[2];
+  uds_funnel_queue_put_chain(queue, &entries[1], &entries[2]);
+  uds_funnel_queue_put(queue, &entries[3]);
+  unsigned int i;
+  for (i = 0; i < 4; i++) {
+    CU_ASSERT_PTR_EQUAL(&entries[i], uds_funnel_queue_poll(queue));
+  }
+  CU_ASSERT_PTR_NULL(uds_funnel_queue_poll(queue));
+
+  uds_free_funnel_queue(queue);
+}
+
 /**
  * Thread function that loops ITERATIONS times, putting newly allocated Entry
  * instances with values 0 .. ITERATIONS - 1 on the funnel queue passed as the
@@ -103,6 +130,34 @@ static void enqueueLoop(void *arg)
   }
 }
 
+/**
+ * Thread function like enqueueLoop(), but which puts its entries on the
+ * queue in chains of one to eight entries.
+ **/
+static void chainEnqueueLoop(void *arg)
+{
+  struct funnel_queue *queue = (struct funnel_queue *) arg;
+  unsigned int i = 0;
+  while (i < ITERATIONS) {
+    unsigned int length = min(ITERATIONS - i, (i % 8) + 1);
+    Entry *first = NULL;
+    Entry *last = NULL;
+    unsigned int j;
+    for (j = 0; j < length; j++, i++) {
+      Entry *entry;
+      UDS_ASSERT_SUCCESS(uds_allocate(1, Entry, __func__, &entry));
+      entry->value = i;
+      if (first == NULL) {
+        first = entry;
+      } else {
+        last->link.next = &entry->link;
+      }
+      last = entry;
+    }
+    uds_funnel_queue_put_chain(queue, &first->link, &last->link);
+  }
+}
+
 /**
  * Remove an Entry from a funnel queue, looping and sleeping if the queue
  * appears to be empty.
@@ -198,6 +253,52 @@ static void testTenProducers(void)
   uds_free_funnel_queue(queue);
 }
 
+/**
+ * Exercise ten producer threads each putting ITERATIONS entries on the queue
+ * in chains, checking that each producer's entries arrive in order.
+ **/
+static void testTenChainProducers(void)
+{
+  enum { PRODUCER_COUNT = 10 };
+  struct thread *producers[PRODUCER_COUNT];
+  struct funnel_queue *queue;
+  UDS_ASSERT_SUCCESS(uds_make_funnel_queue(&queue));
+
+  unsigned int i;
+  for (i = 0; i < PRODUCER_COUNT; i++) {
+    char nameBuf[100];
+    UDS_ASSERT_SUCCESS(uds_fixed_sprintf(nameBuf, sizeof(nameBuf),
+                                         "chainer%d", i));
+    UDS_ASSERT_SUCCESS(uds_create_thread(chainEnqueueLoop, queue, nameBuf,
+                                         &producers[i]));
+  }
+
+  // Entries from one producer arrive in order, so every value is seen once
+  // per producer and no value is seen more often than a smaller one.
+  u8 *seen;
+  UDS_ASSERT_SUCCESS(uds_allocate(ITERATIONS, u8, __func__, &seen));
+  for (i = 0; i < ITERATIONS * PRODUCER_COUNT; i++) {
+    Entry *entry = dequeue(queue);
+    seen[entry->value] += 1;
+    if (entry->value > 0) {
+      CU_ASSERT(seen[entry->value] <= seen[entry->value - 1]);
+    }
+    uds_free(entry);
+  }
+
+  for (i = 0; i < ITERATIONS; i++) {
+    CU_ASSERT_EQUAL(PRODUCER_COUNT, seen[i]);
+  }
+  uds_free(seen);
+
+  for (i = 0; i < PRODUCER_COUNT; i++) {
+    uds_join_threads(producers[i]);
+  }
+
+  CU_ASSERT_PTR_NULL(uds_funnel_queue_poll(queue));
+  uds_free_funnel_queue(queue);
+}
+
 /**********************************************************************/
 
 static const CU_TestInfo funnelQueueTests[] = {
@@ -206,6 +307,8 @@ static const CU_TestInfo funnelQueueTests[] = {
   {"singleton queue",          testSingletonQueue  },
   {"one producer",             testOneProducer     },
   {"ten producers",            testTenProducers    },
+  {"chain queue",              testChainQueue      },
+  {"ten chain producers",      testTenChainProducers },
   CU_TEST_INFO_NULL,
 };
 
@@ -47,7 +47,7 @@ int uds_make_open_chapter_index(struct open_chapter_index **chapter_index,
 					    geometry->delta_lists_per_chapter,
 					    geometry->chapter_mean_delta,
 					    geometry->chapter_payload_bits,
-					    memory_size, 'm');
+					    memory_size, 'm', false);
 	if (result != UDS_SUCCESS) {
 		uds_free(index);
 		return result;
@@ -14,6 +14,7 @@
 static const u8 INDEX_CONFIG_MAGIC[] = "ALBIC";
 static const u8 INDEX_CONFIG_VERSION_6_02[] = "06.02";
 static const u8 INDEX_CONFIG_VERSION_8_02[] = "08.02";
+static const u8 INDEX_CONFIG_VERSION_8_03[] = "08.03";
 
 enum {
 	DEFAULT_VOLUME_READ_THREADS = 2,
@@ -114,7 +115,8 @@ int uds_validate_config_contents(struct buffered_reader *reader,
 		return uds_log_error_strerror(result, "cannot read index config version");
 
 	if (!is_version(INDEX_CONFIG_VERSION_6_02, version_buffer) &&
-	    !is_version(INDEX_CONFIG_VERSION_8_02, version_buffer)) {
+	    !is_version(INDEX_CONFIG_VERSION_8_02, version_buffer) &&
+	    !is_version(INDEX_CONFIG_VERSION_8_03, version_buffer)) {
 		return uds_log_error_strerror(UDS_CORRUPT_DATA,
 					      "unsupported configuration version: '%.*s'",
 					      INDEX_CONFIG_VERSION_LENGTH,
@@ -129,7 +131,7 @@ int uds_validate_config_contents(struct buffered_reader *reader,
 	decode_u32_le(buffer, &offset, &geometry.chapters_per_volume);
 	decode_u32_le(buffer, &offset, &geometry.sparse_chapters_per_volume);
 	decode_u32_le(buffer, &offset, &config.cache_chapters);
-	offset += sizeof(u32);
+	decode_u32_le(buffer, &offset, &config.fingerprint);
 	decode_u32_le(buffer, &offset, &config.volume_index_mean_delta);
 	decode_u32_le(buffer, &offset, &bytes_per_page);
 	geometry.bytes_per_page = bytes_per_page;
@@ -160,6 +162,21 @@ int uds_validate_config_contents(struct buffered_reader *reader,
 			      &user_config->geometry->remapped_physical);
 	}
 
+	/* Only version 8.03 records a fingerprint; the field is unused in earlier versions. */
+	if (!is_version(INDEX_CONFIG_VERSION_8_03, version_buffer))
+		config.fingerprint = 0;
+
+	/*
+	 * Records named with a different hash can never match, and rebuilding the index would
+	 * only discard it, so refuse to load it at all.
+	 */
+	if (config.fingerprint != user_config->fingerprint) {
+		return uds_log_error_strerror(UDS_UNSUPPORTED_VERSION,
+					      "index record name fingerprint (%u) does not match (%u)",
+					      config.fingerprint,
+					      user_config->fingerprint);
+	}
+
 	if (!are_matching_configurations(&config, &geometry, user_config)) {
 		uds_log_warning("Supplied configuration does not match save");
 		return UDS_NO_INDEX;
@@ -171,7 +188,9 @@ int uds_validate_config_contents(struct buffered_reader *reader,
 /*
  * Write the configuration to stable storage. If the superblock version is < 4, write the 6.02
  * version; otherwise write the 8.02 version, indicating the configuration is for an index that has
- * been reduced by one chapter.
+ * been reduced by one chapter. An index whose records are not named with MurmurHash3 is written
+ * as version 8.03, which adds the fingerprint to the 8.02 format and which older versions of UDS
+ * will refuse.
  */
 int uds_write_config_contents(struct buffered_writer *writer,
 			      struct configuration *config, u32 version)
@@ -190,7 +209,12 @@ int uds_write_config_contents(struct buffered_writer *writer,
 	 * If version is < 4, the index has not been reduced by a chapter so it must be written out
 	 * as version 6.02 so that it is still compatible with older versions of UDS.
 	 */
-	if (version >= 4) {
+	if (config->fingerprint != 0) {
+		result = uds_write_to_buffered_writer(writer, INDEX_CONFIG_VERSION_8_03,
+						      INDEX_CONFIG_VERSION_LENGTH);
+		if (result != UDS_SUCCESS)
+			return result;
+	} else if (version >= 4) {
 		result = uds_write_to_buffered_writer(writer, INDEX_CONFIG_VERSION_8_02,
 						      INDEX_CONFIG_VERSION_LENGTH);
 		if (result != UDS_SUCCESS)
@@ -206,7 +230,7 @@ int uds_write_config_contents(struct buffered_writer *writer,
 	encode_u32_le(buffer, &offset, geometry->chapters_per_volume);
 	encode_u32_le(buffer, &offset, geometry->sparse_chapters_per_volume);
 	encode_u32_le(buffer, &offset, config->cache_chapters);
-	encode_u32_le(buffer, &offset, 0);
+	encode_u32_le(buffer, &offset, config->fingerprint);
 	encode_u32_le(buffer, &offset, config->volume_index_mean_delta);
 	encode_u32_le(buffer, &offset, geometry->bytes_per_page);
 	encode_u32_le(buffer, &offset, config->sparse_sample_rate);
@@ -218,7 +242,7 @@ int uds_write_config_contents(struct buffered_writer *writer,
 	if (result != UDS_SUCCESS)
 		return result;
 
-	if (version >= 4) {
+	if ((version >= 4) || (config->fingerprint != 0)) {
 		encode_u64_le(buffer, &offset, geometry->remapped_virtual);
 		encode_u64_le(buffer, &offset, geometry->remapped_physical);
 	}
@@ -317,6 +341,20 @@ static unsigned int __must_check normalize_read_threads(unsigned int requested)
 	return read_threads;
 }
 
+static void log_zone_placement(unsigned int zone_count)
+{
+	char nodes[MAX_ZONES * 5];
+	char *position = nodes;
+	unsigned int z;
+
+	nodes[0] = '\0';
+	for (z = 0; z < zone_count; z++)
+		position = uds_append_to_buffer(position, nodes + sizeof(nodes), " %d",
+						uds_get_zone_node(z));
+
+	uds_log_info("Placing indexing zone memory on NUMA nodes%s", nodes);
+}
+
 int uds_make_configuration(const struct uds_parameters *params,
 			   struct configuration **config_ptr)
 {
@@ -350,7 +388,11 @@ int uds_make_configuration(const struct uds_parameters *params,
 	config->cache_chapters = DEFAULT_CACHE_CHAPTERS;
 	config->volume_index_mean_delta = DEFAULT_VOLUME_INDEX_MEAN_DELTA;
 	config->sparse_sample_rate = (params->sparse ? DEFAULT_SPARSE_SAMPLE_RATE : 0);
+	config->numa_placement = params->numa_placement;
+	if (config->numa_placement)
+		log_zone_placement(config->zone_count);
 	config->nonce = params->nonce;
+	config->fingerprint = params->fingerprint;
 	config->bdev = params->bdev;
 	config->offset = params->offset;
 	config->size = params->size;
@@ -380,4 +422,5 @@ void uds_log_configuration(struct configuration *config)
 	uds_log_debug("  Bytes per page:             %10zu", geometry->bytes_per_page);
 	uds_log_debug("  Sparse sample rate:         %10u", config->sparse_sample_rate);
 	uds_log_debug("  Nonce:                      %llu", (unsigned long long) config->nonce);
+	uds_log_debug("  Record name fingerprint:    %10u", config->fingerprint);
 }
@@ -42,6 +42,9 @@ struct configuration {
 	/* Index owner's nonce */
 	u64 nonce;
 
+	/* The hash the index owner uses to compute record names */
+	u32 fingerprint;
+
 	/* The number of threads used to process index requests */
 	unsigned int zone_count;
 
@@ -58,9 +61,15 @@ struct configuration {
 
 	/* Sampling rate for sparse indexing */
 	u32 sparse_sample_rate;
+
+	/* Whether to place each zone's volume index memory on its own NUMA node */
+	bool numa_placement;
 };
 
-/* On-disk structure of data for a version 8.02 index. */
+/*
+ * On-disk structure of data for a version 8.02 index. Version 8.03 has the same layout, with the
+ * unused field holding the fingerprint of the index owner's record names.
+ */
 struct uds_configuration_8_02 {
 	/* Smaller (16), Small (64) or large (256) indices */
 	u32 record_pages_per_chapter;
@@ -70,7 +79,7 @@ struct uds_configuration_8_02 {
 	u32 sparse_chapters_per_volume;
 	/* Size of the page cache, in chapters */
 	u32 cache_chapters;
-	/* Unused field */
+	/* Unused field (the record name fingerprint in version 8.03) */
 	u32 unused;
 	/* The volume index mean delta to use */
 	u32 volume_index_mean_delta;
@@ -325,11 +325,11 @@ void uds_uninitialize_delta_index(struct delta_index *delta_index)
 
 static int initialize_delta_zone(struct delta_zone *delta_zone, size_t size,
 				 u32 first_list, u32 list_count, u32 mean_delta,
-				 u32 payload_bits, u8 tag)
+				 u32 payload_bits, u8 tag, int node)
 {
 	int result;
 
-	result = uds_allocate(size, u8, "delta list", &delta_zone->memory);
+	result = uds_allocate_arena(size, node, "delta list", &delta_zone->memory);
 	if (result != UDS_SUCCESS)
 		return result;
 
@@ -364,7 +364,7 @@ static int initialize_delta_zone(struct delta_zone *delta_zone, size_t size,
 
 int uds_initialize_delta_index(struct delta_index *delta_index, unsigned int zone_count,
 			       u32 list_count, u32 mean_delta, u32 payload_bits,
-			       size_t memory_size, u8 tag)
+			       size_t memory_size, u8 tag, bool numa_placement)
 {
 	int result;
 	unsigned int z;
@@ -403,7 +403,8 @@ int uds_initialize_delta_index(struct delta_index *delta_index, unsigned int zon
 		zone_memory = get_zone_memory_size(zone_count, memory_size);
 		result = initialize_delta_zone(&delta_index->delta_zones[z], zone_memory,
 					       first_list_in_zone, lists_in_zone,
-					       mean_delta, payload_bits, tag);
+					       mean_delta, payload_bits, tag,
+					       (numa_placement ? uds_get_zone_node(z) : NUMA_NO_NODE));
 		if (result != UDS_SUCCESS) {
 			uds_uninitialize_delta_index(delta_index);
 			return result;
@@ -209,7 +209,7 @@ void swap_delta_index_page_endianness(u8 *memory);
 int __must_check uds_initialize_delta_index(struct delta_index *delta_index,
 					    unsigned int zone_count, u32 list_count,
 					    u32 mean_delta, u32 payload_bits,
-					    size_t memory_size, u8 tag);
+					    size_t memory_size, u8 tag, bool numa_placement);
 
 int __must_check uds_initialize_delta_index_page(struct delta_index_page *delta_index_page,
 						 u64 expected_nonce, u32 mean_delta,
@@ -101,6 +101,29 @@ static inline void uds_funnel_queue_put(struct funnel_queue *queue,
 	WRITE_ONCE(previous->next, entry);
 }
 
+/*
+ * Put a chain of entries on the end of the queue with a single atomic exchange.
+ *
+ * The entries from first to last must already be linked together through their "next" fields, in
+ * the order they are to be consumed; last's "next" field will be cleared. The chain becomes
+ * visible to the consumer all at once. The same offset requirement as for uds_funnel_queue_put()
+ * applies to every entry in the chain.
+ */
+static inline void uds_funnel_queue_put_chain(struct funnel_queue *queue,
+					      struct funnel_queue_entry *first,
+					      struct funnel_queue_entry *last)
+{
+	struct funnel_queue_entry *previous;
+
+	/*
+	 * Barrier requirements are the same as for uds_funnel_queue_put(); the full barrier of the
+	 * xchg also orders the stores of the links within the chain before the chain is published.
+	 */
+	WRITE_ONCE(last->next, NULL);
+	previous = xchg(&queue->newest, last);
+	WRITE_ONCE(previous->next, first);
+}
+
 struct funnel_queue_entry *__must_check uds_funnel_queue_poll(struct funnel_queue *queue);
 
 bool __must_check uds_is_funnel_queue_empty(struct funnel_queue *queue);
@@ -9,6 +9,7 @@
 #include <linux/cache.h>
 #ifdef __KERNEL__
 #include <linux/io.h> /* for PAGE_SIZE */
+#include <linux/numa.h>
 #else
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +20,10 @@
 #include "thread-registry.h"
 #endif
 
+#ifndef __KERNEL__
+#define NUMA_NO_NODE (-1)
+#endif
+
 /* Custom memory allocation function for UDS that tracks memory usage */
 int __must_check uds_allocate_memory(size_t size, size_t align, const char *what, void *ptr);
 
@@ -130,6 +135,31 @@ static inline int __must_check uds_allocate_cache_aligned(size_t size, const cha
  */
 void *__must_check uds_allocate_memory_nowait(size_t size, const char *what);
 
+/*
+ * Allocate a large, long-lived arena, logging an error if the allocation fails. The memory will be
+ * zeroed, and page aligned if it is at least a page in size. If a node is given, the memory is
+ * placed on that NUMA node where possible. Without a node, this is the same as
+ * uds_allocate_memory().
+ *
+ * @size: The number of bytes to allocate
+ * @node: The NUMA node on which to place the memory, or NUMA_NO_NODE
+ * @what: What is being allocated (for error logging)
+ * @ptr: A pointer to hold the allocated memory
+ *
+ * Return: UDS_SUCCESS or an error code
+ */
+int __must_check uds_allocate_arena(size_t size, int node, const char *what, void *ptr);
+
+/*
+ * Get the NUMA node on which to place the memory of a zone. Zones are spread over the online nodes
+ * in turn.
+ *
+ * @zone: The number of the zone
+ *
+ * Return: The node for the zone
+ */
+int __must_check uds_get_zone_node(unsigned int zone);
+
 int __must_check uds_reallocate_memory(void *ptr, size_t old_size, size_t size,
 				       const char *what, void *new_ptr);
 
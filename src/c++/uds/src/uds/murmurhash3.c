@@ -49,51 +49,43 @@ static __always_inline u64 fmix64(u64 k)
 	return k;
 }
 
-void murmurhash3_128(const void *key, const int len, const u32 seed, void *out)
+static __always_inline void mix_block(u64 *h1_ptr, u64 *h2_ptr, u64 k1, u64 k2)
 {
-	const u8 *data = key;
-	const int nblocks = len / 16;
-
-	u64 h1 = seed;
-	u64 h2 = seed;
-
 	const u64 c1 = 0x87c37b91114253d5LLU;
 	const u64 c2 = 0x4cf5ad432745937fLLU;
+	u64 h1 = *h1_ptr;
+	u64 h2 = *h2_ptr;
 
-	/* body */
-
-	const u64 *blocks = (const u64 *)(data);
-
-	int i;
+	k1 *= c1;
+	k1 = ROTL64(k1, 31);
+	k1 *= c2;
+	h1 ^= k1;
 
-	for (i = 0; i < nblocks; i++) {
-		u64 k1 = getblock64(blocks, i * 2 + 0);
-		u64 k2 = getblock64(blocks, i * 2 + 1);
+	h1 = ROTL64(h1, 27);
+	h1 += h2;
+	h1 = h1 * 5 + 0x52dce729;
 
-		k1 *= c1;
-		k1 = ROTL64(k1, 31);
-		k1 *= c2;
-		h1 ^= k1;
+	k2 *= c2;
+	k2 = ROTL64(k2, 33);
+	k2 *= c1;
+	h2 ^= k2;
 
-		h1 = ROTL64(h1, 27);
-		h1 += h2;
-		h1 = h1 * 5 + 0x52dce729;
+	h2 = ROTL64(h2, 31);
+	h2 += h1;
+	h2 = h2 * 5 + 0x38495ab5;
 
-		k2 *= c2;
-		k2 = ROTL64(k2, 33);
-		k2 *= c1;
-		h2 ^= k2;
+	*h1_ptr = h1;
+	*h2_ptr = h2;
+}
 
-		h2 = ROTL64(h2, 31);
-		h2 += h1;
-		h2 = h2 * 5 + 0x38495ab5;
-	}
+static void finish_hash(u64 h1, u64 h2, const u8 *tail, int len, void *out)
+{
+	const u64 c1 = 0x87c37b91114253d5LLU;
+	const u64 c2 = 0x4cf5ad432745937fLLU;
 
 	/* tail */
 
 	{
-		const u8 *tail = (const u8 *)(data + nblocks * 16);
-
 		u64 k1 = 0;
 		u64 k2 = 0;
 
@@ -173,3 +165,63 @@ void murmurhash3_128(const void *key, const int len, const u32 seed, void *out)
 	putblock64((u64 *)out, 0, h1);
 	putblock64((u64 *)out, 1, h2);
 }
+
+void murmurhash3_128(const void *key, const int len, const u32 seed, void *out)
+{
+	const u8 *data = key;
+	const int nblocks = len / 16;
+
+	u64 h1 = seed;
+	u64 h2 = seed;
+
+	/* body */
+
+	const u64 *blocks = (const u64 *)(data);
+
+	int i;
+
+	for (i = 0; i < nblocks; i++)
+		mix_block(&h1, &h2, getblock64(blocks, i * 2 + 0), getblock64(blocks, i * 2 + 1));
+
+	finish_hash(h1, h2, data + nblocks * 16, len, out);
+}
+
+/*
+ * Hash several keys of the same length. Groups of MURMURHASH3_LANES keys are hashed together, with
+ * the blocks of each key mixed in interleaved lanes, so that the long multiply chains of the
+ * independent hashes overlap instead of running back to back. The result for each key is
+ * identical to that of murmurhash3_128().
+ */
+void murmurhash3_128_multi(const void *const keys[], unsigned int count, const int len,
+			   const u32 seed, void *const outs[])
+{
+	const int nblocks = len / 16;
+	unsigned int first;
+
+	for (first = 0; first + MURMURHASH3_LANES <= count; first += MURMURHASH3_LANES) {
+		const u64 *blocks[MURMURHASH3_LANES];
+		u64 h1[MURMURHASH3_LANES];
+		u64 h2[MURMURHASH3_LANES];
+		unsigned int lane;
+		int i;
+
+		for (lane = 0; lane < MURMURHASH3_LANES; lane++) {
+			blocks[lane] = keys[first + lane];
+			h1[lane] = seed;
+			h2[lane] = seed;
+		}
+
+		for (i = 0; i < nblocks; i++) {
+			for (lane = 0; lane < MURMURHASH3_LANES; lane++)
+				mix_block(&h1[lane], &h2[lane], getblock64(blocks[lane], i * 2 + 0),
+					  getblock64(blocks[lane], i * 2 + 1));
+		}
+
+		for (lane = 0; lane < MURMURHASH3_LANES; lane++)
+			finish_hash(h1[lane], h2[lane], (const u8 *) keys[first + lane] + nblocks * 16,
+				    len, outs[first + lane]);
+	}
+
+	for (; first < count; first++)
+		murmurhash3_128(keys[first], len, seed, outs[first]);
+}
@@ -10,6 +10,14 @@
 #include <linux/compiler.h>
 #include <linux/types.h>
 
+enum {
+	/* The number of keys hashed together by murmurhash3_128_multi() */
+	MURMURHASH3_LANES = 4,
+};
+
 void murmurhash3_128(const void *key, int len, u32 seed, void *out);
 
+void murmurhash3_128_multi(const void *const keys[], unsigned int count, int len, u32 seed,
+			   void *const outs[]);
+
 #endif /* _MURMURHASH3_H_ */
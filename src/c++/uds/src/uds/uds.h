@@ -147,10 +147,14 @@ struct uds_parameters {
 	bool sparse;
 	/* A 64-bit nonce to validate the index */
 	u64 nonce;
+	/* The hash the index owner uses to compute record names (0 is MurmurHash3) */
+	u32 fingerprint;
 	/* The number of threads used to process index requests */
 	unsigned int zone_count;
 	/* The number of threads used to read volume pages */
 	unsigned int read_threads;
+	/* Whether to place each zone's volume index memory on its own NUMA node */
+	bool numa_placement;
 };
 
 /*
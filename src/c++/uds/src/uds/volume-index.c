@@ -1269,7 +1269,7 @@ static int initialize_volume_sub_index(const struct configuration *config,
 	result = uds_initialize_delta_index(&sub_index->delta_index, zone_count,
 					    params.list_count, params.mean_delta,
 					    params.chapter_bits, params.memory_size,
-					    tag);
+					    tag, config->numa_placement);
 	if (result != UDS_SUCCESS)
 		return result;
 
@@ -51,44 +51,6 @@ static inline unsigned long __attribute__((const)) swab(unsigned long x) {
  */
 #define round_down(x, y) ((x) & ~__round_mask(x, y))
 
-// From asm-generic/bitops/__ffs.h
-/**
- * __ffs - find first bit in word.
- * @word: The word to search
- *
- * Undefined if no bit exists, so code should check against 0 first.
- */
-static __always_inline unsigned long __ffs(unsigned long word)
-{
-	int num = 0;
-
-#if __BITS_PER_LONG == 64
-	if ((word & 0xffffffff) == 0) {
-		num += 32;
-		word >>= 32;
-	}
-#endif
-	if ((word & 0xffff) == 0) {
-		num += 16;
-		word >>= 16;
-	}
-	if ((word & 0xff) == 0) {
-		num += 8;
-		word >>= 8;
-	}
-	if ((word & 0xf) == 0) {
-		num += 4;
-		word >>= 4;
-	}
-	if ((word & 0x3) == 0) {
-		num += 2;
-		word >>= 2;
-	}
-	if ((word & 0x1) == 0)
-		num += 1;
-	return num;
-}
-
 // From asm-generic/bitops/ffz.h
 /*
  * ffz - find first zero in word.
@@ -149,6 +111,14 @@ static unsigned long _find_next_bit(const unsigned long *addr1,
 	return min(start + __ffs(tmp), nbits);
 }
 
+/**********************************************************************/
+unsigned long find_next_bit(const unsigned long *addr,
+			    unsigned long size,
+			    unsigned long offset)
+{
+	return _find_next_bit(addr, NULL, size, offset, 0UL, 0);
+}
+
 /**********************************************************************/
 unsigned long find_next_zero_bit(const unsigned long *addr,
 				 unsigned long size,
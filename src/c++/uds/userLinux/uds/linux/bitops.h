@@ -14,6 +14,7 @@
 #include <linux/bits.h> 
 #include <linux/compiler.h> 
 #include <linux/const.h>
+#include <linux/types.h>
 
 // From vdso/const.h
 #define UL(x)		(_UL(x))
@@ -64,6 +65,33 @@ static inline int test_bit(int nr, const volatile unsigned long *addr)
 	return 1UL & (addr[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG-1)));
 }
 
+/**
+ * __ffs - find first set bit in word
+ * @word: The word to search
+ *
+ * Undefined if no bit exists, so code should check against 0 first.
+ **/
+static inline unsigned long __ffs(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+/**
+ * rol32 - rotate a 32-bit value left
+ * @word: value to rotate
+ * @shift: bits to roll
+ **/
+static inline u32 rol32(u32 word, unsigned int shift)
+{
+	return (word << (shift & 31)) | (word >> ((-shift) & 31));
+}
+
+/**********************************************************************/
+unsigned long __must_check
+find_next_bit(const unsigned long *addr,
+	      unsigned long size,
+	      unsigned long offset);
+
 /**********************************************************************/
 unsigned long __must_check
 find_next_zero_bit(const unsigned long *addr,
@@ -21,4 +21,6 @@
 #error "unknown cache line size"
 #endif
 
+#define ____cacheline_aligned __aligned(L1_CACHE_BYTES)
+
 #endif  /* __LINUX_CACHE_H */
@@ -6,12 +6,18 @@
 #include <linux/types.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "logger.h"
 #include "memory-alloc.h"
 
 enum { DEFAULT_MALLOC_ALIGNMENT = 2 * sizeof(size_t) }; // glibc malloc
 
+enum {
+	ARENA_PAGE_SIZE = 4096,
+	HUGE_PAGE_SIZE = 2 * 1024 * 1024,
+};
+
 /**
  * Allocate storage based on memory size and alignment, logging an error if
  * the allocation fails. The memory will be zeroed.
@@ -85,6 +91,40 @@ void *uds_allocate_memory_nowait(size_t size, const char *what)
 	return p;
 }
 
+/**
+ * Allocate a large, long-lived arena. There is no NUMA placement in user
+ * space, but an arena with a node is aligned to a huge page and advised to
+ * use transparent huge pages, so that the rest of the mode is exercised.
+ *
+ * @param size  The number of bytes to allocate
+ * @param node  The NUMA node on which to place the memory, or NUMA_NO_NODE
+ * @param what  What is being allocated (for error logging)
+ * @param ptr   A pointer to hold the allocated memory
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int uds_allocate_arena(size_t size, int node, const char *what, void *ptr)
+{
+	int result;
+
+	if ((node == NUMA_NO_NODE) || (size < HUGE_PAGE_SIZE))
+		return uds_allocate_memory(size, ARENA_PAGE_SIZE, what, ptr);
+
+	result = uds_allocate_memory(size, HUGE_PAGE_SIZE, what, ptr);
+	if (result != UDS_SUCCESS)
+		return result;
+
+	// The advice is only a hint, so failing to take it is not an error.
+	madvise(*((void **) ptr), size, MADV_HUGEPAGE);
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int uds_get_zone_node(unsigned int zone __always_unused)
+{
+	return 0;
+}
+
 /**********************************************************************/
 void uds_free(void *ptr)
 {
@@ -0,0 +1,610 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright 2023 Red Hat
+ */
+
+#include "block-compare.h"
+
+#include <asm/unaligned.h>
+#include <linux/bitops.h>
+#include <linux/build_bug.h>
+#include <linux/kernel.h>
+#include <linux/minmax.h>
+#if defined(__KERNEL__) && defined(__x86_64__)
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#include <asm/simd.h>
+#include <linux/percpu.h>
+#include <linux/preempt.h>
+#endif /* __KERNEL__ && __x86_64__ */
+
+#include "logger.h"
+#include "permassert.h"
+#include "string-utils.h"
+
+#include "constants.h"
+#include "status-codes.h"
+
+#if defined(__x86_64__)
+#define VDO_VECTOR_COMPARE
+#endif /* __x86_64__ */
+
+enum {
+	/*
+	 * The unit of work for a vector kernel. It must be a multiple of the widest vector stride
+	 * and divide VDO_BLOCK_SIZE evenly.
+	 */
+	COMPARE_CHUNK_SIZE = 256,
+};
+
+struct block_compare_ops {
+	const char *name;
+	/* Check whether a run of COMPARE_CHUNK_SIZE multiples is all zero. */
+	bool (*is_zero)(const char *data, unsigned int size);
+	/* Check whether two runs of COMPARE_CHUNK_SIZE multiples are identical. */
+	bool (*equal)(const char *data1, const char *data2, unsigned int size);
+	/* Whether the variant uses vector registers, and so needs to save the FPU state. */
+	bool uses_fpu;
+};
+
+static bool scalar_is_zero(const char *data, unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; i += sizeof(u64)) {
+		if (*((const u64 *) &data[i]) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static bool scalar_equal(const char *data1, const char *data2, unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; i += sizeof(u64)) {
+		if (*((const u64 *) &data1[i]) != *((const u64 *) &data2[i]))
+			return false;
+	}
+
+	return true;
+}
+
+static const struct block_compare_ops scalar_ops = {
+	.name = "scalar",
+	.is_zero = scalar_is_zero,
+	.equal = scalar_equal,
+	.uses_fpu = false,
+};
+
+#ifdef VDO_VECTOR_COMPARE
+/*
+ * The vector kernels are written with inline assembly rather than compiler intrinsics since the
+ * kernel is built without SSE or AVX code generation enabled. Unaligned loads are used
+ * throughout; data blocks are normally at least cache line aligned, in which case they cost
+ * nothing extra.
+ */
+
+static bool sse2_is_zero(const char *data, unsigned int size)
+{
+	unsigned int offset;
+	u32 mask;
+
+	for (offset = 0; offset < size; offset += 64) {
+		asm volatile("movdqu     (%[p]), %%xmm0\n\t"
+			     "movdqu   16(%[p]), %%xmm1\n\t"
+			     "movdqu   32(%[p]), %%xmm2\n\t"
+			     "movdqu   48(%[p]), %%xmm3\n\t"
+			     "por      %%xmm1, %%xmm0\n\t"
+			     "por      %%xmm3, %%xmm2\n\t"
+			     "por      %%xmm2, %%xmm0\n\t"
+			     "pxor     %%xmm1, %%xmm1\n\t"
+			     "pcmpeqb  %%xmm1, %%xmm0\n\t"
+			     "pmovmskb %%xmm0, %[mask]\n\t"
+			     : [mask] "=r" (mask)
+			     : [p] "r" (data + offset)
+			     : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+		if (mask != 0xffff)
+			return false;
+	}
+
+	return true;
+}
+
+static bool sse2_equal(const char *data1, const char *data2, unsigned int size)
+{
+	unsigned int offset;
+	u32 mask;
+
+	for (offset = 0; offset < size; offset += 64) {
+		asm volatile("movdqu     (%[p1]), %%xmm0\n\t"
+			     "movdqu   16(%[p1]), %%xmm1\n\t"
+			     "movdqu   32(%[p1]), %%xmm2\n\t"
+			     "movdqu   48(%[p1]), %%xmm3\n\t"
+			     "movdqu     (%[p2]), %%xmm4\n\t"
+			     "movdqu   16(%[p2]), %%xmm5\n\t"
+			     "movdqu   32(%[p2]), %%xmm6\n\t"
+			     "movdqu   48(%[p2]), %%xmm7\n\t"
+			     "pcmpeqb  %%xmm4, %%xmm0\n\t"
+			     "pcmpeqb  %%xmm5, %%xmm1\n\t"
+			     "pcmpeqb  %%xmm6, %%xmm2\n\t"
+			     "pcmpeqb  %%xmm7, %%xmm3\n\t"
+			     "pand     %%xmm1, %%xmm0\n\t"
+			     "pand     %%xmm3, %%xmm2\n\t"
+			     "pand     %%xmm2, %%xmm0\n\t"
+			     "pmovmskb %%xmm0, %[mask]\n\t"
+			     : [mask] "=r" (mask)
+			     : [p1] "r" (data1 + offset), [p2] "r" (data2 + offset)
+			     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+			       "memory");
+		if (mask != 0xffff)
+			return false;
+	}
+
+	return true;
+}
+
+static const struct block_compare_ops sse2_ops = {
+	.name = "sse2",
+	.is_zero = sse2_is_zero,
+	.equal = sse2_equal,
+	.uses_fpu = true,
+};
+
+static bool avx2_is_zero(const char *data, unsigned int size)
+{
+	unsigned int offset;
+	u8 zero = 1;
+
+	for (offset = 0; (offset < size) && zero; offset += 128) {
+		asm volatile("vmovdqu   (%[p]), %%ymm0\n\t"
+			     "vpor    32(%[p]), %%ymm0, %%ymm0\n\t"
+			     "vpor    64(%[p]), %%ymm0, %%ymm0\n\t"
+			     "vpor    96(%[p]), %%ymm0, %%ymm0\n\t"
+			     "vptest  %%ymm0, %%ymm0\n\t"
+			     "setz    %[zero]\n\t"
+			     : [zero] "=q" (zero)
+			     : [p] "r" (data + offset)
+			     : "xmm0", "cc", "memory");
+	}
+
+	asm volatile("vzeroupper" ::: "memory");
+	return zero;
+}
+
+static bool avx2_equal(const char *data1, const char *data2, unsigned int size)
+{
+	unsigned int offset;
+	u8 equal = 1;
+
+	for (offset = 0; (offset < size) && equal; offset += 128) {
+		asm volatile("vmovdqu   (%[p1]), %%ymm0\n\t"
+			     "vmovdqu 32(%[p1]), %%ymm1\n\t"
+			     "vmovdqu 64(%[p1]), %%ymm2\n\t"
+			     "vmovdqu 96(%[p1]), %%ymm3\n\t"
+			     "vpxor     (%[p2]), %%ymm0, %%ymm0\n\t"
+			     "vpxor   32(%[p2]), %%ymm1, %%ymm1\n\t"
+			     "vpxor   64(%[p2]), %%ymm2, %%ymm2\n\t"
+			     "vpxor   96(%[p2]), %%ymm3, %%ymm3\n\t"
+			     "vpor    %%ymm1, %%ymm0, %%ymm0\n\t"
+			     "vpor    %%ymm3, %%ymm2, %%ymm2\n\t"
+			     "vpor    %%ymm2, %%ymm0, %%ymm0\n\t"
+			     "vptest  %%ymm0, %%ymm0\n\t"
+			     "setz    %[equal]\n\t"
+			     : [equal] "=q" (equal)
+			     : [p1] "r" (data1 + offset), [p2] "r" (data2 + offset)
+			     : "xmm0", "xmm1", "xmm2", "xmm3", "cc", "memory");
+	}
+
+	asm volatile("vzeroupper" ::: "memory");
+	return equal;
+}
+
+static const struct block_compare_ops avx2_ops = {
+	.name = "avx2",
+	.is_zero = avx2_is_zero,
+	.equal = avx2_equal,
+	.uses_fpu = true,
+};
+
+static bool avx512_is_zero(const char *data, unsigned int size)
+{
+	unsigned int offset;
+	u8 zero = 1;
+
+	for (offset = 0; (offset < size) && zero; offset += 256) {
+		asm volatile("vmovdqu64   (%[p]), %%zmm0\n\t"
+			     "vporq     64(%[p]), %%zmm0, %%zmm0\n\t"
+			     "vporq    128(%[p]), %%zmm0, %%zmm0\n\t"
+			     "vporq    192(%[p]), %%zmm0, %%zmm0\n\t"
+			     "vextracti64x4 $1, %%zmm0, %%ymm1\n\t"
+			     "vpor     %%ymm1, %%ymm0, %%ymm0\n\t"
+			     "vptest   %%ymm0, %%ymm0\n\t"
+			     "setz     %[zero]\n\t"
+			     : [zero] "=q" (zero)
+			     : [p] "r" (data + offset)
+			     : "xmm0", "xmm1", "cc", "memory");
+	}
+
+	asm volatile("vzeroupper" ::: "memory");
+	return zero;
+}
+
+static bool avx512_equal(const char *data1, const char *data2, unsigned int size)
+{
+	unsigned int offset;
+	u8 equal = 1;
+
+	for (offset = 0; (offset < size) && equal; offset += 256) {
+		asm volatile("vmovdqu64    (%[p1]), %%zmm0\n\t"
+			     "vmovdqu64  64(%[p1]), %%zmm1\n\t"
+			     "vmovdqu64 128(%[p1]), %%zmm2\n\t"
+			     "vmovdqu64 192(%[p1]), %%zmm3\n\t"
+			     "vpxorq       (%[p2]), %%zmm0, %%zmm0\n\t"
+			     "vpxorq     64(%[p2]), %%zmm1, %%zmm1\n\t"
+			     "vpxorq    128(%[p2]), %%zmm2, %%zmm2\n\t"
+			     "vpxorq    192(%[p2]), %%zmm3, %%zmm3\n\t"
+			     "vporq     %%zmm1, %%zmm0, %%zmm0\n\t"
+			     "vporq     %%zmm3, %%zmm2, %%zmm2\n\t"
+			     "vporq     %%zmm2, %%zmm0, %%zmm0\n\t"
+			     "vextracti64x4 $1, %%zmm0, %%ymm1\n\t"
+			     "vpor      %%ymm1, %%ymm0, %%ymm0\n\t"
+			     "vptest    %%ymm0, %%ymm0\n\t"
+			     "setz      %[equal]\n\t"
+			     : [equal] "=q" (equal)
+			     : [p1] "r" (data1 + offset), [p2] "r" (data2 + offset)
+			     : "xmm0", "xmm1", "xmm2", "xmm3", "cc", "memory");
+	}
+
+	asm volatile("vzeroupper" ::: "memory");
+	return equal;
+}
+
+static const struct block_compare_ops avx512_ops = {
+	.name = "avx512",
+	.is_zero = avx512_is_zero,
+	.equal = avx512_equal,
+	.uses_fpu = true,
+};
+
+#ifdef __KERNEL__
+static bool cpu_supports_avx2(void)
+{
+	return (boot_cpu_has(X86_FEATURE_AVX) && boot_cpu_has(X86_FEATURE_AVX2) &&
+		cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL));
+}
+
+static bool cpu_supports_avx512(void)
+{
+	return (boot_cpu_has(X86_FEATURE_AVX512F) &&
+		cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+				  XFEATURE_MASK_AVX512, NULL));
+}
+
+static inline bool begin_vector_section(void)
+{
+	if (!may_use_simd())
+		return false;
+
+	kernel_fpu_begin();
+	return true;
+}
+
+static inline void end_vector_section(void)
+{
+	kernel_fpu_end();
+}
+
+/*
+ * The variant in use by the batch open on each cpu, if any. An open batch holds the vector section
+ * open, and so runs with preemption disabled, so the batch of the current thread can be kept per
+ * cpu. Interrupts may not use it, since they did not open it.
+ */
+static DEFINE_PER_CPU(const struct block_compare_ops *, batch_ops);
+
+static inline const struct block_compare_ops **get_batch_ops_ptr(void)
+{
+	return get_cpu_ptr(&batch_ops);
+}
+
+static inline void put_batch_ops_ptr(void)
+{
+	put_cpu_ptr(&batch_ops);
+}
+
+static inline bool may_use_compare_batch(void)
+{
+	return in_task();
+}
+#else /* not __KERNEL__ */
+static bool cpu_supports_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static bool cpu_supports_avx512(void)
+{
+	return __builtin_cpu_supports("avx512f");
+}
+
+static inline bool begin_vector_section(void)
+{
+	return true;
+}
+
+static inline void end_vector_section(void)
+{
+}
+
+/* The variant in use by the batch open on this thread, if any. */
+static __thread const struct block_compare_ops *batch_ops;
+
+static inline const struct block_compare_ops **get_batch_ops_ptr(void)
+{
+	return &batch_ops;
+}
+
+static inline void put_batch_ops_ptr(void)
+{
+}
+
+static inline bool may_use_compare_batch(void)
+{
+	return true;
+}
+#endif /* __KERNEL__ */
+#endif /* VDO_VECTOR_COMPARE */
+
+/* All the variants, ordered from least to most preferred. */
+static const struct block_compare_ops *all_ops[] = {
+	&scalar_ops,
+#ifdef VDO_VECTOR_COMPARE
+	&sse2_ops,
+	&avx2_ops,
+	&avx512_ops,
+#endif /* VDO_VECTOR_COMPARE */
+};
+
+static const struct block_compare_ops *selected_ops = &scalar_ops;
+
+static bool is_variant_supported(const struct block_compare_ops *ops)
+{
+#ifdef VDO_VECTOR_COMPARE
+	if (ops == &avx512_ops)
+		return cpu_supports_avx512();
+
+	if (ops == &avx2_ops)
+		return cpu_supports_avx2();
+#endif /* VDO_VECTOR_COMPARE */
+
+	/* Scalar code is always available, and SSE2 is part of the x86_64 baseline. */
+	return true;
+}
+
+/**
+ * vdo_initialize_block_compare() - Select the fastest block comparison variant supported by this
+ *                                  processor.
+ *
+ * This must be called once, at module load, before any data_vios are launched.
+ */
+void vdo_initialize_block_compare(void)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(all_ops) - 1; i >= 0; i--) {
+		if (is_variant_supported(all_ops[i])) {
+			selected_ops = all_ops[i];
+			break;
+		}
+	}
+
+	uds_log_info("using %s block comparison", selected_ops->name);
+}
+
+#ifdef VDO_VECTOR_COMPARE
+/* Get the variant of the batch open on this thread, if any. */
+static inline const struct block_compare_ops *get_batch_ops(void)
+{
+	const struct block_compare_ops *ops;
+
+	if (!may_use_compare_batch())
+		return NULL;
+
+	ops = *get_batch_ops_ptr();
+	put_batch_ops_ptr();
+	return ops;
+}
+
+#endif /* VDO_VECTOR_COMPARE */
+static inline const struct block_compare_ops *begin_compare(void)
+{
+#ifdef VDO_VECTOR_COMPARE
+	const struct block_compare_ops *ops = get_batch_ops();
+
+	if (ops != NULL)
+		return ops;
+
+	ops = READ_ONCE(selected_ops);
+	if (!ops->uses_fpu || begin_vector_section())
+		return ops;
+
+	/* Vector registers can't be used in this context, so fall back to the scalar code. */
+	return &scalar_ops;
+#else
+	return &scalar_ops;
+#endif /* VDO_VECTOR_COMPARE */
+}
+
+static inline void end_compare(const struct block_compare_ops *ops)
+{
+#ifdef VDO_VECTOR_COMPARE
+	if (ops->uses_fpu && (get_batch_ops() == NULL))
+		end_vector_section();
+#endif /* VDO_VECTOR_COMPARE */
+}
+
+/**
+ * vdo_start_block_compare_batch() - Open a vector section for a batch of block operations.
+ *
+ * Saving and restoring the FPU state costs about as much as comparing a block, so a thread which
+ * is about to check or compare several blocks should bracket them with this and
+ * vdo_finish_block_compare_batch(), so that the state is saved once for the batch. Vector code
+ * runs with preemption disabled, so a batch should be short, and must not sleep or call code which
+ * may itself use the FPU. Batches do not nest.
+ */
+void vdo_start_block_compare_batch(void)
+{
+#ifdef VDO_VECTOR_COMPARE
+	const struct block_compare_ops *ops = READ_ONCE(selected_ops);
+	const struct block_compare_ops **batch;
+
+	if (!ops->uses_fpu || !may_use_compare_batch() || !begin_vector_section())
+		return;
+
+	batch = get_batch_ops_ptr();
+	ASSERT_LOG_ONLY(*batch == NULL, "block compare batches do not nest");
+	*batch = ops;
+	put_batch_ops_ptr();
+#endif /* VDO_VECTOR_COMPARE */
+}
+
+/**
+ * vdo_finish_block_compare_batch() - Close the vector section opened by
+ *                                    vdo_start_block_compare_batch().
+ */
+void vdo_finish_block_compare_batch(void)
+{
+#ifdef VDO_VECTOR_COMPARE
+	const struct block_compare_ops **batch;
+	bool open;
+
+	if (!may_use_compare_batch())
+		return;
+
+	batch = get_batch_ops_ptr();
+	open = (*batch != NULL);
+	*batch = NULL;
+	put_batch_ops_ptr();
+	if (open)
+		end_vector_section();
+#endif /* VDO_VECTOR_COMPARE */
+}
+
+/**
+ * vdo_is_zero_block() - Check whether a block contains only zeros.
+ * @block: The block to check.
+ *
+ * Return: true if every byte of the block is zero.
+ */
+bool vdo_is_zero_block(const char *block)
+{
+	const struct block_compare_ops *ops;
+	bool zero;
+
+#ifdef INTERNAL
+	BUILD_BUG_ON(VDO_BLOCK_SIZE % COMPARE_CHUNK_SIZE != 0);
+	ASSERT_LOG_ONLY((uintptr_t) block % sizeof(u64) == 0,
+			"Data blocks are expected to be aligned");
+
+#endif /* INTERNAL */
+	ops = begin_compare();
+	zero = ops->is_zero(block, VDO_BLOCK_SIZE);
+	end_compare(ops);
+	return zero;
+}
+
+/**
+ * vdo_blocks_equal() - Check whether two blocks have identical contents.
+ * @block1: The first block.
+ * @block2: The second block.
+ *
+ * Return: true if the blocks are identical.
+ */
+bool vdo_blocks_equal(const char *block1, const char *block2)
+{
+	const struct block_compare_ops *ops;
+	bool equal;
+
+#ifdef INTERNAL
+	ASSERT_LOG_ONLY((uintptr_t) block1 % sizeof(u64) == 0,
+			"Data blocks are expected to be aligned");
+	ASSERT_LOG_ONLY((uintptr_t) block2 % sizeof(u64) == 0,
+			"Data blocks are expected to be aligned");
+
+#endif /* INTERNAL */
+	ops = begin_compare();
+	equal = ops->equal(block1, block2, VDO_BLOCK_SIZE);
+	end_compare(ops);
+	return equal;
+}
+
+/*
+ * Flag the zero bytes of a little-endian word. Bytes above the first zero byte may be flagged
+ * spuriously, but the lowest flag is always exact.
+ */
+static inline u64 flag_zero_bytes(u64 word)
+{
+	return ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL);
+}
+
+/**
+ * vdo_find_zero_byte() - Find the first zero byte in an array of bytes.
+ * @data: The bytes to search.
+ * @size: The number of bytes to search.
+ *
+ * This is used to search the reference counters of a slab for a free block. The slab's free group
+ * map limits each search to a single group of counters, which is too short to be worth saving
+ * the FPU state for a vector search, so the search is done a word at a time. This may read up to
+ * seven bytes past the end of the range, so the array must be padded accordingly.
+ *
+ * Return: The offset of the first zero byte, or size if there is none.
+ */
+unsigned int vdo_find_zero_byte(const u8 *data, unsigned int size)
+{
+	unsigned int offset;
+
+	for (offset = 0; offset < size; offset += sizeof(u64)) {
+		u64 zeros = flag_zero_bytes(get_unaligned_le64(&data[offset]));
+
+		if (zeros != 0)
+			return min(offset + (unsigned int) (__ffs(zeros) / BITS_PER_BYTE), size);
+	}
+
+	return size;
+}
+
+#ifdef INTERNAL
+/**
+ * vdo_get_block_compare_variant() - Get the name of the block comparison variant in use.
+ */
+const char *vdo_get_block_compare_variant(void)
+{
+	return selected_ops->name;
+}
+
+/**
+ * vdo_set_block_compare_variant() - Override the block comparison variant (for testing).
+ * @name: The name of the variant to use.
+ *
+ * Return: VDO_SUCCESS, or VDO_NOT_IMPLEMENTED if the variant is unknown or not supported by this
+ *         processor.
+ */
+int vdo_set_block_compare_variant(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(all_ops); i++) {
+		if (strcmp(name, all_ops[i]->name) != 0)
+			continue;
+
+		if (!is_variant_supported(all_ops[i]))
+			break;
+
+		selected_ops = all_ops[i];
+		return VDO_SUCCESS;
+	}
+
+	return VDO_NOT_IMPLEMENTED;
+}
+#endif /* INTERNAL */
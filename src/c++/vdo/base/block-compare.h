@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright 2023 Red Hat
+ */
+
+#ifndef VDO_BLOCK_COMPARE_H
+#define VDO_BLOCK_COMPARE_H
+
+#include <linux/compiler.h>
+#include <linux/types.h>
+
+/*
+ * Kernels for scanning and comparing whole data blocks. Every write checks for an all-zero block,
+ * and every dedupe verification compares two blocks, so these are on the hot path for the CPU
+ * threads. On x86_64, vectorized variants (SSE2, AVX2, and AVX-512) are provided along with the
+ * portable scalar code; the widest variant supported by the processor is selected once, when the
+ * module is loaded. All block arguments must point to VDO_BLOCK_SIZE bytes. The search of the
+ * reference counters of a slab for a free block is short enough that it is always done with the
+ * scalar code.
+ */
+
+void vdo_initialize_block_compare(void);
+
+void vdo_start_block_compare_batch(void);
+void vdo_finish_block_compare_batch(void);
+
+bool __must_check vdo_is_zero_block(const char *block);
+
+bool __must_check vdo_blocks_equal(const char *block1, const char *block2);
+
+unsigned int __must_check vdo_find_zero_byte(const u8 *data, unsigned int size);
+
+#ifdef INTERNAL
+const char *vdo_get_block_compare_variant(void);
+int __must_check vdo_set_block_compare_variant(const char *name);
+#endif /* INTERNAL */
+
+#endif /* VDO_BLOCK_COMPARE_H */
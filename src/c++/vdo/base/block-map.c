@@ -56,6 +56,26 @@ union page_key {
 	u64 key;
 };
 
+/* A read of a tree page ahead of any lookup which needs it. */
+struct tree_prefetch {
+	/* The lock on loading the page, held as a data_vio would hold its own */
+	struct tree_lock lock;
+	/* The waiter for a vio from the zone's pool */
+	struct vdo_waiter waiter;
+	/* The leaf page below the page being read */
+	page_number_t page_number;
+};
+
+/* A write of a run of adjacent cache pages, copied into one buffer so that one bio writes them. */
+struct page_writeback {
+	struct vdo_page_cache *cache;
+	struct vio *vio;
+	char *buffer;
+	/* The pages being written, in pbn order, or none if the writeback is idle */
+	page_count_t page_count;
+	struct page_info *pages[BLOCK_MAP_WRITEBACK_BLOCKS];
+};
+
 struct write_if_not_dirtied_context {
 	struct block_map_zone *zone;
 	u8 generation;
@@ -117,6 +137,13 @@ const struct block_map_entry UNMAPPED_BLOCK_MAP_ENTRY = {
 enum {
 	LOG_INTERVAL = 4000,
 	DISPLAY_INTERVAL = 100000,
+	/*
+	 * The most pages which the user I/O in progress at once can map in sequence. A page on
+	 * probation must be referenced again after this many other pages have been loaded for the
+	 * reference not to be counted as part of the same scan.
+	 */
+	CORRELATED_PAGE_LOADS = DIV_ROUND_UP(MAXIMUM_VDO_USER_VIOS,
+					     VDO_BLOCK_MAP_ENTRIES_PER_PAGE) + 1,
 };
 
 /*
@@ -208,6 +235,53 @@ static int initialize_info(struct vdo_page_cache *cache)
 	return VDO_SUCCESS;
 }
 
+/**
+ * allocate_writebacks() - Allocate the writebacks of a cache, and the heap which orders the pages
+ *                         waiting for them.
+ */
+static int __must_check allocate_writebacks(struct vdo_page_cache *cache)
+{
+	struct page_info **pages;
+	struct page_writeback *writeback;
+	int result;
+
+	result = uds_allocate(cache->page_count, struct page_info *, "page writeback heap",
+			      &pages);
+	if (result != UDS_SUCCESS)
+		return result;
+
+	cache->writeback_heap = (struct min_heap) {
+		.data = pages,
+		.nr = 0,
+		.size = cache->page_count,
+	};
+
+	result = uds_allocate(BLOCK_MAP_MAXIMUM_WRITEBACKS, struct page_writeback,
+			      "page writebacks", &cache->writebacks);
+	if (result != UDS_SUCCESS)
+		return result;
+
+	for (writeback = cache->writebacks;
+	     writeback < cache->writebacks + BLOCK_MAP_MAXIMUM_WRITEBACKS;
+	     writeback++) {
+		writeback->cache = cache;
+		result = uds_allocate_memory(BLOCK_MAP_WRITEBACK_BLOCKS * VDO_BLOCK_SIZE,
+					     VDO_BLOCK_SIZE, "page writeback buffer",
+					     &writeback->buffer);
+		if (result != UDS_SUCCESS)
+			return result;
+
+		result = create_multi_block_metadata_vio(cache->vdo, VIO_TYPE_BLOCK_MAP,
+							 VIO_PRIORITY_METADATA, writeback,
+							 BLOCK_MAP_WRITEBACK_BLOCKS,
+							 writeback->buffer, &writeback->vio);
+		if (result != VDO_SUCCESS)
+			return result;
+	}
+
+	return VDO_SUCCESS;
+}
+
 /**
  * allocate_cache_components() - Allocate components of the cache which require their own
  *                               allocation.
@@ -221,6 +295,7 @@ static int initialize_info(struct vdo_page_cache *cache)
 static int __must_check allocate_cache_components(struct vdo_page_cache *cache)
 {
 	u64 size = cache->page_count * (u64) VDO_BLOCK_SIZE;
+	page_count_t i;
 	int result;
 
 	result = uds_allocate(cache->page_count, struct page_info, "page infos",
@@ -228,7 +303,8 @@ static int __must_check allocate_cache_components(struct vdo_page_cache *cache)
 	if (result != UDS_SUCCESS)
 		return result;
 
-	result = uds_allocate_memory(size, VDO_BLOCK_SIZE, "cache pages", &cache->pages);
+	result = uds_allocate_arena(size, vdo_get_zone_node(cache->vdo, cache->zone->zone_number),
+				    "cache pages", &cache->pages);
 	if (result != UDS_SUCCESS)
 		return result;
 
@@ -236,6 +312,28 @@ static int __must_check allocate_cache_components(struct vdo_page_cache *cache)
 	if (result != UDS_SUCCESS)
 		return result;
 
+	result = allocate_writebacks(cache);
+	if (result != VDO_SUCCESS)
+		return result;
+
+	if (cache->policy != VDO_CACHE_POLICY_2Q)
+		return initialize_info(cache);
+
+	/* 2Q works best with a probation list of a quarter of the cache, and half as many ghosts. */
+	cache->probation_target = cache->page_count / 4;
+	cache->ghost_count = max_t(page_count_t, cache->page_count / 2, 1);
+	result = uds_allocate(cache->ghost_count, physical_block_number_t, "page cache ghosts",
+			      &cache->ghosts);
+	if (result != UDS_SUCCESS)
+		return result;
+
+	for (i = 0; i < cache->ghost_count; i++)
+		cache->ghosts[i] = NO_PAGE;
+
+	result = vdo_int_map_create(cache->ghost_count, &cache->ghost_map);
+	if (result != UDS_SUCCESS)
+		return result;
+
 	return initialize_info(cache);
 }
 
@@ -336,11 +434,54 @@ static void update_counter(struct page_info *info, s32 delta)
 	}
 }
 
-/** update_lru() - Update the lru information for an active page. */
+/**
+ * update_lru() - Update the lru information for an active page.
+ *
+ * A page on the probation list is promoted to the lru ring if it is referenced again once more
+ * than CORRELATED_PAGE_LOADS other pages have been loaded. References before then are most likely
+ * correlated, such as those from a sequential scan which reads every entry of each page it loads,
+ * so they leave the page in its place.
+ */
 static void update_lru(struct page_info *info)
 {
-	if (info->cache->lru_list.prev != &info->lru_entry)
-		list_move_tail(&info->lru_entry, &info->cache->lru_list);
+	struct vdo_page_cache *cache = info->cache;
+
+	if (!info->hot) {
+		if (list_empty(&info->lru_entry)) {
+			list_add_tail(&info->lru_entry, &cache->probation_list);
+			cache->probation_count++;
+			return;
+		}
+
+		if ((cache->stats.pages_loaded - info->loaded_at) <= CORRELATED_PAGE_LOADS)
+			return;
+
+		list_del_init(&info->lru_entry);
+		cache->probation_count--;
+		info->hot = true;
+	}
+
+	if (cache->lru_list.prev != &info->lru_entry)
+		list_move_tail(&info->lru_entry, &cache->lru_list);
+}
+
+/**
+ * record_ghost() - Remember the pbn of a page evicted from the probation list, forgetting the
+ *                  oldest such pbn.
+ */
+static void record_ghost(struct vdo_page_cache *cache, physical_block_number_t pbn)
+{
+	physical_block_number_t *ghost = &cache->ghosts[cache->next_ghost];
+
+	/* The entry may be stale if its page has since been loaded again. */
+	if ((*ghost != NO_PAGE) && (vdo_int_map_get(cache->ghost_map, *ghost) == ghost))
+		vdo_int_map_remove(cache->ghost_map, *ghost);
+
+	*ghost = pbn;
+	if (vdo_int_map_put(cache->ghost_map, pbn, ghost, true, NULL) != UDS_SUCCESS)
+		*ghost = NO_PAGE;
+
+	cache->next_ghost = (cache->next_ghost + 1) % cache->ghost_count;
 }
 
 /**
@@ -412,6 +553,13 @@ static int reset_page_info(struct page_info *info)
 	if (result != UDS_SUCCESS)
 		return result;
 
+	if (!info->hot && !list_empty(&info->lru_entry)) {
+		info->cache->probation_count--;
+		record_ghost(info->cache, info->pbn);
+	}
+
+	info->prefetched = false;
+
 	result = set_info_pbn(info, NO_PAGE);
 	set_info_state(info, PS_FREE);
 	list_del_init(&info->lru_entry);
@@ -451,6 +599,22 @@ static struct page_info * __must_check find_page(struct vdo_page_cache *cache,
 	return cache->last_found;
 }
 
+/**
+ * select_page_from() - Find the first page on an lru or probation list which may be discarded.
+ *
+ * Return: A pointer to the info structure for the page, or NULL if there is none.
+ */
+static struct page_info * __must_check select_page_from(struct list_head *list)
+{
+	struct page_info *info;
+
+	list_for_each_entry(info, list, lru_entry)
+		if ((info->busy == 0) && !is_in_flight(info))
+			return info;
+
+	return NULL;
+}
+
 /**
  * select_lru_page() - Determine which page is least recently used.
  *
@@ -458,6 +622,11 @@ static struct page_info * __must_check find_page(struct vdo_page_cache *cache,
  * ring. Since whenever we mark a page busy we also put it to the end of the ring it is unlikely
  * that the entries at the front are busy unless the queue is very short, but not impossible.
  *
+ * With the 2Q policy, the oldest page on the probation list is picked instead while that list is
+ * longer than its target. Pages only reach the lru ring when they are reused while on probation,
+ * or loaded again soon after being evicted from it, so a scan through many pages which are never
+ * reused only displaces other pages on probation.
+ *
  * Return: A pointer to the info structure for a relevant page, or NULL if no such page can be
  *         found. The page can be dirty or resident.
  */
@@ -465,11 +634,17 @@ static struct page_info * __must_check select_lru_page(struct vdo_page_cache *ca
 {
 	struct page_info *info;
 
-	list_for_each_entry(info, &cache->lru_list, lru_entry)
-		if ((info->busy == 0) && !is_in_flight(info))
+	if (cache->probation_count > cache->probation_target) {
+		info = select_page_from(&cache->probation_list);
+		if (info != NULL)
 			return info;
+	}
 
-	return NULL;
+	info = select_page_from(&cache->lru_list);
+	if (info != NULL)
+		return info;
+
+	return select_page_from(&cache->probation_list);
 }
 
 /* ASYNCHRONOUS INTERFACE BEYOND THIS POINT */
@@ -661,6 +836,18 @@ validate_completed_page_or_enter_read_only_mode(struct vdo_page_completion *comp
 	return false;
 }
 
+static void discard_page_if_needed(struct vdo_page_cache *cache);
+
+/** finish_prefetch_load() - Account for the end of a page load, if it was a prefetch. */
+static void finish_prefetch_load(struct page_info *info)
+{
+	if (!info->prefetching)
+		return;
+
+	info->prefetching = false;
+	info->cache->zone->prefetches_in_flight--;
+}
+
 /**
  * handle_load_error() - Handle page load errors.
  * @completion: The page read vio.
@@ -675,6 +862,7 @@ static void handle_load_error(struct vdo_completion *completion)
 	vio_record_metadata_io_error(as_vio(completion));
 	vdo_enter_read_only_mode(cache->zone->block_map->vdo, result);
 	ADD_ONCE(cache->stats.failed_reads, 1);
+	finish_prefetch_load(info);
 	set_info_state(info, PS_FAILED);
 	vdo_waitq_notify_all_waiters(&info->waiting, complete_waiter_with_error, &result);
 	reset_page_info(info);
@@ -719,8 +907,21 @@ static void page_is_loaded(struct vdo_completion *completion)
 
 	info->recovery_lock = 0;
 	set_info_state(info, PS_RESIDENT);
+	if (info->prefetching) {
+		/* Nothing has asked for a prefetched page yet, so it must be evictable until then. */
+		update_lru(info);
+	}
+
+	finish_prefetch_load(info);
 	distribute_page_over_waitq(info, &info->waiting);
 
+	/*
+	 * A request which found no page to discard while this one was incoming will not try again
+	 * until some page is released, which this page never will be if no request was waiting for it.
+	 */
+	if (info->busy == 0)
+		discard_page_if_needed(cache);
+
 	/*
 	 * Don't decrement until right before calling check_for_drain_complete() to
 	 * ensure that the above work can't cause the page cache to be freed out from under us.
@@ -781,9 +982,18 @@ static int __must_check launch_page_load(struct page_info *info,
 	if (result != VDO_SUCCESS)
 		return result;
 
+	if (cache->policy == VDO_CACHE_POLICY_2Q) {
+		info->hot = (vdo_int_map_remove(cache->ghost_map, pbn) != NULL);
+		if (info->hot)
+			ADD_ONCE(cache->stats.ghost_hits, 1);
+	} else {
+		info->hot = true;
+	}
+
 	set_info_state(info, PS_INCOMING);
 	cache->outstanding_reads++;
 	ADD_ONCE(cache->stats.pages_loaded, 1);
+	info->loaded_at = cache->stats.pages_loaded;
 	callback = (cache->rebuilding ? handle_rebuild_read_error : handle_load_error);
 	vdo_submit_metadata_vio(info->vio, pbn, load_cache_page_endio,
 				callback, REQ_OP_READ | REQ_PRIO);
@@ -1000,17 +1210,14 @@ static bool write_has_finished(struct page_info *info)
 }
 
 /**
- * handle_page_write_error() - Handler for page write errors.
- * @completion: The page write vio.
+ * page_write_failed() - Handle the failure of a page write.
+ * @info: The page which failed to write.
+ * @result: The error.
  */
-static void handle_page_write_error(struct vdo_completion *completion)
+static void page_write_failed(struct page_info *info, int result)
 {
-	int result = completion->result;
-	struct page_info *info = completion->parent;
 	struct vdo_page_cache *cache = info->cache;
 
-	vio_record_metadata_io_error(as_vio(completion));
-
 	/* If we're already read-only, write failures are to be expected. */
 	if (result != VDO_READ_ONLY) {
 #if __KERNEL__
@@ -1037,6 +1244,16 @@ static void handle_page_write_error(struct vdo_completion *completion)
 	check_for_drain_complete(cache->zone);
 }
 
+/**
+ * handle_page_write_error() - Handler for page write errors.
+ * @completion: The page write vio.
+ */
+static void handle_page_write_error(struct vdo_completion *completion)
+{
+	vio_record_metadata_io_error(as_vio(completion));
+	page_write_failed(completion->parent, completion->result);
+}
+
 static void page_is_written_out(struct vdo_completion *completion);
 
 static void write_cache_page_endio(struct bio *bio)
@@ -1048,14 +1265,13 @@ static void write_cache_page_endio(struct bio *bio)
 }
 
 /**
- * page_is_written_out() - Callback used when a page has been written out.
- * @completion: The vio which wrote the page. Its parent is a page_info.
+ * page_was_written() - Finish a page which has been written out.
+ * @info: The page which was written.
  */
-static void page_is_written_out(struct vdo_completion *completion)
+static void page_was_written(struct page_info *info)
 {
 	bool was_discard, reclaimed;
 	u32 reclamations;
-	struct page_info *info = completion->parent;
 	struct vdo_page_cache *cache = info->cache;
 	struct block_map_page *page = (struct block_map_page *) get_page_buffer(info);
 
@@ -1094,8 +1310,162 @@ static void page_is_written_out(struct vdo_completion *completion)
 }
 
 /**
- * write_pages() - Write the batch of pages which were covered by the layer flush which just
- *                 completed.
+ * page_is_written_out() - Callback used when a page has been written out.
+ * @completion: The vio which wrote the page. Its parent is a page_info.
+ */
+static void page_is_written_out(struct vdo_completion *completion)
+{
+	page_was_written(completion->parent);
+}
+
+/* Implements the min_heap less function, ordering pages by pbn. */
+static bool page_pbn_is_less_than(const void *item1, const void *item2)
+{
+	const struct page_info *info1 = *((struct page_info * const *) item1);
+	const struct page_info *info2 = *((struct page_info * const *) item2);
+
+	return info1->pbn < info2->pbn;
+}
+
+static void swap_page_infos(void *item1, void *item2)
+{
+	struct page_info **info1 = item1;
+	struct page_info **info2 = item2;
+
+	swap(*info1, *info2);
+}
+
+static const struct min_heap_callbacks writeback_min_heap = {
+	.elem_size = sizeof(struct page_info *),
+	.less = page_pbn_is_less_than,
+	.swp = swap_page_infos,
+};
+
+static void launch_writebacks(struct vdo_page_cache *cache);
+
+/**
+ * finish_writeback() - Finish each of the pages a writeback wrote, once the next writeback has
+ *                      been started.
+ * @result: The result of the write.
+ */
+static void finish_writeback(struct page_writeback *writeback, int result)
+{
+	struct page_info *pages[BLOCK_MAP_WRITEBACK_BLOCKS];
+	page_count_t page_count = writeback->page_count;
+	page_count_t i;
+
+	memcpy(pages, writeback->pages, page_count * sizeof(struct page_info *));
+	writeback->page_count = 0;
+	launch_writebacks(writeback->cache);
+
+	/* Once the last of these pages has finished, the cache may be freed. */
+	for (i = 0; i < page_count; i++) {
+		if (result == VDO_SUCCESS)
+			page_was_written(pages[i]);
+		else
+			page_write_failed(pages[i], result);
+	}
+}
+
+static void writeback_is_written(struct vdo_completion *completion)
+{
+	finish_writeback(completion->parent, VDO_SUCCESS);
+}
+
+static void handle_writeback_error(struct vdo_completion *completion)
+{
+	vio_record_metadata_io_error(as_vio(completion));
+	finish_writeback(completion->parent, completion->result);
+}
+
+static void writeback_endio(struct bio *bio)
+{
+	struct vio *vio = bio->bi_private;
+	struct page_writeback *writeback = vio->completion.parent;
+
+	continue_vio_after_io(vio, writeback_is_written, writeback->cache->zone->thread_id);
+}
+
+/**
+ * launch_writeback() - Write the flushed page with the lowest pbn, along with as many of the
+ *                      flushed pages which follow it on disk as one bio can hold.
+ * @writeback: An idle writeback.
+ */
+static void launch_writeback(struct page_writeback *writeback)
+{
+	struct vdo_page_cache *cache = writeback->cache;
+	struct min_heap *heap = &cache->writeback_heap;
+	struct page_info **next = heap->data;
+	physical_block_number_t pbn = (*next)->pbn;
+
+	do {
+		memcpy(writeback->buffer + (writeback->page_count * VDO_BLOCK_SIZE),
+		       get_page_buffer(*next), VDO_BLOCK_SIZE);
+		writeback->pages[writeback->page_count++] = *next;
+		min_heap_pop(heap, &writeback_min_heap);
+	} while ((writeback->page_count < BLOCK_MAP_WRITEBACK_BLOCKS) && (heap->nr > 0) &&
+		 ((*next)->pbn == pbn + writeback->page_count));
+
+	ADD_ONCE(cache->stats.pages_saved, writeback->page_count);
+	ADD_ONCE(cache->stats.writeback_bios, 1);
+
+	/* The vio is big enough for the longest run, but must only write this one. */
+	vdo_submit_metadata_vio_with_size(writeback->vio, pbn, writeback_endio,
+					  handle_writeback_error, REQ_OP_WRITE | REQ_PRIO,
+					  writeback->page_count * VDO_BLOCK_SIZE);
+}
+
+/**
+ * abandon_page_write() - Fail the write of a flushed page because the vdo is read-only.
+ * @info: The page.
+ */
+static void abandon_page_write(struct page_info *info)
+{
+	struct vdo_completion *completion = &info->vio->completion;
+
+	vdo_reset_completion(completion);
+	completion->callback = page_is_written_out;
+	completion->error_handler = handle_page_write_error;
+	vdo_fail_completion(completion, VDO_READ_ONLY);
+}
+
+/**
+ * launch_writebacks() - Start writing flushed pages in pbn order with each idle writeback.
+ *
+ * Each writeback writes a run of adjacent pages with one bio, so a batch of pages which are near
+ * each other on disk is written with a few large sequential writes rather than many scattered
+ * small ones, and no more than BLOCK_MAP_MAXIMUM_WRITEBACKS writes are in progress at once.
+ */
+static void launch_writebacks(struct vdo_page_cache *cache)
+{
+	struct min_heap *heap = &cache->writeback_heap;
+	struct page_writeback *writeback;
+
+	if (vdo_is_read_only(cache->zone->block_map->vdo)) {
+		int remaining = heap->nr;
+
+		/* Once the last page has been abandoned, the cache may be freed. */
+		while (remaining-- > 0) {
+			struct page_info *info = *((struct page_info **) heap->data);
+
+			min_heap_pop(heap, &writeback_min_heap);
+			abandon_page_write(info);
+		}
+
+		return;
+	}
+
+	for (writeback = cache->writebacks;
+	     (writeback < cache->writebacks + BLOCK_MAP_MAXIMUM_WRITEBACKS) && (heap->nr > 0);
+	     writeback++) {
+		if (writeback->page_count == 0)
+			launch_writeback(writeback);
+	}
+}
+
+/**
+ * write_pages() - Queue the batch of pages which were covered by the layer flush which just
+ *                 completed to be written in pbn order.
  * @flush_completion: The flush vio.
  *
  * This callback is registered in save_pages().
@@ -1103,13 +1473,6 @@ static void page_is_written_out(struct vdo_completion *completion)
 static void write_pages(struct vdo_completion *flush_completion)
 {
 	struct vdo_page_cache *cache = ((struct page_info *) flush_completion->parent)->cache;
-
-	/*
-	 * We need to cache these two values on the stack since in the error case below, it is
-	 * possible for the last page info to cause the page cache to get freed. Hence once we
-	 * launch the last page, it may be unsafe to dereference the cache [VDO-4724].
-	 */
-	bool has_unflushed_pages = (cache->pages_to_flush > 0);
 	page_count_t pages_in_flush = cache->pages_in_flush;
 
 	cache->pages_in_flush = 0;
@@ -1119,27 +1482,15 @@ static void write_pages(struct vdo_completion *flush_completion)
 					 state_entry);
 
 		list_del_init(&info->state_entry);
-		if (vdo_is_read_only(info->cache->zone->block_map->vdo)) {
-			struct vdo_completion *completion = &info->vio->completion;
-
-			vdo_reset_completion(completion);
-			completion->callback = page_is_written_out;
-			completion->error_handler = handle_page_write_error;
-			vdo_fail_completion(completion, VDO_READ_ONLY);
-			continue;
-		}
-		ADD_ONCE(info->cache->stats.pages_saved, 1);
-		vdo_submit_metadata_vio(info->vio, info->pbn, write_cache_page_endio,
-					handle_page_write_error, REQ_OP_WRITE | REQ_PRIO);
+		min_heap_push(&cache->writeback_heap, &info, &writeback_min_heap);
 	}
 
-	if (has_unflushed_pages) {
-		/*
-		 * If there are unflushed pages, the cache can't have been freed, so this call is
-		 * safe.
-		 */
-		save_pages(cache);
-	}
+	/*
+	 * Start the next flush before any of these pages can finish, since in the read-only case,
+	 * once the last page has finished, it may be unsafe to dereference the cache [VDO-4724].
+	 */
+	save_pages(cache);
+	launch_writebacks(cache);
 }
 
 /**
@@ -1201,6 +1552,47 @@ static void load_page_for_completion(struct page_info *info,
 	}
 }
 
+/**
+ * prefetch_cache_page() - Load a page into the cache in anticipation of it being requested.
+ * @pbn: The absolute physical block number of the page.
+ *
+ * The page is loaded into a free page if there is one, or else in place of the page which would be
+ * discarded next if that page is clean. Nothing is done if any request is waiting for a page.
+ */
+static void prefetch_cache_page(struct vdo_page_cache *cache, physical_block_number_t pbn)
+{
+	struct page_info *info;
+	int result;
+
+	if ((cache->waiter_count > 0) || (find_page(cache, pbn) != NULL))
+		return;
+
+	info = find_free_page(cache);
+	if (info == NULL) {
+		info = select_lru_page(cache);
+		if ((info == NULL) || is_dirty(info))
+			return;
+
+		result = reset_page_info(info);
+		if (result != VDO_SUCCESS) {
+			set_persistent_error(cache, "cannot reset page info", result);
+			return;
+		}
+
+		list_del_init(&info->state_entry);
+	}
+
+	info->prefetched = true;
+	info->prefetching = true;
+	cache->zone->prefetches_in_flight++;
+	ADD_ONCE(cache->stats.pages_prefetched, 1);
+	result = launch_page_load(info, pbn);
+	if (result != VDO_SUCCESS) {
+		finish_prefetch_load(info);
+		set_persistent_error(cache, "cannot prefetch page", result);
+	}
+}
+
 /**
  * vdo_get_page() - Initialize a page completion and get a block map page.
  * @page_completion: The vdo_page_completion to initialize.
@@ -1254,6 +1646,14 @@ void vdo_get_page(struct vdo_page_completion *page_completion,
 	info = find_page(cache, page_completion->pbn);
 	if (info != NULL) {
 		/* The page is in the cache already. */
+		ADD_ONCE(cache->stats.cache_hits, 1);
+		if (info->prefetched) {
+			/* Its first use, rather than the prefetch, is what counts as its load. */
+			ADD_ONCE(cache->stats.prefetch_hits, 1);
+			info->prefetched = false;
+			info->loaded_at = cache->stats.pages_loaded;
+		}
+
 		if ((info->write_status == WRITE_STATUS_DEFERRED) ||
 		    is_incoming(info) ||
 		    (is_outgoing(info) && page_completion->writable)) {
@@ -1279,6 +1679,7 @@ void vdo_get_page(struct vdo_page_completion *page_completion,
 	}
 
 	/* The page must be fetched. */
+	ADD_ONCE(cache->stats.cache_misses, 1);
 	info = find_free_page(cache);
 	if (info != NULL) {
 		ADD_ONCE(cache->stats.fetch_required, 1);
@@ -1891,27 +2292,32 @@ static void load_page(struct vdo_waiter *waiter, void *context)
 				handle_io_error, REQ_OP_READ | REQ_PRIO);
 }
 
-/*
- * If the page is already locked, queue up to wait for the lock to be released. If the lock is
- * acquired, @data_vio->tree_lock.locked will be true.
- */
-static int attempt_page_lock(struct block_map_zone *zone, struct data_vio *data_vio)
+/* Set the key of the lock on loading or allocating the page below the lock's current height. */
+static void set_page_key(struct tree_lock *lock)
 {
-	int result;
-	struct tree_lock *lock_holder;
-	struct tree_lock *lock = &data_vio->tree_lock;
-	height_t height = lock->height;
-	struct block_map_tree_slot tree_slot = lock->tree_slots[height];
+	struct block_map_tree_slot tree_slot = lock->tree_slots[lock->height];
 	union page_key key;
 
 	key.descriptor = (struct page_descriptor) {
 		.root_index = lock->root_index,
-		.height = height,
+		.height = lock->height,
 		.page_index = tree_slot.page_index,
 		.slot = tree_slot.block_map_slot.slot,
 	};
 	lock->key = key.key;
+}
 
+/*
+ * If the page is already locked, queue up to wait for the lock to be released. If the lock is
+ * acquired, @data_vio->tree_lock.locked will be true.
+ */
+static int attempt_page_lock(struct block_map_zone *zone, struct data_vio *data_vio)
+{
+	int result;
+	struct tree_lock *lock_holder;
+	struct tree_lock *lock = &data_vio->tree_lock;
+
+	set_page_key(lock);
 	result = vdo_int_map_put(zone->loading_pages, lock->key,
 				 lock, false, (void **) &lock_holder);
 	if (result != VDO_SUCCESS)
@@ -1945,6 +2351,86 @@ static void load_block_map_page(struct block_map_zone *zone, struct data_vio *da
 	}
 }
 
+static void prefetch_leaf_page(struct block_map_zone *zone, page_number_t page_number);
+
+/* Release the lock of a tree page prefetch which has finished. */
+static void release_prefetch_lock(struct block_map_zone *zone, struct tree_prefetch *prefetch)
+{
+	struct tree_lock *lock_holder;
+
+	lock_holder = vdo_int_map_remove(zone->loading_pages, prefetch->lock.key);
+	ASSERT_LOG_ONLY((lock_holder == &prefetch->lock),
+			"block map page prefetch mismatch for key %llu in tree %u",
+			(unsigned long long) prefetch->lock.key, prefetch->lock.root_index);
+	prefetch->lock.locked = false;
+	zone->prefetches_in_flight--;
+}
+
+static void finish_tree_prefetch(struct vdo_completion *completion)
+{
+	physical_block_number_t pbn;
+	struct block_map_page *page;
+	struct vio *vio = as_vio(completion);
+	struct pooled_vio *pooled = vio_as_pooled_vio(vio);
+	struct tree_prefetch *prefetch = completion->parent;
+	struct block_map_zone *zone = pooled->context;
+	struct tree_lock *lock = &prefetch->lock;
+	nonce_t nonce = zone->block_map->nonce;
+
+	lock->height--;
+	pbn = lock->tree_slots[lock->height].block_map_slot.pbn;
+	page = (struct block_map_page *) get_tree_page(zone, lock)->page_buffer;
+	if (!vdo_copy_valid_page(vio->data, nonce, pbn, page))
+		vdo_format_block_map_page(page, nonce, pbn, false);
+	return_vio_to_pool(zone->vio_pool, pooled);
+
+	release_prefetch_lock(zone, prefetch);
+	vdo_waitq_notify_all_waiters(&lock->waiters, continue_load_for_waiter, page);
+	prefetch_leaf_page(zone, prefetch->page_number);
+	check_for_drain_complete(zone);
+}
+
+/* Let a data_vio which was waiting on a failed prefetch load the page itself. */
+static void retry_load_for_waiter(struct vdo_waiter *waiter, void *context)
+{
+	load_block_map_page(context, vdo_waiter_as_data_vio(waiter));
+}
+
+static void handle_tree_prefetch_error(struct vdo_completion *completion)
+{
+	struct vio *vio = as_vio(completion);
+	struct pooled_vio *pooled = vio_as_pooled_vio(vio);
+	struct tree_prefetch *prefetch = completion->parent;
+	struct block_map_zone *zone = pooled->context;
+
+	vio_record_metadata_io_error(vio);
+	return_vio_to_pool(zone->vio_pool, pooled);
+	release_prefetch_lock(zone, prefetch);
+	vdo_waitq_notify_all_waiters(&prefetch->lock.waiters, retry_load_for_waiter, zone);
+	check_for_drain_complete(zone);
+}
+
+static void tree_prefetch_endio(struct bio *bio)
+{
+	struct vio *vio = bio->bi_private;
+	struct block_map_zone *zone = vio_as_pooled_vio(vio)->context;
+
+	continue_vio_after_io(vio, finish_tree_prefetch, zone->thread_id);
+}
+
+/* Implements waiter_callback_fn. */
+static void launch_tree_prefetch(struct vdo_waiter *waiter, void *context)
+{
+	struct pooled_vio *pooled = context;
+	struct tree_prefetch *prefetch = container_of(waiter, struct tree_prefetch, waiter);
+	struct tree_lock *lock = &prefetch->lock;
+	physical_block_number_t pbn = lock->tree_slots[lock->height - 1].block_map_slot.pbn;
+
+	pooled->vio.completion.parent = prefetch;
+	vdo_submit_metadata_vio(&pooled->vio, pbn, tree_prefetch_endio,
+				handle_tree_prefetch_error, REQ_OP_READ | REQ_PRIO);
+}
+
 static void allocation_failure(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
@@ -2227,23 +2713,20 @@ static void allocate_block_map_page(struct block_map_zone *zone,
  *
  * All ancestors in the tree will be allocated or loaded, as needed.
  */
-void vdo_find_block_map_slot(struct data_vio *data_vio)
+/**
+ * find_lowest_loaded_page() - Find the lowest loaded tree page on the path to a leaf page.
+ * @lock: A tree lock whose root index and leaf page index are set. Its height and tree slots will
+ *        be set to those of the lowest loaded page.
+ *
+ * Return: The mapping in the lowest loaded page of the page below it.
+ */
+static struct data_location find_lowest_loaded_page(struct block_map_zone *zone,
+						    struct tree_lock *lock)
 {
 	page_number_t page_index;
 	struct block_map_tree_slot tree_slot;
-	struct data_location mapping;
 	struct block_map_page *page = NULL;
-	struct tree_lock *lock = &data_vio->tree_lock;
-	struct block_map_zone *zone = data_vio->logical.zone->block_map_zone;
 
-	zone->active_lookups++;
-	if (vdo_is_state_draining(&zone->state)) {
-		finish_lookup(data_vio, VDO_SHUTTING_DOWN);
-		return;
-	}
-
-	lock->tree_slots[0].block_map_slot.slot =
-		data_vio->logical.lbn % VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
 	page_index = (lock->tree_slots[0].page_index / zone->block_map->root_count);
 	tree_slot = (struct block_map_tree_slot) {
 		.page_index = page_index / VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
@@ -2270,8 +2753,148 @@ void vdo_find_block_map_slot(struct data_vio *data_vio)
 		tree_slot.page_index = tree_slot.page_index / VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
 	}
 
-	/* The page at this height has been allocated and loaded. */
-	mapping = vdo_unpack_block_map_entry(&page->entries[tree_slot.block_map_slot.slot]);
+	return vdo_unpack_block_map_entry(&page->entries[tree_slot.block_map_slot.slot]);
+}
+
+/**
+ * next_zone_page() - Find the next leaf page after a given one which belongs to a zone.
+ *
+ * Return: The page number, which is past the last leaf page if there is no such page.
+ */
+static page_number_t next_zone_page(struct block_map_zone *zone, page_number_t page_number)
+{
+	struct block_map *map = zone->block_map;
+	page_count_t leaf_pages = vdo_compute_block_map_page_count(map->entry_count);
+
+	do {
+		page_number++;
+	} while ((page_number < leaf_pages) &&
+		 (((page_number % map->root_count) % map->zone_count) != zone->zone_number));
+
+	return page_number;
+}
+
+/**
+ * prefetch_leaf_page() - Start reading a leaf page, or the highest of its ancestors in the tree
+ *                        which is not loaded, before any lookup needs it.
+ *
+ * A leaf page is read into the page cache. A tree page is read while holding the same lock a
+ * data_vio would, so that lookups which need it wait for it rather than reading it again, and once
+ * it has been read, the prefetch continues down the tree.
+ */
+static void prefetch_leaf_page(struct block_map_zone *zone, page_number_t page_number)
+{
+	struct tree_prefetch *prefetch;
+	struct data_location mapping;
+	struct tree_lock *lock_holder;
+	struct tree_lock lock = {
+		.root_index = page_number % zone->block_map->root_count,
+	};
+	int result;
+
+	if (vdo_is_state_draining(&zone->state) || vdo_is_read_only(zone->block_map->vdo))
+		return;
+
+	lock.tree_slots[0].page_index = page_number;
+	mapping = find_lowest_loaded_page(zone, &lock);
+	if (is_invalid_tree_entry(zone->block_map->vdo, &mapping, lock.height) ||
+	    !vdo_is_mapped_location(&mapping))
+		return;
+
+	if (lock.height == 1) {
+		prefetch_cache_page(&zone->page_cache, mapping.pbn);
+		return;
+	}
+
+	for (prefetch = zone->tree_prefetches;
+	     prefetch < zone->tree_prefetches + BLOCK_MAP_MAXIMUM_PREFETCHES;
+	     prefetch++) {
+		if (!prefetch->lock.locked)
+			break;
+	}
+
+	if (prefetch == zone->tree_prefetches + BLOCK_MAP_MAXIMUM_PREFETCHES)
+		return;
+
+	lock.tree_slots[lock.height - 1].block_map_slot.pbn = mapping.pbn;
+	set_page_key(&lock);
+	result = vdo_int_map_put(zone->loading_pages, lock.key, &prefetch->lock, false,
+				 (void **) &lock_holder);
+	if ((result != VDO_SUCCESS) || (lock_holder != NULL)) {
+		/* The page is already being loaded. */
+		return;
+	}
+
+	prefetch->lock = lock;
+	prefetch->lock.locked = true;
+	prefetch->page_number = page_number;
+	zone->prefetches_in_flight++;
+	ADD_ONCE(zone->page_cache.stats.pages_prefetched, 1);
+	prefetch->waiter.callback = launch_tree_prefetch;
+	acquire_vio_from_pool(zone->vio_pool, &prefetch->waiter);
+}
+
+/**
+ * prefetch_ahead() - Detect a sequential stream of lookups, and prefetch the leaf pages ahead of
+ *                    it.
+ * @page_number: The leaf page of a lookup.
+ *
+ * A lookup is part of a stream if it is for a following page not far beyond the last lookup's.
+ * Lookups from the same stream may arrive a little out of order, so one for a page not far before
+ * the last is ignored.
+ */
+static void prefetch_ahead(struct block_map_zone *zone, page_number_t page_number)
+{
+	page_number_t window = 2 * zone->block_map->zone_count;
+	page_number_t page;
+	unsigned int i;
+
+	if ((page_number <= zone->last_page) && (zone->last_page - page_number <= window))
+		return;
+
+	if ((page_number > zone->last_page) && (page_number - zone->last_page <= window)) {
+		zone->sequential_lookups++;
+	} else {
+		zone->sequential_lookups = 0;
+		zone->prefetched_through = page_number;
+	}
+
+	zone->last_page = page_number;
+	if (zone->sequential_lookups < BLOCK_MAP_PREFETCH_TRIGGER)
+		return;
+
+	for (i = 0, page = page_number; i < BLOCK_MAP_PREFETCH_PAGES; i++) {
+		page = next_zone_page(zone, page);
+		if (page >= vdo_compute_block_map_page_count(zone->block_map->entry_count))
+			return;
+
+		if (page <= zone->prefetched_through)
+			continue;
+
+		if (zone->prefetches_in_flight >= BLOCK_MAP_MAXIMUM_PREFETCHES)
+			return;
+
+		zone->prefetched_through = page;
+		prefetch_leaf_page(zone, page);
+	}
+}
+
+void vdo_find_block_map_slot(struct data_vio *data_vio)
+{
+	struct data_location mapping;
+	struct tree_lock *lock = &data_vio->tree_lock;
+	struct block_map_zone *zone = data_vio->logical.zone->block_map_zone;
+
+	zone->active_lookups++;
+	if (vdo_is_state_draining(&zone->state)) {
+		finish_lookup(data_vio, VDO_SHUTTING_DOWN);
+		return;
+	}
+
+	prefetch_ahead(zone, lock->tree_slots[0].page_index);
+	lock->tree_slots[0].block_map_slot.slot =
+		data_vio->logical.lbn % VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+	mapping = find_lowest_loaded_page(zone, lock);
 	if (is_invalid_tree_entry(vdo_from_data_vio(data_vio), &mapping, lock->height)) {
 		uds_log_error_strerror(VDO_BAD_MAPPING,
 				       "Invalid block map tree PBN: %llu with state %u for page index %u at height %u",
@@ -2720,8 +3343,30 @@ void vdo_traverse_forest(struct block_map *map, vdo_entry_callback_fn callback,
 	};
 }
 
+static const char * const CACHE_POLICY_NAMES[] = {
+	[VDO_CACHE_POLICY_LRU] = "lru",
+	[VDO_CACHE_POLICY_2Q] = "2q",
+};
+
+/**
+ * vdo_get_cache_policy_name() - Get the name of a page cache replacement policy.
+ * @policy: The policy.
+ *
+ * Return: The name of the policy, or NULL if the policy is unknown.
+ */
+const char *vdo_get_cache_policy_name(enum vdo_cache_policy policy)
+{
+	BUILD_BUG_ON(ARRAY_SIZE(CACHE_POLICY_NAMES) != VDO_CACHE_POLICY_COUNT);
+
+	if (policy >= VDO_CACHE_POLICY_COUNT)
+		return NULL;
+
+	return CACHE_POLICY_NAMES[policy];
+}
+
 /**
  * initialize_block_map_zone() - Initialize the per-zone portions of the block map.
+ * @cache_policy: The replacement policy of the zone's page cache.
  * @maximum_age: The number of journal blocks before a dirtied page is considered old and must be
  *               written out.
  */
@@ -2729,6 +3374,7 @@ static int __must_check initialize_block_map_zone(struct block_map *map,
 						  zone_count_t zone_number,
 						  struct vdo *vdo,
 						  page_count_t cache_size,
+						  enum vdo_cache_policy cache_policy,
 						  block_count_t maximum_age)
 {
 	int result;
@@ -2760,7 +3406,12 @@ static int __must_check initialize_block_map_zone(struct block_map *map,
 	if (result != VDO_SUCCESS)
 		return result;
 
-	result = make_vio_pool(vdo, BLOCK_MAP_VIO_POOL_SIZE,
+	result = uds_allocate(BLOCK_MAP_MAXIMUM_PREFETCHES, struct tree_prefetch,
+			      "block map tree prefetches", &zone->tree_prefetches);
+	if (result != VDO_SUCCESS)
+		return result;
+
+	result = make_vio_pool(vdo, BLOCK_MAP_VIO_POOL_SIZE, 1,
 			       zone->thread_id, VIO_TYPE_BLOCK_MAP_INTERIOR,
 			       VIO_PRIORITY_METADATA, zone, &zone->vio_pool);
 	if (result != VDO_SUCCESS)
@@ -2771,6 +3422,7 @@ static int __must_check initialize_block_map_zone(struct block_map *map,
 	zone->page_cache.zone = zone;
 	zone->page_cache.vdo = vdo;
 	zone->page_cache.page_count = cache_size / map->zone_count;
+	zone->page_cache.policy = cache_policy;
 	zone->page_cache.stats.free_pages = zone->page_cache.page_count;
 
 	result = allocate_cache_components(&zone->page_cache);
@@ -2779,6 +3431,7 @@ static int __must_check initialize_block_map_zone(struct block_map *map,
 
 	/* initialize empty circular queues */
 	INIT_LIST_HEAD(&zone->page_cache.lru_list);
+	INIT_LIST_HEAD(&zone->page_cache.probation_list);
 	INIT_LIST_HEAD(&zone->page_cache.outgoing_list);
 
 	return VDO_SUCCESS;
@@ -2837,6 +3490,7 @@ static void uninitialize_block_map_zone(struct block_map_zone *zone)
 	uds_free(uds_forget(zone->dirty_lists));
 	free_vio_pool(uds_forget(zone->vio_pool));
 	vdo_int_map_free(uds_forget(zone->loading_pages));
+	uds_free(uds_forget(zone->tree_prefetches));
 	if (cache->infos != NULL) {
 		struct page_info *info;
 
@@ -2844,9 +3498,24 @@ static void uninitialize_block_map_zone(struct block_map_zone *zone)
 			free_vio(uds_forget(info->vio));
 	}
 
+	if (cache->writebacks != NULL) {
+		struct page_writeback *writeback;
+
+		for (writeback = cache->writebacks;
+		     writeback < cache->writebacks + BLOCK_MAP_MAXIMUM_WRITEBACKS;
+		     writeback++) {
+			free_vio(uds_forget(writeback->vio));
+			uds_free(uds_forget(writeback->buffer));
+		}
+	}
+
 	vdo_int_map_free(uds_forget(cache->page_map));
+	vdo_int_map_free(uds_forget(cache->ghost_map));
+	uds_free(uds_forget(cache->ghosts));
 	uds_free(uds_forget(cache->infos));
 	uds_free(uds_forget(cache->pages));
+	uds_free(uds_forget(cache->writebacks));
+	uds_free(uds_forget(cache->writeback_heap.data));
 }
 
 void vdo_free_block_map(struct block_map *map)
@@ -2869,7 +3538,8 @@ void vdo_free_block_map(struct block_map *map)
 /* @journal may be NULL. */
 int vdo_decode_block_map(struct block_map_state_2_0 state, block_count_t logical_blocks,
 			 struct vdo *vdo, struct recovery_journal *journal,
-			 nonce_t nonce, page_count_t cache_size, block_count_t maximum_age,
+			 nonce_t nonce, page_count_t cache_size,
+			 enum vdo_cache_policy cache_policy, block_count_t maximum_age,
 			 struct block_map **map_ptr)
 {
 	struct block_map *map;
@@ -2907,7 +3577,7 @@ int vdo_decode_block_map(struct block_map_state_2_0 state, block_count_t logical
 	map->zone_count = vdo->thread_config.logical_zone_count;
 	for (zone = 0; zone < map->zone_count; zone++) {
 		result = initialize_block_map_zone(map, zone, vdo, cache_size,
-						   maximum_age);
+						   cache_policy, maximum_age);
 		if (result != VDO_SUCCESS) {
 			vdo_free_block_map(map);
 			return result;
@@ -3324,6 +3994,12 @@ struct block_map_statistics vdo_get_block_map_statistics(struct block_map *map)
 		totals.fetch_required += READ_ONCE(stats->fetch_required);
 		totals.pages_loaded += READ_ONCE(stats->pages_loaded);
 		totals.pages_saved += READ_ONCE(stats->pages_saved);
+		totals.writeback_bios += READ_ONCE(stats->writeback_bios);
+		totals.cache_hits += READ_ONCE(stats->cache_hits);
+		totals.cache_misses += READ_ONCE(stats->cache_misses);
+		totals.ghost_hits += READ_ONCE(stats->ghost_hits);
+		totals.pages_prefetched += READ_ONCE(stats->pages_prefetched);
+		totals.prefetch_hits += READ_ONCE(stats->prefetch_hits);
 		totals.flush_count += READ_ONCE(stats->flush_count);
 	}
 
@@ -7,6 +7,7 @@
 #define VDO_BLOCK_MAP_H
 
 #include <linux/list.h>
+#include <linux/min_heap.h>
 #ifndef __KERNEL__
 #include <stdint.h>
 #endif
@@ -24,6 +25,16 @@
 
 enum {
 	BLOCK_MAP_VIO_POOL_SIZE = 64,
+	/* The number of a zone's leaf pages to read ahead of a sequential stream of lookups */
+	BLOCK_MAP_PREFETCH_PAGES = 8,
+	/* The most prefetch reads a zone may have in progress */
+	BLOCK_MAP_MAXIMUM_PREFETCHES = 8,
+	/* The number of consecutive moves to a following leaf page which start prefetching */
+	BLOCK_MAP_PREFETCH_TRIGGER = 2,
+	/* The most adjacent cache pages one writeback bio may write */
+	BLOCK_MAP_WRITEBACK_BLOCKS = 16,
+	/* The most writeback bios a zone may have in progress */
+	BLOCK_MAP_MAXIMUM_WRITEBACKS = 4,
 };
 
 /*
@@ -33,6 +44,8 @@ typedef u32 vdo_page_generation;
 
 extern const struct block_map_entry UNMAPPED_BLOCK_MAP_ENTRY;
 
+struct page_writeback;
+
 /* The VDO Page Cache abstraction. */
 struct vdo_page_cache {
 	/* the VDO which owns this cache */
@@ -43,6 +56,8 @@ struct vdo_page_cache {
 	page_count_t pages_in_batch;
 	/* Whether the VDO is doing a read-only rebuild */
 	bool rebuilding;
+	/* The replacement policy */
+	enum vdo_cache_policy policy;
 
 	/* array of page information entries */
 	struct page_info *infos;
@@ -52,8 +67,25 @@ struct vdo_page_cache {
 	struct page_info *last_found;
 	/* map of page number to info */
 	struct int_map *page_map;
-	/* main LRU list (all infos) */
+	/*
+	 * main LRU list; with the 2Q policy, only the pages which have been referenced again after
+	 * leaving the probation list
+	 */
 	struct list_head lru_list;
+	/* pages loaded for the first time recently, oldest first (2Q policy only) */
+	struct list_head probation_list;
+	/* number of pages on the probation list */
+	page_count_t probation_count;
+	/* number of pages the probation list may hold before it is evicted from first */
+	page_count_t probation_target;
+	/* the pbns of pages recently evicted from probation, as a ring (2Q policy only) */
+	physical_block_number_t *ghosts;
+	/* number of entries in the ghost ring */
+	page_count_t ghost_count;
+	/* index of the next ghost ring entry to replace */
+	page_count_t next_ghost;
+	/* map of pbn to ghost ring entry */
+	struct int_map *ghost_map;
 	/* free page list (oldest first) */
 	struct list_head free_list;
 	/* outgoing page list */
@@ -66,6 +98,10 @@ struct vdo_page_cache {
 	page_count_t pages_in_flush;
 	/* number of pages waiting to be included in the next flush */
 	page_count_t pages_to_flush;
+	/* flushed pages waiting for a writeback, ordered by pbn */
+	struct min_heap writeback_heap;
+	/* the writebacks of runs of adjacent pages */
+	struct page_writeback *writebacks;
 	/* number of discards in progress */
 	unsigned int discard_count;
 	/* how many VPCs waiting for free page */
@@ -137,6 +173,14 @@ struct page_info {
 	struct list_head state_entry;
 	/* LRU entry */
 	struct list_head lru_entry;
+	/* whether the page belongs on the main LRU list rather than the probation list */
+	bool hot;
+	/* the cache's count of pages loaded when this page was loaded */
+	u64 loaded_at;
+	/* whether the page was loaded by a prefetch, and has not been requested since */
+	bool prefetched;
+	/* whether the page is being loaded by a prefetch */
+	bool prefetching;
 	/*
 	 * The earliest recovery journal block containing uncommitted updates to the block map page
 	 * associated with this page_info. A reference (lock) is held on that block to prevent it
@@ -203,6 +247,8 @@ enum block_map_page_type {
 
 typedef struct list_head dirty_era_t[2];
 
+struct tree_prefetch;
+
 struct dirty_lists {
 	/** The number of periods after which an element will be expired */
 	block_count_t maximum_age;
@@ -229,6 +275,16 @@ struct block_map_zone {
 	data_vio_count_t active_lookups;
 	struct int_map *loading_pages;
 	struct vio_pool *vio_pool;
+	/* The leaf page of the most recent lookup, for detecting sequential access */
+	page_number_t last_page;
+	/* The number of consecutive lookups which have moved on to a following leaf page */
+	unsigned int sequential_lookups;
+	/* The last leaf page which has been prefetched */
+	page_number_t prefetched_through;
+	/* The number of prefetch reads of leaf and tree pages in progress */
+	unsigned int prefetches_in_flight;
+	/* The tree page prefetches, which are in use while their page lock is held */
+	struct tree_prefetch *tree_prefetches;
 	/* The tree page which has issued or will be issuing a flush */
 	struct tree_page *flusher;
 	struct vdo_wait_queue flush_waiters;
@@ -318,10 +374,13 @@ void vdo_write_tree_page(struct tree_page *page, struct block_map_zone *zone);
 void vdo_traverse_forest(struct block_map *map, vdo_entry_callback_fn callback,
 			 struct vdo_completion *parent);
 
+const char * __must_check vdo_get_cache_policy_name(enum vdo_cache_policy policy);
+
 int __must_check vdo_decode_block_map(struct block_map_state_2_0 state,
 				      block_count_t logical_blocks, struct vdo *vdo,
 				      struct recovery_journal *journal, nonce_t nonce,
-				      page_count_t cache_size, block_count_t maximum_age,
+				      page_count_t cache_size, enum vdo_cache_policy cache_policy,
+				      block_count_t maximum_age,
 				      struct block_map **map_ptr);
 
 void vdo_drain_block_map(struct block_map *map, const struct admin_state_code *operation,
@@ -7,12 +7,14 @@
 
 #include <linux/atomic.h>
 #include <linux/bio.h>
+#include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/delay.h>
 #include <linux/device-mapper.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 #include <linux/lz4.h>
 #include <linux/minmax.h>
 #include <linux/sched.h>
@@ -26,10 +28,13 @@
 #include "memory-alloc.h"
 #include "murmurhash3.h"
 #include "permassert.h"
+#include "time-utils.h"
 
+#include "block-compare.h"
 #include "block-map.h"
 #include "dump.h"
 #include "encodings.h"
+#include "fingerprint.h"
 #include "int-map.h"
 #include "io-submitter.h"
 #include "logical-zone.h"
@@ -111,14 +116,38 @@ static unsigned int PASSTHROUGH_FLAGS = (REQ_PRIO | REQ_META | REQ_SYNC | REQ_RA
  * is a blocked bio waiting for a discard permit, that permit is notionally transferred to the
  * eldest discard waiter, and that waiter is moved to the end of the list of discard bios waiting
  * for a data_vio. If there are no discard waiters, the discard permit is returned to the pool.
- * Next, the data_vio is assigned to the oldest blocked bio which either has a discard permit, or
- * doesn't need one and relaunched. If neither of these exist, the data_vio is returned to the
- * pool. Finally, if any waiting bios were launched, the threads which blocked trying to submit
- * them are awakened.
+ * Next, the data_vio is assigned to a blocked bio which either has a discard permit, or doesn't
+ * need one and relaunched. If neither of these exist, the data_vio is returned to the pool.
+ * Finally, if any waiting bios were launched, the threads which blocked trying to submit them are
+ * awakened.
+ *
+ * Waiting reads are kept apart from waiting writes and discards so that the choice of which bio
+ * to relaunch can be weighted (see select_waiters()). Writes may not take the last read_reserve
+ * free data_vios, even if no reads are waiting. When both reads and writes are waiting, writes
+ * get write_share percent of the data_vios released, except that a bio which has waited longer
+ * than the admission deadline is relaunched first. By default, nothing is reserved and the write
+ * share is 100%, which relaunches blocked bios in the order they arrived.
  */
 
 enum {
 	DATA_VIO_RELEASE_BATCH_SIZE = 128,
+	/* The most released data_vios reused in one batch of block comparisons */
+	DATA_VIO_COMPARE_BATCH_SIZE = 16,
+	/* The default age at which a waiting bio is admitted regardless of the write share */
+	DATA_VIO_ADMISSION_DEADLINE_MS = 50,
+	/* Each CPU thread hashes at most one set of interleaved lanes at a time. */
+	DATA_VIO_HASH_BATCH_SIZE = MURMURHASH3_LANES,
+	/*
+	 * Before a block is compressed, bytes are sampled from it. If the samples contain many
+	 * distinct byte values, LZ4 is unlikely to shrink the block enough to pack it, so it is
+	 * not tried. Uniformly random samples of this size contain about 221 distinct values,
+	 * while text and most structured data contain far fewer.
+	 */
+	INCOMPRESSIBLE_PROBE_SAMPLES = 64,
+	INCOMPRESSIBLE_PROBE_SAMPLE_SIZE = 8,
+	/* An odd stride, so that the samples do not all fall at one offset of a record. */
+	INCOMPRESSIBLE_PROBE_STRIDE = 61,
+	INCOMPRESSIBLE_PROBE_DISTINCT_BYTES = 200,
 };
 
 static const unsigned int VDO_SECTORS_PER_BLOCK_MASK = VDO_SECTORS_PER_BLOCK - 1;
@@ -126,7 +155,7 @@ static const u32 COMPRESSION_STATUS_MASK = 0xff;
 static const u32 MAY_NOT_COMPRESS_MASK = 0x80000000;
 
 struct limiter;
-typedef void (*assigner_fn)(struct limiter *limiter);
+typedef bool (*assigner_fn)(struct limiter *limiter);
 
 /* Bookkeeping structure for a single type of resource. */
 struct limiter {
@@ -142,18 +171,28 @@ struct limiter {
 	data_vio_count_t release_count;
 	/* The number of waiters to wake */
 	data_vio_count_t wake_count;
-	/* The list of waiting bios which are known to process_release_callback() */
+	/*
+	 * The list of waiting bios which are known to process_release_callback(), less any reads
+	 * which are admitted separately
+	 */
 	struct bio_list waiters;
+	/* The list of waiting reads known to process_release_callback(), if separate */
+	struct bio_list *read_waiters;
 	/* The list of waiting bios which are not yet known to process_release_callback() */
 	struct bio_list new_waiters;
 	/* The list of waiters which have their permits */
 	struct bio_list *permitted_waiters;
-	/* The function for assigning a resource to a waiter */
+	/* The function for assigning a resource to a waiter, if there is one it may have */
 	assigner_fn assigner;
 	/* The queue of blocked threads */
 	wait_queue_head_t blocked_threads;
-	/* The arrival time of the eldest waiter */
-	u64 arrival;
+};
+
+/* The time spent in one asynchronous operation by sampled data_vios. */
+struct stage_histogram {
+	atomic64_t samples;
+	atomic64_t total_ns;
+	atomic64_t buckets[DATA_VIO_STAGE_LATENCY_BUCKETS];
 };
 
 /*
@@ -173,12 +212,36 @@ struct data_vio_pool {
 	struct limiter discard_limiter;
 	/* The list of bios which have discard permits but still need a data_vio */
 	struct bio_list permitted_discards;
+	/* The list of reads waiting for a data_vio */
+	struct bio_list read_waiters;
+	/* The number of data_vios which writes may not take, so that reads need not wait */
+	data_vio_count_t read_reserve;
+	/* The percentage of data_vios given to writes when both reads and writes are waiting */
+	unsigned int write_share;
+	/* The age, in jiffies, at which a waiter is admitted ahead of its share */
+	unsigned long admission_deadline;
+	/* The balance between the shares of reads and writes admitted so far */
+	int write_credit;
 	/* The list of available data_vios */
 	struct list_head available;
 	/* The queue of data_vios waiting to be returned to the pool */
 	struct funnel_queue *queue;
 	/* Whether the pool is processing, or scheduled to process releases */
 	atomic_t processing;
+	/* The number of writes and discards which have yet to make recovery journal entries */
+	atomic_t pending_writes;
+	/* Completion for scheduling the hashing of data_vios */
+	struct vdo_completion hash_completion;
+	/* The queue of data_vios waiting to be hashed */
+	struct funnel_queue *hash_queue;
+	/* Whether a batch of data_vios is being collected for hashing, or is scheduled to be */
+	atomic_t hashing;
+	/* Sample the stage latencies of one in this many data_vios, or of none if 0 */
+	unsigned int stage_sample_interval;
+	/* The number of data_vios launched since the last one sampled */
+	atomic_t stage_sample_count;
+	/* The time sampled data_vios have spent in each asynchronous operation */
+	struct stage_histogram stage_histograms[MAX_VIO_ASYNC_OPERATION_NUMBER];
 	/* The data vios in the pool */
 	struct data_vio data_vios[];
 };
@@ -269,7 +332,7 @@ static void launch_locked_request(struct data_vio *data_vio)
 		}
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_FIND_BLOCK_MAP_SLOT;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_FIND_BLOCK_MAP_SLOT);
 	vdo_find_block_map_slot(data_vio);
 }
 
@@ -496,7 +559,7 @@ static void attempt_logical_block_lock(struct vdo_completion *completion)
 		return;
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_ATTEMPT_LOGICAL_BLOCK_LOCK;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_ATTEMPT_LOGICAL_BLOCK_LOCK);
 	vdo_waitq_enqueue_waiter(&lock_holder->logical.waiters, &data_vio->waiter);
 
 	/*
@@ -539,24 +602,6 @@ static void launch_data_vio(struct data_vio *data_vio, logical_block_number_t lb
 	vdo_enqueue_completion(completion, VDO_DEFAULT_Q_MAP_BIO_PRIORITY);
 }
 
-STATIC bool is_zero_block(char *block)
-{
-	int i;
-
-#ifdef INTERNAL
-	BUILD_BUG_ON(VDO_BLOCK_SIZE % sizeof(u64) != 0);
-	ASSERT_LOG_ONLY((uintptr_t) block % sizeof(u64) == 0,
-			"Data blocks are expected to be aligned");
-
-#endif	/* INTERNAL */
-	for (i = 0; i < VDO_BLOCK_SIZE; i += sizeof(u64)) {
-		if (*((u64 *) &block[i]))
-			return false;
-	}
-
-	return true;
-}
-
 static void copy_from_bio(struct bio *bio, char *data_ptr)
 {
 	struct bio_vec biovec;
@@ -568,9 +613,27 @@ static void copy_from_bio(struct bio *bio, char *data_ptr)
 	}
 }
 
-static void launch_bio(struct vdo *vdo, struct data_vio *data_vio, struct bio *bio)
+/* Decide whether the data_vio being launched should have its stage latencies recorded. */
+static bool should_sample_stages(struct data_vio_pool *pool)
+{
+	unsigned int interval = READ_ONCE(pool->stage_sample_interval);
+
+	if (interval == 0)
+		return false;
+
+	return ((atomic_inc_return(&pool->stage_sample_count) % interval) == 0);
+}
+
+/**
+ * prepare_data_vio() - Set up a data_vio to service a bio.
+ * @vdo: The vdo.
+ * @data_vio: The data_vio.
+ * @bio: The bio.
+ *
+ * The data of a full block write is copied, but not yet checked for zeros.
+ */
+static void prepare_data_vio(struct vdo *vdo, struct data_vio *data_vio, struct bio *bio)
 {
-	logical_block_number_t lbn;
 #ifdef VDO_INTERNAL
 	u64 arrival = get_arrival_time(bio);
 	u64 startup_jiffies = jiffies - arrival;
@@ -617,42 +680,158 @@ static void launch_bio(struct vdo *vdo, struct data_vio *data_vio, struct bio *b
 		 * we acknowledge the bio.
 		 */
 		copy_from_bio(bio, data_vio->vio.data);
-		data_vio->is_zero = is_zero_block(data_vio->vio.data);
 		data_vio->write = true;
 	}
 
 	if (data_vio->user_bio->bi_opf & REQ_FUA)
 		data_vio->fua = true;
 
+	if (data_vio->write) {
+		data_vio->pending_write = true;
+		atomic_inc(&vdo->data_vio_pool->pending_writes);
+	}
+}
+
+/* Check whether a prepared data_vio holds a full block of data which must be checked for zeros. */
+static bool is_full_block_write(const struct data_vio *data_vio)
+{
+	return (data_vio->write && !data_vio->read && !data_vio->is_trim);
+}
+
+static void start_data_vio(struct vdo *vdo, struct data_vio *data_vio)
+{
+	struct bio *bio = data_vio->user_bio;
+	logical_block_number_t lbn;
+
+	if (unlikely(should_sample_stages(vdo->data_vio_pool)))
+		data_vio->stage_start_ns = current_time_ns(CLOCK_MONOTONIC);
+
 	lbn = (bio->bi_iter.bi_sector - vdo->starting_sector_offset) / VDO_SECTORS_PER_BLOCK;
 	launch_data_vio(data_vio, lbn);
 }
 
-static void assign_data_vio(struct limiter *limiter, struct data_vio *data_vio)
+static void launch_bio(struct vdo *vdo, struct data_vio *data_vio, struct bio *bio)
 {
-	struct bio *bio = bio_list_pop(limiter->permitted_waiters);
+	prepare_data_vio(vdo, data_vio, bio);
+	if (is_full_block_write(data_vio))
+		data_vio->is_zero = vdo_is_zero_block(data_vio->vio.data);
+
+	start_data_vio(vdo, data_vio);
+}
 
-	launch_bio(limiter->pool->completion.vdo, data_vio, bio);
+static void assign_data_vio(struct limiter *limiter, struct bio_list *waiters,
+			    struct data_vio *data_vio)
+{
+	launch_bio(limiter->pool->completion.vdo, data_vio, bio_list_pop(waiters));
 	limiter->wake_count++;
+}
 
-	bio = bio_list_peek(limiter->permitted_waiters);
-	limiter->arrival = ((bio == NULL) ? U64_MAX : get_arrival_time(bio));
+/*
+ * Set up a released data_vio for a waiting bio, and add it to a list of data_vios to be launched
+ * once the batch of releases has been processed.
+ */
+static void reassign_data_vio(struct limiter *limiter, struct bio_list *waiters,
+			      struct data_vio *data_vio, struct list_head *relaunched)
+{
+	prepare_data_vio(limiter->pool->completion.vdo, data_vio, bio_list_pop(waiters));
+	list_add_tail(&data_vio->pool_entry, relaunched);
+	limiter->wake_count++;
 }
 
-static void assign_discard_permit(struct limiter *limiter)
+static bool assign_discard_permit(struct limiter *limiter)
 {
 	struct bio *bio = bio_list_pop(&limiter->waiters);
 
-	if (limiter->arrival == U64_MAX)
-		limiter->arrival = get_arrival_time(bio);
+	if (bio == NULL)
+		return false;
 
 	bio_list_add(limiter->permitted_waiters, bio);
+	return true;
 }
 
 static void get_waiters(struct limiter *limiter)
 {
-	bio_list_merge(&limiter->waiters, &limiter->new_waiters);
-	bio_list_init(&limiter->new_waiters);
+	struct bio *bio;
+
+	if (limiter->read_waiters == NULL) {
+		bio_list_merge(&limiter->waiters, &limiter->new_waiters);
+		bio_list_init(&limiter->new_waiters);
+		return;
+	}
+
+	while ((bio = bio_list_pop(&limiter->new_waiters)) != NULL) {
+		if (bio_data_dir(bio) == READ)
+			bio_list_add(limiter->read_waiters, bio);
+		else
+			bio_list_add(&limiter->waiters, bio);
+	}
+}
+
+static inline u64 get_eldest_arrival(struct bio_list *waiters)
+{
+	struct bio *bio = bio_list_peek(waiters);
+
+	return ((bio == NULL) ? U64_MAX : get_arrival_time(bio));
+}
+
+/**
+ * may_admit_write() - Check whether a write may take a data_vio without using the read reserve.
+ * @pool: The pool.
+ * @busy: The number of data_vios in use, not counting the one the write would take.
+ */
+static inline bool may_admit_write(struct data_vio_pool *pool, data_vio_count_t busy)
+{
+	return ((busy + READ_ONCE(pool->read_reserve)) < pool->limiter.limit);
+}
+
+/**
+ * select_waiters() - Choose the list from which the next waiting bio will be given a data_vio.
+ * @pool: The pool.
+ * @busy: The number of data_vios in use, not counting the one to be given out.
+ *
+ * Writes and discards may not use the data_vios reserved for reads. When both reads and writes
+ * are waiting, the eldest is chosen if the write share is 100%, or if it has waited longer than
+ * the admission deadline; otherwise writes are given the configured share of data_vios.
+ *
+ * Return: The list of waiters to take the next bio from, or NULL if no waiter may be admitted.
+ */
+static struct bio_list *select_waiters(struct data_vio_pool *pool, data_vio_count_t busy)
+{
+	struct bio_list *reads = &pool->read_waiters;
+	struct bio_list *writes = &pool->limiter.waiters;
+	u64 read_arrival = get_eldest_arrival(reads);
+	u64 write_arrival = get_eldest_arrival(writes);
+	u64 discard_arrival = get_eldest_arrival(&pool->permitted_discards);
+	unsigned int share;
+
+	if (discard_arrival < write_arrival) {
+		writes = &pool->permitted_discards;
+		write_arrival = discard_arrival;
+	}
+
+	if ((write_arrival == U64_MAX) || !may_admit_write(pool, busy))
+		return ((read_arrival == U64_MAX) ? NULL : reads);
+
+	if (read_arrival == U64_MAX)
+		return writes;
+
+	share = READ_ONCE(pool->write_share);
+	if ((share >= 100) ||
+	    ((jiffies - min(read_arrival, write_arrival)) >= READ_ONCE(pool->admission_deadline)))
+		return ((read_arrival < write_arrival) ? reads : writes);
+
+	/*
+	 * Each write costs the writes' credit the reads' share, and each read repays it with the
+	 * writes' share, so that writes get their share of the data_vios over time. The credit is
+	 * bounded so that a long run of one class does not starve the other later.
+	 */
+	if (pool->write_credit >= 0) {
+		pool->write_credit = max(pool->write_credit - (int) (100 - share), -100);
+		return writes;
+	}
+
+	pool->write_credit = min(pool->write_credit + (int) share, 100);
+	return reads;
 }
 
 static inline struct data_vio *get_available_data_vio(struct data_vio_pool *pool)
@@ -664,23 +843,30 @@ static inline struct data_vio *get_available_data_vio(struct data_vio_pool *pool
 	return data_vio;
 }
 
-static void assign_data_vio_to_waiter(struct limiter *limiter)
+static bool assign_data_vio_to_waiter(struct limiter *limiter)
 {
-	assign_data_vio(limiter, get_available_data_vio(limiter->pool));
+	struct data_vio_pool *pool = limiter->pool;
+	struct bio_list *waiters =
+		select_waiters(pool, limiter->busy - limiter->release_count);
+
+	if (waiters == NULL)
+		return false;
+
+	assign_data_vio(((waiters == &pool->permitted_discards) ?
+			 &pool->discard_limiter : limiter),
+			waiters, get_available_data_vio(pool));
+	return true;
 }
 
 static void update_limiter(struct limiter *limiter)
 {
-	struct bio_list *waiters = &limiter->waiters;
-	data_vio_count_t available = limiter->limit - limiter->busy;
-
 	ASSERT_LOG_ONLY((limiter->release_count <= limiter->busy),
 			"Release count %u is not more than busy count %u",
 			limiter->release_count, limiter->busy);
 
 	get_waiters(limiter);
-	for (; (limiter->release_count > 0) && !bio_list_empty(waiters); limiter->release_count--)
-		limiter->assigner(limiter);
+	while ((limiter->release_count > 0) && limiter->assigner(limiter))
+		limiter->release_count--;
 
 	if (limiter->release_count > 0) {
 		WRITE_ONCE(limiter->busy, limiter->busy - limiter->release_count);
@@ -688,10 +874,9 @@ static void update_limiter(struct limiter *limiter)
 		return;
 	}
 
-	for (; (available > 0) && !bio_list_empty(waiters); available--)
-		limiter->assigner(limiter);
+	while ((limiter->busy < limiter->limit) && limiter->assigner(limiter))
+		WRITE_ONCE(limiter->busy, limiter->busy + 1);
 
-	WRITE_ONCE(limiter->busy, limiter->limit - available);
 	if (limiter->max_busy < limiter->busy)
 		WRITE_ONCE(limiter->max_busy, limiter->busy);
 }
@@ -716,8 +901,11 @@ static void schedule_releases(struct data_vio_pool *pool)
 
 static void reuse_or_release_resources(struct data_vio_pool *pool,
 				       struct data_vio *data_vio,
-				       struct list_head *returned)
+				       struct list_head *returned,
+				       struct list_head *relaunched)
 {
+	struct bio_list *waiters;
+
 	if (data_vio->remaining_discard > 0) {
 		if (bio_list_empty(&pool->discard_limiter.waiters)) {
 			/* Return the data_vio's discard permit. */
@@ -727,16 +915,51 @@ static void reuse_or_release_resources(struct data_vio_pool *pool,
 		}
 	}
 
-	if (pool->limiter.arrival < pool->discard_limiter.arrival) {
-		assign_data_vio(&pool->limiter, data_vio);
-	} else if (pool->discard_limiter.arrival < U64_MAX) {
-		assign_data_vio(&pool->discard_limiter, data_vio);
+	/* The busy count still includes this data_vio and any already returned. */
+	waiters = select_waiters(pool, (READ_ONCE(pool->limiter.busy) -
+					pool->limiter.release_count - 1));
+	if (waiters == &pool->permitted_discards) {
+		reassign_data_vio(&pool->discard_limiter, waiters, data_vio, relaunched);
+	} else if (waiters != NULL) {
+		reassign_data_vio(&pool->limiter, waiters, data_vio, relaunched);
 	} else {
 		list_add(&data_vio->pool_entry, returned);
 		pool->limiter.release_count++;
 	}
 }
 
+/**
+ * check_for_zero_blocks() - Check whether the blocks of relaunched writes are all zeros.
+ * @relaunched: The data_vios which have been prepared for new bios.
+ *
+ * The blocks are checked in short batches which each save the FPU state once. Vector code runs
+ * with preemption disabled, so nothing but the checks is done in a batch; the data_vios are
+ * launched afterwards.
+ */
+static void check_for_zero_blocks(struct list_head *relaunched)
+{
+	struct data_vio *data_vio;
+	unsigned int checked = 0;
+
+	list_for_each_entry(data_vio, relaunched, pool_entry) {
+		if (!is_full_block_write(data_vio))
+			continue;
+
+		if ((checked % DATA_VIO_COMPARE_BATCH_SIZE) == 0) {
+			if (checked > 0)
+				vdo_finish_block_compare_batch();
+
+			vdo_start_block_compare_batch();
+		}
+
+		data_vio->is_zero = vdo_is_zero_block(data_vio->vio.data);
+		checked++;
+	}
+
+	if (checked > 0)
+		vdo_finish_block_compare_batch();
+}
+
 /**
  * process_release_callback() - Process a batch of data_vio releases.
  * @completion: The pool with data_vios to release.
@@ -749,20 +972,15 @@ static void process_release_callback(struct vdo_completion *completion)
 	data_vio_count_t processed;
 	data_vio_count_t to_wake;
 	data_vio_count_t discards_to_wake;
+	LIST_HEAD(released);
 	LIST_HEAD(returned);
+	LIST_HEAD(relaunched);
 
 	spin_lock(&pool->lock);
 	get_waiters(&pool->discard_limiter);
 	get_waiters(&pool->limiter);
 	spin_unlock(&pool->lock);
 
-	if (pool->limiter.arrival == U64_MAX) {
-		struct bio *bio = bio_list_peek(&pool->limiter.waiters);
-
-		if (bio != NULL)
-			pool->limiter.arrival = get_arrival_time(bio);
-	}
-
 	for (processed = 0; processed < DATA_VIO_RELEASE_BATCH_SIZE; processed++) {
 		struct data_vio *data_vio;
 		struct funnel_queue_entry *entry = uds_funnel_queue_poll(pool->queue);
@@ -773,7 +991,25 @@ static void process_release_callback(struct vdo_completion *completion)
 		data_vio = as_data_vio(container_of(entry, struct vdo_completion,
 						    work_queue_entry_link));
 		acknowledge_data_vio(data_vio);
-		reuse_or_release_resources(pool, data_vio, &returned);
+		clear_data_vio_pending_write(data_vio);
+		list_add_tail(&data_vio->pool_entry, &released);
+	}
+
+	while (!list_empty(&released)) {
+		struct data_vio *data_vio =
+			list_first_entry(&released, struct data_vio, pool_entry);
+
+		list_del_init(&data_vio->pool_entry);
+		reuse_or_release_resources(pool, data_vio, &returned, &relaunched);
+	}
+
+	check_for_zero_blocks(&relaunched);
+	while (!list_empty(&relaunched)) {
+		struct data_vio *data_vio =
+			list_first_entry(&relaunched, struct data_vio, pool_entry);
+
+		list_del_init(&data_vio->pool_entry);
+		start_data_vio(completion->vdo, data_vio);
 	}
 
 	spin_lock(&pool->lock);
@@ -813,13 +1049,81 @@ static void process_release_callback(struct vdo_completion *completion)
 		vdo_finish_draining(&pool->state);
 }
 
+static void schedule_hashing(struct data_vio_pool *pool)
+{
+	/* Pairs with the barrier in hash_data_vios(). */
+	smp_mb__before_atomic();
+	if (atomic_cmpxchg(&pool->hashing, false, true))
+		return;
+
+	pool->hash_completion.requeue = true;
+	vdo_launch_completion_with_priority(&pool->hash_completion,
+					    CPU_Q_HASH_BLOCK_PRIORITY);
+}
+
+/**
+ * hash_data_vios() - Hash a batch of data_vios and set their hash zones (which also flags their
+ *		      record names as set).
+ * @completion: The hash completion of the data_vio pool.
+ *
+ * The data_vios waiting to be hashed are hashed together, which is considerably faster than
+ * hashing them one at a time. A batch is only as large as the number of lanes the hash
+ * interleaves, and the next batch is scheduled before this one is hashed, so that a burst of
+ * data_vios is spread across the CPU threads rather than hashed one after another on one of them.
+ *
+ * This callback is registered in make_data_vio_pool().
+ */
+static void hash_data_vios(struct vdo_completion *completion)
+{
+	struct data_vio_pool *pool = container_of(completion, struct data_vio_pool,
+						  hash_completion);
+	struct data_vio *data_vios[DATA_VIO_HASH_BATCH_SIZE];
+	const void *blocks[DATA_VIO_HASH_BATCH_SIZE];
+	void *record_names[DATA_VIO_HASH_BATCH_SIZE];
+	unsigned int count, i;
+
+	for (count = 0; count < DATA_VIO_HASH_BATCH_SIZE; count++) {
+		struct data_vio *data_vio;
+		struct funnel_queue_entry *entry = uds_funnel_queue_poll(pool->hash_queue);
+
+		if (entry == NULL)
+			break;
+
+		data_vio = as_data_vio(container_of(entry, struct vdo_completion,
+						    work_queue_entry_link));
+		ASSERT_LOG_ONLY(!data_vio->is_zero, "zero blocks should not be hashed");
+		data_vios[count] = data_vio;
+		blocks[count] = data_vio->vio.data;
+		record_names[count] = &data_vio->record_name;
+	}
+
+	/* The hash completion must not be touched once this is cleared. */
+	atomic_set(&pool->hashing, false);
+	/* Pairs with the barrier in schedule_hashing(). */
+	smp_mb();
+	if (!uds_is_funnel_queue_empty(pool->hash_queue))
+		schedule_hashing(pool);
+
+	vdo_compute_fingerprints(completion->vdo->geometry.index_config.fingerprint, blocks,
+				 count, record_names);
+
+	for (i = 0; i < count; i++) {
+		struct data_vio *data_vio = data_vios[i];
+
+		data_vio->hash_zone =
+			vdo_select_hash_zone(vdo_from_data_vio(data_vio)->hash_zones,
+					     &data_vio->record_name);
+		set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_ACQUIRE_VDO_HASH_LOCK);
+		launch_data_vio_hash_zone_callback(data_vio, vdo_acquire_hash_lock);
+	}
+}
+
 static void initialize_limiter(struct limiter *limiter, struct data_vio_pool *pool,
 			       assigner_fn assigner, data_vio_count_t limit)
 {
 	limiter->pool = pool;
 	limiter->assigner = assigner;
 	limiter->limit = limit;
-	limiter->arrival = U64_MAX;
 	init_waitqueue_head(&limiter->blocked_threads);
 }
 
@@ -904,6 +1208,9 @@ int make_data_vio_pool(struct vdo *vdo, data_vio_count_t pool_size,
 	pool->discard_limiter.permitted_waiters = &pool->permitted_discards;
 	initialize_limiter(&pool->limiter, pool, assign_data_vio_to_waiter, pool_size);
 	pool->limiter.permitted_waiters = &pool->limiter.waiters;
+	pool->limiter.read_waiters = &pool->read_waiters;
+	pool->write_share = 100;
+	pool->admission_deadline = msecs_to_jiffies(DATA_VIO_ADMISSION_DEADLINE_MS);
 	INIT_LIST_HEAD(&pool->available);
 	spin_lock_init(&pool->lock);
 	vdo_set_admin_state_code(&pool->state, VDO_ADMIN_STATE_NORMAL_OPERATION);
@@ -918,6 +1225,15 @@ int make_data_vio_pool(struct vdo *vdo, data_vio_count_t pool_size,
 		return result;
 	}
 
+	vdo_initialize_completion(&pool->hash_completion, vdo, VDO_DATA_VIO_POOL_COMPLETION);
+	vdo_prepare_completion(&pool->hash_completion, hash_data_vios, hash_data_vios,
+			       vdo->thread_config.cpu_thread, NULL);
+	result = uds_make_funnel_queue(&pool->hash_queue);
+	if (result != UDS_SUCCESS) {
+		free_data_vio_pool(uds_forget(pool));
+		return result;
+	}
+
 	for (i = 0; i < pool_size; i++) {
 		struct data_vio *data_vio = &pool->data_vios[i];
 
@@ -953,6 +1269,7 @@ void free_data_vio_pool(struct data_vio_pool *pool)
 	 */
 	smp_mb();
 	BUG_ON(atomic_read(&pool->processing));
+	BUG_ON(atomic_read(&pool->hashing));
 
 	spin_lock(&pool->lock);
 	ASSERT_LOG_ONLY((pool->limiter.busy == 0),
@@ -971,13 +1288,14 @@ void free_data_vio_pool(struct data_vio_pool *pool)
 		destroy_data_vio(data_vio);
 	}
 
+	uds_free_funnel_queue(uds_forget(pool->hash_queue));
 	uds_free_funnel_queue(uds_forget(pool->queue));
 	uds_free(pool);
 }
 
-static bool acquire_permit(struct limiter *limiter, struct bio *bio)
+static bool acquire_permit(struct limiter *limiter, struct bio *bio, bool blocked)
 {
-	if (limiter->busy >= limiter->limit) {
+	if (blocked || (limiter->busy >= limiter->limit)) {
 		DEFINE_WAIT(wait);
 
 		bio_list_add(&limiter->new_waiters, bio);
@@ -1011,10 +1329,12 @@ void vdo_launch_bio(struct data_vio_pool *pool, struct bio *bio)
 	bio->bi_private = (void *) jiffies;
 	spin_lock(&pool->lock);
 	if ((bio_op(bio) == REQ_OP_DISCARD) &&
-	    !acquire_permit(&pool->discard_limiter, bio))
+	    !acquire_permit(&pool->discard_limiter, bio, false))
 		return;
 
-	if (!acquire_permit(&pool->limiter, bio))
+	if (!acquire_permit(&pool->limiter, bio,
+			    ((bio_data_dir(bio) == WRITE) &&
+			     !may_admit_write(pool, pool->limiter.busy))))
 		return;
 
 	data_vio = get_available_data_vio(pool);
@@ -1068,7 +1388,9 @@ static void dump_limiter(const char *name, struct limiter *limiter)
 	uds_log_info("%s: %u of %u busy (max %u), %s", name, limiter->busy,
 		     limiter->limit, limiter->max_busy,
 		     ((bio_list_empty(&limiter->waiters) &&
-		       bio_list_empty(&limiter->new_waiters)) ?
+		       bio_list_empty(&limiter->new_waiters) &&
+		       ((limiter->read_waiters == NULL) ||
+			bio_list_empty(limiter->read_waiters))) ?
 		      "no waiters" : "has waiters"));
 }
 
@@ -1148,6 +1470,25 @@ data_vio_count_t get_data_vio_pool_active_requests(struct data_vio_pool *pool)
 	return READ_ONCE(pool->limiter.busy);
 }
 
+data_vio_count_t get_data_vio_pool_pending_writes(struct data_vio_pool *pool)
+{
+	return atomic_read(&pool->pending_writes);
+}
+
+/**
+ * clear_data_vio_pending_write() - Note that a write no longer has a recovery journal entry to
+ *                                  make, either because it is making it or because it is done.
+ * @data_vio: The data_vio.
+ */
+void clear_data_vio_pending_write(struct data_vio *data_vio)
+{
+	if (!data_vio->pending_write)
+		return;
+
+	data_vio->pending_write = false;
+	atomic_dec(&vdo_from_data_vio(data_vio)->data_vio_pool->pending_writes);
+}
+
 data_vio_count_t get_data_vio_pool_request_limit(struct data_vio_pool *pool)
 {
 	return READ_ONCE(pool->limiter.limit);
@@ -1158,6 +1499,143 @@ data_vio_count_t get_data_vio_pool_maximum_requests(struct data_vio_pool *pool)
 	return READ_ONCE(pool->limiter.max_busy);
 }
 
+data_vio_count_t get_data_vio_pool_read_reserve(struct data_vio_pool *pool)
+{
+	return READ_ONCE(pool->read_reserve);
+}
+
+/**
+ * set_data_vio_pool_read_reserve() - Set the number of data_vios which writes may not take.
+ * @pool: The pool.
+ * @reserve: The number of data_vios to hold back for reads.
+ *
+ * Return: VDO_SUCCESS or -EINVAL if the reserve would leave no data_vios for writes.
+ */
+int set_data_vio_pool_read_reserve(struct data_vio_pool *pool, data_vio_count_t reserve)
+{
+	if (reserve >= get_data_vio_pool_request_limit(pool))
+		return -EINVAL;
+
+	WRITE_ONCE(pool->read_reserve, reserve);
+	return VDO_SUCCESS;
+}
+
+unsigned int get_data_vio_pool_write_share(struct data_vio_pool *pool)
+{
+	return READ_ONCE(pool->write_share);
+}
+
+/**
+ * set_data_vio_pool_write_share() - Set the share of data_vios given to writes under contention.
+ * @pool: The pool.
+ * @share: The percentage of released data_vios to give to writes while reads are also waiting;
+ *         100 relaunches waiters in the order they arrived.
+ *
+ * Return: VDO_SUCCESS or -EINVAL if the share is not between 1 and 100.
+ */
+int set_data_vio_pool_write_share(struct data_vio_pool *pool, unsigned int share)
+{
+	if ((share == 0) || (share > 100))
+		return -EINVAL;
+
+	WRITE_ONCE(pool->write_share, share);
+	return VDO_SUCCESS;
+}
+
+unsigned int get_data_vio_pool_admission_deadline(struct data_vio_pool *pool)
+{
+	return jiffies_to_msecs(READ_ONCE(pool->admission_deadline));
+}
+
+/**
+ * set_data_vio_pool_admission_deadline() - Set how long a bio may wait before it is relaunched
+ *                                          ahead of the write share.
+ * @pool: The pool.
+ * @deadline_ms: The deadline in milliseconds.
+ */
+void set_data_vio_pool_admission_deadline(struct data_vio_pool *pool, unsigned int deadline_ms)
+{
+	WRITE_ONCE(pool->admission_deadline, msecs_to_jiffies(deadline_ms));
+}
+
+unsigned int get_data_vio_pool_stage_sample_interval(struct data_vio_pool *pool)
+{
+	return READ_ONCE(pool->stage_sample_interval);
+}
+
+/**
+ * set_data_vio_pool_stage_sample_interval() - Set how often data_vios are sampled for stage
+ *                                             latencies.
+ * @pool: The pool.
+ * @interval: Sample one in this many data_vios; 0 turns sampling off.
+ *
+ * The latencies recorded so far are discarded, so that they always reflect a single interval.
+ */
+void set_data_vio_pool_stage_sample_interval(struct data_vio_pool *pool, unsigned int interval)
+{
+	enum async_operation_number operation;
+
+	WRITE_ONCE(pool->stage_sample_interval, 0);
+	for (operation = MIN_VIO_ASYNC_OPERATION_NUMBER;
+	     operation < MAX_VIO_ASYNC_OPERATION_NUMBER; operation++) {
+		struct stage_histogram *histogram = &pool->stage_histograms[operation];
+		unsigned int i;
+
+		atomic64_set(&histogram->samples, 0);
+		atomic64_set(&histogram->total_ns, 0);
+		for (i = 0; i < DATA_VIO_STAGE_LATENCY_BUCKETS; i++)
+			atomic64_set(&histogram->buckets[i], 0);
+	}
+
+	atomic_set(&pool->stage_sample_count, 0);
+	WRITE_ONCE(pool->stage_sample_interval, interval);
+}
+
+/**
+ * get_data_vio_pool_stage_latencies() - Get the latencies recorded for one asynchronous operation.
+ * @pool: The pool.
+ * @operation: The operation.
+ * @latencies: A structure to hold the latencies.
+ */
+void get_data_vio_pool_stage_latencies(struct data_vio_pool *pool,
+				       enum async_operation_number operation,
+				       struct data_vio_stage_latencies *latencies)
+{
+	struct stage_histogram *histogram = &pool->stage_histograms[operation];
+	unsigned int i;
+
+	latencies->samples = atomic64_read(&histogram->samples);
+	latencies->total_ns = atomic64_read(&histogram->total_ns);
+	for (i = 0; i < DATA_VIO_STAGE_LATENCY_BUCKETS; i++)
+		latencies->buckets[i] = atomic64_read(&histogram->buckets[i]);
+}
+
+/**
+ * record_data_vio_stage() - Record the time a sampled data_vio spent in its last asynchronous
+ *                           operation, and start timing the next one.
+ *
+ * Sampled data_vios move between threads, so the histograms are updated atomically.
+ */
+void record_data_vio_stage(struct data_vio *data_vio)
+{
+	struct data_vio_pool *pool = vdo_from_data_vio(data_vio)->data_vio_pool;
+	u64 now = current_time_ns(CLOCK_MONOTONIC);
+	u64 elapsed = ((now > data_vio->stage_start_ns) ? now - data_vio->stage_start_ns : 0);
+	struct stage_histogram *histogram;
+	unsigned int bucket;
+
+	data_vio->stage_start_ns = now;
+	if (data_vio->last_async_operation >= MAX_VIO_ASYNC_OPERATION_NUMBER)
+		return;
+
+	bucket = ((elapsed == 0) ? 0 : ilog2(elapsed));
+	histogram = &pool->stage_histograms[data_vio->last_async_operation];
+	atomic64_inc(&histogram->samples);
+	atomic64_add(elapsed, &histogram->total_ns);
+	atomic64_inc(&histogram->buckets[min_t(unsigned int, bucket,
+					       DATA_VIO_STAGE_LATENCY_BUCKETS - 1)]);
+}
+
 static void update_data_vio_error_stats(struct data_vio *data_vio)
 {
 	u8 index = 0;
@@ -1323,6 +1801,11 @@ static void finish_cleanup(struct data_vio *data_vio)
 	    (completion->result != VDO_SUCCESS)) {
 		struct data_vio_pool *pool = completion->vdo->data_vio_pool;
 
+		if (unlikely(data_vio->stage_start_ns != 0)) {
+			record_data_vio_stage(data_vio);
+			data_vio->stage_start_ns = 0;
+		}
+
 #ifdef INTERNAL
 		release_data_vio_hook(data_vio);
 #endif /* INTERNAL */
@@ -1383,7 +1866,7 @@ void complete_data_vio(struct vdo_completion *completion)
 	struct data_vio *data_vio = as_data_vio(completion);
 
 	completion->error_handler = NULL;
-	data_vio->last_async_operation = VIO_ASYNC_OP_CLEANUP;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_CLEANUP);
 	perform_cleanup_stage(data_vio,
 			      (data_vio->write ? VIO_CLEANUP_START : VIO_RELEASE_LOGICAL));
 }
@@ -1424,13 +1907,18 @@ void handle_data_vio_error(struct vdo_completion *completion)
  *				   data_vio.
  */
 const char *get_data_vio_operation_name(struct data_vio *data_vio)
+{
+	return get_async_operation_name(data_vio->last_async_operation);
+}
+
+/** get_async_operation_name() - Get the name of an asynchronous operation. */
+const char *get_async_operation_name(enum async_operation_number operation)
 {
 	BUILD_BUG_ON((MAX_VIO_ASYNC_OPERATION_NUMBER - MIN_VIO_ASYNC_OPERATION_NUMBER) !=
 		     ARRAY_SIZE(ASYNC_OPERATION_NAMES));
 
-	return ((data_vio->last_async_operation < MAX_VIO_ASYNC_OPERATION_NUMBER) ?
-		ASYNC_OPERATION_NAMES[data_vio->last_async_operation] :
-		"unknown async operation");
+	return ((operation < MAX_VIO_ASYNC_OPERATION_NUMBER) ?
+		ASYNC_OPERATION_NAMES[operation] : "unknown async operation");
 }
 
 /**
@@ -1487,8 +1975,10 @@ int uncompress_data_vio(struct data_vio *data_vio,
 {
 	int size;
 	u16 fragment_offset, fragment_size;
+	enum vdo_compression_type type;
 	struct compressed_block *block = data_vio->compression.block;
-	int result = vdo_get_compressed_block_fragment(mapping_state, block,
+	const char *fragment;
+	int result = vdo_get_compressed_block_fragment(mapping_state, block, &type,
 						       &fragment_offset, &fragment_size);
 
 	if (result != VDO_SUCCESS) {
@@ -1496,8 +1986,19 @@ int uncompress_data_vio(struct data_vio *data_vio,
 		return result;
 	}
 
-	size = LZ4_decompress_safe((block->data + fragment_offset), buffer,
-				   fragment_size, VDO_BLOCK_SIZE);
+	fragment = (const char *) block + fragment_offset;
+	switch (type) {
+	case VDO_COMPRESSION_LZ4:
+	case VDO_COMPRESSION_LZ4HC:
+		/* LZ4HC produces the same format as LZ4. */
+		size = LZ4_decompress_safe(fragment, buffer, fragment_size, VDO_BLOCK_SIZE);
+		break;
+
+	default:
+		uds_log_debug("%s: unknown compression type %u", __func__, type);
+		return VDO_INVALID_FRAGMENT;
+	}
+
 	if (size != VDO_BLOCK_SIZE) {
 		uds_log_debug("%s: lz4 error", __func__);
 		return VDO_INVALID_FRAGMENT;
@@ -1528,7 +2029,7 @@ static void modify_for_partial_write(struct vdo_completion *completion)
 		copy_from_bio(bio, data + data_vio->offset);
 	}
 
-	data_vio->is_zero = is_zero_block(data);
+	data_vio->is_zero = vdo_is_zero_block(data);
 	data_vio->read = false;
 	launch_data_vio_logical_callback(data_vio,
 					 continue_data_vio_with_block_map_slot);
@@ -1614,7 +2115,7 @@ static void read_block(struct vdo_completion *completion)
 		return;
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_READ_DATA_VIO;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_READ_DATA_VIO);
 	if (vdo_is_state_compressed(data_vio->mapped.state)) {
 		result = vio_reset_bio(vio, (char *) data_vio->compression.block,
 				       read_endio, REQ_OP_READ, data_vio->mapped.pbn);
@@ -1701,7 +2202,7 @@ static void update_block_map(struct vdo_completion *completion)
 	else
 		completion->callback = complete_data_vio;
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_PUT_MAPPED_BLOCK;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_PUT_MAPPED_BLOCK);
 	vdo_put_mapped_block(data_vio);
 }
 
@@ -1766,7 +2267,7 @@ static void journal_remapping(struct vdo_completion *completion)
 					    data_vio->mapped.zone->thread_id);
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_JOURNAL_REMAPPING;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_JOURNAL_REMAPPING);
 	vdo_add_recovery_journal_entry(completion->vdo->recovery_journal, data_vio);
 }
 
@@ -1782,7 +2283,7 @@ static void read_old_block_mapping(struct vdo_completion *completion)
 
 	assert_data_vio_in_logical_zone(data_vio);
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_GET_MAPPED_BLOCK_FOR_WRITE;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_GET_MAPPED_BLOCK_FOR_WRITE);
 	set_data_vio_journal_callback(data_vio, journal_remapping);
 	vdo_get_mapped_block(data_vio);
 }
@@ -1816,10 +2317,41 @@ static void pack_compressed_data(struct vdo_completion *completion)
 		return;
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_ATTEMPT_PACKING;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_ATTEMPT_PACKING);
 	vdo_attempt_packing(data_vio);
 }
 
+/**
+ * is_probably_incompressible() - Check whether a block is unlikely to compress well enough to be
+ *				  packed.
+ * @data: The data of the block.
+ *
+ * This samples only an eighth of the block, which costs far less than an attempt to compress it.
+ * Blocks which fail the probe are not compressed, so it is deliberately conservative.
+ *
+ * Return: true if the block should not be compressed.
+ */
+static bool is_probably_incompressible(const char *data)
+{
+	unsigned long seen[BITS_TO_LONGS(U8_MAX + 1)] = { 0 };
+	unsigned int distinct = 0;
+	unsigned int sample, i;
+
+	for (sample = 0; sample < INCOMPRESSIBLE_PROBE_SAMPLES; sample++) {
+		const u8 *bytes = (const u8 *) data + (sample * INCOMPRESSIBLE_PROBE_STRIDE);
+
+		for (i = 0; i < INCOMPRESSIBLE_PROBE_SAMPLE_SIZE; i++) {
+			if (test_bit(bytes[i], seen))
+				continue;
+
+			__set_bit(bytes[i], seen);
+			distinct++;
+		}
+	}
+
+	return (distinct >= INCOMPRESSIBLE_PROBE_DISTINCT_BYTES);
+}
+
 /**
  * compress_data_vio() - Do the actual work of compressing the data on a CPU queue.
  *
@@ -1828,18 +2360,40 @@ static void pack_compressed_data(struct vdo_completion *completion)
 static void compress_data_vio(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
+	struct vdo *vdo = vdo_from_data_vio(data_vio);
+	char *context = vdo_get_work_queue_private_data();
+	enum vdo_compression_type type = READ_ONCE(vdo->compression_type);
+	int level = READ_ONCE(vdo->compression_level);
+	char *compressed = data_vio->compression.block->data;
 	int size;
 
 	assert_data_vio_on_cpu_thread(data_vio);
 
+	if (is_probably_incompressible(data_vio->vio.data)) {
+		atomic64_inc(&vdo->packer->skipped_as_incompressible);
+		write_data_vio(data_vio);
+		return;
+	}
+
 	/*
 	 * By putting the compressed data at the start of the compressed block data field, we won't
 	 * need to copy it if this data_vio becomes a compressed write agent.
 	 */
-	size = LZ4_compress_default(data_vio->vio.data,
-				    data_vio->compression.block->data, VDO_BLOCK_SIZE,
-				    VDO_MAX_COMPRESSED_FRAGMENT_SIZE,
-				    (char *) vdo_get_work_queue_private_data());
+	switch (type) {
+	case VDO_COMPRESSION_LZ4HC:
+		size = LZ4_compress_HC(data_vio->vio.data, compressed, VDO_BLOCK_SIZE,
+				       VDO_MAX_COMPRESSED_FRAGMENT_SIZE,
+				       ((level == 0) ? LZ4HC_DEFAULT_CLEVEL : level), context);
+		break;
+
+	default:
+		size = LZ4_compress_fast(data_vio->vio.data, compressed, VDO_BLOCK_SIZE,
+					 VDO_MAX_COMPRESSED_FRAGMENT_SIZE,
+					 ((level == 0) ? LZ4_ACCELERATION_DEFAULT : level), context);
+		break;
+	}
+
+	data_vio->compression.type = type;
 	if ((size > 0) && (size < VDO_COMPRESSED_BLOCK_DATA_SIZE)) {
 		data_vio->compression.size = size;
 		launch_data_vio_packer_callback(data_vio, pack_compressed_data);
@@ -1885,45 +2439,30 @@ void launch_compress_data_vio(struct data_vio *data_vio)
 		return;
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_COMPRESS_DATA_VIO;
+	/*
+	 * Each data_vio is compressed by its own completion so that compressions are spread across
+	 * the CPU threads, and may be stolen by an idle one.
+	 */
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_COMPRESS_DATA_VIO);
 	launch_data_vio_cpu_callback(data_vio, compress_data_vio,
 				     CPU_Q_COMPRESS_BLOCK_PRIORITY);
 }
 
-/**
- * hash_data_vio() - Hash the data in a data_vio and set the hash zone (which also flags the record
- *		     name as set).
-
- * This callback is registered in prepare_for_dedupe().
- */
-static void hash_data_vio(struct vdo_completion *completion)
-{
-	struct data_vio *data_vio = as_data_vio(completion);
-
-	assert_data_vio_on_cpu_thread(data_vio);
-	ASSERT_LOG_ONLY(!data_vio->is_zero, "zero blocks should not be hashed");
-
-	murmurhash3_128(data_vio->vio.data, VDO_BLOCK_SIZE, 0x62ea60be,
-			&data_vio->record_name);
-
-	data_vio->hash_zone = vdo_select_hash_zone(vdo_from_data_vio(data_vio)->hash_zones,
-						   &data_vio->record_name);
-	data_vio->last_async_operation = VIO_ASYNC_OP_ACQUIRE_VDO_HASH_LOCK;
-	launch_data_vio_hash_zone_callback(data_vio, vdo_acquire_hash_lock);
-}
-
 /** prepare_for_dedupe() - Prepare for the dedupe path after attempting to get an allocation. */
 static void prepare_for_dedupe(struct data_vio *data_vio)
 {
+	struct data_vio_pool *pool = vdo_from_data_vio(data_vio)->data_vio_pool;
+
 	/* We don't care what thread we are on. */
 	ASSERT_LOG_ONLY(!data_vio->is_zero, "must not prepare to dedupe zero blocks");
 
 	/*
-	 * Before we can dedupe, we need to know the record name, so the first
-	 * step is to hash the block data.
+	 * Before we can dedupe, we need to know the record name, so the first step is to hash the
+	 * block data. Data_vios are hashed in batches on the CPU threads.
 	 */
-	data_vio->last_async_operation = VIO_ASYNC_OP_HASH_DATA_VIO;
-	launch_data_vio_cpu_callback(data_vio, hash_data_vio, CPU_Q_HASH_BLOCK_PRIORITY);
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_HASH_DATA_VIO);
+	uds_funnel_queue_put(pool->hash_queue, &data_vio->vio.completion.work_queue_entry_link);
+	schedule_hashing(pool);
 }
 
 /**
@@ -1975,7 +2514,7 @@ void write_data_vio(struct data_vio *data_vio)
 		return;
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_WRITE_DATA_VIO;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_WRITE_DATA_VIO);
 	vdo_submit_data_vio(data_vio);
 }
 
@@ -2031,7 +2570,7 @@ static void allocate_block(struct vdo_completion *completion)
 		return;
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_ACKNOWLEDGE_WRITE;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_ACKNOWLEDGE_WRITE);
 	launch_data_vio_on_bio_ack_queue(data_vio, acknowledge_write_callback);
 }
 
@@ -2076,7 +2615,7 @@ void continue_data_vio_with_block_map_slot(struct vdo_completion *completion)
 	assert_data_vio_in_logical_zone(data_vio);
 	if (data_vio->read) {
 		set_data_vio_logical_callback(data_vio, read_block);
-		data_vio->last_async_operation = VIO_ASYNC_OP_GET_MAPPED_BLOCK_FOR_READ;
+		set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_GET_MAPPED_BLOCK_FOR_READ);
 		vdo_get_mapped_block(data_vio);
 		return;
 	}
@@ -2118,6 +2657,6 @@ void continue_data_vio_with_block_map_slot(struct vdo_completion *completion)
 		return;
 	}
 
-	data_vio->last_async_operation = VIO_ASYNC_OP_ACKNOWLEDGE_WRITE;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_ACKNOWLEDGE_WRITE);
 	launch_data_vio_on_bio_ack_queue(data_vio, acknowledge_write_callback);
 }
@@ -51,6 +51,21 @@ enum async_operation_number {
 	MAX_VIO_ASYNC_OPERATION_NUMBER,
 } __packed;
 
+enum {
+	/*
+	 * Bucket i of a stage latency histogram counts stages which took at least 2^i but less
+	 * than 2^(i+1) nanoseconds; the last bucket also counts anything longer.
+	 */
+	DATA_VIO_STAGE_LATENCY_BUCKETS = 36,
+};
+
+/* A snapshot of the time sampled data_vios have spent in one asynchronous operation. */
+struct data_vio_stage_latencies {
+	u64 samples;
+	u64 total_ns;
+	u64 buckets[DATA_VIO_STAGE_LATENCY_BUCKETS];
+};
+
 struct lbn_lock {
 	logical_block_number_t lbn;
 	bool locked;
@@ -120,12 +135,18 @@ struct compression_state {
 	/* The compressed size of this block */
 	u16 size;
 
+	/* The compressor which produced the compressed form of this block */
+	enum vdo_compression_type type;
+
 	/* The packer input or output bin slot which holds the enclosing data_vio */
 	slot_number_t slot;
 
 	/* The packer bin to which the enclosing data_vio has been assigned */
 	struct packer_bin *bin;
 
+	/* The time at which the enclosing data_vio entered the packer, in nanoseconds */
+	u64 arrival;
+
 	/* A link in the chain of data_vios which have been packed together */
 	struct data_vio *next_in_batch;
 
@@ -191,6 +212,9 @@ struct data_vio {
 	/* Used for logging and debugging */
 	enum async_operation_number last_async_operation;
 
+	/* When the last asynchronous operation started, if this data_vio is sampled, else 0 */
+	u64 stage_start_ns;
+
 	/* The operations to record in the recovery and slab journals */
 	struct reference_updater increment_updater;
 	struct reference_updater decrement_updater;
@@ -204,6 +228,7 @@ struct data_vio {
 	u16 is_duplicate : 1;
 	u16 first_reference_operation_complete : 1;
 	u16 downgrade_allocation_lock : 1;
+	u16 pending_write : 1;
 
 	struct allocation allocation;
 
@@ -216,7 +241,7 @@ struct data_vio {
 	/* The new partition address of this block after the vio write completes */
 	struct zoned_pbn new_mapped;
 
-	/* The hash zone responsible for the name (NULL if is_zero_block) */
+	/* The hash zone responsible for the name (NULL if vdo_is_zero_block) */
 	struct hash_zone *hash_zone;
 
 	/* The lock this vio holds or shares with other vios with the same data */
@@ -354,8 +379,22 @@ data_vio_count_t get_data_vio_pool_maximum_discards(struct data_vio_pool *pool);
 int __must_check set_data_vio_pool_discard_limit(struct data_vio_pool *pool,
 						 data_vio_count_t limit);
 data_vio_count_t get_data_vio_pool_active_requests(struct data_vio_pool *pool);
+data_vio_count_t get_data_vio_pool_pending_writes(struct data_vio_pool *pool);
+void clear_data_vio_pending_write(struct data_vio *data_vio);
 data_vio_count_t get_data_vio_pool_request_limit(struct data_vio_pool *pool);
 data_vio_count_t get_data_vio_pool_maximum_requests(struct data_vio_pool *pool);
+data_vio_count_t get_data_vio_pool_read_reserve(struct data_vio_pool *pool);
+int __must_check set_data_vio_pool_read_reserve(struct data_vio_pool *pool,
+						data_vio_count_t reserve);
+unsigned int get_data_vio_pool_write_share(struct data_vio_pool *pool);
+int __must_check set_data_vio_pool_write_share(struct data_vio_pool *pool, unsigned int share);
+unsigned int get_data_vio_pool_admission_deadline(struct data_vio_pool *pool);
+void set_data_vio_pool_admission_deadline(struct data_vio_pool *pool, unsigned int deadline_ms);
+unsigned int get_data_vio_pool_stage_sample_interval(struct data_vio_pool *pool);
+void set_data_vio_pool_stage_sample_interval(struct data_vio_pool *pool, unsigned int interval);
+void get_data_vio_pool_stage_latencies(struct data_vio_pool *pool,
+				       enum async_operation_number operation,
+				       struct data_vio_stage_latencies *latencies);
 
 void complete_data_vio(struct vdo_completion *completion);
 void handle_data_vio_error(struct vdo_completion *completion);
@@ -377,6 +416,24 @@ static inline void continue_data_vio_with_error(struct data_vio *data_vio, int r
 }
 
 const char * __must_check get_data_vio_operation_name(struct data_vio *data_vio);
+const char * __must_check get_async_operation_name(enum async_operation_number operation);
+
+void record_data_vio_stage(struct data_vio *data_vio);
+
+/**
+ * set_data_vio_async_operation() - Record the asynchronous operation a data_vio is starting.
+ *
+ * If the data_vio is sampled for stage latencies, the time spent in the previous operation is
+ * also recorded.
+ */
+static inline void set_data_vio_async_operation(struct data_vio *data_vio,
+						enum async_operation_number operation)
+{
+	if (unlikely(data_vio->stage_start_ns != 0))
+		record_data_vio_stage(data_vio);
+
+	data_vio->last_async_operation = operation;
+}
 
 static inline void assert_data_vio_in_hash_zone(struct data_vio *data_vio)
 {
@@ -673,9 +730,6 @@ int __must_check uncompress_data_vio(struct data_vio *data_vio,
 				     enum block_mapping_state mapping_state,
 				     char *buffer);
 
-#ifdef INTERNAL
-bool is_zero_block(char *block);
-#endif /* INTERNAL */
 void update_metadata_for_data_vio_write(struct data_vio *data_vio,
 					struct pbn_lock *lock);
 void write_data_vio(struct data_vio *data_vio);
@@ -130,9 +130,12 @@
 
 #include "action-manager.h"
 #include "admin-state.h"
+#include "block-compare.h"
 #include "completion.h"
 #include "constants.h"
 #include "data-vio.h"
+#include "fingerprint.h"
+#include "funnel-workqueue.h"
 #include "int-map.h"
 #include "io-submitter.h"
 #include "packer.h"
@@ -810,7 +813,7 @@ static void start_updating(struct hash_lock *lock, struct data_vio *agent)
 	ASSERT_LOG_ONLY(lock->verified, "new advice should have been verified");
 	ASSERT_LOG_ONLY(lock->update_advice, "should only update advice if needed");
 
-	agent->last_async_operation = VIO_ASYNC_OP_UPDATE_DEDUPE_INDEX;
+	set_data_vio_async_operation(agent, VIO_ASYNC_OP_UPDATE_DEDUPE_INDEX);
 	set_data_vio_hash_zone_callback(agent, finish_updating);
 	query_index(agent, UDS_UPDATE);
 }
@@ -1048,12 +1051,14 @@ static void start_deduping(struct hash_lock *lock, struct data_vio *agent,
 	 * available increments for on the dedupe path. If we run out of increments, rollover will
 	 * be triggered and the remaining waiters will be transferred to the new lock.
 	 */
+	vdo_start_enqueue_batch();
 	if (!agent_is_done) {
 		launch_dedupe(lock, agent, true);
 		agent = NULL;
 	}
 	while (vdo_waitq_has_waiters(&lock->waiters))
 		launch_dedupe(lock, dequeue_lock_waiter(lock), false);
+	vdo_finish_enqueue_batch();
 
 	if (agent_is_done) {
 		/*
@@ -1134,31 +1139,11 @@ static void finish_verifying(struct vdo_completion *completion)
 	}
 }
 
-static bool blocks_equal(char *block1, char *block2)
-{
-	int i;
-
-#ifdef INTERNAL
-	BUILD_BUG_ON(VDO_BLOCK_SIZE % sizeof(u64) != 0);
-	ASSERT_LOG_ONLY((uintptr_t) block1 % sizeof(u64) == 0,
-			"Data blocks are expected to be aligned");
-	ASSERT_LOG_ONLY((uintptr_t) block2 % sizeof(u64) == 0,
-			"Data blocks are expected to be aligned");
-#endif  /* INTERNAL */
-
-	for (i = 0; i < VDO_BLOCK_SIZE; i += sizeof(u64)) {
-		if (*((u64 *) &block1[i]) != *((u64 *) &block2[i]))
-			return false;
-	}
-
-	return true;
-}
-
 static void verify_callback(struct vdo_completion *completion)
 {
 	struct data_vio *agent = as_data_vio(completion);
 
-	agent->is_duplicate = blocks_equal(agent->vio.data, agent->scratch_block);
+	agent->is_duplicate = vdo_blocks_equal(agent->vio.data, agent->scratch_block);
 	launch_data_vio_hash_zone_callback(agent, finish_verifying);
 }
 
@@ -1222,7 +1207,7 @@ static void start_verifying(struct hash_lock *lock, struct data_vio *agent)
 	lock->state = VDO_HASH_LOCK_VERIFYING;
 	ASSERT_LOG_ONLY(!lock->verified, "hash lock only verifies advice once");
 
-	agent->last_async_operation = VIO_ASYNC_OP_VERIFY_DUPLICATION;
+	set_data_vio_async_operation(agent, VIO_ASYNC_OP_VERIFY_DUPLICATION);
 	result = vio_reset_bio(vio, buffer, verify_endio, REQ_OP_READ,
 			       agent->duplicate.pbn);
 	if (result != VDO_SUCCESS) {
@@ -1444,7 +1429,7 @@ static void start_locking(struct hash_lock *lock, struct data_vio *agent)
 	 * accepting the advice, and don't explicitly change lock states (or use an agent-local
 	 * state, or an atomic), we can avoid a thread transition here.
 	 */
-	agent->last_async_operation = VIO_ASYNC_OP_LOCK_DUPLICATE_PBN;
+	set_data_vio_async_operation(agent, VIO_ASYNC_OP_LOCK_DUPLICATE_PBN);
 	launch_data_vio_duplicate_zone_callback(agent, lock_duplicate_pbn);
 }
 
@@ -1734,7 +1719,7 @@ static void start_querying(struct hash_lock *lock, struct data_vio *data_vio)
 {
 	lock->agent = data_vio;
 	lock->state = VDO_HASH_LOCK_QUERYING;
-	data_vio->last_async_operation = VIO_ASYNC_OP_CHECK_FOR_DUPLICATION;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_CHECK_FOR_DUPLICATION);
 	set_data_vio_hash_zone_callback(data_vio, finish_querying);
 	query_index(data_vio,
 		    (data_vio_has_allocation(data_vio) ? UDS_POST : UDS_QUERY));
@@ -1825,7 +1810,7 @@ static bool is_hash_collision(struct hash_lock *lock, struct data_vio *candidate
 	lock_holder = list_first_entry(&lock->duplicate_ring, struct data_vio,
 				       hash_lock_entry);
 	zone = candidate->hash_zone;
-	collides = !blocks_equal(lock_holder->vio.data, candidate->vio.data);
+	collides = !vdo_blocks_equal(lock_holder->vio.data, candidate->vio.data);
 	if (collides)
 		increment_stat(&zone->statistics.concurrent_hash_collisions);
 	else
@@ -2276,8 +2261,16 @@ static int initialize_index(struct vdo *vdo, struct hash_zones *zones)
 		.memory_size = geometry.index_config.mem,
 		.sparse = geometry.index_config.sparse,
 		.nonce = (u64) geometry.nonce,
+		.fingerprint = geometry.index_config.fingerprint,
+		.numa_placement = (vdo->device_config->memory_placement ==
+				   VDO_MEMORY_PLACEMENT_NUMA),
 	};
 
+	if (!vdo_is_fingerprint_accelerated(geometry.index_config.fingerprint)) {
+		uds_log_warning("%s record names must be computed without AES-NI on this processor",
+				vdo_get_fingerprint_name(geometry.index_config.fingerprint));
+	}
+
 	result = uds_create_index_session(&zones->index_session);
 	if (result != UDS_SUCCESS)
 		return result;
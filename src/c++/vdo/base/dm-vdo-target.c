@@ -6,9 +6,11 @@
 #include <linux/atomic.h>
 #include <linux/bitops.h>
 #include <linux/completion.h>
+#include <linux/ctype.h>
 #include <linux/delay.h>
 #include <linux/device-mapper.h>
 #include <linux/err.h>
+#include <linux/lz4.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
@@ -21,6 +23,7 @@
 
 #ifdef __KERNEL__
 #include "dm-vdo/admin-state.h"
+#include "dm-vdo/block-compare.h"
 #include "dm-vdo/block-map.h"
 #include "dm-vdo/completion.h"
 #include "dm-vdo/constants.h"
@@ -29,6 +32,7 @@
 #include "dm-vdo/dump.h"
 #include "dm-vdo/encodings.h"
 #include "dm-vdo/errors.h"
+#include "dm-vdo/fingerprint.h"
 #include "dm-vdo/flush.h"
 #include "dm-vdo/io-submitter.h"
 #include "dm-vdo/logger.h"
@@ -48,6 +52,7 @@
 #include "dm-vdo/vio.h"
 #else /* not __KERNEL__ */
 #include "admin-state.h"
+#include "block-compare.h"
 #include "block-map.h"
 #include "completion.h"
 #include "constants.h"
@@ -57,6 +62,7 @@
 #include "dump.h"
 #include "encodings.h"
 #include "errors.h"
+#include "fingerprint.h"
 #include "flush.h"
 #include "io-submitter.h"
 #include "logger.h"
@@ -179,6 +185,11 @@ enum {
 	TABLE_VERSION = 4,
 };
 
+enum {
+	/* The largest acceleration LZ4 distinguishes; larger values behave the same */
+	MAX_LZ4_ACCELERATION = 65537,
+};
+
 /* arrays for handling different table versions */
 static const u8 REQUIRED_ARGC[] = { 10, 12, 9, 7, 6 };
 /* pool name no longer used. only here for verification of older versions */
@@ -541,15 +552,143 @@ static int process_one_thread_config_spec(const char *thread_param_type,
 	return VDO_SUCCESS;
 }
 
+/**
+ * get_thread_affinity_class() - Get the thread class named by an affinity parameter key.
+ * @key: The parameter key, of the form "<class>Affinity", such as "logicalAffinity".
+ * @class_ptr: A pointer to hold the thread class.
+ *
+ * Return: true if the key names the affinity of a thread class.
+ */
+static bool get_thread_affinity_class(const char *key, enum vdo_thread_class *class_ptr)
+{
+	enum vdo_thread_class class;
+
+	for (class = 0; class < VDO_THREAD_CLASS_COUNT; class++) {
+		const char *name = vdo_get_thread_class_name(class);
+		size_t length = strlen(name);
+
+		if ((strncmp(key, name, length) == 0) && (strcmp(key + length, "Affinity") == 0)) {
+			*class_ptr = class;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * is_cpu_list() - Check whether a string is a list of CPUs in cpulist format.
+ * @string: The string to check, such as "0-3,8,10-11".
+ *
+ * Whether the CPUs exist is only checked when the threads are started.
+ */
+static bool is_cpu_list(const char *string)
+{
+	while (true) {
+		unsigned int low = 0;
+		unsigned int high;
+
+		if (!isdigit(*string))
+			return false;
+
+		while (isdigit(*string))
+			low = (low * 10) + (*string++ - '0');
+
+		if (*string == '-') {
+			string++;
+			if (!isdigit(*string))
+				return false;
+
+			high = 0;
+			while (isdigit(*string))
+				high = (high * 10) + (*string++ - '0');
+
+			if (high < low)
+				return false;
+		}
+
+		if (*string == '\0')
+			return true;
+
+		if (*string++ != ',')
+			return false;
+	}
+}
+
+/**
+ * parse_thread_affinity() - Parse the affinity of a class of threads.
+ * @string: The affinity to parse: a cpulist such as "0-3,8", "node:<n>" for the CPUs of NUMA node
+ *          n, "zone" to run each logical, physical, or hash zone thread on the node of its zone,
+ *          or "device" to run the bio threads on the node of the backing device.
+ * @class: The class of threads the affinity is for.
+ * @affinity: The affinity to update.
+ *
+ * Return: VDO_SUCCESS or -EINVAL.
+ */
+static int parse_thread_affinity(const char *string, enum vdo_thread_class class,
+				 struct vdo_thread_affinity *affinity)
+{
+	const char *class_name = vdo_get_thread_class_name(class);
+
+	if (strcmp(string, "zone") == 0) {
+		if ((class != VDO_THREAD_CLASS_LOGICAL) && (class != VDO_THREAD_CLASS_PHYSICAL) &&
+		    (class != VDO_THREAD_CLASS_HASH)) {
+			uds_log_error("thread affinity error: only zone threads may have '%s' affinity, not '%s' threads",
+				      string, class_name);
+			return -EINVAL;
+		}
+
+		*affinity = (struct vdo_thread_affinity) { .type = VDO_AFFINITY_ZONE };
+		return VDO_SUCCESS;
+	}
+
+	if (strcmp(string, "device") == 0) {
+		if (class != VDO_THREAD_CLASS_BIO) {
+			uds_log_error("thread affinity error: only bio threads may have '%s' affinity, not '%s' threads",
+				      string, class_name);
+			return -EINVAL;
+		}
+
+		*affinity = (struct vdo_thread_affinity) { .type = VDO_AFFINITY_DEVICE };
+		return VDO_SUCCESS;
+	}
+
+	if (strncmp(string, "node:", 5) == 0) {
+		unsigned int node;
+
+		if (kstrtouint(string + 5, 10, &node) != 0) {
+			uds_log_error("thread affinity error: node number needed, found \"%s\"",
+				      string);
+			return -EINVAL;
+		}
+
+		*affinity = (struct vdo_thread_affinity) {
+			.type = VDO_AFFINITY_NODE,
+			.node = node,
+		};
+		return VDO_SUCCESS;
+	}
+
+	if ((strlen(string) >= VDO_AFFINITY_CPU_LIST_LENGTH) || !is_cpu_list(string)) {
+		uds_log_error("thread affinity error: '%s' threads need a cpulist of fewer than %d characters, 'node:<n>', 'zone', or 'device', found \"%s\"",
+			      class_name, VDO_AFFINITY_CPU_LIST_LENGTH, string);
+		return -EINVAL;
+	}
+
+	*affinity = (struct vdo_thread_affinity) { .type = VDO_AFFINITY_CPUS };
+	memcpy(affinity->cpus, string, strlen(string) + 1);
+	return VDO_SUCCESS;
+}
+
 /**
  * parse_one_thread_config_spec() - Parse one component of a thread parameter configuration string
  *				    and update the configuration data structure.
  * @spec: The thread parameter specification string.
  * @config: The configuration data to be updated.
  */
-static int parse_one_thread_config_spec(const char *spec,
-					struct thread_count_config *config)
+static int parse_one_thread_config_spec(const char *spec, struct device_config *config)
 {
+	enum vdo_thread_class class;
 	unsigned int count;
 	char **fields;
 	int result;
@@ -565,6 +704,13 @@ static int parse_one_thread_config_spec(const char *spec,
 		return -EINVAL;
 	}
 
+	if (get_thread_affinity_class(fields[0], &class)) {
+		result = parse_thread_affinity(fields[1], class,
+					       &config->thread_affinities[class]);
+		free_string_array(fields);
+		return result;
+	}
+
 	result = kstrtouint(fields[1], 10, &count);
 	if (result != UDS_SUCCESS) {
 		uds_log_error("thread config string error: integer value needed, found \"%s\"",
@@ -573,7 +719,7 @@ static int parse_one_thread_config_spec(const char *spec,
 		return result;
 	}
 
-	result = process_one_thread_config_spec(fields[0], count, config);
+	result = process_one_thread_config_spec(fields[0], count, &config->thread_counts);
 	free_string_array(fields);
 	return result;
 }
@@ -587,7 +733,9 @@ static int parse_one_thread_config_spec(const char *spec,
  *
  * The configuration string should contain one or more comma-separated specs of the form
  * "typename=number"; the supported type names are "cpu", "ack", "bio", "bioRotationInterval",
- * "logical", "physical", and "hash".
+ * "logical", "physical", and "hash". Specs of the form "classAffinity=affinity" set the affinity
+ * of a class of threads; since the specs are comma-separated, a cpulist given here may only be a
+ * single range.
  *
  * If an error occurs during parsing of a single key/value pair, we deem it serious enough to stop
  * further parsing.
@@ -598,8 +746,7 @@ static int parse_one_thread_config_spec(const char *spec,
  *
  * Return: VDO_SUCCESS or -EINVAL or -ENOMEM
  */
-static int parse_thread_config_string(const char *string,
-				      struct thread_count_config *config)
+static int parse_thread_config_string(const char *string, struct device_config *config)
 {
 	int result = VDO_SUCCESS;
 	char **specs;
@@ -621,6 +768,113 @@ static int parse_thread_config_string(const char *string,
 	return result;
 }
 
+/**
+ * parse_compression_type() - Parse a compression type and optional level.
+ * @string: The string to parse, of the form "type" or "type:level", such as "lz4hc:12".
+ * @type_ptr: A pointer to hold the compression type.
+ * @level_ptr: A pointer to hold the level, which is 0 (the default for the type) if none is given.
+ *
+ * Return: VDO_SUCCESS or -EINVAL.
+ */
+static int parse_compression_type(const char *string, enum vdo_compression_type *type_ptr,
+				  int *level_ptr)
+{
+	enum vdo_compression_type type;
+	unsigned int level = 0;
+	unsigned int max_level;
+	char **fields;
+	int result;
+
+	result = split_string(string, ':', &fields);
+	if (result != UDS_SUCCESS)
+		return result;
+
+	if ((fields[0] == NULL) || ((fields[1] != NULL) && (fields[2] != NULL))) {
+		uds_log_error("compression type error: expected type[:level], saw \"%s\"",
+			      string);
+		free_string_array(fields);
+		return -EINVAL;
+	}
+
+	for (type = 0; type < VDO_COMPRESSION_TYPE_COUNT; type++) {
+		if (strcmp(fields[0], vdo_get_compression_type_name(type)) == 0)
+			break;
+	}
+
+	if (type == VDO_COMPRESSION_TYPE_COUNT) {
+		uds_log_error("compression type error: unknown type \"%s\"", fields[0]);
+		free_string_array(fields);
+		return -EINVAL;
+	}
+
+	if (fields[1] != NULL) {
+		result = kstrtouint(fields[1], 10, &level);
+		if (result != UDS_SUCCESS) {
+			uds_log_error("compression type error: integer level needed, found \"%s\"",
+				      fields[1]);
+			free_string_array(fields);
+			return -EINVAL;
+		}
+	}
+
+	free_string_array(fields);
+	max_level = ((type == VDO_COMPRESSION_LZ4HC) ? LZ4HC_MAX_CLEVEL : MAX_LZ4_ACCELERATION);
+	if (level > max_level) {
+		uds_log_error("compression type error: %s level must be at most %u",
+			      vdo_get_compression_type_name(type), max_level);
+		return -EINVAL;
+	}
+
+	*type_ptr = type;
+	*level_ptr = level;
+	return VDO_SUCCESS;
+}
+
+/**
+ * parse_cache_policy() - Parse the name of a block map page cache replacement policy.
+ * @string: The string to parse.
+ * @policy_ptr: A pointer to hold the policy.
+ *
+ * Return: VDO_SUCCESS or -EINVAL.
+ */
+static int parse_cache_policy(const char *string, enum vdo_cache_policy *policy_ptr)
+{
+	enum vdo_cache_policy policy;
+
+	for (policy = 0; policy < VDO_CACHE_POLICY_COUNT; policy++) {
+		if (strcmp(string, vdo_get_cache_policy_name(policy)) == 0) {
+			*policy_ptr = policy;
+			return VDO_SUCCESS;
+		}
+	}
+
+	uds_log_error("block map cache policy error: unknown policy \"%s\"", string);
+	return -EINVAL;
+}
+
+/**
+ * parse_memory_placement() - Parse the name of a memory placement mode.
+ * @string: The string to parse.
+ * @placement_ptr: A pointer to hold the placement mode.
+ *
+ * Return: VDO_SUCCESS or -EINVAL.
+ */
+static int parse_memory_placement(const char *string,
+				  enum vdo_memory_placement *placement_ptr)
+{
+	enum vdo_memory_placement placement;
+
+	for (placement = 0; placement < VDO_MEMORY_PLACEMENT_COUNT; placement++) {
+		if (strcmp(string, vdo_get_memory_placement_name(placement)) == 0) {
+			*placement_ptr = placement;
+			return VDO_SUCCESS;
+		}
+	}
+
+	uds_log_error("memory placement error: unknown placement \"%s\"", string);
+	return -EINVAL;
+}
+
 /**
  * process_one_key_value_pair() - Process one component of an optional parameter string and update
  *				  the configuration data structure.
@@ -651,6 +905,17 @@ static int process_one_key_value_pair(const char *key, unsigned int value,
 		config->max_discard_blocks = value;
 		return VDO_SUCCESS;
 	}
+
+	if (strcmp(key, "packerBins") == 0) {
+		if ((value == 0) || (value > MAXIMUM_PACKER_BINS)) {
+			uds_log_error("optional parameter error: packer bins must be from 1 to %d",
+				      MAXIMUM_PACKER_BINS);
+			return -EINVAL;
+		}
+
+		config->packer_bins = value;
+		return VDO_SUCCESS;
+	}
 	/* Handles unknown key names */
 	return process_one_thread_config_spec(key, value, &config->thread_counts);
 }
@@ -667,6 +932,7 @@ static int process_one_key_value_pair(const char *key, unsigned int value,
 static int parse_one_key_value_pair(const char *key, const char *value,
 				    struct device_config *config)
 {
+	enum vdo_thread_class class;
 	unsigned int count;
 	int result;
 
@@ -676,6 +942,19 @@ static int parse_one_key_value_pair(const char *key, const char *value,
 	if (strcmp(key, "compression") == 0)
 		return parse_bool(value, "on", "off", &config->compression);
 
+	if (strcmp(key, "compressionType") == 0)
+		return parse_compression_type(value, &config->compression_type,
+					      &config->compression_level);
+
+	if (strcmp(key, "blockMapCachePolicy") == 0)
+		return parse_cache_policy(value, &config->cache_policy);
+
+	if (strcmp(key, "memoryPlacement") == 0)
+		return parse_memory_placement(value, &config->memory_placement);
+
+	if (get_thread_affinity_class(key, &class))
+		return parse_thread_affinity(value, class, &config->thread_affinities[class]);
+
 	/* The remaining arguments must have integral values. */
 	result = kstrtouint(value, 10, &count);
 	if (result != UDS_SUCCESS) {
@@ -739,8 +1018,7 @@ static int parse_optional_arguments(struct dm_arg_set *arg_set, char **error_ptr
 	int result = VDO_SUCCESS;
 
 	if (config->version == 0 || config->version == 1) {
-		result = parse_thread_config_string(arg_set->argv[0],
-						    &config->thread_counts);
+		result = parse_thread_config_string(arg_set->argv[0], config);
 		if (result != VDO_SUCCESS) {
 			*error_ptr = "Invalid thread-count configuration";
 			return VDO_BAD_CONFIGURATION;
@@ -832,8 +1110,13 @@ static int parse_device_config(int argc, char **argv, struct dm_target *ti,
 		.hash_zones = 0,
 	};
 	config->max_discard_blocks = 1;
+	config->packer_bins = DEFAULT_PACKER_BINS;
+	config->cache_policy = VDO_CACHE_POLICY_LRU;
+	config->memory_placement = VDO_MEMORY_PLACEMENT_DEFAULT;
 	config->deduplication = true;
 	config->compression = false;
+	config->compression_type = VDO_COMPRESSION_LZ4;
+	config->compression_level = 0;
 
 	arg_set.argc = argc;
 	arg_set.argv = argv;
@@ -1184,6 +1467,24 @@ static int __must_check process_vdo_message_locked(struct vdo *vdo, unsigned int
 		return -EINVAL;
 	}
 
+	if ((argc == 2) && (strcasecmp(argv[0], "compression-type") == 0)) {
+		enum vdo_compression_type type;
+		int level;
+		int result = parse_compression_type(argv[1], &type, &level);
+
+		if (result != VDO_SUCCESS)
+			return result;
+
+		if (!vdo_supports_compression_type(vdo, type)) {
+			uds_log_warning("compression type %s must first be selected by the table",
+					vdo_get_compression_type_name(type));
+			return -EINVAL;
+		}
+
+		vdo_set_compression_type(vdo, type, level);
+		return 0;
+	}
+
 	uds_log_warning("unrecognized dmsetup message '%s' received", argv[0]);
 	return -EINVAL;
 }
@@ -1518,7 +1819,8 @@ static int __must_check decode_vdo(struct vdo *vdo)
 	result = vdo_decode_block_map(vdo->states.block_map,
 				      vdo->states.vdo.config.logical_blocks, vdo,
 				      vdo->recovery_journal, vdo->states.vdo.nonce,
-				      vdo->device_config->cache_size, maximum_age,
+				      vdo->device_config->cache_size,
+				      vdo->device_config->cache_policy, maximum_age,
 				      &vdo->block_map);
 	if (result != VDO_SUCCESS)
 		return result;
@@ -1600,9 +1902,63 @@ static void set_device_config(struct dm_target *ti, struct vdo *vdo,
 #endif /* __KERNEL__ */
 }
 
+/**
+ * log_memory_placement() - Log the NUMA node on which the block map cache and slab reference
+ *                          counts of each zone will be placed.
+ * @vdo: The vdo.
+ */
+static void log_memory_placement(const struct vdo *vdo)
+{
+	const struct thread_config *config = &vdo->thread_config;
+	zone_count_t zone_count = max(config->logical_zone_count, config->physical_zone_count);
+	char nodes[MAX_VDO_LOGICAL_ZONES * 8];
+	char *position = nodes;
+	zone_count_t zone;
+
+	nodes[0] = '\0';
+	for (zone = 0; zone < zone_count; zone++)
+		position = uds_append_to_buffer(position, nodes + sizeof(nodes), " %u:%d", zone,
+						vdo_get_zone_node(vdo, zone));
+
+	uds_log_info("Placing zone memory on NUMA nodes (zone:node)%s", nodes);
+}
+
+/**
+ * log_thread_affinity() - Log the configured affinity of a class of threads, if any.
+ * @class: The thread class.
+ * @affinity: The affinity of the class.
+ */
+static void log_thread_affinity(enum vdo_thread_class class,
+				const struct vdo_thread_affinity *affinity)
+{
+	const char *name = vdo_get_thread_class_name(class);
+
+	switch (affinity->type) {
+	case VDO_AFFINITY_CPUS:
+		uds_log_debug("Thread affinity        = %s:%s", name, affinity->cpus);
+		break;
+
+	case VDO_AFFINITY_NODE:
+		uds_log_debug("Thread affinity        = %s:node:%d", name, affinity->node);
+		break;
+
+	case VDO_AFFINITY_ZONE:
+		uds_log_debug("Thread affinity        = %s:zone", name);
+		break;
+
+	case VDO_AFFINITY_DEVICE:
+		uds_log_debug("Thread affinity        = %s:device", name);
+		break;
+
+	default:
+		break;
+	}
+}
+
 static int vdo_initialize(struct dm_target *ti, unsigned int instance,
 			  struct device_config *config)
 {
+	enum vdo_thread_class class;
 	struct vdo *vdo;
 	int result;
 	u64 block_size = VDO_BLOCK_SIZE;
@@ -1616,8 +1972,19 @@ static int vdo_initialize(struct dm_target *ti, unsigned int instance,
 	uds_log_debug("Physical blocks        = %llu", config->physical_blocks);
 	uds_log_debug("Block map cache blocks = %u", config->cache_size);
 	uds_log_debug("Block map maximum age  = %u", config->block_map_maximum_age);
+	uds_log_debug("Block map cache policy = %s",
+		      vdo_get_cache_policy_name(config->cache_policy));
+	uds_log_debug("Memory placement       = %s",
+		      vdo_get_memory_placement_name(config->memory_placement));
 	uds_log_debug("Deduplication          = %s", (config->deduplication ? "on" : "off"));
 	uds_log_debug("Compression            = %s", (config->compression ? "on" : "off"));
+	uds_log_debug("Packer bins            = %llu",
+		      (unsigned long long) config->packer_bins);
+	uds_log_debug("Compression type       = %s:%d",
+		      vdo_get_compression_type_name(config->compression_type),
+		      config->compression_level);
+	for (class = 0; class < VDO_THREAD_CLASS_COUNT; class++)
+		log_thread_affinity(class, &config->thread_affinities[class]);
 
 	vdo = vdo_find_matching(vdo_uses_device, config);
 	if (vdo != NULL) {
@@ -1635,6 +2002,9 @@ static int vdo_initialize(struct dm_target *ti, unsigned int instance,
 		return result;
 	}
 
+	if (config->memory_placement == VDO_MEMORY_PLACEMENT_NUMA)
+		log_memory_placement(vdo);
+
 	result = perform_admin_operation(vdo, PRE_LOAD_PHASE_START, pre_load_callback,
 					 finish_operation_callback, "pre-load");
 	if (result != VDO_SUCCESS) {
@@ -1948,12 +2318,33 @@ static int validate_new_device_config(struct device_config *to_validate,
 		return VDO_PARAMETER_MISMATCH;
 	}
 
+	if (to_validate->cache_policy != config->cache_policy) {
+		*error_ptr = "Block map cache policy cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (to_validate->memory_placement != config->memory_placement) {
+		*error_ptr = "Memory placement cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
 	if (memcmp(&to_validate->thread_counts, &config->thread_counts,
 		   sizeof(struct thread_count_config)) != 0) {
 		*error_ptr = "Thread configuration cannot change";
 		return VDO_PARAMETER_MISMATCH;
 	}
 
+	if (memcmp(to_validate->thread_affinities, config->thread_affinities,
+		   sizeof(config->thread_affinities)) != 0) {
+		*error_ptr = "Thread affinity cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (to_validate->packer_bins != config->packer_bins) {
+		*error_ptr = "Packer bin count cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
 	if (to_validate->physical_blocks < config->physical_blocks) {
 		*error_ptr = "Removing physical storage from a VDO is not supported";
 		return VDO_NOT_IMPLEMENTED;
@@ -2436,6 +2827,7 @@ static void load_callback(struct vdo_completion *completion)
 
 	case LOAD_PHASE_MAKE_DIRTY:
 		vdo_set_state(vdo, VDO_DIRTY);
+		vdo_upgrade_for_compression_type(vdo, vdo->device_config->compression_type);
 		vdo_save_components(vdo, completion);
 		return;
 
@@ -2455,6 +2847,8 @@ static void load_callback(struct vdo_completion *completion)
 
 	case LOAD_PHASE_DATA_REDUCTION:
 		WRITE_ONCE(vdo->compressing, vdo->device_config->compression);
+		vdo_set_compression_type(vdo, vdo->device_config->compression_type,
+					 vdo->device_config->compression_level);
 		if (vdo->device_config->deduplication) {
 			/*
 			 * Don't try to load or rebuild the index first (and log scary error
@@ -2531,10 +2925,20 @@ static void write_super_block_for_resume(struct vdo_completion *completion)
 	case VDO_CLEAN:
 	case VDO_NEW:
 		vdo_set_state(vdo, VDO_DIRTY);
+		vdo_upgrade_for_compression_type(vdo, vdo->device_config->compression_type);
 		vdo_save_components(vdo, completion);
 		return;
 
 	case VDO_DIRTY:
+		/* A new table may select a compression type the volume does not yet record. */
+		if (vdo_upgrade_for_compression_type(vdo, vdo->device_config->compression_type)) {
+			vdo_save_components(vdo, completion);
+			return;
+		}
+
+		vdo_launch_completion(completion);
+		return;
+
 	case VDO_READ_ONLY_MODE:
 	case VDO_FORCE_REBUILD:
 	case VDO_RECOVERING:
@@ -2604,6 +3008,8 @@ static void resume_callback(struct vdo_completion *completion)
 		if (enable != was_enabled)
 			WRITE_ONCE(vdo->compressing, enable);
 		uds_log_info("compression is %s", (enable ? "enabled" : "disabled"));
+		vdo_set_compression_type(vdo, vdo->device_config->compression_type,
+					 vdo->device_config->compression_level);
 
 		vdo_resume_packer(vdo->packer, completion);
 		return;
@@ -3113,6 +3519,8 @@ static int __init vdo_init(void)
 #endif /* __KERNEL__ */
 
 	vdo_initialize_device_registry_once();
+	vdo_initialize_block_compare();
+	vdo_initialize_fingerprints();
 	uds_log_info("loaded version %s", CURRENT_VERSION);
 
 	/* Add VDO errors to the already existing set of errors in UDS. */
@@ -10,6 +10,7 @@
 #include "logger.h"
 #include "memory-alloc.h"
 #include "permassert.h"
+#include "string-utils.h"
 
 #include "constants.h"
 #include "status-codes.h"
@@ -34,6 +35,20 @@ static const struct header GEOMETRY_BLOCK_HEADER_5_0 = {
 	.size = sizeof(struct geometry_block) + sizeof(struct volume_geometry),
 };
 
+/* Version 5.1 records the record name fingerprint, which version 5.0 leaves unused. */
+static const struct header GEOMETRY_BLOCK_HEADER_5_1 = {
+	.id = VDO_GEOMETRY_BLOCK,
+	.version = {
+		.major_version = 5,
+		.minor_version = 1,
+	},
+	/*
+	 * Note: this size isn't just the payload size following the header, like it is everywhere
+	 * else in VDO.
+	 */
+	.size = sizeof(struct geometry_block) + sizeof(struct volume_geometry),
+};
+
 static const struct header GEOMETRY_BLOCK_HEADER_4_0 = {
 	.id = VDO_GEOMETRY_BLOCK,
 	.version = {
@@ -85,6 +100,15 @@ const struct header VDO_SLAB_DEPOT_HEADER_2_0 = {
 	.size = sizeof(struct slab_depot_state_2_0),
 };
 
+const struct header VDO_SLAB_DEPOT_HEADER_2_1 = {
+	.id = VDO_SLAB_DEPOT,
+	.version = {
+		.major_version = 2,
+		.minor_version = 1,
+	},
+	.size = sizeof(struct slab_depot_state_2_0),
+};
+
 const struct header VDO_LAYOUT_HEADER_3_0 = {
 	.id = VDO_LAYOUT,
 	.version = {
@@ -115,6 +139,11 @@ const struct version_number VDO_VOLUME_VERSION_67_0 = {
 	.minor_version = 0,
 };
 
+const struct version_number VDO_VOLUME_VERSION_67_1 = {
+	.major_version = 67,
+	.minor_version = 1,
+};
+
 static const struct header SUPER_BLOCK_HEADER_12_0 = {
 	.id = VDO_SUPER_BLOCK,
 	.version = {
@@ -242,9 +271,10 @@ void vdo_decode_header(u8 *buffer, size_t *offset, struct header *header)
  * @version: The geometry block version to decode.
  */
 static void decode_volume_geometry(u8 *buffer, size_t *offset,
-				   struct volume_geometry *geometry, u32 version)
+				   struct volume_geometry *geometry,
+				   struct version_number version)
 {
-	u32 unused, mem;
+	u32 unused, mem, fingerprint;
 	enum volume_region_id id;
 	nonce_t nonce;
 	block_count_t bio_offset = 0;
@@ -260,7 +290,7 @@ static void decode_volume_geometry(u8 *buffer, size_t *offset,
 	memcpy((unsigned char *) &geometry->uuid, buffer + *offset, sizeof(uuid_t));
 	*offset += sizeof(uuid_t);
 
-	if (version > 4)
+	if (version.major_version > 4)
 		decode_u64_le(buffer, offset, &bio_offset);
 	geometry->bio_offset = bio_offset;
 
@@ -278,11 +308,16 @@ static void decode_volume_geometry(u8 *buffer, size_t *offset,
 	}
 
 	decode_u32_le(buffer, offset, &mem);
-	*offset += sizeof(u32);
+	decode_u32_le(buffer, offset, &fingerprint);
 	sparse = buffer[(*offset)++];
 
+	/* Earlier versions leave the fingerprint unused; they all use MurmurHash3. */
+	if (!vdo_are_same_version(version, GEOMETRY_BLOCK_HEADER_5_1.version))
+		fingerprint = VDO_FINGERPRINT_MURMUR3;
+
 	geometry->index_config = (struct index_config) {
 		.mem = mem,
+		.fingerprint = fingerprint,
 		.sparse = sparse,
 	};
 }
@@ -295,6 +330,8 @@ static void decode_volume_geometry(u8 *buffer, size_t *offset,
  * @geometry: The geometry to encode.
  * @version: The geometry block version to encode.
  *
+ * A version 5 geometry which uses a fingerprint other than MurmurHash3 is encoded as version 5.1.
+ *
  * Return: VDO_SUCCESS or an error
  */
 int encode_volume_geometry(u8 *buffer, size_t *offset,
@@ -302,8 +339,22 @@ int encode_volume_geometry(u8 *buffer, size_t *offset,
 {
 	enum volume_region_id id;
 	const struct header *header;
+	bool fingerprinted = (geometry->index_config.fingerprint != VDO_FINGERPRINT_MURMUR3);
+	int result;
+
+	if (version <= 4) {
+		result = ASSERT(!fingerprinted,
+				"version 4 geometry must use the murmur3 fingerprint");
+		if (result != VDO_SUCCESS)
+			return result;
+
+		header = &GEOMETRY_BLOCK_HEADER_4_0;
+	} else if (fingerprinted) {
+		header = &GEOMETRY_BLOCK_HEADER_5_1;
+	} else {
+		header = &GEOMETRY_BLOCK_HEADER_5_0;
+	}
 
-	header = ((version <= 4) ? &GEOMETRY_BLOCK_HEADER_4_0 : &GEOMETRY_BLOCK_HEADER_5_0);
 	vdo_encode_header(buffer, offset, header);
 
 	/* This is for backwards compatibility */
@@ -321,7 +372,7 @@ int encode_volume_geometry(u8 *buffer, size_t *offset,
 	}
 
 	encode_u32_le(buffer, offset, geometry->index_config.mem);
-	encode_u32_le(buffer, offset, 0);
+	encode_u32_le(buffer, offset, geometry->index_config.fingerprint);
 
 	if (geometry->index_config.sparse)
 		buffer[(*offset)++] = 1;
@@ -353,6 +404,9 @@ int __must_check vdo_parse_geometry_block(u8 *block, struct volume_geometry *geo
 	if (header.version.major_version <= 4) {
 		result = vdo_validate_header(&GEOMETRY_BLOCK_HEADER_4_0, &header,
 					     true, __func__);
+	} else if (header.version.minor_version == 1) {
+		result = vdo_validate_header(&GEOMETRY_BLOCK_HEADER_5_1, &header,
+					     true, __func__);
 	} else {
 		result = vdo_validate_header(&GEOMETRY_BLOCK_HEADER_5_0, &header,
 					     true, __func__);
@@ -360,7 +414,7 @@ int __must_check vdo_parse_geometry_block(u8 *block, struct volume_geometry *geo
 	if (result != VDO_SUCCESS)
 		return result;
 
-	decode_volume_geometry(block, &offset, geometry, header.version.major_version);
+	decode_volume_geometry(block, &offset, geometry, header.version);
 
 	result = ASSERT(header.size == offset + sizeof(u32),
 			"should have decoded up to the geometry checksum");
@@ -370,10 +424,61 @@ int __must_check vdo_parse_geometry_block(u8 *block, struct volume_geometry *geo
 	/* Decode and verify the checksum. */
 	checksum = vdo_crc32(block, offset);
 	decode_u32_le(block, &offset, &saved_checksum);
+	if (checksum != saved_checksum)
+		return VDO_CHECKSUM_MISMATCH;
+
+	if (geometry->index_config.fingerprint >= VDO_FINGERPRINT_COUNT) {
+		return uds_log_error_strerror(VDO_UNSUPPORTED_VERSION,
+					      "unknown record name fingerprint %u",
+					      geometry->index_config.fingerprint);
+	}
+
+	return VDO_SUCCESS;
+}
+
+static const char *const FINGERPRINT_NAMES[] = {
+	[VDO_FINGERPRINT_MURMUR3] = "murmur3",
+	[VDO_FINGERPRINT_AES] = "aes",
+};
 
-	return ((checksum == saved_checksum) ? VDO_SUCCESS : VDO_CHECKSUM_MISMATCH);
+/**
+ * vdo_get_fingerprint_name() - Get the name of a record name fingerprint.
+ * @fingerprint: The fingerprint to name.
+ *
+ * Return: The name of the fingerprint.
+ */
+const char *vdo_get_fingerprint_name(enum vdo_fingerprint fingerprint)
+{
+	if (fingerprint >= VDO_FINGERPRINT_COUNT)
+		return "unknown fingerprint";
+
+	return FINGERPRINT_NAMES[fingerprint];
 }
 
+#if (defined(VDO_USER) || defined(INTERNAL))
+/**
+ * vdo_parse_fingerprint_name() - Look up a record name fingerprint by name.
+ * @name: The name of the fingerprint.
+ * @fingerprint_ptr: A pointer to hold the fingerprint.
+ *
+ * Return: VDO_SUCCESS or VDO_BAD_CONFIGURATION if the name is not known.
+ */
+int vdo_parse_fingerprint_name(const char *name, enum vdo_fingerprint *fingerprint_ptr)
+{
+	enum vdo_fingerprint fingerprint;
+
+	for (fingerprint = 0; fingerprint < VDO_FINGERPRINT_COUNT; fingerprint++) {
+		if (strcmp(name, FINGERPRINT_NAMES[fingerprint]) == 0) {
+			*fingerprint_ptr = fingerprint;
+			return VDO_SUCCESS;
+		}
+	}
+
+	return VDO_BAD_CONFIGURATION;
+}
+
+#endif /* VDO_USER */
+
 struct block_map_page *vdo_format_block_map_page(void *buffer, nonce_t nonce,
 						 physical_block_number_t pbn,
 						 bool initialized)
@@ -587,14 +692,19 @@ const char *vdo_get_journal_operation_name(enum journal_operation operation)
 /**
  * encode_slab_depot_state_2_0() - Encode the state of a slab depot into a buffer.
  *
+ * If the slab journals may hold version 2 blocks, the state is encoded as version 2.1.
+ *
  * Return: UDS_SUCCESS or an error.
  */
 STATIC void encode_slab_depot_state_2_0(u8 *buffer, size_t *offset,
-					struct slab_depot_state_2_0 state)
+					struct slab_depot_state_2_0 state,
+					bool compact_slab_journals)
 {
 	size_t initial_offset;
 
-	vdo_encode_header(buffer, offset, &VDO_SLAB_DEPOT_HEADER_2_0);
+	vdo_encode_header(buffer, offset,
+			  (compact_slab_journals ? &VDO_SLAB_DEPOT_HEADER_2_1 :
+			   &VDO_SLAB_DEPOT_HEADER_2_0));
 
 	initial_offset = *offset;
 	encode_u64_le(buffer, offset, state.slab_config.slab_blocks);
@@ -613,12 +723,17 @@ STATIC void encode_slab_depot_state_2_0(u8 *buffer, size_t *offset,
 }
 
 /**
- * decode_slab_depot_state_2_0() - Decode slab depot component state version 2.0 from a buffer.
+ * decode_slab_depot_state_2_0() - Decode slab depot component state version 2.0 or 2.1 from a
+ *                                 buffer.
+ *
+ * Version 2.1 differs only in that its slab journals may hold version 2 blocks, which is noted in
+ * compact_slab_journals.
  *
  * Return: UDS_SUCCESS or an error code.
  */
 STATIC int decode_slab_depot_state_2_0(u8 *buffer, size_t *offset,
-				       struct slab_depot_state_2_0 *state)
+				       struct slab_depot_state_2_0 *state,
+				       bool *compact_slab_journals)
 {
 	struct header header;
 	int result;
@@ -629,8 +744,11 @@ STATIC int decode_slab_depot_state_2_0(u8 *buffer, size_t *offset,
 	zone_count_t zone_count;
 
 	vdo_decode_header(buffer, offset, &header);
-	result = vdo_validate_header(&VDO_SLAB_DEPOT_HEADER_2_0, &header, true,
-				     __func__);
+	*compact_slab_journals = vdo_are_same_version(header.version,
+						      VDO_SLAB_DEPOT_HEADER_2_1.version);
+	result = vdo_validate_header((*compact_slab_journals ? &VDO_SLAB_DEPOT_HEADER_2_1 :
+				      &VDO_SLAB_DEPOT_HEADER_2_0),
+				     &header, true, __func__);
 	if (result != VDO_SUCCESS)
 		return result;
 
@@ -826,6 +944,156 @@ struct slab_journal_entry vdo_decode_slab_journal_entry(struct packed_slab_journ
 	return entry;
 }
 
+/**
+ * vdo_encode_slab_journal_run_entry() - Append an entry to a version 2 slab journal block.
+ * @header: The unpacked header for the block.
+ * @cursor: The encoder for the block, which must have room for the entry.
+ * @payload: The journal block payload to hold the entry.
+ * @sbn: The slab block number of the entry to encode.
+ * @operation: The type of the entry.
+ * @increment: True if this is an increment.
+ *
+ * The entry extends the last record if it continues that record's run, and otherwise starts a new
+ * record in the smallest form which can describe it.
+ */
+void vdo_encode_slab_journal_run_entry(struct slab_journal_block_header *header,
+				       struct slab_journal_block_cursor *cursor,
+				       slab_journal_payload *payload, slab_block_number sbn,
+				       enum journal_operation operation, bool increment)
+{
+	u8 *record = &payload->space[cursor->record];
+	u8 flags = ((increment ? VDO_SLAB_JOURNAL_RUN_INCREMENT : 0) |
+		    ((operation == VDO_JOURNAL_BLOCK_MAP_REMAPPING) ?
+		     VDO_SLAB_JOURNAL_RUN_BLOCK_MAP : 0));
+	s64 delta = (s64) sbn - cursor->next_sbn[increment];
+
+	header->entry_count++;
+	if (operation == VDO_JOURNAL_BLOCK_MAP_REMAPPING)
+		header->has_block_map_increments = true;
+
+	cursor->next_sbn[increment] = sbn + 1;
+	if ((cursor->offset > 0) && (delta == 0) &&
+	    ((*record & VDO_SLAB_JOURNAL_RUN_TYPE_MASK) == flags) &&
+	    ((*record & VDO_SLAB_JOURNAL_RUN_LENGTH_MASK) < VDO_SLAB_JOURNAL_RUN_LENGTH_MASK)) {
+		/* The length is stored less one, so this adds the entry to the run. */
+		(*record)++;
+		return;
+	}
+
+	cursor->record = cursor->offset;
+	record = &payload->space[cursor->offset++];
+	if (delta == 0) {
+		*record = flags | VDO_SLAB_JOURNAL_RUN_CONTINUES;
+	} else if ((delta >= -128) && (delta <= 127)) {
+		*record = flags | VDO_SLAB_JOURNAL_RUN_DELTA8;
+		payload->space[cursor->offset++] = (u8) delta;
+	} else if ((delta >= -32768) && (delta <= 32767)) {
+		*record = flags | VDO_SLAB_JOURNAL_RUN_DELTA16;
+		payload->space[cursor->offset++] = (delta & 0x00FF);
+		payload->space[cursor->offset++] = (delta & 0xFF00) >> 8;
+	} else {
+		*record = flags | VDO_SLAB_JOURNAL_RUN_ABSOLUTE;
+		payload->space[cursor->offset++] = (sbn & 0x0000FF);
+		payload->space[cursor->offset++] = (sbn & 0x00FF00) >> 8;
+		payload->space[cursor->offset++] = (sbn & 0xFF0000) >> 16;
+	}
+}
+
+/**
+ * start_run() - Decode the record which starts the next run of a version 2 slab journal block.
+ * @payload: The payload of the block.
+ * @cursor: The decoder for the block.
+ *
+ * Return: VDO_SUCCESS or VDO_CORRUPT_JOURNAL if the record does not fit in the block.
+ */
+static int start_run(const slab_journal_payload *payload,
+		     struct slab_journal_block_cursor *cursor)
+{
+	const u8 *bytes = &payload->space[cursor->offset];
+	u8 tag;
+	u8 form;
+	bool increment;
+	u16 size;
+	slab_block_number sbn;
+
+	if (cursor->offset >= VDO_SLAB_JOURNAL_PAYLOAD_SIZE)
+		return VDO_CORRUPT_JOURNAL;
+
+	tag = bytes[0];
+	form = tag & VDO_SLAB_JOURNAL_RUN_FORM_MASK;
+	size = 1 + (form >> 4);
+	if ((cursor->offset + size) > VDO_SLAB_JOURNAL_PAYLOAD_SIZE)
+		return VDO_CORRUPT_JOURNAL;
+
+	increment = ((tag & VDO_SLAB_JOURNAL_RUN_INCREMENT) != 0);
+	sbn = cursor->next_sbn[increment];
+	switch (form) {
+	case VDO_SLAB_JOURNAL_RUN_DELTA8:
+		sbn += (s8) bytes[1];
+		break;
+
+	case VDO_SLAB_JOURNAL_RUN_DELTA16:
+		sbn += (s16) (bytes[1] | (bytes[2] << 8));
+		break;
+
+	case VDO_SLAB_JOURNAL_RUN_ABSOLUTE:
+		sbn = bytes[1] | (bytes[2] << 8) | (bytes[3] << 16);
+		break;
+
+	default:
+		break;
+	}
+
+	cursor->record = cursor->offset;
+	cursor->offset += size;
+	cursor->run_remaining = (tag & VDO_SLAB_JOURNAL_RUN_LENGTH_MASK) + 1;
+	cursor->next_sbn[increment] = sbn;
+	return VDO_SUCCESS;
+}
+
+/**
+ * vdo_decode_next_slab_journal_entry() - Decode the next entry of a slab journal block of either
+ *                                        version.
+ * @block: The journal block holding the entry.
+ * @cursor: The decoder for the block, which must be zeroed before the first entry is decoded.
+ * @entry: A pointer to hold the decoded entry.
+ *
+ * The caller is responsible for not decoding more entries than the block header says it holds.
+ *
+ * Return: VDO_SUCCESS or VDO_CORRUPT_JOURNAL if the block can not be decoded.
+ */
+int vdo_decode_next_slab_journal_entry(struct packed_slab_journal_block *block,
+				       struct slab_journal_block_cursor *cursor,
+				       struct slab_journal_entry *entry)
+{
+	u8 tag;
+	bool increment;
+
+	if (block->header.metadata_type != VDO_METADATA_SLAB_JOURNAL_2) {
+		*entry = vdo_decode_slab_journal_entry(block, cursor->entry++);
+		return VDO_SUCCESS;
+	}
+
+	if (cursor->run_remaining == 0) {
+		int result = start_run(&block->payload, cursor);
+
+		if (result != VDO_SUCCESS)
+			return result;
+	}
+
+	tag = block->payload.space[cursor->record];
+	increment = ((tag & VDO_SLAB_JOURNAL_RUN_INCREMENT) != 0);
+	*entry = (struct slab_journal_entry) {
+		.sbn = cursor->next_sbn[increment]++,
+		.operation = (((tag & VDO_SLAB_JOURNAL_RUN_BLOCK_MAP) != 0) ?
+			      VDO_JOURNAL_BLOCK_MAP_REMAPPING : VDO_JOURNAL_DATA_REMAPPING),
+		.increment = increment,
+	};
+	cursor->run_remaining--;
+	cursor->entry++;
+	return VDO_SUCCESS;
+}
+
 /**
  * allocate_partition() - Allocate a partition and add it to a layout.
  * @layout: The layout containing the partition.
@@ -1388,7 +1656,8 @@ static int __must_check decode_components(u8 *buffer, size_t *offset,
 	if (result != VDO_SUCCESS)
 		return result;
 
-	result = decode_slab_depot_state_2_0(buffer, offset, &states->slab_depot);
+	result = decode_slab_depot_state_2_0(buffer, offset, &states->slab_depot,
+					     &states->compact_slab_journals);
 	if (result != VDO_SUCCESS)
 		return result;
 
@@ -1420,10 +1689,12 @@ int vdo_decode_component_states(u8 *buffer, struct volume_geometry *geometry,
 
 	/* Check the VDO volume version */
 	decode_version_number(buffer, &offset, &states->volume_version);
-	result = validate_version(VDO_VOLUME_VERSION_67_0, states->volume_version,
-				  "volume");
-	if (result != VDO_SUCCESS)
-		return result;
+	if (!vdo_are_same_version(VDO_VOLUME_VERSION_67_1, states->volume_version)) {
+		result = validate_version(VDO_VOLUME_VERSION_67_0, states->volume_version,
+					  "volume");
+		if (result != VDO_SUCCESS)
+			return result;
+	}
 
 	result = decode_components(buffer, &offset, geometry, states);
 	if (result != VDO_SUCCESS)
@@ -1468,7 +1739,8 @@ static void vdo_encode_component_states(u8 *buffer, size_t *offset,
 	encode_vdo_component(buffer, offset, states->vdo);
 	encode_layout(buffer, offset, &states->layout);
 	encode_recovery_journal_state_7_0(buffer, offset, states->recovery_journal);
-	encode_slab_depot_state_2_0(buffer, offset, states->slab_depot);
+	encode_slab_depot_state_2_0(buffer, offset, states->slab_depot,
+				    states->compact_slab_journals);
 	encode_block_map_state_2_0(buffer, offset, states->block_map);
 
 	ASSERT_LOG_ONLY(*offset == VDO_COMPONENT_DATA_OFFSET + VDO_COMPONENT_DATA_SIZE,
@@ -79,9 +79,22 @@ enum {
 	VDO_DEFAULT_GEOMETRY_BLOCK_VERSION = 5,
 };
 
+/*
+ * The function used to compute the record name of each data block. It is chosen when the volume
+ * is formatted, since the names recorded in the index are only useful to a VDO computing them the
+ * same way. A volume using any fingerprint other than MurmurHash3 has a version 5.1 geometry block,
+ * which older versions of VDO will refuse to load.
+ */
+enum vdo_fingerprint {
+	VDO_FINGERPRINT_MURMUR3 = 0,
+	VDO_FINGERPRINT_AES = 1,
+	VDO_FINGERPRINT_COUNT,
+};
+
 struct index_config {
 	u32 mem;
-	u32 unused;
+	/* The enum vdo_fingerprint used to name data blocks (unused before version 5.1) */
+	u32 fingerprint;
 	bool sparse;
 } __packed;
 
@@ -450,6 +463,12 @@ struct slab_depot_state_2_0 {
 
 extern const struct header VDO_SLAB_DEPOT_HEADER_2_0;
 
+/*
+ * A version 2.1 slab depot has the same state as version 2.0, but its slab journals may hold
+ * version 2 (VDO_METADATA_SLAB_JOURNAL_2) blocks, so older versions must not load it.
+ */
+extern const struct header VDO_SLAB_DEPOT_HEADER_2_1;
+
 /*
  * vdo_slab journal blocks may have one of two formats, depending upon whether or not any of the
  * entries in the block are block map increments. Since the steady state for a VDO is that all of
@@ -509,7 +528,7 @@ struct packed_slab_journal_block_header {
 	struct packed_journal_point recovery_point;
 	/* The 64-bit nonce for a given VDO instance */
 	__le64 nonce;
-	/* 8-bit metadata type (should always be two, for the slab journal) */
+	/* 8-bit metadata type (should be two or four, for the slab journal) */
 	u8 metadata_type;
 	/* Whether this block contains block map increments */
 	bool has_block_map_increments;
@@ -549,6 +568,54 @@ struct packed_slab_journal_block {
 	slab_journal_payload payload;
 } __packed;
 
+/*
+ * A version 2 (VDO_METADATA_SLAB_JOURNAL_2) slab journal block instead fills its payload with
+ * variable length records, each describing a run of up to 16 entries of the same type to
+ * consecutive slab block numbers. A record begins with a tag byte holding the increment flag,
+ * the block map flag, the form of the record, and the length of the run less one. The form says
+ * how the first slab block number of the run is given, relative to the slab block number which
+ * would continue the last run of the same direction (increment or decrement):
+ *
+ * VDO_SLAB_JOURNAL_RUN_CONTINUES: it is that slab block number; the record is just the tag.
+ * VDO_SLAB_JOURNAL_RUN_DELTA8: it is offset from it by a signed byte which follows the tag.
+ * VDO_SLAB_JOURNAL_RUN_DELTA16: it is offset from it by a signed little-endian 16-bit value.
+ * VDO_SLAB_JOURNAL_RUN_ABSOLUTE: it is given in full by the 24-bit little-endian value following.
+ *
+ * Sequential writes therefore cost a byte for every 16 entries, and overwrites of sequentially
+ * written data a byte per entry, against three bytes per entry in the original format.
+ */
+enum {
+	VDO_SLAB_JOURNAL_RUN_INCREMENT = 0x80,
+	VDO_SLAB_JOURNAL_RUN_BLOCK_MAP = 0x40,
+	VDO_SLAB_JOURNAL_RUN_TYPE_MASK = 0xc0,
+	VDO_SLAB_JOURNAL_RUN_FORM_MASK = 0x30,
+	VDO_SLAB_JOURNAL_RUN_CONTINUES = 0x00,
+	VDO_SLAB_JOURNAL_RUN_DELTA8 = 0x10,
+	VDO_SLAB_JOURNAL_RUN_DELTA16 = 0x20,
+	VDO_SLAB_JOURNAL_RUN_ABSOLUTE = 0x30,
+	VDO_SLAB_JOURNAL_RUN_LENGTH_MASK = 0x0f,
+	VDO_SLAB_JOURNAL_MAX_RECORD_SIZE = 4,
+	/*
+	 * Runs can pack far more entries than this into a block; the limit bounds the span of the
+	 * recovery journal which each slab journal block may keep locked.
+	 */
+	VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK = VDO_SLAB_JOURNAL_PAYLOAD_SIZE * 2,
+};
+
+/* The position of an encoder or decoder in the payload of a version 2 slab journal block */
+struct slab_journal_block_cursor {
+	/* The number of entries decoded so far */
+	journal_entry_count_t entry;
+	/* The offset in the payload of the next record */
+	u16 offset;
+	/* The offset in the payload of the current (or last) record */
+	u16 record;
+	/* The number of entries of the current record not yet decoded */
+	u8 run_remaining;
+	/* The slab block numbers which would continue the last run of decrements and increments */
+	slab_block_number next_sbn[2];
+};
+
 /* The offset of a slab journal tail block. */
 typedef u8 tail_block_offset_t;
 
@@ -661,6 +728,12 @@ struct packed_vdo_component_41_0 {
  */
 extern const struct version_number VDO_VOLUME_VERSION_67_0;
 
+/*
+ * Version 67.1 volumes may hold compressed blocks which record the compression type of their
+ * fragments. A volume is upgraded to it before any such block is written.
+ */
+extern const struct version_number VDO_VOLUME_VERSION_67_1;
+
 enum {
 	VDO_ENCODED_HEADER_SIZE = sizeof(struct packed_header),
 	BLOCK_MAP_COMPONENT_ENCODED_SIZE =
@@ -700,6 +773,8 @@ struct vdo_component_states {
 	struct block_map_state_2_0 block_map;
 	struct recovery_journal_state_7_0 recovery_journal;
 	struct slab_depot_state_2_0 slab_depot;
+	/* Whether the slab depot is version 2.1, whose slab journals may hold version 2 blocks */
+	bool compact_slab_journals;
 
 	/* Our partitioning of the underlying storage */
 	struct layout layout;
@@ -843,11 +918,16 @@ vdo_get_index_region_size(struct volume_geometry geometry)
 int __must_check vdo_parse_geometry_block(unsigned char *block,
 					  struct volume_geometry *geometry);
 
+const char * __must_check vdo_get_fingerprint_name(enum vdo_fingerprint fingerprint);
+
 #if (defined(VDO_USER) || defined(INTERNAL))
 int __must_check encode_volume_geometry(u8 *buffer, size_t *offset,
 					const struct volume_geometry *geometry,
 					u32 version);
 
+int __must_check vdo_parse_fingerprint_name(const char *name,
+					    enum vdo_fingerprint *fingerprint_ptr);
+
 #endif /* VDO_USER */
 static inline bool vdo_is_state_compressed(const enum block_mapping_state mapping_state)
 {
@@ -1261,6 +1341,29 @@ struct slab_journal_entry __must_check
 vdo_decode_slab_journal_entry(struct packed_slab_journal_block *block,
 			      journal_entry_count_t entry_count);
 
+/**
+ * vdo_slab_journal_run_block_has_room() - Check whether a version 2 slab journal block is
+ *                                         guaranteed to have room for another entry.
+ * @cursor: The encoder for the block.
+ *
+ * Return: true if any entry may be appended to the block.
+ */
+static inline bool __must_check
+vdo_slab_journal_run_block_has_room(const struct slab_journal_block_cursor *cursor)
+{
+	return ((cursor->offset + VDO_SLAB_JOURNAL_MAX_RECORD_SIZE) <=
+		VDO_SLAB_JOURNAL_PAYLOAD_SIZE);
+}
+
+void vdo_encode_slab_journal_run_entry(struct slab_journal_block_header *header,
+				       struct slab_journal_block_cursor *cursor,
+				       slab_journal_payload *payload, slab_block_number sbn,
+				       enum journal_operation operation, bool increment);
+
+int __must_check vdo_decode_next_slab_journal_entry(struct packed_slab_journal_block *block,
+						    struct slab_journal_block_cursor *cursor,
+						    struct slab_journal_entry *entry);
+
 /**
  * vdo_get_slab_summary_hint_shift() - Compute the shift for slab summary hints.
  * @slab_size_shift: Exponent for the number of blocks per slab.
@@ -1306,9 +1409,11 @@ int __must_check decode_recovery_journal_state_7_0(u8 *buffer, size_t *offset,
 						   struct recovery_journal_state_7_0 *state);
 
 void encode_slab_depot_state_2_0(u8 *buffer, size_t *offset,
-				 struct slab_depot_state_2_0 state);
+				 struct slab_depot_state_2_0 state,
+				 bool compact_slab_journals);
 int __must_check decode_slab_depot_state_2_0(u8 *buffer, size_t *offset,
-					     struct slab_depot_state_2_0 *state);
+					     struct slab_depot_state_2_0 *state,
+					     bool *compact_slab_journals);
 
 void encode_layout(u8 *buffer, size_t *offset, const struct layout *layout);
 int decode_layout(u8 *buffer, size_t *offset, physical_block_number_t start,
@@ -0,0 +1,491 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright 2023 Red Hat
+ */
+
+#include "fingerprint.h"
+
+#include <asm/unaligned.h>
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#if defined(__KERNEL__) && defined(__x86_64__)
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#include <asm/simd.h>
+#endif /* __KERNEL__ && __x86_64__ */
+
+#include "logger.h"
+#include "murmurhash3.h"
+#include "permassert.h"
+#include "string-utils.h"
+
+#include "constants.h"
+#include "status-codes.h"
+
+#if defined(__x86_64__)
+#define VDO_AESNI_FINGERPRINT
+#endif /* __x86_64__ */
+
+/*
+ * The aes fingerprint keeps four 16 byte lanes. Each lane starts as one of the keys below, XORed
+ * with the length of the data and the seed. Each 64 byte chunk of the data is absorbed by one AES
+ * round (ShiftRows, SubBytes, MixColumns) of each lane, using the lane's 16 bytes of the chunk as
+ * the round key. A partial final chunk is padded with zeros; since the length went into the
+ * initial lanes, a key does not collide with its zero-padded extension. The lanes are then folded
+ * together with three more rounds, and the result passed through four rounds keyed with the
+ * remaining keys, so that every bit of the data affects every bit of the fingerprint.
+ *
+ * This is not a cryptographic hash, any more than MurmurHash3 is; VDO compares the data of every
+ * block before sharing it. The lanes are independent, so the four rounds of a chunk overlap in
+ * the processor, and a block is fingerprinted at close to the rate it can be read from memory.
+ */
+
+enum {
+	FINGERPRINT_LANES = 4,
+	FINGERPRINT_LANE_SIZE = 16,
+	FINGERPRINT_CHUNK_SIZE = FINGERPRINT_LANES * FINGERPRINT_LANE_SIZE,
+	FINGERPRINT_FINAL_ROUNDS = 4,
+	/* The seed VDO has always used for record names. */
+	RECORD_NAME_SEED = 0x62ea60be,
+};
+
+/*
+ * The first 128 bytes of the fractional part of pi (the start of the Blowfish P-array), so that
+ * the keys hide no structure. They are bytes rather than words so that the lanes are the same on
+ * every processor.
+ */
+static const u8 FINGERPRINT_KEYS[FINGERPRINT_LANES + FINGERPRINT_FINAL_ROUNDS]
+				[FINGERPRINT_LANE_SIZE] __aligned(16) = {
+	{ 0x24, 0x3f, 0x6a, 0x88, 0x85, 0xa3, 0x08, 0xd3,
+	  0x13, 0x19, 0x8a, 0x2e, 0x03, 0x70, 0x73, 0x44 },
+	{ 0xa4, 0x09, 0x38, 0x22, 0x29, 0x9f, 0x31, 0xd0,
+	  0x08, 0x2e, 0xfa, 0x98, 0xec, 0x4e, 0x6c, 0x89 },
+	{ 0x45, 0x28, 0x21, 0xe6, 0x38, 0xd0, 0x13, 0x77,
+	  0xbe, 0x54, 0x66, 0xcf, 0x34, 0xe9, 0x0c, 0x6c },
+	{ 0xc0, 0xac, 0x29, 0xb7, 0xc9, 0x7c, 0x50, 0xdd,
+	  0x3f, 0x84, 0xd5, 0xb5, 0xb5, 0x47, 0x09, 0x17 },
+	{ 0x92, 0x16, 0xd5, 0xd9, 0x89, 0x79, 0xfb, 0x1b,
+	  0xd1, 0x31, 0x0b, 0xa6, 0x98, 0xdf, 0xb5, 0xac },
+	{ 0x2f, 0xfd, 0x72, 0xdb, 0xd0, 0x1a, 0xdf, 0xb7,
+	  0xb8, 0xe1, 0xaf, 0xed, 0x6a, 0x26, 0x7e, 0x96 },
+	{ 0xba, 0x7c, 0x90, 0x45, 0xf1, 0x2c, 0x7f, 0x99,
+	  0x24, 0xa1, 0x99, 0x47, 0xb3, 0x91, 0x6c, 0xf7 },
+	{ 0x08, 0x01, 0xf2, 0xe2, 0x85, 0x8e, 0xfc, 0x16,
+	  0x63, 0x69, 0x20, 0xd8, 0x71, 0x57, 0x4e, 0x69 },
+};
+
+struct fingerprint_ops {
+	const char *name;
+	/* Absorb a run of whole chunks into the lanes. */
+	void (*absorb)(u8 lanes[][FINGERPRINT_LANE_SIZE], const u8 *data, unsigned int chunks);
+	/* Fold the lanes into the fingerprint. */
+	void (*finish)(u8 lanes[][FINGERPRINT_LANE_SIZE], u8 *out);
+	/* Whether the variant uses vector registers, and so needs to save the FPU state. */
+	bool uses_fpu;
+};
+
+/*
+ * The SubBytes and MixColumns contribution of the first byte of a column to each byte of the
+ * column, as a little-endian word; the other bytes' contributions are rotations of it.
+ */
+static const u32 AES_ROUND_TABLE[256] = {
+	0xa56363c6, 0x847c7cf8, 0x997777ee, 0x8d7b7bf6,
+	0x0df2f2ff, 0xbd6b6bd6, 0xb16f6fde, 0x54c5c591,
+	0x50303060, 0x03010102, 0xa96767ce, 0x7d2b2b56,
+	0x19fefee7, 0x62d7d7b5, 0xe6abab4d, 0x9a7676ec,
+	0x45caca8f, 0x9d82821f, 0x40c9c989, 0x877d7dfa,
+	0x15fafaef, 0xeb5959b2, 0xc947478e, 0x0bf0f0fb,
+	0xecadad41, 0x67d4d4b3, 0xfda2a25f, 0xeaafaf45,
+	0xbf9c9c23, 0xf7a4a453, 0x967272e4, 0x5bc0c09b,
+	0xc2b7b775, 0x1cfdfde1, 0xae93933d, 0x6a26264c,
+	0x5a36366c, 0x413f3f7e, 0x02f7f7f5, 0x4fcccc83,
+	0x5c343468, 0xf4a5a551, 0x34e5e5d1, 0x08f1f1f9,
+	0x937171e2, 0x73d8d8ab, 0x53313162, 0x3f15152a,
+	0x0c040408, 0x52c7c795, 0x65232346, 0x5ec3c39d,
+	0x28181830, 0xa1969637, 0x0f05050a, 0xb59a9a2f,
+	0x0907070e, 0x36121224, 0x9b80801b, 0x3de2e2df,
+	0x26ebebcd, 0x6927274e, 0xcdb2b27f, 0x9f7575ea,
+	0x1b090912, 0x9e83831d, 0x742c2c58, 0x2e1a1a34,
+	0x2d1b1b36, 0xb26e6edc, 0xee5a5ab4, 0xfba0a05b,
+	0xf65252a4, 0x4d3b3b76, 0x61d6d6b7, 0xceb3b37d,
+	0x7b292952, 0x3ee3e3dd, 0x712f2f5e, 0x97848413,
+	0xf55353a6, 0x68d1d1b9, 0x00000000, 0x2cededc1,
+	0x60202040, 0x1ffcfce3, 0xc8b1b179, 0xed5b5bb6,
+	0xbe6a6ad4, 0x46cbcb8d, 0xd9bebe67, 0x4b393972,
+	0xde4a4a94, 0xd44c4c98, 0xe85858b0, 0x4acfcf85,
+	0x6bd0d0bb, 0x2aefefc5, 0xe5aaaa4f, 0x16fbfbed,
+	0xc5434386, 0xd74d4d9a, 0x55333366, 0x94858511,
+	0xcf45458a, 0x10f9f9e9, 0x06020204, 0x817f7ffe,
+	0xf05050a0, 0x443c3c78, 0xba9f9f25, 0xe3a8a84b,
+	0xf35151a2, 0xfea3a35d, 0xc0404080, 0x8a8f8f05,
+	0xad92923f, 0xbc9d9d21, 0x48383870, 0x04f5f5f1,
+	0xdfbcbc63, 0xc1b6b677, 0x75dadaaf, 0x63212142,
+	0x30101020, 0x1affffe5, 0x0ef3f3fd, 0x6dd2d2bf,
+	0x4ccdcd81, 0x140c0c18, 0x35131326, 0x2fececc3,
+	0xe15f5fbe, 0xa2979735, 0xcc444488, 0x3917172e,
+	0x57c4c493, 0xf2a7a755, 0x827e7efc, 0x473d3d7a,
+	0xac6464c8, 0xe75d5dba, 0x2b191932, 0x957373e6,
+	0xa06060c0, 0x98818119, 0xd14f4f9e, 0x7fdcdca3,
+	0x66222244, 0x7e2a2a54, 0xab90903b, 0x8388880b,
+	0xca46468c, 0x29eeeec7, 0xd3b8b86b, 0x3c141428,
+	0x79dedea7, 0xe25e5ebc, 0x1d0b0b16, 0x76dbdbad,
+	0x3be0e0db, 0x56323264, 0x4e3a3a74, 0x1e0a0a14,
+	0xdb494992, 0x0a06060c, 0x6c242448, 0xe45c5cb8,
+	0x5dc2c29f, 0x6ed3d3bd, 0xefacac43, 0xa66262c4,
+	0xa8919139, 0xa4959531, 0x37e4e4d3, 0x8b7979f2,
+	0x32e7e7d5, 0x43c8c88b, 0x5937376e, 0xb76d6dda,
+	0x8c8d8d01, 0x64d5d5b1, 0xd24e4e9c, 0xe0a9a949,
+	0xb46c6cd8, 0xfa5656ac, 0x07f4f4f3, 0x25eaeacf,
+	0xaf6565ca, 0x8e7a7af4, 0xe9aeae47, 0x18080810,
+	0xd5baba6f, 0x887878f0, 0x6f25254a, 0x722e2e5c,
+	0x241c1c38, 0xf1a6a657, 0xc7b4b473, 0x51c6c697,
+	0x23e8e8cb, 0x7cdddda1, 0x9c7474e8, 0x211f1f3e,
+	0xdd4b4b96, 0xdcbdbd61, 0x868b8b0d, 0x858a8a0f,
+	0x907070e0, 0x423e3e7c, 0xc4b5b571, 0xaa6666cc,
+	0xd8484890, 0x05030306, 0x01f6f6f7, 0x120e0e1c,
+	0xa36161c2, 0x5f35356a, 0xf95757ae, 0xd0b9b969,
+	0x91868617, 0x58c1c199, 0x271d1d3a, 0xb99e9e27,
+	0x38e1e1d9, 0x13f8f8eb, 0xb398982b, 0x33111122,
+	0xbb6969d2, 0x70d9d9a9, 0x898e8e07, 0xa7949433,
+	0xb69b9b2d, 0x221e1e3c, 0x92878715, 0x20e9e9c9,
+	0x49cece87, 0xff5555aa, 0x78282850, 0x7adfdfa5,
+	0x8f8c8c03, 0xf8a1a159, 0x80898909, 0x170d0d1a,
+	0xdabfbf65, 0x31e6e6d7, 0xc6424284, 0xb86868d0,
+	0xc3414182, 0xb0999929, 0x772d2d5a, 0x110f0f1e,
+	0xcbb0b07b, 0xfc5454a8, 0xd6bbbb6d, 0x3a16162c,
+};
+
+/* Replace a lane with one AES round of it, as the AESENC instruction does. */
+static void software_aes_round(u8 *lane, const u8 *key)
+{
+	u32 in[4], out[4];
+	unsigned int c;
+
+	for (c = 0; c < 4; c++)
+		in[c] = get_unaligned_le32(&lane[4 * c]);
+
+	/* ShiftRows takes row r of output column c from input column c + r. */
+	for (c = 0; c < 4; c++) {
+		out[c] = (AES_ROUND_TABLE[in[c] & 0xff] ^
+			  rol32(AES_ROUND_TABLE[(in[(c + 1) % 4] >> 8) & 0xff], 8) ^
+			  rol32(AES_ROUND_TABLE[(in[(c + 2) % 4] >> 16) & 0xff], 16) ^
+			  rol32(AES_ROUND_TABLE[in[(c + 3) % 4] >> 24], 24) ^
+			  get_unaligned_le32(&key[4 * c]));
+	}
+
+	for (c = 0; c < 4; c++)
+		put_unaligned_le32(out[c], &lane[4 * c]);
+}
+
+static void software_absorb(u8 lanes[][FINGERPRINT_LANE_SIZE], const u8 *data,
+			    unsigned int chunks)
+{
+	unsigned int i;
+
+	for (; chunks > 0; chunks--, data += FINGERPRINT_CHUNK_SIZE) {
+		for (i = 0; i < FINGERPRINT_LANES; i++)
+			software_aes_round(lanes[i], &data[i * FINGERPRINT_LANE_SIZE]);
+	}
+}
+
+static void software_finish(u8 lanes[][FINGERPRINT_LANE_SIZE], u8 *out)
+{
+	unsigned int i;
+
+	software_aes_round(lanes[0], lanes[1]);
+	software_aes_round(lanes[2], lanes[3]);
+	software_aes_round(lanes[0], lanes[2]);
+	for (i = 0; i < FINGERPRINT_FINAL_ROUNDS; i++)
+		software_aes_round(lanes[0], FINGERPRINT_KEYS[FINGERPRINT_LANES + i]);
+
+	memcpy(out, lanes[0], FINGERPRINT_LANE_SIZE);
+}
+
+static const struct fingerprint_ops software_ops = {
+	.name = "software",
+	.absorb = software_absorb,
+	.finish = software_finish,
+	.uses_fpu = false,
+};
+
+#ifdef VDO_AESNI_FINGERPRINT
+/*
+ * The AES-NI variant is written with inline assembly rather than compiler intrinsics since the
+ * kernel is built without SSE code generation enabled. Each asm statement keeps the lanes in
+ * registers only for its own duration.
+ */
+
+static void aesni_absorb(u8 lanes[][FINGERPRINT_LANE_SIZE], const u8 *data, unsigned int chunks)
+{
+	asm volatile("movdqu     (%[lanes]), %%xmm0\n\t"
+		     "movdqu   16(%[lanes]), %%xmm1\n\t"
+		     "movdqu   32(%[lanes]), %%xmm2\n\t"
+		     "movdqu   48(%[lanes]), %%xmm3\n\t"
+		     "1:\n\t"
+		     "movdqu     (%[p]), %%xmm4\n\t"
+		     "movdqu   16(%[p]), %%xmm5\n\t"
+		     "movdqu   32(%[p]), %%xmm6\n\t"
+		     "movdqu   48(%[p]), %%xmm7\n\t"
+		     "aesenc   %%xmm4, %%xmm0\n\t"
+		     "aesenc   %%xmm5, %%xmm1\n\t"
+		     "aesenc   %%xmm6, %%xmm2\n\t"
+		     "aesenc   %%xmm7, %%xmm3\n\t"
+		     "add      $64, %[p]\n\t"
+		     "dec      %[n]\n\t"
+		     "jnz      1b\n\t"
+		     "movdqu   %%xmm0,   (%[lanes])\n\t"
+		     "movdqu   %%xmm1, 16(%[lanes])\n\t"
+		     "movdqu   %%xmm2, 32(%[lanes])\n\t"
+		     "movdqu   %%xmm3, 48(%[lanes])\n\t"
+		     : [p] "+r" (data), [n] "+r" (chunks)
+		     : [lanes] "r" (lanes)
+		     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "cc",
+		       "memory");
+}
+
+static void aesni_finish(u8 lanes[][FINGERPRINT_LANE_SIZE], u8 *out)
+{
+	asm volatile("movdqu     (%[lanes]), %%xmm0\n\t"
+		     "movdqu   16(%[lanes]), %%xmm1\n\t"
+		     "movdqu   32(%[lanes]), %%xmm2\n\t"
+		     "movdqu   48(%[lanes]), %%xmm3\n\t"
+		     "aesenc   %%xmm1, %%xmm0\n\t"
+		     "aesenc   %%xmm3, %%xmm2\n\t"
+		     "aesenc   %%xmm2, %%xmm0\n\t"
+		     "movdqu     (%[keys]), %%xmm4\n\t"
+		     "movdqu   16(%[keys]), %%xmm5\n\t"
+		     "movdqu   32(%[keys]), %%xmm6\n\t"
+		     "movdqu   48(%[keys]), %%xmm7\n\t"
+		     "aesenc   %%xmm4, %%xmm0\n\t"
+		     "aesenc   %%xmm5, %%xmm0\n\t"
+		     "aesenc   %%xmm6, %%xmm0\n\t"
+		     "aesenc   %%xmm7, %%xmm0\n\t"
+		     "movdqu   %%xmm0, (%[out])\n\t"
+		     :
+		     : [lanes] "r" (lanes), [keys] "r" (FINGERPRINT_KEYS[FINGERPRINT_LANES]),
+		       [out] "r" (out)
+		     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+		       "memory");
+}
+
+static const struct fingerprint_ops aesni_ops = {
+	.name = "aesni",
+	.absorb = aesni_absorb,
+	.finish = aesni_finish,
+	.uses_fpu = true,
+};
+
+#ifdef __KERNEL__
+static bool cpu_supports_aesni(void)
+{
+	return boot_cpu_has(X86_FEATURE_AES);
+}
+
+static inline bool begin_vector_section(void)
+{
+	if (!may_use_simd())
+		return false;
+
+	kernel_fpu_begin();
+	return true;
+}
+
+static inline void end_vector_section(void)
+{
+	kernel_fpu_end();
+}
+#else /* not __KERNEL__ */
+static bool cpu_supports_aesni(void)
+{
+	return __builtin_cpu_supports("aes");
+}
+
+static inline bool begin_vector_section(void)
+{
+	return true;
+}
+
+static inline void end_vector_section(void)
+{
+}
+#endif /* __KERNEL__ */
+#endif /* VDO_AESNI_FINGERPRINT */
+
+/* All the variants, ordered from least to most preferred. */
+static const struct fingerprint_ops *all_ops[] = {
+	&software_ops,
+#ifdef VDO_AESNI_FINGERPRINT
+	&aesni_ops,
+#endif /* VDO_AESNI_FINGERPRINT */
+};
+
+static const struct fingerprint_ops *selected_ops = &software_ops;
+
+static bool is_variant_supported(const struct fingerprint_ops *ops)
+{
+#ifdef VDO_AESNI_FINGERPRINT
+	if (ops == &aesni_ops)
+		return cpu_supports_aesni();
+#endif /* VDO_AESNI_FINGERPRINT */
+
+	return true;
+}
+
+/**
+ * vdo_initialize_fingerprints() - Select the fastest aes fingerprint variant supported by this
+ *                                 processor.
+ *
+ * This must be called once, at module load, before any data_vios are launched.
+ */
+void vdo_initialize_fingerprints(void)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(all_ops) - 1; i >= 0; i--) {
+		if (is_variant_supported(all_ops[i])) {
+			selected_ops = all_ops[i];
+			break;
+		}
+	}
+
+	uds_log_info("using %s aes fingerprints", selected_ops->name);
+}
+
+/**
+ * vdo_is_fingerprint_accelerated() - Check whether a fingerprint can be computed at full speed on
+ *                                    this processor.
+ * @fingerprint: The fingerprint to check.
+ *
+ * Return: false if the fingerprint must be computed in software.
+ */
+bool vdo_is_fingerprint_accelerated(enum vdo_fingerprint fingerprint)
+{
+	return ((fingerprint != VDO_FINGERPRINT_AES) || READ_ONCE(selected_ops)->uses_fpu);
+}
+
+static inline const struct fingerprint_ops *begin_fingerprints(void)
+{
+#ifdef VDO_AESNI_FINGERPRINT
+	const struct fingerprint_ops *ops = READ_ONCE(selected_ops);
+
+	if (!ops->uses_fpu || begin_vector_section())
+		return ops;
+
+	/* Vector registers can't be used in this context, so fall back to the software rounds. */
+#endif /* VDO_AESNI_FINGERPRINT */
+	return &software_ops;
+}
+
+static inline void end_fingerprints(const struct fingerprint_ops *ops)
+{
+#ifdef VDO_AESNI_FINGERPRINT
+	if (ops->uses_fpu)
+		end_vector_section();
+#endif /* VDO_AESNI_FINGERPRINT */
+}
+
+static void aes_fingerprint(const struct fingerprint_ops *ops, const u8 *key, unsigned int len,
+			    u32 seed, u8 *out)
+{
+	u8 lanes[FINGERPRINT_LANES][FINGERPRINT_LANE_SIZE] __aligned(16);
+	u8 parameters[FINGERPRINT_LANE_SIZE];
+	unsigned int chunks = len / FINGERPRINT_CHUNK_SIZE;
+	unsigned int tail = len % FINGERPRINT_CHUNK_SIZE;
+	unsigned int i, j;
+
+	put_unaligned_le64(len, &parameters[0]);
+	put_unaligned_le32(seed, &parameters[8]);
+	put_unaligned_le32(0, &parameters[12]);
+	for (i = 0; i < FINGERPRINT_LANES; i++) {
+		for (j = 0; j < FINGERPRINT_LANE_SIZE; j++)
+			lanes[i][j] = FINGERPRINT_KEYS[i][j] ^ parameters[j];
+	}
+
+	if (chunks > 0)
+		ops->absorb(lanes, key, chunks);
+
+	if (tail > 0) {
+		u8 padded[FINGERPRINT_CHUNK_SIZE] = { 0 };
+
+		memcpy(padded, &key[chunks * FINGERPRINT_CHUNK_SIZE], tail);
+		ops->absorb(lanes, padded, 1);
+	}
+
+	ops->finish(lanes, out);
+}
+
+/**
+ * vdo_aes_fingerprint_128() - Compute the aes fingerprint of an arbitrary key.
+ * @key: The data to fingerprint.
+ * @len: The length of the data in bytes.
+ * @seed: The seed for the fingerprint.
+ * @out: A buffer to receive the 16 byte fingerprint.
+ */
+void vdo_aes_fingerprint_128(const void *key, unsigned int len, u32 seed, void *out)
+{
+	const struct fingerprint_ops *ops = begin_fingerprints();
+
+	aes_fingerprint(ops, key, len, seed, out);
+	end_fingerprints(ops);
+}
+
+/**
+ * vdo_compute_fingerprints() - Compute the record names of a batch of data blocks.
+ * @fingerprint: The fingerprint the volume uses for record names.
+ * @blocks: The data blocks, each VDO_BLOCK_SIZE bytes.
+ * @count: The number of blocks.
+ * @names: The record names to fill in.
+ *
+ * The FPU state is saved once for the whole batch, so a batch should be short.
+ */
+void vdo_compute_fingerprints(enum vdo_fingerprint fingerprint, const void *const blocks[],
+			      unsigned int count, void *const names[])
+{
+	const struct fingerprint_ops *ops;
+	unsigned int i;
+
+	if (fingerprint == VDO_FINGERPRINT_MURMUR3) {
+		murmurhash3_128_multi(blocks, count, VDO_BLOCK_SIZE, RECORD_NAME_SEED, names);
+		return;
+	}
+
+	ops = begin_fingerprints();
+	for (i = 0; i < count; i++)
+		aes_fingerprint(ops, blocks[i], VDO_BLOCK_SIZE, RECORD_NAME_SEED, names[i]);
+	end_fingerprints(ops);
+}
+
+#ifdef INTERNAL
+/**
+ * vdo_get_fingerprint_variant() - Get the name of the aes fingerprint variant in use.
+ */
+const char *vdo_get_fingerprint_variant(void)
+{
+	return selected_ops->name;
+}
+
+/**
+ * vdo_set_fingerprint_variant() - Override the aes fingerprint variant (for testing).
+ * @name: The name of the variant to use.
+ *
+ * Return: VDO_SUCCESS, or VDO_NOT_IMPLEMENTED if the variant is unknown or not supported by this
+ *         processor.
+ */
+int vdo_set_fingerprint_variant(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(all_ops); i++) {
+		if (strcmp(name, all_ops[i]->name) != 0)
+			continue;
+
+		if (!is_variant_supported(all_ops[i]))
+			break;
+
+		selected_ops = all_ops[i];
+		return VDO_SUCCESS;
+	}
+
+	return VDO_NOT_IMPLEMENTED;
+}
+#endif /* INTERNAL */
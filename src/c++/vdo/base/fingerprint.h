@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright 2023 Red Hat
+ */
+
+#ifndef VDO_FINGERPRINT_H
+#define VDO_FINGERPRINT_H
+
+#include <linux/compiler.h>
+#include <linux/types.h>
+
+#include "encodings.h"
+
+/*
+ * The fingerprint of a data block is the 128-bit hash used as its record name in the deduplication
+ * index. Which hash is used is chosen when the volume is formatted, and recorded in the volume
+ * geometry and in the index configuration (see enum vdo_fingerprint). MurmurHash3 is the original
+ * choice. The aes fingerprint absorbs each 16 bytes of data with a single AES round, in four
+ * independent lanes, which the AES-NI instructions on x86_64 do several times faster than
+ * MurmurHash3. On processors without AES-NI, and in contexts which may not use the FPU, an
+ * equivalent table-driven round is computed in software, so every VDO computes the same names.
+ */
+
+void vdo_initialize_fingerprints(void);
+
+bool __must_check vdo_is_fingerprint_accelerated(enum vdo_fingerprint fingerprint);
+
+void vdo_aes_fingerprint_128(const void *key, unsigned int len, u32 seed, void *out);
+
+void vdo_compute_fingerprints(enum vdo_fingerprint fingerprint, const void *const blocks[],
+			      unsigned int count, void *const names[]);
+
+#ifdef INTERNAL
+const char *vdo_get_fingerprint_variant(void);
+int __must_check vdo_set_fingerprint_variant(const char *name);
+#endif /* INTERNAL */
+
+#endif /* VDO_FINGERPRINT_H */
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright 2023 Red Hat
+ */
+
+#ifndef VDO_WORK_QUEUE_INTERNALS_H
+#define VDO_WORK_QUEUE_INTERNALS_H
+
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include "funnel-queue.h"
+
+#include "funnel-workqueue.h"
+
+/**
+ * DOC: Work queue definition.
+ *
+ * There are two types of work queues: simple, with one worker thread, and round-robin, which uses
+ * a group of the former to do the work, and assigns work to them in round-robin fashion (roughly).
+ * Externally, both are represented via the same common sub-structure, though there's actually not
+ * a great deal of overlap between the two types internally.
+ *
+ * A round-robin queue whose type allows it may also do work stealing: a worker which runs out of
+ * its own work takes waiting completions from its siblings, so that one slow completion does not
+ * hold up the work assigned behind it while other workers are idle.
+ */
+struct vdo_work_queue {
+	/* Name of just the work queue (e.g., "cpuQ12") */
+	char *name;
+	bool round_robin_mode;
+	struct vdo_thread *owner;
+	/* Life cycle functions, etc */
+	const struct vdo_work_queue_type *type;
+};
+
+struct simple_work_queue {
+	struct vdo_work_queue common;
+	struct funnel_queue *priority_lists[VDO_WORK_Q_MAX_PRIORITY + 1];
+	void *private;
+
+	/*
+	 * The fields above are unchanged after setup but often read, and are good candidates for
+	 * caching -- and if the max priority is 2, just fit in one x86-64 cache line if aligned.
+	 * The fields below are often modified as we sleep and wake, so we want a separate cache
+	 * line for performance.
+	 */
+
+	/* Any (0 or 1) worker threads waiting for new work to do */
+	wait_queue_head_t waiting_worker_threads ____cacheline_aligned;
+	/* Hack to reduce wakeup calls if the worker thread is running */
+	atomic_t idle;
+	/* The round-robin queue whose siblings this queue steals from, if work stealing */
+	struct round_robin_work_queue *group;
+	/*
+	 * In a work-stealing group, the funnel queues may be polled by siblings as well as by the
+	 * worker, so each poll must hold this lock to keep the queues single-consumer.
+	 */
+	spinlock_t consumer_lock;
+	/* The number of completions this worker has taken from its siblings */
+	u64 steals;
+
+	/*
+	 * Written only by the worker thread. The average gap (in nanoseconds) between running out
+	 * of work and finding more determines whether, and for how long, the worker spins.
+	 */
+	u64 average_idle_gap;
+	/* The number of times the worker went to sleep and was woken */
+	u64 wakeups;
+	/* The number of times the worker spun and found work, or spun and then slept */
+	u64 spin_hits;
+	u64 spin_misses;
+
+	/*
+	 * Completions this worker has enqueued during an open batch but not yet published to
+	 * their queues. Only the worker thread touches these.
+	 */
+	unsigned int batch_depth;
+	unsigned int batch_count;
+	struct vdo_completion *batch[VDO_ENQUEUE_BATCH_SIZE];
+
+	/* These are infrequently used so in terms of performance we don't care where they land. */
+	struct task_struct *thread;
+	/* Notify creator once worker has initialized */
+	struct completion *started;
+};
+
+struct round_robin_work_queue {
+	struct vdo_work_queue common;
+	struct simple_work_queue **service_queues;
+	unsigned int num_service_queues;
+	/* Whether idle service queue threads take completions from busy siblings */
+	bool work_stealing;
+};
+
+static inline struct simple_work_queue *as_simple_work_queue(struct vdo_work_queue *queue)
+{
+	return ((queue == NULL) ?
+		NULL : container_of(queue, struct simple_work_queue, common));
+}
+
+static inline struct round_robin_work_queue *as_round_robin_work_queue(struct vdo_work_queue *queue)
+{
+	return ((queue == NULL) ?
+		 NULL :
+		 container_of(queue, struct round_robin_work_queue, common));
+}
+
+/*
+ * Work stealing, shared between the queues of a round-robin group. These are kept apart from the
+ * rest of the work queue code so that they can be tested in user space.
+ */
+bool __must_check vdo_work_queue_has_backlog(struct simple_work_queue *queue);
+struct vdo_completion * __must_check vdo_steal_completion(struct simple_work_queue *queue);
+void vdo_wake_idle_sibling(struct simple_work_queue *queue);
+
+#endif /* VDO_WORK_QUEUE_INTERNALS_H */
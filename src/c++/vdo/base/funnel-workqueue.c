@@ -8,9 +8,14 @@
 #include <linux/atomic.h>
 #include <linux/cache.h>
 #include <linux/completion.h>
+#include <linux/cpumask.h>
 #include <linux/err.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/topology.h>
 #ifndef VDO_UPSTREAM
 #include <linux/version.h>
 #endif /* VDO_UPSTREAM */
@@ -23,69 +28,21 @@
 #include "string-utils.h"
 
 #include "completion.h"
+#include "funnel-workqueue-internals.h"
 #include "status-codes.h"
 
 static DEFINE_PER_CPU(unsigned int, service_queue_rotor);
 
-/**
- * DOC: Work queue definition.
- *
- * There are two types of work queues: simple, with one worker thread, and round-robin, which uses
- * a group of the former to do the work, and assigns work to them in round-robin fashion (roughly).
- * Externally, both are represented via the same common sub-structure, though there's actually not
- * a great deal of overlap between the two types internally.
- */
-struct vdo_work_queue {
-	/* Name of just the work queue (e.g., "cpuQ12") */
-	char *name;
-	bool round_robin_mode;
-	struct vdo_thread *owner;
-	/* Life cycle functions, etc */
-	const struct vdo_work_queue_type *type;
-};
-
-struct simple_work_queue {
-	struct vdo_work_queue common;
-	struct funnel_queue *priority_lists[VDO_WORK_Q_MAX_PRIORITY + 1];
-	void *private;
-
-	/*
-	 * The fields above are unchanged after setup but often read, and are good candidates for
-	 * caching -- and if the max priority is 2, just fit in one x86-64 cache line if aligned.
-	 * The fields below are often modified as we sleep and wake, so we want a separate cache
-	 * line for performance.
-	 */
-
-	/* Any (0 or 1) worker threads waiting for new work to do */
-	wait_queue_head_t waiting_worker_threads ____cacheline_aligned;
-	/* Hack to reduce wakeup calls if the worker thread is running */
-	atomic_t idle;
-
-	/* These are infrequently used so in terms of performance we don't care where they land. */
-	struct task_struct *thread;
-	/* Notify creator once worker has initialized */
-	struct completion *started;
-};
+unsigned int vdo_work_queue_spin_limit;
+bool vdo_work_queue_stealing;
 
-struct round_robin_work_queue {
-	struct vdo_work_queue common;
-	struct simple_work_queue **service_queues;
-	unsigned int num_service_queues;
+enum {
+	/* The weight of the newest idle gap in the average, as a power of two */
+	IDLE_GAP_WEIGHT_SHIFT = 3,
+	/* The most completions the worker takes off its queues before running them */
+	MAX_DRAINED_COMPLETIONS = 16,
 };
 
-static inline struct simple_work_queue *as_simple_work_queue(struct vdo_work_queue *queue)
-{
-	return ((queue == NULL) ?
-		NULL : container_of(queue, struct simple_work_queue, common));
-}
-
-static inline struct round_robin_work_queue *as_round_robin_work_queue(struct vdo_work_queue *queue)
-{
-	return ((queue == NULL) ?
-		 NULL :
-		 container_of(queue, struct round_robin_work_queue, common));
-}
-
 /* Processing normal completions. */
 
 /*
@@ -96,22 +53,83 @@ static inline struct round_robin_work_queue *as_round_robin_work_queue(struct vd
  * we'll grab the latter (but we'll catch the high-priority item on the next call). If strict
  * enforcement of priorities becomes necessary, this function will need fixing.
  */
-static struct vdo_completion *poll_for_completion(struct simple_work_queue *queue)
+static struct vdo_completion *poll_own_queue(struct simple_work_queue *queue)
 {
+	struct vdo_completion *completion = NULL;
 	int i;
 
+	if (queue->group != NULL)
+		spin_lock(&queue->consumer_lock);
+
 	for (i = queue->common.type->max_priority; i >= 0; i--) {
 		struct funnel_queue_entry *link = uds_funnel_queue_poll(queue->priority_lists[i]);
 
-		if (link != NULL)
-			return container_of(link, struct vdo_completion, work_queue_entry_link);
+		if (link != NULL) {
+			completion = container_of(link, struct vdo_completion,
+						  work_queue_entry_link);
+			break;
+		}
 	}
 
-	return NULL;
+	if (queue->group != NULL)
+		spin_unlock(&queue->consumer_lock);
+
+	return completion;
 }
 
-static void enqueue_work_queue_completion(struct simple_work_queue *queue,
-					  struct vdo_completion *completion)
+/*
+ * Return the next completion for this worker: its own, if any, or else one stolen from a sibling.
+ */
+static struct vdo_completion *poll_for_completion(struct simple_work_queue *queue)
+{
+	struct vdo_completion *completion = poll_own_queue(queue);
+
+	if ((completion != NULL) || (queue->group == NULL))
+		return completion;
+
+	return vdo_steal_completion(queue);
+}
+
+/*
+ * Take up to MAX_DRAINED_COMPLETIONS waiting completions off the queue, highest priority first,
+ * so that they can be run without going back to the shared queue for each one. The same priority
+ * race described for poll_for_completion() applies, and a completion of higher priority enqueued
+ * while the drained ones are running waits for at most one drained batch.
+ */
+static unsigned int drain_completions(struct simple_work_queue *queue,
+				      struct vdo_completion **completions)
+{
+	unsigned int count = 0;
+	int i;
+
+	/*
+	 * Drained completions can't be stolen, so a worker in a work-stealing group takes just one
+	 * at a time and leaves the rest to whichever thread becomes free first.
+	 */
+	if (queue->group != NULL) {
+		completions[0] = poll_own_queue(queue);
+		return (completions[0] == NULL) ? 0 : 1;
+	}
+
+	for (i = queue->common.type->max_priority; i >= 0; i--) {
+		while (count < MAX_DRAINED_COMPLETIONS) {
+			struct funnel_queue_entry *link =
+				uds_funnel_queue_poll(queue->priority_lists[i]);
+
+			if (link == NULL)
+				break;
+
+			completions[count++] = container_of(link, struct vdo_completion,
+							    work_queue_entry_link);
+		}
+	}
+
+	return count;
+}
+
+/* Prepare a completion to be put on one of the queue's priority lists. */
+static void prepare_completion(struct simple_work_queue *queue,
+			       struct vdo_completion *completion)
 {
 	ASSERT_LOG_ONLY(completion->my_queue == NULL,
 			"completion %px (fn %px) to enqueue (%px) is not already queued (%px)",
@@ -124,11 +142,15 @@ static void enqueue_work_queue_completion(struct simple_work_queue *queue,
 		completion->priority = 0;
 
 	completion->my_queue = &queue->common;
+}
 
-	/* Funnel queue handles the synchronization for the put. */
-	uds_funnel_queue_put(queue->priority_lists[completion->priority],
-			     &completion->work_queue_entry_link);
-
+/*
+ * Wake the worker thread if it might be asleep, after completions have been put on its queue. If
+ * the worker is busy and other completions were already waiting behind it, wake an idle sibling
+ * in its work-stealing group instead, if there is one.
+ */
+static void wake_worker(struct simple_work_queue *queue, bool backlogged)
+{
 	/*
 	 * Due to how funnel queue synchronization is handled (just atomic operations), the
 	 * simplest safe implementation here would be to wake-up any waiting threads after
@@ -146,11 +168,75 @@ static void enqueue_work_queue_completion(struct simple_work_queue *queue,
 	 * first is any better or worse for other platforms, even other x86 configurations.
 	 */
 	smp_mb();
-	if ((atomic_read(&queue->idle) != 1) || (atomic_cmpxchg(&queue->idle, 1, 0) != 1))
+	if ((atomic_read(&queue->idle) == 1) && (atomic_cmpxchg(&queue->idle, 1, 0) == 1)) {
+		/* There's a maximum of one thread in this list. */
+		wake_up(&queue->waiting_worker_threads);
 		return;
+	}
+
+	/*
+	 * The worker is busy. If the new work would only wait for the completion it is running,
+	 * waking a sibling costs more than it saves.
+	 */
+	if (backlogged && (queue->group != NULL))
+		vdo_wake_idle_sibling(queue);
+}
+
+static void enqueue_work_queue_completion(struct simple_work_queue *queue,
+					  struct vdo_completion *completion)
+{
+	bool backlogged;
+
+	prepare_completion(queue, completion);
+	backlogged = vdo_work_queue_has_backlog(queue);
+
+	/* Funnel queue handles the synchronization for the put. */
+	uds_funnel_queue_put(queue->priority_lists[completion->priority],
+			     &completion->work_queue_entry_link);
+	wake_worker(queue, backlogged);
+}
+
+/*
+ * Publish the completions held back by an enqueue batch. The completions bound for each priority
+ * list of each queue are linked into a chain, in the order they were enqueued, and put on that
+ * list with a single atomic exchange.
+ */
+static void flush_enqueue_batch(struct simple_work_queue *current_queue)
+{
+	struct vdo_completion **batch = current_queue->batch;
+	unsigned int count = current_queue->batch_count;
+	unsigned int i, j;
+
+	for (i = 0; i < count; i++) {
+		struct vdo_completion *first = batch[i];
+		struct vdo_completion *last = first;
+		struct simple_work_queue *queue;
+		bool backlogged;
+
+		if (first == NULL)
+			continue;
+
+		for (j = i + 1; j < count; j++) {
+			struct vdo_completion *completion = batch[j];
+
+			if ((completion == NULL) || (completion->my_queue != first->my_queue) ||
+			    (completion->priority != first->priority))
+				continue;
 
-	/* There's a maximum of one thread in this list. */
-	wake_up(&queue->waiting_worker_threads);
+			last->work_queue_entry_link.next = &completion->work_queue_entry_link;
+			last = completion;
+			batch[j] = NULL;
+		}
+
+		queue = as_simple_work_queue(first->my_queue);
+		backlogged = ((first != last) || vdo_work_queue_has_backlog(queue));
+		uds_funnel_queue_put_chain(queue->priority_lists[first->priority],
+					   &first->work_queue_entry_link,
+					   &last->work_queue_entry_link);
+		wake_worker(queue, backlogged);
+	}
+
+	current_queue->batch_count = 0;
 }
 
 static void run_start_hook(struct simple_work_queue *queue)
@@ -165,6 +251,50 @@ static void run_finish_hook(struct simple_work_queue *queue)
 		queue->common.type->finish(queue->private);
 }
 
+/*
+ * Poll for the next completion for as long as more work is expected to arrive soon, based on the
+ * recent gaps between running out of work and finding more. Spinning is only worthwhile when the
+ * expected gap is shorter than the configured limit; otherwise the worker goes straight to sleep.
+ * Since the idle flag stays clear while spinning, producers do not try to wake the worker.
+ */
+static struct vdo_completion *spin_for_completion(struct simple_work_queue *queue, u64 start)
+{
+	u64 limit = READ_ONCE(vdo_work_queue_spin_limit) * NSEC_PER_USEC;
+	u64 deadline;
+
+	if ((limit == 0) || (queue->average_idle_gap > limit))
+		return NULL;
+
+	/* Allow for a gap somewhat longer than the average before giving up. */
+	deadline = start + min(limit, 2 * queue->average_idle_gap + NSEC_PER_USEC);
+	do {
+		struct vdo_completion *completion = poll_for_completion(queue);
+
+		if (completion != NULL) {
+			WRITE_ONCE(queue->spin_hits, queue->spin_hits + 1);
+			return completion;
+		}
+
+		if (need_resched() || kthread_should_stop())
+			break;
+
+		cpu_relax();
+	} while (ktime_get_ns() < deadline);
+
+	WRITE_ONCE(queue->spin_misses, queue->spin_misses + 1);
+	return NULL;
+}
+
+/* Fold the gap between running out of work and finding more into the running average. */
+static void record_idle_gap(struct simple_work_queue *queue, u64 start)
+{
+	s64 gap = ktime_get_ns() - start;
+	s64 average = queue->average_idle_gap;
+
+	WRITE_ONCE(queue->average_idle_gap,
+		   average + ((gap - average) >> IDLE_GAP_WEIGHT_SHIFT));
+}
+
 /*
  * Wait for the next completion to process, or until kthread_should_stop indicates that it's time
  * for us to shut down.
@@ -177,8 +307,15 @@ static void run_finish_hook(struct simple_work_queue *queue)
 static struct vdo_completion *wait_for_next_completion(struct simple_work_queue *queue)
 {
 	struct vdo_completion *completion;
+	u64 start = ktime_get_ns();
 	DEFINE_WAIT(wait);
 
+	completion = spin_for_completion(queue, start);
+	if (completion != NULL) {
+		record_idle_gap(queue, start);
+		return completion;
+	}
+
 	while (true) {
 		prepare_to_wait(&queue->waiting_worker_threads, &wait,
 				TASK_INTERRUPTIBLE);
@@ -206,6 +343,7 @@ static struct vdo_completion *wait_for_next_completion(struct simple_work_queue
 			break;
 
 		schedule();
+		WRITE_ONCE(queue->wakeups, queue->wakeups + 1);
 
 		/*
 		 * Most of the time when we wake, it should be because there's work to do. If it
@@ -219,6 +357,9 @@ static struct vdo_completion *wait_for_next_completion(struct simple_work_queue
 	finish_wait(&queue->waiting_worker_threads, &wait);
 	atomic_set(&queue->idle, 0);
 
+	if (completion != NULL)
+		record_idle_gap(queue, start);
+
 	return completion;
 }
 
@@ -238,17 +379,22 @@ static void service_work_queue(struct simple_work_queue *queue)
 	run_start_hook(queue);
 
 	while (true) {
-		struct vdo_completion *completion = poll_for_completion(queue);
+		struct vdo_completion *completions[MAX_DRAINED_COMPLETIONS];
+		unsigned int count = drain_completions(queue, completions);
+		unsigned int i;
 
-		if (completion == NULL)
-			completion = wait_for_next_completion(queue);
+		if (count == 0) {
+			completions[0] = wait_for_next_completion(queue);
+			if (completions[0] == NULL) {
+				/* No completions but kthread_should_stop() was triggered. */
+				break;
+			}
 
-		if (completion == NULL) {
-			/* No completions but kthread_should_stop() was triggered. */
-			break;
+			count = 1;
 		}
 
-		process_completion(queue, completion);
+		for (i = 0; i < count; i++)
+			process_completion(queue, completions[i]);
 
 		/*
 		 * Be friendly to a CPU that has other work to do, if the kernel has told us to.
@@ -314,6 +460,7 @@ void vdo_free_work_queue(struct vdo_work_queue *queue)
 static int make_simple_work_queue(const char *thread_name_prefix, const char *name,
 				  struct vdo_thread *owner, void *private,
 				  const struct vdo_work_queue_type *type,
+				  struct round_robin_work_queue *group,
 				  struct simple_work_queue **queue_ptr)
 {
 	DECLARE_COMPLETION_ONSTACK(started);
@@ -334,7 +481,9 @@ static int make_simple_work_queue(const char *thread_name_prefix, const char *na
 	queue->started = &started;
 	queue->common.type = type;
 	queue->common.owner = owner;
+	queue->group = group;
 	init_waitqueue_head(&queue->waiting_worker_threads);
+	spin_lock_init(&queue->consumer_lock);
 
 	result = uds_duplicate_string(name, "queue name", &queue->common.name);
 	if (result != VDO_SUCCESS) {
@@ -396,7 +545,7 @@ int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 		void *context = ((thread_privates != NULL) ? thread_privates[0] : NULL);
 
 		result = make_simple_work_queue(thread_name_prefix, name, owner, context,
-						type, &simple_queue);
+						type, NULL, &simple_queue);
 		if (result == VDO_SUCCESS)
 			*queue_ptr = &simple_queue->common;
 		return result;
@@ -417,6 +566,7 @@ int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 	queue->num_service_queues = thread_count;
 	queue->common.round_robin_mode = true;
 	queue->common.owner = owner;
+	queue->work_stealing = (type->work_stealing && READ_ONCE(vdo_work_queue_stealing));
 
 	result = uds_duplicate_string(name, "queue name", &queue->common.name);
 	if (result != VDO_SUCCESS) {
@@ -432,7 +582,9 @@ int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 
 		snprintf(thread_name, sizeof(thread_name), "%s%u", name, i);
 		result = make_simple_work_queue(thread_name_prefix, thread_name, owner,
-						context, type, &queue->service_queues[i]);
+						context, type,
+						(queue->work_stealing ? queue : NULL),
+						&queue->service_queues[i]);
 		if (result != VDO_SUCCESS) {
 			queue->num_service_queues = i;
 			/* Destroy previously created subordinates. */
@@ -476,8 +628,83 @@ void vdo_finish_work_queue(struct vdo_work_queue *queue)
 		finish_simple_work_queue(as_simple_work_queue(queue));
 }
 
+/**
+ * vdo_set_work_queue_affinity() - Restrict the threads of a work queue to a set of CPUs.
+ * @queue: The work queue.
+ * @cpus: A list of CPUs in cpulist format, or NULL to use the CPUs of a NUMA node.
+ * @node: The node whose CPUs to use if no list is given.
+ *
+ * Return: VDO_SUCCESS, -EINVAL if none of the CPUs is online, or another error.
+ */
+int vdo_set_work_queue_affinity(struct vdo_work_queue *queue, const char *cpus, int node)
+{
+	struct simple_work_queue *simple_queue = as_simple_work_queue(queue);
+	struct simple_work_queue **queues = &simple_queue;
+	unsigned int count = 1;
+	cpumask_var_t mask;
+	unsigned int i;
+	int result = VDO_SUCCESS;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	if (cpus != NULL)
+		result = cpulist_parse(cpus, mask);
+	else if ((node >= 0) && (node < nr_node_ids) && node_online(node))
+		cpumask_copy(mask, cpumask_of_node(node));
+	else
+		cpumask_clear(mask);
+
+	if ((result == VDO_SUCCESS) && !cpumask_intersects(mask, cpu_online_mask))
+		result = -EINVAL;
+
+	if (result != VDO_SUCCESS) {
+		free_cpumask_var(mask);
+		if (cpus != NULL)
+			return uds_log_error_strerror(result, "cannot run %s on CPUs %s",
+						      queue->name, cpus);
+
+		return uds_log_error_strerror(result, "cannot run %s on NUMA node %d",
+					      queue->name, node);
+	}
+
+	if (queue->round_robin_mode) {
+		struct round_robin_work_queue *round_robin = as_round_robin_work_queue(queue);
+
+		queues = round_robin->service_queues;
+		count = round_robin->num_service_queues;
+	}
+
+	for (i = 0; (i < count) && (result == VDO_SUCCESS); i++)
+		result = set_cpus_allowed_ptr(queues[i]->thread, mask);
+
+	free_cpumask_var(mask);
+	if (result != VDO_SUCCESS)
+		return uds_log_error_strerror(result, "cannot set CPU affinity of %s",
+					      queue->name);
+
+	if (cpus != NULL)
+		uds_log_info("%s running on CPUs %s", queue->name, cpus);
+	else
+		uds_log_info("%s running on NUMA node %d", queue->name, node);
+
+	return VDO_SUCCESS;
+}
+
 /* Debugging dumps */
 
+static void log_spin_statistics(struct simple_work_queue *queue)
+{
+	u64 hits = READ_ONCE(queue->spin_hits);
+	u64 spins = hits + READ_ONCE(queue->spin_misses);
+
+	uds_log_info("  wakeups %llu, spins %llu (%llu%% found work), average idle gap %llu ns",
+		     (unsigned long long) READ_ONCE(queue->wakeups),
+		     (unsigned long long) spins,
+		     (unsigned long long) ((spins == 0) ? 0 : (hits * 100) / spins),
+		     (unsigned long long) READ_ONCE(queue->average_idle_gap));
+}
+
 static void dump_simple_work_queue(struct simple_work_queue *queue)
 {
 	const char *thread_status = "no threads";
@@ -490,6 +717,10 @@ static void dump_simple_work_queue(struct simple_work_queue *queue)
 
 	uds_log_info("workQ %px (%s) %s (%c)", &queue->common, queue->common.name,
 		     thread_status, task_state_report);
+	log_spin_statistics(queue);
+	if (queue->group != NULL)
+		uds_log_info("  completions stolen from siblings %llu",
+			     (unsigned long long) READ_ONCE(queue->steals));
 
 	/* ->waiting_worker_threads wait queue status? anyone waiting? */
 }
@@ -552,6 +783,9 @@ void vdo_dump_completion_to_buffer(struct vdo_completion *completion, char *buff
 }
 
 /* Completion submission */
+
+static struct simple_work_queue *get_current_thread_work_queue(void);
+
 /*
  * If the completion has a timeout that has already passed, the timeout handler function may be
  * invoked by this function.
@@ -564,6 +798,7 @@ void vdo_enqueue_work_queue(struct vdo_work_queue *queue,
 	 * on.
 	 */
 	struct simple_work_queue *simple_queue = NULL;
+	struct simple_work_queue *current_queue;
 
 	if (!queue->round_robin_mode) {
 		simple_queue = as_simple_work_queue(queue);
@@ -583,7 +818,48 @@ void vdo_enqueue_work_queue(struct vdo_work_queue *queue,
 		simple_queue = round_robin->service_queues[index];
 	}
 
-	enqueue_work_queue_completion(simple_queue, completion);
+	current_queue = get_current_thread_work_queue();
+	if ((current_queue == NULL) || (current_queue->batch_depth == 0)) {
+		enqueue_work_queue_completion(simple_queue, completion);
+		return;
+	}
+
+	prepare_completion(simple_queue, completion);
+	current_queue->batch[current_queue->batch_count++] = completion;
+	if (current_queue->batch_count == VDO_ENQUEUE_BATCH_SIZE)
+		flush_enqueue_batch(current_queue);
+}
+
+/**
+ * vdo_start_enqueue_batch() - Start holding back the completions enqueued by the current thread.
+ *
+ * Completions enqueued from a work queue thread until the matching call to
+ * vdo_finish_enqueue_batch() are published together, with one atomic operation per destination
+ * priority list rather than one per completion. Batches may nest; only the outermost one
+ * publishes. Calls from threads which are not work queue threads have no effect.
+ */
+void vdo_start_enqueue_batch(void)
+{
+	struct simple_work_queue *queue = get_current_thread_work_queue();
+
+	if (queue != NULL)
+		queue->batch_depth++;
+}
+
+/**
+ * vdo_finish_enqueue_batch() - Publish the completions held back since the matching call to
+ *                              vdo_start_enqueue_batch().
+ */
+void vdo_finish_enqueue_batch(void)
+{
+	struct simple_work_queue *queue = get_current_thread_work_queue();
+
+	if (queue == NULL)
+		return;
+
+	ASSERT_LOG_ONLY(queue->batch_depth > 0, "enqueue batch finished after being started");
+	if ((queue->batch_depth > 0) && (--queue->batch_depth == 0))
+		flush_enqueue_batch(queue);
 }
 
 /* Misc */
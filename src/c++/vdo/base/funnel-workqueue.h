@@ -12,6 +12,10 @@
 
 enum {
 	MAX_VDO_WORK_QUEUE_NAME_LEN = TASK_COMM_LEN,
+	/* The longest a worker may be configured to spin before sleeping, in microseconds */
+	MAXIMUM_VDO_WORK_QUEUE_SPIN = 1000,
+	/* The most completions a work queue thread holds back in an open enqueue batch */
+	VDO_ENQUEUE_BATCH_SIZE = 32,
 };
 
 struct vdo_work_queue_type {
@@ -19,12 +23,23 @@ struct vdo_work_queue_type {
 	void (*finish)(void *context);
 	enum vdo_completion_priority max_priority;
 	enum vdo_completion_priority default_priority;
+	/* Whether idle threads of a multi-threaded queue may take work from busy ones */
+	bool work_stealing;
 };
 
 struct vdo_completion;
 struct vdo_thread;
 struct vdo_work_queue;
 
+/*
+ * The longest (in microseconds) an idle worker polls its queue for more work before going to
+ * sleep. Zero, the default, disables spinning.
+ */
+extern unsigned int vdo_work_queue_spin_limit;
+
+/* Whether multi-threaded queues of types which allow it do work stealing. The default is false. */
+extern bool vdo_work_queue_stealing;
+
 int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 			struct vdo_thread *owner, const struct vdo_work_queue_type *type,
 			unsigned int thread_count, void *thread_privates[],
@@ -32,6 +47,12 @@ int vdo_make_work_queue(const char *thread_name_prefix, const char *name,
 
 void vdo_enqueue_work_queue(struct vdo_work_queue *queue, struct vdo_completion *completion);
 
+void vdo_start_enqueue_batch(void);
+void vdo_finish_enqueue_batch(void);
+
+int __must_check vdo_set_work_queue_affinity(struct vdo_work_queue *queue, const char *cpus,
+					     int node);
+
 void vdo_finish_work_queue(struct vdo_work_queue *queue);
 
 void vdo_free_work_queue(struct vdo_work_queue *queue);
@@ -6,6 +6,7 @@
 #include "io-submitter.h"
 
 #include <linux/bio.h>
+#include <linux/cache.h>
 #include <linux/kernel.h>
 #include <linux/mutex.h>
 
@@ -28,17 +29,34 @@
  * on the PBN, so a given PBN will consistently wind up on the same thread. Flush operations are
  * assigned round-robin.
  *
- * The map (protected by the mutex) collects pending I/O operations so that the worker thread can
- * reorder them to try to encourage I/O request merging in the request queue underneath.
+ * The bio map collects pending I/O operations so that the worker thread can reorder them to try to
+ * encourage I/O request merging in the request queue underneath. Many threads submit bios, so the
+ * map for each bio queue is split into shards, each with its own mutex. The device is divided into
+ * regions of BIO_MAP_REGION_BLOCKS blocks, and each region belongs to one shard. Bios are only
+ * merged with other bios in the same region, so every lookup and update for a bio is made in a
+ * single shard, and submitters writing to different regions rarely contend for the same lock.
  */
+enum {
+	BIO_MAP_SHARD_BITS = 4,
+	BIO_MAP_SHARDS = 1 << BIO_MAP_SHARD_BITS,
+	/* This bounds the size of a merged I/O, which the block layer may merge further. */
+	BIO_MAP_REGION_BLOCKS = 64,
+	BIO_MAP_REGION_SECTORS = BIO_MAP_REGION_BLOCKS * VDO_SECTORS_PER_BLOCK,
+};
+
+struct bio_map_shard {
+	struct mutex lock;
+	/* The pending bios in this shard's regions, by the first and last sectors of each batch */
+	struct int_map *map;
+} __aligned(L1_CACHE_BYTES);
+
 struct bio_queue_data {
 	struct vdo_work_queue *queue;
 #ifdef __KERNEL__
 	struct blk_plug plug;
 #endif /* __KERNEL__ */
-	struct int_map *map;
-	struct mutex lock;
 	unsigned int queue_number;
+	struct bio_map_shard shards[BIO_MAP_SHARDS];
 };
 
 struct io_submitter {
@@ -144,6 +162,26 @@ void vdo_submit_vio(struct vdo_completion *completion)
 	send_bio_to_device(vio, vio->bio);
 }
 
+/**
+ * get_bio_map_shard() - Get the bio map shard for the region containing a sector.
+ * @bio_queue_data: The bio queue.
+ * @sector: The sector.
+ *
+ * Return: The shard.
+ */
+static struct bio_map_shard *get_bio_map_shard(struct bio_queue_data *bio_queue_data,
+					       sector_t sector)
+{
+	u64 region = sector / BIO_MAP_REGION_SECTORS;
+
+	/*
+	 * A bio queue only sees the regions of its own bio zone, which are evenly spaced, so hash
+	 * the region number (with the golden ratio multiplier) to spread them over every shard.
+	 */
+	return &bio_queue_data->shards[(region * 0x9e3779b97f4a7c15ULL) >>
+				       (64 - BIO_MAP_SHARD_BITS)];
+}
+
 /**
  * get_bio_list() - Extract the list of bios to submit from a vio.
  * @vio: The vio submitting I/O.
@@ -158,17 +196,18 @@ static struct bio *get_bio_list(struct vio *vio)
 	struct bio *bio;
 	struct io_submitter *submitter = vio->completion.vdo->io_submitter;
 	struct bio_queue_data *bio_queue_data = &(submitter->bio_queue_data[vio->bio_zone]);
+	/* Every bio merged with this vio's bio is in the same region, and so the same shard. */
+	struct bio_map_shard *shard = get_bio_map_shard(bio_queue_data,
+							vio->bio->bi_iter.bi_sector);
 
 	assert_in_bio_zone(vio);
 
-	mutex_lock(&bio_queue_data->lock);
-	vdo_int_map_remove(bio_queue_data->map,
-			   vio->bios_merged.head->bi_iter.bi_sector);
-	vdo_int_map_remove(bio_queue_data->map,
-			   vio->bios_merged.tail->bi_iter.bi_sector);
+	mutex_lock(&shard->lock);
+	vdo_int_map_remove(shard->map, vio->bios_merged.head->bi_iter.bi_sector);
+	vdo_int_map_remove(shard->map, vio->bios_merged.tail->bi_iter.bi_sector);
 	bio = vio->bios_merged.head;
 	bio_list_init(&vio->bios_merged);
-	mutex_unlock(&bio_queue_data->lock);
+	mutex_unlock(&shard->lock);
 
 	return bio;
 }
@@ -200,7 +239,7 @@ static void submit_data_vio(struct vdo_completion *completion)
  * @back_merge: Set to true for a back merge, false for a front merge.
  *
  * There are two types of merging possible, forward and backward, which are distinguished by a flag
- * that uses kernel elevator terminology.
+ * that uses kernel elevator terminology. Bios in different regions are never merged.
  *
  * Return: the vio to merge to, NULL if no merging is possible.
  */
@@ -216,6 +255,10 @@ static struct vio *get_mergeable_locked(struct int_map *map, struct vio *vio,
 	else
 		merge_sector += VDO_SECTORS_PER_BLOCK;
 
+	if ((merge_sector / BIO_MAP_REGION_SECTORS) !=
+	    (bio->bi_iter.bi_sector / BIO_MAP_REGION_SECTORS))
+		return NULL;
+
 	vio_merge = vdo_int_map_get(map, merge_sector);
 
 	if (vio_merge == NULL)
@@ -291,31 +334,30 @@ static bool try_bio_map_merge(struct vio *vio)
 	struct vdo *vdo = vio->completion.vdo;
 	struct bio_queue_data *bio_queue_data =
 		&vdo->io_submitter->bio_queue_data[vio->bio_zone];
+	struct bio_map_shard *shard = get_bio_map_shard(bio_queue_data, bio->bi_iter.bi_sector);
 
 	bio->bi_next = NULL;
 	bio_list_init(&vio->bios_merged);
 	bio_list_add(&vio->bios_merged, bio);
 
-	mutex_lock(&bio_queue_data->lock);
-	prev_vio = get_mergeable_locked(bio_queue_data->map, vio, true);
-	next_vio = get_mergeable_locked(bio_queue_data->map, vio, false);
+	mutex_lock(&shard->lock);
+	prev_vio = get_mergeable_locked(shard->map, vio, true);
+	next_vio = get_mergeable_locked(shard->map, vio, false);
 	if (prev_vio == next_vio)
 		next_vio = NULL;
 
 	if ((prev_vio == NULL) && (next_vio == NULL)) {
 		/* no merge. just add to bio_queue */
 		merged = false;
-		result = vdo_int_map_put(bio_queue_data->map,
-					 bio->bi_iter.bi_sector,
-					 vio, true, NULL);
+		result = vdo_int_map_put(shard->map, bio->bi_iter.bi_sector, vio, true, NULL);
 	} else if (next_vio == NULL) {
 		/* Only prev. merge to prev's tail */
-		result = merge_to_prev_tail(bio_queue_data->map, vio, prev_vio);
+		result = merge_to_prev_tail(shard->map, vio, prev_vio);
 	} else {
 		/* Only next. merge to next's head */
-		result = merge_to_next_head(bio_queue_data->map, vio, next_vio);
+		result = merge_to_next_head(shard->map, vio, next_vio);
 	}
-	mutex_unlock(&bio_queue_data->lock);
+	mutex_unlock(&shard->lock);
 
 	/* We don't care about failure of int_map_put in this case. */
 	ASSERT_LOG_ONLY(result == UDS_SUCCESS, "bio map insertion succeeds");
@@ -348,6 +390,7 @@ void vdo_submit_data_vio(struct data_vio *data_vio)
  * @error_handler: the handler for submission or I/O errors (may be NULL)
  * @operation: the type of I/O to perform
  * @data: the buffer to read or write (may be NULL)
+ * @size: the number of bytes to read or write, which may be less than the size of the vio
  *
  * The vio is enqueued on a vdo bio queue so that bio submission (which may block) does not block
  * other vdo threads.
@@ -359,7 +402,7 @@ void vdo_submit_data_vio(struct data_vio *data_vio)
  */
 void __submit_metadata_vio(struct vio *vio, physical_block_number_t physical,
 			   bio_end_io_t callback, vdo_action_fn error_handler,
-			   unsigned int operation, char *data)
+			   unsigned int operation, char *data, int size)
 {
 	int result;
 	struct vdo_completion *completion = &vio->completion;
@@ -381,7 +424,8 @@ void __submit_metadata_vio(struct vio *vio, physical_block_number_t physical,
 
 	vdo_reset_completion(completion);
 	completion->error_handler = error_handler;
-	result = vio_reset_bio(vio, data, callback, operation | REQ_META, physical);
+	result = vio_reset_bio_with_size(vio, data, size, callback, operation | REQ_META,
+					 physical);
 	if (result != VDO_SUCCESS) {
 		continue_vio(vio, result);
 		return;
@@ -392,6 +436,54 @@ void __submit_metadata_vio(struct vio *vio, physical_block_number_t physical,
 	vdo_launch_completion_with_priority(completion, get_metadata_priority(vio));
 }
 
+/**
+ * free_bio_map_shards() - Free the bio map shards of a bio queue.
+ * @bio_queue_data: The bio queue.
+ */
+static void free_bio_map_shards(struct bio_queue_data *bio_queue_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < BIO_MAP_SHARDS; i++)
+		vdo_int_map_free(uds_forget(bio_queue_data->shards[i].map));
+}
+
+/**
+ * make_bio_map_shards() - Make the bio map shards of a bio queue.
+ * @bio_queue_data: The bio queue.
+ * @max_requests_active: Number of bios for merge tracking.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+static int make_bio_map_shards(struct bio_queue_data *bio_queue_data,
+			       unsigned int max_requests_active)
+{
+	/*
+	 * One I/O operation per request, but both first & last sector numbers.
+	 *
+	 * If requests are assigned to threads round-robin, they should be distributed quite evenly.
+	 * But if they're assigned based on PBN, things can sometimes be very uneven. So for now,
+	 * we'll assume that all requests *may* wind up on one thread. The regions are spread
+	 * evenly over the shards, which grow if they are not.
+	 */
+	size_t capacity = DIV_ROUND_UP(max_requests_active * 2, BIO_MAP_SHARDS);
+	unsigned int i;
+	int result;
+
+	for (i = 0; i < BIO_MAP_SHARDS; i++) {
+		struct bio_map_shard *shard = &bio_queue_data->shards[i];
+
+		mutex_init(&shard->lock);
+		result = vdo_int_map_create(capacity, &shard->map);
+		if (result != VDO_SUCCESS) {
+			free_bio_map_shards(bio_queue_data);
+			return result;
+		}
+	}
+
+	return VDO_SUCCESS;
+}
+
 /**
  * vdo_make_io_submitter() - Create an io_submitter structure.
  * @thread_count: Number of bio-submission threads to set up.
@@ -423,18 +515,8 @@ int vdo_make_io_submitter(unsigned int thread_count, unsigned int rotation_inter
 	for (i = 0; i < thread_count; i++) {
 		struct bio_queue_data *bio_queue_data = &io_submitter->bio_queue_data[i];
 
-		mutex_init(&bio_queue_data->lock);
-		/*
-		 * One I/O operation per request, but both first & last sector numbers.
-		 *
-		 * If requests are assigned to threads round-robin, they should be distributed
-		 * quite evenly. But if they're assigned based on PBN, things can sometimes be very
-		 * uneven. So for now, we'll assume that all requests *may* wind up on one thread,
-		 * and thus all in the same map.
-		 */
-		result = vdo_int_map_create(max_requests_active * 2,
-					    &bio_queue_data->map);
-		if (result != 0) {
+		result = make_bio_map_shards(bio_queue_data, max_requests_active);
+		if (result != VDO_SUCCESS) {
 			/*
 			 * Clean up the partially initialized bio-queue entirely and indicate that
 			 * initialization failed.
@@ -453,7 +535,7 @@ int vdo_make_io_submitter(unsigned int thread_count, unsigned int rotation_inter
 			 * Clean up the partially initialized bio-queue entirely and indicate that
 			 * initialization failed.
 			 */
-			vdo_int_map_free(uds_forget(bio_queue_data->map));
+			free_bio_map_shards(bio_queue_data);
 			uds_log_error("bio queue initialization failed %d", result);
 			vdo_cleanup_io_submitter(io_submitter);
 			vdo_free_io_submitter(io_submitter);
@@ -502,7 +584,7 @@ void vdo_free_io_submitter(struct io_submitter *io_submitter)
 		io_submitter->num_bio_queues_used--;
 		/* vdo_destroy() will free the work queue, so just give up our reference to it. */
 		uds_forget(io_submitter->bio_queue_data[i].queue);
-		vdo_int_map_free(uds_forget(io_submitter->bio_queue_data[i].map));
+		free_bio_map_shards(&io_submitter->bio_queue_data[i]);
 	}
 	uds_free(io_submitter);
 }
@@ -7,11 +7,13 @@
 
 #include <linux/atomic.h>
 #include <linux/blkdev.h>
+#include <linux/hrtimer.h>
 
 #include "logger.h"
 #include "memory-alloc.h"
 #include "permassert.h"
 #include "string-utils.h"
+#include "time-utils.h"
 
 #include "admin-state.h"
 #include "completion.h"
@@ -19,6 +21,7 @@
 #include "data-vio.h"
 #include "dedupe.h"
 #include "encodings.h"
+#include "funnel-workqueue.h"
 #include "io-submitter.h"
 #include "physical-zone.h"
 #include "status-codes.h"
@@ -30,53 +33,125 @@ static const struct version_number COMPRESSED_BLOCK_1_0 = {
 	.minor_version = 0,
 };
 
+static const struct version_number COMPRESSED_BLOCK_2_0 = {
+	.major_version = 2,
+	.minor_version = 0,
+};
+
+/*
+ * The header of a compressed block which records the compression type of its fragments. Blocks of
+ * LZ4 fragments keep the version 1.0 header, so that they remain readable by older versions.
+ */
+struct compressed_block_header_2_0 {
+	struct packed_version_number version;
+	/* The enum vdo_compression_type of every fragment in the block */
+	u8 compression_type;
+	__le16 sizes[VDO_MAX_COMPRESSION_SLOTS];
+} __packed;
+
 enum {
 	COMPRESSED_BLOCK_1_0_SIZE = 4 + 4 + (2 * VDO_MAX_COMPRESSION_SLOTS),
+	COMPRESSED_BLOCK_2_0_SIZE = 4 + 4 + 1 + (2 * VDO_MAX_COMPRESSION_SLOTS),
+};
+
+enum {
+	/* The moving averages are kept in sixteenths, and weight each new sample by one eighth. */
+	PACKER_AVERAGE_SCALE_SHIFT = 4,
+	PACKER_AVERAGE_WEIGHT_SHIFT = 3,
+	/* Arbitrary minimum age deadline, so that the timer never fires more often */
+	PACKER_MINIMUM_AGE_NS = 100 * NSEC_PER_USEC,
+};
+
+enum packer_timer_state {
+	PACKER_TIMER_IDLE,
+	PACKER_TIMER_RUNNING,
+	PACKER_TIMER_FIRED,
 };
 
+/**
+ * get_fragment_size() - Get the size of a fragment from a compressed block header.
+ * @block: The compressed block.
+ * @has_type: Whether the block has a version 2.0 header, which records the compression type.
+ * @slot: The slot of the fragment.
+ *
+ * Return: The size of the fragment.
+ */
+static u16 get_fragment_size(const struct compressed_block *block, bool has_type,
+			     slot_number_t slot)
+{
+	const struct compressed_block_header_2_0 *header_2_0;
+
+	if (!has_type)
+		return __le16_to_cpu(block->header.sizes[slot]);
+
+	header_2_0 = (const struct compressed_block_header_2_0 *) block;
+	return __le16_to_cpu(header_2_0->sizes[slot]);
+}
+
 /**
  * vdo_get_compressed_block_fragment() - Get a reference to a compressed fragment from a compressed
  *                                       block.
  * @mapping_state [in] The mapping state for the look up.
  * @compressed_block [in] The compressed block that was read from disk.
- * @fragment_offset [out] The offset of the fragment within a compressed block.
+ * @type_ptr [out] The compression type of the fragment.
+ * @fragment_offset [out] The offset of the fragment from the start of the compressed block.
  * @fragment_size [out] The size of the fragment.
  *
+ * Blocks with a version 1.0 header, which has no compression type, were compressed with LZ4.
+ *
  * Return: If a valid compressed fragment is found, VDO_SUCCESS; otherwise, VDO_INVALID_FRAGMENT if
  *         the fragment is invalid.
  */
 int vdo_get_compressed_block_fragment(enum block_mapping_state mapping_state,
 				      struct compressed_block *block,
+				      enum vdo_compression_type *type_ptr,
 				      u16 *fragment_offset, u16 *fragment_size)
 {
 	u16 compressed_size;
 	u16 offset = 0;
+	u16 data_start, data_size;
 	unsigned int i;
 	u8 slot;
+	bool has_type;
+	enum vdo_compression_type type;
 	struct version_number version;
 
 	if (!vdo_is_state_compressed(mapping_state))
 		return VDO_INVALID_FRAGMENT;
 
 	version = vdo_unpack_version_number(block->header.version);
-	if (!vdo_are_same_version(version, COMPRESSED_BLOCK_1_0))
+	if (vdo_are_same_version(version, COMPRESSED_BLOCK_2_0)) {
+		has_type = true;
+		type = ((const struct compressed_block_header_2_0 *) block)->compression_type;
+		data_start = COMPRESSED_BLOCK_2_0_SIZE;
+	} else if (vdo_are_same_version(version, COMPRESSED_BLOCK_1_0)) {
+		has_type = false;
+		type = VDO_COMPRESSION_LZ4;
+		data_start = COMPRESSED_BLOCK_1_0_SIZE;
+	} else {
+		return VDO_INVALID_FRAGMENT;
+	}
+
+	if (type >= VDO_COMPRESSION_TYPE_COUNT)
 		return VDO_INVALID_FRAGMENT;
 
 	slot = mapping_state - VDO_MAPPING_STATE_COMPRESSED_BASE;
 	if (slot >= VDO_MAX_COMPRESSION_SLOTS)
 		return VDO_INVALID_FRAGMENT;
 
-	compressed_size = __le16_to_cpu(block->header.sizes[slot]);
+	data_size = VDO_BLOCK_SIZE - data_start;
+	compressed_size = get_fragment_size(block, has_type, slot);
 	for (i = 0; i < slot; i++) {
-		offset += __le16_to_cpu(block->header.sizes[i]);
-		if (offset >= VDO_COMPRESSED_BLOCK_DATA_SIZE)
+		offset += get_fragment_size(block, has_type, i);
+		if (offset >= data_size)
 			return VDO_INVALID_FRAGMENT;
 	}
 
-	if ((offset + compressed_size) > VDO_COMPRESSED_BLOCK_DATA_SIZE)
+	if ((offset + compressed_size) > data_size)
 		return VDO_INVALID_FRAGMENT;
 
-	*fragment_offset = offset;
+	*type_ptr = type;
+	*fragment_offset = data_start + offset;
 	*fragment_size = compressed_size;
 	return VDO_SUCCESS;
 }
@@ -93,24 +168,78 @@ static inline void assert_on_packer_thread(struct packer *packer, const char *ca
 }
 
 /**
- * insert_in_sorted_list() - Insert a bin to the list.
+ * file_bin() - Add a bin to the index of bins by free space.
+ * @packer: The packer.
+ * @bin: The bin, which must not already be in the index.
+ */
+static void file_bin(struct packer *packer, struct packer_bin *bin)
+{
+	list_add_tail(&bin->space_entry, &packer->bins_by_space[bin->free_space]);
+	__set_bit(bin->free_space, packer->spaces_in_use);
+}
+
+/**
+ * set_free_space() - Change the amount of free space in a bin.
  * @packer: The packer.
- * @bin: The bin to move to its sorted position.
+ * @bin: The bin.
+ * @free_space: The new amount of free space.
  *
- * The list is in ascending order of free space. Since all bins are already in the list, this
- * actually moves the bin to the correct position in the list.
+ * This moves the bin to the end of the list of bins with its new amount of free space.
  */
-static void insert_in_sorted_list(struct packer *packer, struct packer_bin *bin)
+static void set_free_space(struct packer *packer, struct packer_bin *bin, size_t free_space)
 {
-	struct packer_bin *active_bin;
+	list_del(&bin->space_entry);
+	if (list_empty(&packer->bins_by_space[bin->free_space]))
+		__clear_bit(bin->free_space, packer->spaces_in_use);
 
-	list_for_each_entry(active_bin, &packer->bins, list)
-		if (active_bin->free_space > bin->free_space) {
-			list_move_tail(&bin->list, &active_bin->list);
-			return;
-		}
+	bin->free_space = free_space;
+	file_bin(packer, bin);
+}
+
+/**
+ * first_space_in_use() - Find the least amount of free space, no less than required, of any bin.
+ * @packer: The packer.
+ * @required: The minimum amount of free space.
+ *
+ * Return: The amount of free space, or VDO_PACKER_FREE_SPACE_COUNT if no bin has enough.
+ */
+static size_t first_space_in_use(const struct packer *packer, size_t required)
+{
+	return find_next_bit(packer->spaces_in_use, VDO_PACKER_FREE_SPACE_COUNT, required);
+}
 
-	list_move_tail(&bin->list, &packer->bins);
+static inline bool change_timer_state(struct packer *packer, int old, int new)
+{
+	return (atomic_cmpxchg(&packer->timer_state, old, new) == old);
+}
+
+/**
+ * start_age_timer() - Start the timer for the deadline of the oldest bin, if it is not running.
+ * @packer: The packer.
+ */
+static void start_age_timer(struct packer *packer)
+{
+	struct packer_bin *oldest;
+
+	if (list_empty(&packer->aging) ||
+	    !change_timer_state(packer, PACKER_TIMER_IDLE, PACKER_TIMER_RUNNING))
+		return;
+
+	oldest = list_first_entry(&packer->aging, struct packer_bin, age_entry);
+	hrtimer_start(&packer->timer, ns_to_ktime(oldest->arrival + packer->age_deadline),
+		      HRTIMER_MODE_ABS);
+}
+
+static void write_aged_bins(struct vdo_completion *completion);
+
+static enum hrtimer_restart age_timer_fired(struct hrtimer *timer)
+{
+	struct packer *packer = container_of(timer, struct packer, timer);
+
+	if (change_timer_state(packer, PACKER_TIMER_RUNNING, PACKER_TIMER_FIRED))
+		vdo_launch_completion(&packer->completion);
+
+	return HRTIMER_NORESTART;
 }
 
 /**
@@ -129,7 +258,9 @@ static int __must_check make_bin(struct packer *packer)
 
 	bin->free_space = VDO_COMPRESSED_BLOCK_DATA_SIZE;
 	INIT_LIST_HEAD(&bin->list);
+	INIT_LIST_HEAD(&bin->age_entry);
 	list_add_tail(&bin->list, &packer->bins);
+	file_bin(packer, bin);
 	return VDO_SUCCESS;
 }
 
@@ -155,6 +286,23 @@ int vdo_make_packer(struct vdo *vdo, block_count_t bin_count, struct packer **pa
 	packer->thread_id = vdo->thread_config.packer_thread;
 	packer->size = bin_count;
 	INIT_LIST_HEAD(&packer->bins);
+	for (i = 0; i < VDO_PACKER_FREE_SPACE_COUNT; i++)
+		INIT_LIST_HEAD(&packer->bins_by_space[i]);
+
+	INIT_LIST_HEAD(&packer->aging);
+	vdo_initialize_completion(&packer->completion, vdo, VDO_PACKER_COMPLETION);
+	vdo_set_completion_callback(&packer->completion, write_aged_bins, packer->thread_id);
+	hrtimer_init(&packer->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	packer->timer.function = age_timer_fired;
+	atomic_set(&packer->timer_state, PACKER_TIMER_IDLE);
+
+	/* Until data_vios arrive, assume they will come quickly enough to fill every bin. */
+	packer->last_arrival = current_time_ns(CLOCK_MONOTONIC);
+	packer->age_deadline = PACKER_MINIMUM_AGE_NS;
+	packer->fill_target = VDO_COMPRESSED_BLOCK_DATA_SIZE;
+	packer->statistics.bin_age_deadline = packer->age_deadline / NSEC_PER_USEC;
+	packer->statistics.bin_fill_target = 100;
+
 	vdo_set_admin_state_code(&packer->state, VDO_ADMIN_STATE_NORMAL_OPERATION);
 
 	for (i = 0; i < bin_count; i++) {
@@ -198,6 +346,7 @@ void vdo_free_packer(struct packer *packer)
 	if (packer == NULL)
 		return;
 
+	hrtimer_cancel(&packer->timer);
 	list_for_each_entry_safe(bin, tmp, &packer->bins, list) {
 		list_del_init(&bin->list);
 		uds_free(bin);
@@ -232,9 +381,49 @@ struct packer_statistics vdo_get_packer_statistics(const struct packer *packer)
 		.compressed_fragments_written = READ_ONCE(stats->compressed_fragments_written),
 		.compressed_blocks_written = READ_ONCE(stats->compressed_blocks_written),
 		.compressed_fragments_in_packer = READ_ONCE(stats->compressed_fragments_in_packer),
+		.skipped_as_incompressible = atomic64_read(&packer->skipped_as_incompressible),
+		.bin_age_deadline = READ_ONCE(stats->bin_age_deadline),
+		.bin_fill_target = READ_ONCE(stats->bin_fill_target),
+		.bins_written_at_deadline = READ_ONCE(stats->bins_written_at_deadline),
+		.fragments_held_under_500us = READ_ONCE(stats->fragments_held_under_500us),
+		.fragments_held_under_1ms = READ_ONCE(stats->fragments_held_under_1ms),
+		.fragments_held_under_2ms = READ_ONCE(stats->fragments_held_under_2ms),
+		.fragments_held_under_5ms = READ_ONCE(stats->fragments_held_under_5ms),
+		.fragments_held_under_10ms = READ_ONCE(stats->fragments_held_under_10ms),
+		.fragments_held_under_20ms = READ_ONCE(stats->fragments_held_under_20ms),
+		.fragments_held_longer = READ_ONCE(stats->fragments_held_longer),
 	};
 }
 
+/**
+ * count_departure() - Record how long a data_vio was held in the packer.
+ * @packer: The packer.
+ * @data_vio: The data_vio which is leaving the packer.
+ */
+static void count_departure(struct packer *packer, struct data_vio *data_vio)
+{
+	struct packer_statistics *stats = &packer->statistics;
+	u64 held = current_time_ns(CLOCK_MONOTONIC) - data_vio->compression.arrival;
+	u64 *bucket;
+
+	if (held < 500 * NSEC_PER_USEC)
+		bucket = &stats->fragments_held_under_500us;
+	else if (held < 1 * NSEC_PER_MSEC)
+		bucket = &stats->fragments_held_under_1ms;
+	else if (held < 2 * NSEC_PER_MSEC)
+		bucket = &stats->fragments_held_under_2ms;
+	else if (held < 5 * NSEC_PER_MSEC)
+		bucket = &stats->fragments_held_under_5ms;
+	else if (held < 10 * NSEC_PER_MSEC)
+		bucket = &stats->fragments_held_under_10ms;
+	else if (held < 20 * NSEC_PER_MSEC)
+		bucket = &stats->fragments_held_under_20ms;
+	else
+		bucket = &stats->fragments_held_longer;
+
+	WRITE_ONCE(*bucket, *bucket + 1);
+}
+
 /**
  * abort_packing() - Abort packing a data_vio.
  * @data_vio: The data_vio to abort.
@@ -245,6 +434,7 @@ static void abort_packing(struct data_vio *data_vio)
 
 	WRITE_ONCE(packer->statistics.compressed_fragments_in_packer,
 		   packer->statistics.compressed_fragments_in_packer - 1);
+	count_departure(packer, data_vio);
 
 	write_data_vio(data_vio);
 }
@@ -286,6 +476,7 @@ static void finish_compressed_write(struct vdo_completion *completion)
 	 * Process all the non-agent waiters first to ensure that the pbn lock can not be released
 	 * until all of them have had a chance to journal their increfs.
 	 */
+	vdo_start_enqueue_batch();
 	for (client = agent->compression.next_in_batch; client != NULL; client = next) {
 		next = client->compression.next_in_batch;
 		release_compressed_write_waiter(client, &agent->allocation);
@@ -293,6 +484,7 @@ static void finish_compressed_write(struct vdo_completion *completion)
 
 	completion->error_handler = handle_data_vio_error;
 	release_compressed_write_waiter(agent, &agent->allocation);
+	vdo_finish_enqueue_batch();
 }
 
 static void handle_compressed_write_error(struct vdo_completion *completion)
@@ -353,7 +545,8 @@ static struct data_vio *remove_from_bin(struct packer *packer, struct packer_bin
 	}
 
 	/* The bin is now empty. */
-	bin->free_space = VDO_COMPRESSED_BLOCK_DATA_SIZE;
+	set_free_space(packer, bin, VDO_COMPRESSED_BLOCK_DATA_SIZE);
+	list_del_init(&bin->age_entry);
 	return NULL;
 }
 
@@ -374,11 +567,35 @@ STATIC void initialize_compressed_block(struct compressed_block *block, u16 size
 	 * block header.
 	 */
 	BUILD_BUG_ON(sizeof(struct compressed_block_header) != COMPRESSED_BLOCK_1_0_SIZE);
+	BUILD_BUG_ON(sizeof(struct compressed_block_header_2_0) != COMPRESSED_BLOCK_2_0_SIZE);
 
 	block->header.version = vdo_pack_version_number(COMPRESSED_BLOCK_1_0);
 	block->header.sizes[0] = __cpu_to_le16(size);
 }
 
+/**
+ * record_compression_type() - Convert a packed compressed block to one which records the
+ *                             compression type of its fragments.
+ * @block: The packed compressed block, with a version 1.0 header.
+ * @size: The total size of the fragments in the block.
+ * @type: The compression type of every fragment in the block.
+ *
+ * The version 2.0 header is one byte longer, so the fragments are moved to make room for it. A bin
+ * of fragments of any type other than LZ4 reserves that byte.
+ */
+STATIC void record_compression_type(struct compressed_block *block, block_size_t size,
+				    enum vdo_compression_type type)
+{
+	struct compressed_block_header_2_0 *header = (struct compressed_block_header_2_0 *) block;
+	__le16 sizes[VDO_MAX_COMPRESSION_SLOTS];
+
+	memcpy(sizes, block->header.sizes, sizeof(sizes));
+	memmove(&block->data[1], block->data, size);
+	header->version = vdo_pack_version_number(COMPRESSED_BLOCK_2_0);
+	header->compression_type = type;
+	memcpy(header->sizes, sizes, sizeof(sizes));
+}
+
 /**
  * pack_fragment() - Pack a data_vio's fragment into the compressed block in which it is already
  *                   known to fit.
@@ -461,6 +678,9 @@ static void write_bin(struct packer *packer, struct packer_bin *bin)
 		       (VDO_MAX_COMPRESSION_SLOTS - slot) * sizeof(__le16));
 	}
 
+	if (compression->type != VDO_COMPRESSION_LZ4)
+		record_compression_type(block, offset, compression->type);
+
 	agent->vio.completion.error_handler = handle_compressed_write_error;
 	if (vdo_is_read_only(vdo_from_data_vio(agent))) {
 		continue_data_vio_with_error(agent, VDO_READ_ONLY);
@@ -485,10 +705,24 @@ static void write_bin(struct packer *packer, struct packer_bin *bin)
 		   (stats->compressed_fragments_written + slot));
 	WRITE_ONCE(stats->compressed_blocks_written,
 		   stats->compressed_blocks_written + 1);
+	for (client = agent; client != NULL; client = client->compression.next_in_batch)
+		count_departure(packer, client);
 
 	vdo_submit_data_vio(agent);
 }
 
+/**
+ * bin_accepts_type() - Check whether a bin may hold fragments of a given compression type.
+ * @bin: The bin.
+ * @type: The compression type.
+ *
+ * A compressed block records a single compression type, so every fragment in a bin must share it.
+ */
+static bool bin_accepts_type(const struct packer_bin *bin, enum vdo_compression_type type)
+{
+	return ((bin->slots_used == 0) || (bin->incoming[0]->compression.type == type));
+}
+
 /**
  * add_data_vio_to_packer_bin() - Add a data_vio to a bin's incoming queue
  * @packer: The packer.
@@ -502,19 +736,27 @@ static void add_data_vio_to_packer_bin(struct packer *packer, struct packer_bin
 				       struct data_vio *data_vio)
 {
 	/* If the selected bin doesn't have room, start a new batch to make room. */
-	if (bin->free_space < data_vio->compression.size)
+	if ((bin->free_space < data_vio->compression.size) ||
+	    !bin_accepts_type(bin, data_vio->compression.type))
 		write_bin(packer, bin);
 
+	if (bin->slots_used == 0) {
+		bin->arrival = data_vio->compression.arrival;
+		list_add_tail(&bin->age_entry, &packer->aging);
+		start_age_timer(packer);
+
+		/* Reserve the extra byte of the header which records any type but LZ4. */
+		if (data_vio->compression.type != VDO_COMPRESSION_LZ4)
+			set_free_space(packer, bin, bin->free_space - 1);
+	}
+
 	add_to_bin(bin, data_vio);
-	bin->free_space -= data_vio->compression.size;
+	set_free_space(packer, bin, bin->free_space - data_vio->compression.size);
 
 	/* If we happen to exactly fill the bin, start a new batch. */
 	if ((bin->slots_used == VDO_MAX_COMPRESSION_SLOTS) ||
 	    (bin->free_space == 0))
 		write_bin(packer, bin);
-
-	/* Now that we've finished changing the free space, restore the sort order. */
-	insert_in_sorted_list(packer, bin);
 }
 
 /**
@@ -526,15 +768,21 @@ static void add_data_vio_to_packer_bin(struct packer *packer, struct packer_bin
 static struct packer_bin * __must_check select_bin(struct packer *packer,
 						   struct data_vio *data_vio)
 {
+	struct packer_bin *bin, *fullest_bin;
+	size_t space;
+
 	/*
 	 * First best fit: select the bin with the least free space that has enough room for the
-	 * compressed data in the data_vio.
+	 * compressed data in the data_vio and holds fragments of the same compression type. Bins
+	 * of another type are only present briefly after the compression type is changed.
 	 */
-	struct packer_bin *bin, *fullest_bin;
-
-	list_for_each_entry(bin, &packer->bins, list) {
-		if (bin->free_space >= data_vio->compression.size)
-			return bin;
+	for (space = first_space_in_use(packer, data_vio->compression.size);
+	     space < VDO_PACKER_FREE_SPACE_COUNT;
+	     space = first_space_in_use(packer, space + 1)) {
+		list_for_each_entry(bin, &packer->bins_by_space[space], space_entry) {
+			if (bin_accepts_type(bin, data_vio->compression.type))
+				return bin;
+		}
 	}
 
 	/*
@@ -545,7 +793,8 @@ static struct packer_bin * __must_check select_bin(struct packer *packer,
 	 * size of the incoming block, it seems wrong to force that bin to write when giving up on
 	 * compressing the incoming data_vio would likewise "waste" the least amount of free space.
 	 */
-	fullest_bin = list_first_entry(&packer->bins, struct packer_bin, list);
+	fullest_bin = list_first_entry(&packer->bins_by_space[first_space_in_use(packer, 0)],
+				       struct packer_bin, space_entry);
 	if (data_vio->compression.size >=
 	    (VDO_COMPRESSED_BLOCK_DATA_SIZE - fullest_bin->free_space))
 		return NULL;
@@ -557,6 +806,64 @@ static struct packer_bin * __must_check select_bin(struct packer *packer,
 	return fullest_bin;
 }
 
+/**
+ * update_average() - Add a sample to a moving average.
+ * @average: The average, scaled by PACKER_AVERAGE_SCALE_SHIFT.
+ * @sample: The new sample, unscaled.
+ *
+ * Return: The new average.
+ */
+static u64 update_average(u64 average, u64 sample)
+{
+	return (average - (average >> PACKER_AVERAGE_WEIGHT_SHIFT) +
+		((sample << PACKER_AVERAGE_SCALE_SHIFT) >> PACKER_AVERAGE_WEIGHT_SHIFT));
+}
+
+/**
+ * update_flush_policy() - Tune the age deadline and fill target from the arrival of a data_vio.
+ * @packer: The packer.
+ * @data_vio: The data_vio which has arrived.
+ *
+ * The deadline is the time the packer expects to take to receive a block's worth of fragments, so
+ * a bin has a fair chance to fill before it is written. When that is longer than the maximum age,
+ * the fill target is the fraction of a block the packer expects to receive within the maximum age;
+ * a bin which has reached it is unlikely to gain much by waiting for its own deadline.
+ */
+static void update_flush_policy(struct packer *packer, struct data_vio *data_vio)
+{
+	u64 now = current_time_ns(CLOCK_MONOTONIC);
+	u64 maximum_age = PACKER_MAXIMUM_AGE_MS * NSEC_PER_MSEC;
+	/* A pause longer than the maximum age says nothing more about the arrival rate. */
+	u64 interval = min(now - packer->last_arrival, maximum_age);
+	u64 size = data_vio->compression.size;
+	u64 fragments_per_block, fill_time;
+
+	data_vio->compression.arrival = now;
+	packer->last_arrival = now;
+	packer->mean_interval = update_average(packer->mean_interval, interval);
+	packer->mean_size = update_average(packer->mean_size, size);
+
+	/* The mean size is never zero once it has a sample. */
+	fragments_per_block = ((u64) VDO_COMPRESSED_BLOCK_DATA_SIZE << PACKER_AVERAGE_SCALE_SHIFT);
+	fragments_per_block = min_t(u64, fragments_per_block / packer->mean_size,
+				    VDO_MAX_COMPRESSION_SLOTS);
+	fragments_per_block = max_t(u64, fragments_per_block, 2);
+	fill_time = (packer->mean_interval * fragments_per_block) >> PACKER_AVERAGE_SCALE_SHIFT;
+
+	packer->age_deadline = max_t(u64, min(fill_time, maximum_age), PACKER_MINIMUM_AGE_NS);
+	if (fill_time <= maximum_age) {
+		packer->fill_target = VDO_COMPRESSED_BLOCK_DATA_SIZE;
+	} else {
+		/* Never write a bin early which is less than half full. */
+		packer->fill_target = max_t(size_t, VDO_COMPRESSED_BLOCK_DATA_SIZE / 2,
+					    (VDO_COMPRESSED_BLOCK_DATA_SIZE * maximum_age) / fill_time);
+	}
+
+	WRITE_ONCE(packer->statistics.bin_age_deadline, packer->age_deadline / NSEC_PER_USEC);
+	WRITE_ONCE(packer->statistics.bin_fill_target,
+		   DIV_ROUND_UP(packer->fill_target * 100, VDO_COMPRESSED_BLOCK_DATA_SIZE));
+}
+
 /**
  * vdo_attempt_packing() - Attempt to rewrite the data in this data_vio as part of a compressed
  *                         block.
@@ -583,6 +890,7 @@ void vdo_attempt_packing(struct data_vio *data_vio)
 	 */
 	WRITE_ONCE(packer->statistics.compressed_fragments_in_packer,
 		   packer->statistics.compressed_fragments_in_packer + 1);
+	update_flush_policy(packer, data_vio);
 
 	/*
 	 * If packing of this data_vio is disallowed for administrative reasons, give up before
@@ -621,8 +929,18 @@ void vdo_attempt_packing(struct data_vio *data_vio)
  */
 static void check_for_drain_complete(struct packer *packer)
 {
-	if (vdo_is_state_draining(&packer->state) && (packer->canceled_bin->slots_used == 0))
-		vdo_finish_draining(&packer->state);
+	if (!vdo_is_state_draining(&packer->state) || (packer->canceled_bin->slots_used > 0))
+		return;
+
+	if ((atomic_read(&packer->timer_state) == PACKER_TIMER_IDLE) ||
+	    change_timer_state(packer, PACKER_TIMER_RUNNING, PACKER_TIMER_IDLE)) {
+		hrtimer_cancel(&packer->timer);
+	} else {
+		/* The timer has fired, and its completion will check again once it has run. */
+		return;
+	}
+
+	vdo_finish_draining(&packer->state);
 }
 
 /**
@@ -631,18 +949,79 @@ static void check_for_drain_complete(struct packer *packer)
  */
 static void write_all_non_empty_bins(struct packer *packer)
 {
-	struct packer_bin *bin;
+	size_t space;
 
-	list_for_each_entry(bin, &packer->bins, list)
-		write_bin(packer, bin);
-		/*
-		 * We don't need to re-sort the bin here since this loop will make every bin have
-		 * the same amount of free space, so every ordering is sorted.
-		 */
+	/*
+	 * Writing a bin empties it, which moves it to the list of bins with no space used, so only
+	 * the bins which have something in them are visited.
+	 */
+	vdo_start_enqueue_batch();
+	for (space = first_space_in_use(packer, 0);
+	     space < VDO_COMPRESSED_BLOCK_DATA_SIZE;
+	     space = first_space_in_use(packer, space + 1)) {
+		struct list_head *bins = &packer->bins_by_space[space];
+
+		while (!list_empty(bins))
+			write_bin(packer, list_first_entry(bins, struct packer_bin, space_entry));
+	}
+	vdo_finish_enqueue_batch();
 
 	check_for_drain_complete(packer);
 }
 
+/**
+ * write_aged_bins() - Write out the bins which have reached the age deadline, along with any bins
+ *                     which have reached the fill target.
+ * @completion: The packer's completion.
+ *
+ * This callback is launched by the age timer.
+ */
+static void write_aged_bins(struct vdo_completion *completion)
+{
+	struct packer *packer = container_of(completion, struct packer, completion);
+	struct packer_statistics *stats = &packer->statistics;
+	u64 now = current_time_ns(CLOCK_MONOTONIC);
+	size_t space;
+
+	vdo_assert_completion_type(completion, VDO_PACKER_COMPLETION);
+	assert_on_packer_thread(packer, __func__);
+	atomic_set(&packer->timer_state, PACKER_TIMER_IDLE);
+	if (!vdo_is_state_normal(&packer->state)) {
+		check_for_drain_complete(packer);
+		return;
+	}
+
+	vdo_start_enqueue_batch();
+	while (!list_empty(&packer->aging)) {
+		struct packer_bin *oldest =
+			list_first_entry(&packer->aging, struct packer_bin, age_entry);
+
+		if ((now - oldest->arrival) < packer->age_deadline)
+			break;
+
+		write_bin(packer, oldest);
+		WRITE_ONCE(stats->bins_written_at_deadline, stats->bins_written_at_deadline + 1);
+	}
+
+	/*
+	 * The bins with no more free space than the fill target allows are at least that full. A
+	 * bin with a single data_vio is left to wait for company.
+	 */
+	for (space = first_space_in_use(packer, 0);
+	     space <= VDO_COMPRESSED_BLOCK_DATA_SIZE - packer->fill_target;
+	     space = first_space_in_use(packer, space + 1)) {
+		struct packer_bin *bin, *tmp;
+
+		list_for_each_entry_safe(bin, tmp, &packer->bins_by_space[space], space_entry) {
+			if (bin->slots_used > 1)
+				write_bin(packer, bin);
+		}
+	}
+	vdo_finish_enqueue_batch();
+
+	start_age_timer(packer);
+}
+
 /**
  * vdo_flush_packer() - Request that the packer flush asynchronously.
  * @packer: The packer to flush.
@@ -688,8 +1067,14 @@ void vdo_remove_lock_holder_from_packer(struct vdo_completion *completion)
 	lock_holder->compression.slot = 0;
 
 	if (bin != packer->canceled_bin) {
-		bin->free_space += lock_holder->compression.size;
-		insert_in_sorted_list(packer, bin);
+		if (bin->slots_used == 0) {
+			/* This also releases the space reserved for a longer header. */
+			set_free_space(packer, bin, VDO_COMPRESSED_BLOCK_DATA_SIZE);
+			list_del_init(&bin->age_entry);
+		} else {
+			set_free_space(packer, bin,
+				       bin->free_space + lock_holder->compression.size);
+		}
 	}
 
 	abort_packing(lock_holder);
@@ -6,7 +6,10 @@
 #ifndef VDO_PACKER_H
 #define VDO_PACKER_H
 
+#include <linux/atomic.h>
+#include <linux/bitops.h>
 #include <linux/list.h>
+#include <linux/hrtimer.h>
 
 #include "admin-state.h"
 #include "constants.h"
@@ -17,6 +20,10 @@
 
 enum {
 	DEFAULT_PACKER_BINS = 16,
+	/* A bin is only written if it holds at least two data_vios, so more bins would be idle. */
+	MAXIMUM_PACKER_BINS = MAXIMUM_VDO_USER_VIOS / 2,
+	/* The longest a data_vio will wait in a bin for others to fill it */
+	PACKER_MAXIMUM_AGE_MS = 20,
 };
 
 /* The header of a compressed block. */
@@ -36,6 +43,9 @@ enum {
 	 * fragment which fills the entire data portion of a compressed block is too big.
 	 */
 	VDO_MAX_COMPRESSED_FRAGMENT_SIZE = VDO_COMPRESSED_BLOCK_DATA_SIZE - 1,
+
+	/* The number of distinct amounts of free space a bin may have, from none to an empty bin */
+	VDO_PACKER_FREE_SPACE_COUNT = VDO_COMPRESSED_BLOCK_DATA_SIZE + 1,
 };
 
 /* * The compressed block overlay. */
@@ -46,8 +56,10 @@ struct compressed_block {
 
 /*
  * Each packer_bin holds an incomplete batch of data_vios that only partially fill a compressed
- * block. The bins are kept in a ring sorted by the amount of unused space so the first bin with
- * enough space to hold a newly-compressed data_vio can easily be found. When the bin fills up or
+ * block. The bins are indexed by the amount of unused space: there is a list of the bins with each
+ * possible amount, and a bitmap of which of those lists are not empty. So the bin with the least
+ * space which can still hold a newly-compressed data_vio is found by searching the bitmap from the
+ * size of its fragment, which costs the same however many bins there are. When the bin fills up or
  * is flushed, the first uncanceled data_vio in the bin is selected to be the agent for that bin.
  * Upon entering the packer, each data_vio already has its compressed data in the first slot of the
  * data_vio's compressed_block (overlaid on the data_vio's scratch_block). So the agent's fragment
@@ -56,13 +68,26 @@ struct compressed_block {
  * successful, the agent shares its pbn lock which each of the other data_vios in its compressed
  * block and sends each on its way. Finally the agent itself continues on the write path as before.
  *
+ * A bin which does not fill up is written once its first data_vio has waited for the age deadline,
+ * and any other bin which has reached the fill target is written with it. The packer tunes both
+ * from the rate and size of the data_vios arriving, so that a bin is given about as long as it
+ * takes to collect a full block, but never longer than PACKER_MAXIMUM_AGE_MS. When data_vios
+ * arrive too slowly to fill a block in that time, the fill target drops to the fraction of a block
+ * which can be.
+ *
  * There is one special bin which is used to hold data_vios which have been canceled and removed
  * from their bin by the packer. These data_vios need to wait for the canceller to rendezvous with
  * them (VDO-2809) and so they sit in this special bin.
  */
 struct packer_bin {
-	/* List links for packer.packer_bins */
+	/* List links for packer.bins */
 	struct list_head list;
+	/* List links for the entry of packer.bins_by_space for this bin's free space */
+	struct list_head space_entry;
+	/* List links for packer.aging, while the bin is not empty */
+	struct list_head age_entry;
+	/* The time at which the first data_vio in the current batch arrived, in nanoseconds */
+	u64 arrival;
 	/* The number of items in the bin */
 	slot_number_t slots_used;
 	/* The number of compressed block bytes remaining in the current batch */
@@ -76,14 +101,39 @@ struct packer {
 	thread_id_t thread_id;
 	/* The number of bins */
 	block_count_t size;
-	/* A list of all packer_bins, kept sorted by free_space */
+	/* A list of all packer_bins, in no particular order */
 	struct list_head bins;
+	/* The packer_bins with each amount of free space, in the order they came to have it */
+	struct list_head bins_by_space[VDO_PACKER_FREE_SPACE_COUNT];
+	/* A bit for each amount of free space, set if any bin has that much */
+	unsigned long spaces_in_use[BITS_TO_LONGS(VDO_PACKER_FREE_SPACE_COUNT)];
 	/*
 	 * A bin to hold data_vios which were canceled out of the packer and are waiting to
 	 * rendezvous with the canceling data_vio.
 	 */
 	struct packer_bin *canceled_bin;
 
+	/* The bins which are not empty, in the order they were started */
+	struct list_head aging;
+
+	/* The completion run on the packer thread when the oldest bin may have reached its deadline */
+	struct vdo_completion completion;
+	/* The timer which launches the completion */
+	struct hrtimer timer;
+	/* Whether the timer is idle, running, or has fired */
+	atomic_t timer_state;
+
+	/* The time at which the last data_vio arrived, in nanoseconds */
+	u64 last_arrival;
+	/* The moving average of the time between arrivals, in sixteenths of a nanosecond */
+	u64 mean_interval;
+	/* The moving average of the compressed size of arrivals, in sixteenths of a byte */
+	u64 mean_size;
+	/* The age, in nanoseconds, at which a bin is written however full it is */
+	u64 age_deadline;
+	/* The number of bytes a bin must hold to be written along with bins at their deadline */
+	size_t fill_target;
+
 	/* The current flush generation */
 	sequence_number_t flush_generation;
 
@@ -92,10 +142,14 @@ struct packer {
 
 	/* Statistics are only updated on the packer thread, but are accessed from other threads */
 	struct packer_statistics statistics;
+
+	/* The number of data_vios not compressed because they looked incompressible */
+	atomic64_t skipped_as_incompressible;
 };
 
 int vdo_get_compressed_block_fragment(enum block_mapping_state mapping_state,
 				      struct compressed_block *block,
+				      enum vdo_compression_type *type_ptr,
 				      u16 *fragment_offset, u16 *fragment_size);
 
 int __must_check vdo_make_packer(struct vdo *vdo, block_count_t bin_count,
@@ -122,6 +176,9 @@ void vdo_dump_packer(const struct packer *packer);
 #ifdef INTERNAL
 void initialize_compressed_block(struct compressed_block *block, u16 size);
 
+void record_compression_type(struct compressed_block *block, block_size_t size,
+			     enum vdo_compression_type type);
+
 struct compression_state;
 block_size_t __must_check pack_fragment(struct compression_state *compression,
 					struct data_vio *data_vio, block_size_t offset,
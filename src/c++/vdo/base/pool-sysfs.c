@@ -12,6 +12,7 @@
 
 #include "data-vio.h"
 #include "dedupe.h"
+#include "recovery-journal.h"
 #include "vdo.h"
 
 struct pool_attribute {
@@ -49,6 +50,24 @@ static const struct sysfs_ops vdo_pool_sysfs_ops = {
 	.store = vdo_pool_attr_store,
 };
 
+static ssize_t pool_admission_deadline_ms_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       get_data_vio_pool_admission_deadline(vdo->data_vio_pool));
+}
+
+static ssize_t pool_admission_deadline_ms_store(struct vdo *vdo, const char *buf,
+						size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (kstrtouint(buf, 10, &value) < 0))
+		return -EINVAL;
+
+	set_data_vio_pool_admission_deadline(vdo->data_vio_pool, value);
+	return length;
+}
+
 static ssize_t pool_compressing_show(struct vdo *vdo, char *buf)
 {
 	return sprintf(buf, "%s\n", (vdo_get_compressing(vdo) ? "1" : "0"));
@@ -91,6 +110,60 @@ static ssize_t pool_instance_show(struct vdo *vdo, char *buf)
 	return sprintf(buf, "%u\n", vdo->instance);
 }
 
+/*
+ * Print one line for each size bucket of recovery journal commits: the range of entry counts in
+ * the bucket, and the number of commits in that range.
+ */
+static ssize_t pool_journal_commit_batch_sizes_show(struct vdo *vdo, char *buf)
+{
+	u64 counts[RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS];
+	size_t length = 0;
+	unsigned int i;
+
+	vdo_get_recovery_journal_commit_batch_sizes(vdo->recovery_journal, counts);
+	for (i = 0; i < RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS; i++)
+		length += sprintf(buf + length, "%u-%u %llu\n", 1U << i, (2U << i) - 1,
+				  (unsigned long long) counts[i]);
+
+	return length;
+}
+
+static ssize_t pool_journal_commit_window_us_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       vdo_get_recovery_journal_commit_window(vdo->recovery_journal));
+}
+
+static ssize_t pool_journal_commit_window_us_store(struct vdo *vdo, const char *buf,
+						   size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (kstrtouint(buf, 10, &value) < 0))
+		return -EINVAL;
+
+	vdo_set_recovery_journal_commit_window(vdo->recovery_journal, value);
+	return length;
+}
+
+static ssize_t pool_read_reserve_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", get_data_vio_pool_read_reserve(vdo->data_vio_pool));
+}
+
+static ssize_t pool_read_reserve_store(struct vdo *vdo, const char *buf, size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (kstrtouint(buf, 10, &value) < 0))
+		return -EINVAL;
+
+	if (set_data_vio_pool_read_reserve(vdo->data_vio_pool, value) != VDO_SUCCESS)
+		return -EINVAL;
+
+	return length;
+}
+
 static ssize_t pool_requests_active_show(struct vdo *vdo, char *buf)
 {
 	return sprintf(buf, "%u\n",
@@ -108,11 +181,102 @@ static ssize_t pool_requests_maximum_show(struct vdo *vdo, char *buf)
 		       get_data_vio_pool_maximum_requests(vdo->data_vio_pool));
 }
 
+static ssize_t pool_stage_sample_interval_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       get_data_vio_pool_stage_sample_interval(vdo->data_vio_pool));
+}
+
+static ssize_t pool_stage_sample_interval_store(struct vdo *vdo, const char *buf,
+						size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (kstrtouint(buf, 10, &value) < 0))
+		return -EINVAL;
+
+	set_data_vio_pool_stage_sample_interval(vdo->data_vio_pool, value);
+	return length;
+}
+
+/*
+ * Print one line for each asynchronous operation in which sampled data_vios have spent time: the
+ * operation, the number of samples, the mean time in nanoseconds, and the counts of the log2
+ * nanosecond histogram buckets, starting from the first non-empty bucket (whose number is given)
+ * and ending with the last.
+ */
+static ssize_t pool_stage_latencies_show(struct vdo *vdo, char *buf)
+{
+	enum async_operation_number operation;
+	size_t length = 0;
+
+	for (operation = MIN_VIO_ASYNC_OPERATION_NUMBER;
+	     operation < MAX_VIO_ASYNC_OPERATION_NUMBER; operation++) {
+		struct data_vio_stage_latencies latencies;
+		unsigned int first = 0;
+		unsigned int last = DATA_VIO_STAGE_LATENCY_BUCKETS - 1;
+		unsigned int i;
+
+		get_data_vio_pool_stage_latencies(vdo->data_vio_pool, operation, &latencies);
+		if (latencies.samples == 0)
+			continue;
+
+		while ((first < last) && (latencies.buckets[first] == 0))
+			first++;
+		while ((last > first) && (latencies.buckets[last] == 0))
+			last--;
+
+		length += snprintf(buf + length, PAGE_SIZE - length,
+				   "%s samples %llu mean_ns %llu log2_ns %u:",
+				   get_async_operation_name(operation),
+				   (unsigned long long) latencies.samples,
+				   (unsigned long long) (latencies.total_ns / latencies.samples),
+				   first);
+		for (i = first; (i <= last) && (length < PAGE_SIZE); i++)
+			length += snprintf(buf + length, PAGE_SIZE - length, " %llu",
+					   (unsigned long long) latencies.buckets[i]);
+
+		if (length < PAGE_SIZE)
+			length += snprintf(buf + length, PAGE_SIZE - length, "\n");
+		if (length >= PAGE_SIZE)
+			return PAGE_SIZE - 1;
+	}
+
+	return length;
+}
+
 static void vdo_pool_release(struct kobject *directory)
 {
 	uds_free(container_of(directory, struct vdo, vdo_directory));
 }
 
+static ssize_t pool_write_share_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", get_data_vio_pool_write_share(vdo->data_vio_pool));
+}
+
+static ssize_t pool_write_share_store(struct vdo *vdo, const char *buf, size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (kstrtouint(buf, 10, &value) < 0))
+		return -EINVAL;
+
+	if (set_data_vio_pool_write_share(vdo->data_vio_pool, value) != VDO_SUCCESS)
+		return -EINVAL;
+
+	return length;
+}
+
+static struct pool_attribute vdo_pool_admission_deadline_ms_attr = {
+	.attr = {
+			.name = "admission_deadline_ms",
+			.mode = 0644,
+		},
+	.show = pool_admission_deadline_ms_show,
+	.store = pool_admission_deadline_ms_store,
+};
+
 static struct pool_attribute vdo_pool_compressing_attr = {
 	.attr = {
 			.name = "compressing",
@@ -154,6 +318,32 @@ static struct pool_attribute vdo_pool_instance_attr = {
 	.show = pool_instance_show,
 };
 
+static struct pool_attribute vdo_pool_journal_commit_batch_sizes_attr = {
+	.attr = {
+			.name = "journal_commit_batch_sizes",
+			.mode = 0444,
+		},
+	.show = pool_journal_commit_batch_sizes_show,
+};
+
+static struct pool_attribute vdo_pool_journal_commit_window_us_attr = {
+	.attr = {
+			.name = "journal_commit_window_us",
+			.mode = 0644,
+		},
+	.show = pool_journal_commit_window_us_show,
+	.store = pool_journal_commit_window_us_store,
+};
+
+static struct pool_attribute vdo_pool_read_reserve_attr = {
+	.attr = {
+			.name = "read_reserve",
+			.mode = 0644,
+		},
+	.show = pool_read_reserve_show,
+	.store = pool_read_reserve_store,
+};
+
 static struct pool_attribute vdo_pool_requests_active_attr = {
 	.attr = {
 			.name = "requests_active",
@@ -178,15 +368,48 @@ static struct pool_attribute vdo_pool_requests_maximum_attr = {
 	.show = pool_requests_maximum_show,
 };
 
+static struct pool_attribute vdo_pool_stage_latencies_attr = {
+	.attr = {
+			.name = "stage_latencies",
+			.mode = 0444,
+		},
+	.show = pool_stage_latencies_show,
+};
+
+static struct pool_attribute vdo_pool_stage_sample_interval_attr = {
+	.attr = {
+			.name = "stage_sample_interval",
+			.mode = 0644,
+		},
+	.show = pool_stage_sample_interval_show,
+	.store = pool_stage_sample_interval_store,
+};
+
+static struct pool_attribute vdo_pool_write_share_attr = {
+	.attr = {
+			.name = "write_share",
+			.mode = 0644,
+		},
+	.show = pool_write_share_show,
+	.store = pool_write_share_store,
+};
+
 static struct attribute *pool_attrs[] = {
+	&vdo_pool_admission_deadline_ms_attr.attr,
 	&vdo_pool_compressing_attr.attr,
 	&vdo_pool_discards_active_attr.attr,
 	&vdo_pool_discards_limit_attr.attr,
 	&vdo_pool_discards_maximum_attr.attr,
 	&vdo_pool_instance_attr.attr,
+	&vdo_pool_journal_commit_batch_sizes_attr.attr,
+	&vdo_pool_journal_commit_window_us_attr.attr,
+	&vdo_pool_read_reserve_attr.attr,
 	&vdo_pool_requests_active_attr.attr,
 	&vdo_pool_requests_limit_attr.attr,
 	&vdo_pool_requests_maximum_attr.attr,
+	&vdo_pool_stage_latencies_attr.attr,
+	&vdo_pool_stage_sample_interval_attr.attr,
+	&vdo_pool_write_share_attr.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(pool);
@@ -7,16 +7,21 @@
 
 #include <linux/atomic.h>
 #include <linux/bio.h>
+#include <linux/hrtimer.h>
+#include <linux/log2.h>
+#include <linux/minmax.h>
 
 #include "logger.h"
 #include "memory-alloc.h"
 #include "permassert.h"
+#include "time-utils.h"
 
 #include "block-map.h"
 #include "completion.h"
 #include "constants.h"
 #include "data-vio.h"
 #include "encodings.h"
+#include "funnel-workqueue.h"
 #include "io-submitter.h"
 #include "slab-depot.h"
 #include "types.h"
@@ -35,6 +40,21 @@ enum {
 	RECOVERY_JOURNAL_RESERVED_BLOCKS =
 		(MAXIMUM_VDO_USER_VIOS / RECOVERY_JOURNAL_ENTRIES_PER_BLOCK) + 2,
 	WRITE_FLAGS = REQ_OP_WRITE | REQ_PRIO | REQ_PREFLUSH | REQ_SYNC | REQ_FUA,
+	/* The default longest time to hold a partial block open for more entries */
+	RECOVERY_JOURNAL_DEFAULT_COMMIT_WINDOW_US = 100,
+	/* The adaptive window never shrinks below this fraction of the longest one */
+	RECOVERY_JOURNAL_COMMIT_WINDOW_RANGE = 16,
+	/*
+	 * A partial block is only held if at least this many writes have yet to make their
+	 * entries.
+	 */
+	RECOVERY_JOURNAL_GROUP_COMMIT_MIN_IN_FLIGHT = 4,
+};
+
+enum commit_timer_state {
+	COMMIT_TIMER_IDLE,
+	COMMIT_TIMER_RUNNING,
+	COMMIT_TIMER_FIRED,
 };
 
 /**
@@ -294,6 +314,39 @@ static inline bool has_block_waiters(struct recovery_journal *journal)
 static void recycle_journal_blocks(struct recovery_journal *journal);
 static void recycle_journal_block(struct recovery_journal_block *block);
 static void notify_commit_waiters(struct recovery_journal *journal);
+static void recheck_held_block(struct vdo_completion *completion);
+
+static inline bool change_commit_timer_state(struct recovery_journal *journal, int old, int new)
+{
+	return (atomic_cmpxchg(&journal->commit_timer_state, old, new) == old);
+}
+
+static enum hrtimer_restart commit_timer_fired(struct hrtimer *timer)
+{
+	struct recovery_journal *journal =
+		container_of(timer, struct recovery_journal, commit_timer);
+
+	if (change_commit_timer_state(journal, COMMIT_TIMER_RUNNING, COMMIT_TIMER_FIRED))
+		vdo_launch_completion(&journal->commit_completion);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * cancel_commit_timer() - Stop the timer for a held block, unless it has already fired.
+ * @journal: The journal.
+ *
+ * Return: true if the timer is stopped, false if its completion has yet to run.
+ */
+static bool cancel_commit_timer(struct recovery_journal *journal)
+{
+	if ((atomic_read(&journal->commit_timer_state) != COMMIT_TIMER_IDLE) &&
+	    !change_commit_timer_state(journal, COMMIT_TIMER_RUNNING, COMMIT_TIMER_IDLE))
+		return false;
+
+	hrtimer_cancel(&journal->commit_timer);
+	return true;
+}
 
 /**
  * suspend_lock_counter() - Prevent the lock counter from notifying.
@@ -351,6 +404,7 @@ static void check_for_drain_complete(struct recovery_journal *journal)
 	    journal->reaping ||
 	    has_block_waiters(journal) ||
 	    vdo_waitq_has_waiters(&journal->entry_waiters) ||
+	    !cancel_commit_timer(journal) ||
 	    !suspend_lock_counter(&journal->lock_counter))
 		return;
 
@@ -712,6 +766,8 @@ int vdo_decode_recovery_journal(struct recovery_journal_state_7_0 state, nonce_t
 	struct recovery_journal *journal;
 	int result;
 
+	BUILD_BUG_ON(RECOVERY_JOURNAL_ENTRIES_PER_BLOCK >=
+		     (1 << RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS));
 	result = uds_allocate_extended(struct recovery_journal,
 				       RECOVERY_JOURNAL_RESERVED_BLOCKS,
 				       struct recovery_journal_block, __func__,
@@ -722,6 +778,9 @@ int vdo_decode_recovery_journal(struct recovery_journal_state_7_0 state, nonce_t
 	INIT_LIST_HEAD(&journal->free_tail_blocks);
 	INIT_LIST_HEAD(&journal->active_tail_blocks);
 	vdo_waitq_init(&journal->pending_writes);
+	hrtimer_init(&journal->commit_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	journal->commit_timer.function = commit_timer_fired;
+	atomic_set(&journal->commit_timer_state, COMMIT_TIMER_IDLE);
 
 	journal->thread_id = vdo->thread_config.journal_thread;
 	journal->origin = partition->offset;
@@ -775,6 +834,12 @@ int vdo_decode_recovery_journal(struct recovery_journal_state_7_0 state, nonce_t
 	}
 
 	journal->flush_vio->completion.callback_thread_id = journal->thread_id;
+	journal->max_commit_window = RECOVERY_JOURNAL_DEFAULT_COMMIT_WINDOW_US * NSEC_PER_USEC;
+	journal->commit_window = journal->max_commit_window;
+	vdo_initialize_completion(&journal->commit_completion, vdo,
+				  VDO_RECOVERY_JOURNAL_COMPLETION);
+	vdo_prepare_completion(&journal->commit_completion, recheck_held_block,
+			       recheck_held_block, journal->thread_id, journal);
 	*journal_ptr = journal;
 	return VDO_SUCCESS;
 }
@@ -790,6 +855,7 @@ void vdo_free_recovery_journal(struct recovery_journal *journal)
 	if (journal == NULL)
 		return;
 
+	hrtimer_cancel(&journal->commit_timer);
 	uds_free(uds_forget(journal->lock_counter.logical_zone_counts));
 	uds_free(uds_forget(journal->lock_counter.physical_zone_counts));
 	uds_free(uds_forget(journal->lock_counter.journal_counters));
@@ -1187,7 +1253,7 @@ static void continue_committed_waiter(struct vdo_waiter *waiter, void *context)
 			data_vio->recovery_journal_point.entry_count);
 
 	journal->commit_point = data_vio->recovery_journal_point;
-	data_vio->last_async_operation = VIO_ASYNC_OP_UPDATE_REFERENCE_COUNTS;
+	set_data_vio_async_operation(data_vio, VIO_ASYNC_OP_UPDATE_REFERENCE_COUNTS);
 	if (result != VDO_SUCCESS) {
 		continue_data_vio_with_error(data_vio, result);
 		return;
@@ -1213,9 +1279,11 @@ static void notify_commit_waiters(struct recovery_journal *journal)
 {
 	struct recovery_journal_block *block;
 
+	/* A commit can release many data_vios at once, so hand them off together. */
+	vdo_start_enqueue_batch();
 	list_for_each_entry(block, &journal->active_tail_blocks, list_node) {
 		if (block->committing)
-			return;
+			break;
 
 		vdo_waitq_notify_all_waiters(&block->commit_waiters,
 					     continue_committed_waiter, journal);
@@ -1225,9 +1293,10 @@ static void notify_commit_waiters(struct recovery_journal *journal)
 						     journal);
 		} else if (is_block_dirty(block) || !is_block_full(block)) {
 			/* Stop at partially-committed or partially-filled blocks. */
-			return;
+			break;
 		}
 	}
+	vdo_finish_enqueue_batch();
 }
 
 /**
@@ -1363,6 +1432,28 @@ static void add_queued_recovery_entries(struct recovery_journal_block *block)
 	}
 }
 
+/**
+ * end_hold() - Adapt the commit window when a block which was being held open is written.
+ * @journal: The journal.
+ * @entries: The number of entries in the commit.
+ *
+ * If holding gathered more entries, the window grows so that the next hold may gather more. If it
+ * did not, the window shrinks so that holds which are not paying for themselves cost less latency.
+ */
+static void end_hold(struct recovery_journal *journal, journal_entry_count_t entries)
+{
+	if (journal->hold_start == 0)
+		return;
+
+	/* If the timer has already fired, its recheck will find nothing held. */
+	cancel_commit_timer(journal);
+	journal->hold_start = 0;
+	if (entries > journal->held_entries)
+		journal->commit_window *= 2;
+	else
+		journal->commit_window /= 2;
+}
+
 /**
  * write_block() - Issue a block for writing.
  *
@@ -1381,6 +1472,9 @@ static void write_block(struct vdo_waiter *waiter, void *context __always_unused
 
 	block->entries_in_commit = vdo_waitq_num_waiters(&block->entry_waiters);
 	add_queued_recovery_entries(block);
+	end_hold(journal, block->entries_in_commit);
+	WRITE_ONCE(journal->commit_batch_sizes[ilog2(block->entries_in_commit)],
+		   journal->commit_batch_sizes[ilog2(block->entries_in_commit)] + 1);
 
 	journal->pending_write_count += 1;
 	journal->events.blocks.written += 1;
@@ -1401,6 +1495,54 @@ static void write_block(struct vdo_waiter *waiter, void *context __always_unused
 				complete_write_endio, handle_write_error, WRITE_FLAGS);
 }
 
+/**
+ * hold_active_block() - Decide whether to hold the partially filled active block open for more
+ *                       entries rather than commit it now.
+ * @journal: The journal, which has no writes outstanding.
+ *
+ * Every commit is a flush and FUA write, so committing the active block as soon as the journal is
+ * idle issues many nearly empty writes at moderate concurrency. If enough writes have yet to make
+ * their entries, more entries are on their way, so the block is held for a short window. Each new
+ * entry rechecks the hold, and a high resolution timer rechecks it once the window has passed. A
+ * block which fills is written as soon as it does. At low concurrency, or if the window is 0, the
+ * block is written immediately.
+ *
+ * Return: true if the block is being held.
+ */
+static bool hold_active_block(struct recovery_journal *journal)
+{
+	struct recovery_journal_block *block = journal->active_block;
+	u64 max_window = READ_ONCE(journal->max_commit_window);
+	size_t waiting = vdo_waitq_num_waiters(&block->entry_waiters);
+	struct vdo *vdo = journal->commit_completion.vdo;
+	u64 now;
+
+	if ((max_window == 0) || block->committing || (waiting == 0) ||
+	    !vdo_is_state_normal(&journal->state) || is_read_only(journal))
+		return false;
+
+	if (get_data_vio_pool_pending_writes(vdo->data_vio_pool) <
+	    RECOVERY_JOURNAL_GROUP_COMMIT_MIN_IN_FLIGHT)
+		return false;
+
+	journal->commit_window = min(max(journal->commit_window,
+					 max_window / RECOVERY_JOURNAL_COMMIT_WINDOW_RANGE),
+				     max_window);
+	now = current_time_ns(CLOCK_MONOTONIC);
+	if (journal->hold_start == 0) {
+		journal->hold_start = now;
+		journal->held_entries = waiting;
+	} else if ((now - journal->hold_start) >= journal->commit_window) {
+		return false;
+	}
+
+	if (change_commit_timer_state(journal, COMMIT_TIMER_IDLE, COMMIT_TIMER_RUNNING))
+		hrtimer_start(&journal->commit_timer,
+			      ns_to_ktime(journal->hold_start + journal->commit_window),
+			      HRTIMER_MODE_ABS);
+
+	return true;
+}
 
 /**
  * write_blocks() - Attempt to commit blocks, according to write policy.
@@ -1412,11 +1554,12 @@ static void write_blocks(struct recovery_journal *journal)
 	/*
 	 * We call this function after adding entries to the journal and after finishing a block
 	 * write. Thus, when this function terminates we must either have no VIOs waiting in the
-	 * journal or have some outstanding IO to provide a future wakeup.
+	 * journal or have some outstanding IO, or a held block timer, to provide a future
+	 * wakeup.
 	 *
 	 * We want to only issue full blocks if there are no pending writes. However, if there are
 	 * no outstanding writes and some unwritten entries, we must issue a block, even if it's
-	 * the active block and it isn't full.
+	 * the active block and it isn't full, unless it is being held open for more entries.
 	 */
 	if (journal->pending_write_count > 0)
 		return;
@@ -1428,10 +1571,24 @@ static void write_blocks(struct recovery_journal *journal)
 	 * Do we need to write the active block? Only if we have no outstanding writes, even after
 	 * issuing all of the full writes.
 	 */
-	if ((journal->pending_write_count == 0) && (journal->active_block != NULL))
+	if ((journal->pending_write_count == 0) && (journal->active_block != NULL) &&
+	    !hold_active_block(journal))
 		write_block(&journal->active_block->write_waiter, NULL);
 }
 
+/**
+ * recheck_held_block() - Write a held block if it should no longer be held.
+ * @completion: The journal's commit completion.
+ */
+static void recheck_held_block(struct vdo_completion *completion)
+{
+	struct recovery_journal *journal = completion->parent;
+
+	atomic_set(&journal->commit_timer_state, COMMIT_TIMER_IDLE);
+	write_blocks(journal);
+	check_for_drain_complete(journal);
+}
+
 /**
  * vdo_add_recovery_journal_entry() - Add an entry to a recovery journal.
  * @journal: The journal in which to make an entry.
@@ -1448,6 +1605,7 @@ void vdo_add_recovery_journal_entry(struct recovery_journal *journal,
 				    struct data_vio *data_vio)
 {
 	assert_on_journal_thread(journal, __func__);
+	clear_data_vio_pending_write(data_vio);
 	if (!vdo_is_state_normal(&journal->state)) {
 		continue_data_vio_with_error(data_vio, VDO_INVALID_ADMIN_STATE);
 		return;
@@ -1715,6 +1873,46 @@ vdo_get_recovery_journal_statistics(const struct recovery_journal *journal)
 	return journal->events;
 }
 
+/**
+ * vdo_get_recovery_journal_commit_window() - Get the longest time a partial journal block may be
+ *                                            held open for more entries.
+ * @journal: The recovery journal.
+ *
+ * Return: The window in microseconds; 0 means blocks are never held.
+ */
+unsigned int vdo_get_recovery_journal_commit_window(const struct recovery_journal *journal)
+{
+	return READ_ONCE(journal->max_commit_window) / NSEC_PER_USEC;
+}
+
+/**
+ * vdo_set_recovery_journal_commit_window() - Set the longest time a partial journal block may be
+ *                                            held open for more entries.
+ * @journal: The recovery journal.
+ * @window_us: The window in microseconds; 0 writes each block as soon as the journal is idle,
+ *             favoring latency over the number of journal writes.
+ */
+void vdo_set_recovery_journal_commit_window(struct recovery_journal *journal,
+					    unsigned int window_us)
+{
+	WRITE_ONCE(journal->max_commit_window, (u64) window_us * NSEC_PER_USEC);
+}
+
+/**
+ * vdo_get_recovery_journal_commit_batch_sizes() - Get the number of journal commits of each size.
+ * @journal: The recovery journal.
+ * @counts: An array of RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS counts to fill; bucket i counts the
+ *          commits of between 2^i and 2^(i+1) - 1 entries.
+ */
+void vdo_get_recovery_journal_commit_batch_sizes(const struct recovery_journal *journal,
+						 u64 *counts)
+{
+	unsigned int i;
+
+	for (i = 0; i < RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS; i++)
+		counts[i] = READ_ONCE(journal->commit_batch_sizes[i]);
+}
+
 /**
  * dump_recovery_block() - Dump the contents of the recovery block to the log.
  * @block: The block to dump.
@@ -6,6 +6,8 @@
 #ifndef VDO_RECOVERY_JOURNAL_H
 #define VDO_RECOVERY_JOURNAL_H
 
+#include <linux/atomic.h>
+#include <linux/hrtimer.h>
 #include <linux/list.h>
 
 #include "numeric.h"
@@ -77,6 +79,11 @@
  * 'reap_completion', and will be woken the next time a journal block is reaped.
  */
 
+enum {
+	/* Journal commits are counted by size in log2 buckets: 1, 2-3, 4-7, and so on. */
+	RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS = 9,
+};
+
 enum vdo_zone_type {
 	VDO_ZONE_TYPE_ADMIN,
 	VDO_ZONE_TYPE_JOURNAL,
@@ -207,6 +214,22 @@ struct recovery_journal {
 	block_count_t slab_journal_commit_threshold;
 	/* Counters for events in the journal that are reported as statistics */
 	struct recovery_journal_statistics events;
+	/* The number of commits of each size, in log2 buckets */
+	u64 commit_batch_sizes[RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS];
+	/* The longest a partial block may be held open for more entries, in ns; 0 never holds */
+	u64 max_commit_window;
+	/* The current hold window in ns, adapted to how many entries holding gathers */
+	u64 commit_window;
+	/* When the active block started being held open, or 0 if it is not being held */
+	u64 hold_start;
+	/* The number of entries waiting in the active block when it started being held */
+	journal_entry_count_t held_entries;
+	/* The timer which launches the commit completion when a held block's window has passed */
+	struct hrtimer commit_timer;
+	/* Whether the commit timer is idle, running, or has fired */
+	atomic_t commit_timer_state;
+	/* The completion for rechecking a held block */
+	struct vdo_completion commit_completion;
 	/* The locks for each on-disk block */
 	struct lock_counter lock_counter;
 	/* The tail blocks */
@@ -307,6 +330,15 @@ vdo_get_recovery_journal_logical_blocks_used(const struct recovery_journal *jour
 struct recovery_journal_statistics __must_check
 vdo_get_recovery_journal_statistics(const struct recovery_journal *journal);
 
+unsigned int __must_check
+vdo_get_recovery_journal_commit_window(const struct recovery_journal *journal);
+
+void vdo_set_recovery_journal_commit_window(struct recovery_journal *journal,
+					    unsigned int window_us);
+
+void vdo_get_recovery_journal_commit_batch_sizes(const struct recovery_journal *journal,
+						 u64 *counts);
+
 void vdo_dump_recovery_journal_statistics(const struct recovery_journal *journal);
 
 #ifdef INTERNAL
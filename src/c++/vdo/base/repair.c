@@ -5,12 +5,14 @@
 
 #include "repair.h"
 
+#include <asm/unaligned.h>
 #include <linux/min_heap.h>
 #include <linux/minmax.h>
 
 #include "logger.h"
 #include "memory-alloc.h"
 #include "permassert.h"
+#include "radix-sort.h"
 
 #include "block-map.h"
 #include "completion.h"
@@ -51,6 +53,24 @@ struct recovery_point {
 	bool increment_applied;
 };
 
+enum {
+	/* The sort key of a sortable_block_mapping: the page pbn, the slot, and the number */
+	SORTABLE_MAPPING_PBN_OFFSET = 0,
+	SORTABLE_MAPPING_SLOT_OFFSET = SORTABLE_MAPPING_PBN_OFFSET + sizeof(physical_block_number_t),
+	SORTABLE_MAPPING_NUMBER_OFFSET = SORTABLE_MAPPING_SLOT_OFFSET + sizeof(slot_number_t),
+	SORTABLE_MAPPING_KEY_SIZE = SORTABLE_MAPPING_NUMBER_OFFSET + sizeof(u32),
+};
+
+/*
+ * A numbered block mapping rewritten in place for parallel replay. The fields which order the
+ * mappings are stored big-endian at the front, so that comparing the keys as bytes, as the radix
+ * sort does, gives the same order as mapping_is_less_than().
+ */
+struct sortable_block_mapping {
+	u8 key[SORTABLE_MAPPING_KEY_SIZE];
+	struct block_map_entry block_map_entry;
+} __packed;
+
 struct repair_completion {
 	/* The completion header */
 	struct vdo_completion completion;
@@ -104,6 +124,16 @@ struct repair_completion {
 	/* Current requested page's PBN */
 	physical_block_number_t pbn;
 
+	/* These fields are only used when the logical zones replay the journal in parallel. */
+	/* The number of zones replaying entries */
+	zone_count_t replay_zone_count;
+	/* The number of zones which have not finished replaying */
+	zone_count_t replay_zones_active;
+	/* The replay state of each zone */
+	struct replay_zone *replay_zones;
+	/* The keys of the sortable entries, grouped by zone */
+	const u8 **sort_keys;
+
 	/* These fields are only used during recovery. */
 	/* A location just beyond the last valid entry of the journal */
 	struct recovery_point tail_recovery_point;
@@ -128,6 +158,34 @@ struct repair_completion {
 	struct vdo_page_completion page_completions[];
 };
 
+/*
+ * The part of a parallel block map replay done by one logical zone. Each zone sorts the entries
+ * for the block map pages assigned to it and applies them through its own page cache, in the same
+ * way as the single-threaded replay does for all of the entries.
+ */
+struct replay_zone {
+	/* The completion for running on the zone's thread */
+	struct vdo_completion completion;
+	struct repair_completion *repair;
+	struct block_map_zone *block_map_zone;
+	struct radix_sorter *sorter;
+	/* The keys of the zone's entries, in page order once sorted */
+	const u8 **keys;
+	size_t entry_count;
+	/* The next entry to apply */
+	size_t current_entry;
+	/* The first entry on the next page to fetch */
+	size_t current_unfetched_entry;
+	/* The page of the next entry to apply */
+	physical_block_number_t pbn;
+	/* The number of pages being fetched */
+	page_count_t outstanding;
+	bool launching;
+	/* The zone's share of the repair's page completions */
+	page_count_t page_count;
+	struct vdo_page_completion *page_completions;
+};
+
 /*
  * This is a min_heap callback function that orders numbered_block_mappings using the
  * 'block_map_slot' field as the primary key and the mapping 'number' field as the secondary key.
@@ -206,7 +264,7 @@ static void prepare_repair_completion(struct repair_completion *repair,
 	const struct thread_config *thread_config = &completion->vdo->thread_config;
 	thread_id_t thread_id;
 
-	/* All blockmap access is done on single thread, so use logical zone 0. */
+	/* Block map replay is run, or coordinated, from logical zone 0. */
 	thread_id = ((zone_type == VDO_ZONE_TYPE_LOGICAL) ?
 		     thread_config->logical_threads[0] :
 		     thread_config->admin_thread);
@@ -231,6 +289,9 @@ static void uninitialize_vios(struct repair_completion *repair)
 
 STATIC void free_repair_completion(struct repair_completion *repair)
 {
+	struct block_map *map;
+	zone_count_t z;
+
 	if (repair == NULL)
 		return;
 
@@ -238,11 +299,20 @@ STATIC void free_repair_completion(struct repair_completion *repair)
 	 * We do this here because this function is the only common bottleneck for all clean up
 	 * paths.
 	 */
-	repair->completion.vdo->block_map->zones[0].page_cache.rebuilding = false;
+	map = repair->completion.vdo->block_map;
+	for (z = 0; z < map->zone_count; z++)
+		map->zones[z].page_cache.rebuilding = false;
+
+	if (repair->replay_zones != NULL) {
+		for (z = 0; z < repair->replay_zone_count; z++)
+			uds_free_radix_sorter(repair->replay_zones[z].sorter);
+	}
 
 	uninitialize_vios(repair);
 	uds_free(uds_forget(repair->journal_data));
 	uds_free(uds_forget(repair->entries));
+	uds_free(uds_forget(repair->replay_zones));
+	uds_free(uds_forget(repair->sort_keys));
 	uds_free(repair);
 }
 
@@ -1093,12 +1163,327 @@ static void recover_ready_pages(struct repair_completion *repair,
 	}
 }
 
+static inline struct replay_zone * __must_check as_replay_zone(struct vdo_completion *completion)
+{
+	vdo_assert_completion_type(completion, VDO_REPAIR_ZONE_COMPLETION);
+	return container_of(completion, struct replay_zone, completion);
+}
+
+static inline const struct sortable_block_mapping *get_sorted_mapping(struct replay_zone *zone,
+								      size_t entry)
+{
+	return (const struct sortable_block_mapping *) zone->keys[entry];
+}
+
+static inline physical_block_number_t get_sorted_pbn(struct replay_zone *zone, size_t entry)
+{
+	return get_unaligned_be64(&zone->keys[entry][SORTABLE_MAPPING_PBN_OFFSET]);
+}
+
+/**
+ * finish_zone_replay() - Note that a zone has finished replaying, and continue the repair once all
+ *                        of the zones have.
+ * @completion: The zone's completion.
+ */
+static void finish_zone_replay(struct vdo_completion *completion)
+{
+	struct replay_zone *zone = as_replay_zone(completion);
+	struct repair_completion *repair = zone->repair;
+
+	vdo_assert_on_logical_zone_thread(completion->vdo, 0, __func__);
+	if (completion->result != VDO_SUCCESS)
+		vdo_set_completion_result(&repair->completion, completion->result);
+
+	if (--repair->replay_zones_active > 0)
+		return;
+
+	if (repair->completion.result != VDO_SUCCESS) {
+		vdo_launch_completion(&repair->completion);
+		return;
+	}
+
+	launch_repair_completion(repair, flush_block_map, VDO_ZONE_TYPE_ADMIN);
+}
+
+static bool finish_zone_if_done(struct replay_zone *zone)
+{
+	struct vdo_completion *completion = &zone->completion;
+
+	/* Pages are still being launched or there is still work to do */
+	if (zone->launching || (zone->outstanding > 0))
+		return false;
+
+	if (completion->result != VDO_SUCCESS) {
+		page_count_t i;
+
+		for (i = 0; i < zone->page_count; i++) {
+			struct vdo_page_completion *page_completion = &zone->page_completions[i];
+
+			if (page_completion->ready)
+				vdo_release_page_completion(&page_completion->completion);
+		}
+	} else if (zone->current_entry < zone->entry_count) {
+		return false;
+	}
+
+	vdo_set_completion_callback(completion, finish_zone_replay,
+				    completion->vdo->thread_config.logical_threads[0]);
+	vdo_launch_completion(completion);
+	return true;
+}
+
+static void abort_zone_replay(struct replay_zone *zone, int result)
+{
+	vdo_set_completion_result(&zone->completion, result);
+	finish_zone_if_done(zone);
+}
+
+/* Find the first entry after a given one which is on a different block map page. */
+static size_t find_zone_entry_starting_next_page(struct replay_zone *zone, size_t entry)
+{
+	physical_block_number_t pbn = get_sorted_pbn(zone, entry);
+
+	while ((entry < zone->entry_count) && (get_sorted_pbn(zone, entry) == pbn))
+		entry++;
+
+	return entry;
+}
+
+/* Apply the sorted entries [start, end) to a block map page. */
+static void apply_zone_entries_to_page(struct block_map_page *page, struct replay_zone *zone,
+				       size_t start, size_t end)
+{
+	for (; start < end; start++) {
+		const struct sortable_block_mapping *mapping = get_sorted_mapping(zone, start);
+		slot_number_t slot =
+			get_unaligned_be16(&mapping->key[SORTABLE_MAPPING_SLOT_OFFSET]);
+
+		page->entries[slot] = mapping->block_map_entry;
+	}
+}
+
+static void recover_ready_zone_pages(struct replay_zone *zone, struct vdo_completion *completion);
+
+static void zone_page_loaded(struct vdo_completion *completion)
+{
+	struct replay_zone *zone = completion->parent;
+
+	zone->outstanding--;
+	if (!zone->launching)
+		recover_ready_zone_pages(zone, completion);
+}
+
+static void handle_zone_page_load_error(struct vdo_completion *completion)
+{
+	struct replay_zone *zone = completion->parent;
+
+	zone->outstanding--;
+	abort_zone_replay(zone, completion->result);
+}
+
+static void fetch_zone_page(struct replay_zone *zone, struct vdo_completion *completion)
+{
+	physical_block_number_t pbn;
+
+	if (zone->current_unfetched_entry >= zone->entry_count)
+		/* Nothing left to fetch. */
+		return;
+
+	pbn = get_sorted_pbn(zone, zone->current_unfetched_entry);
+	zone->current_unfetched_entry =
+		find_zone_entry_starting_next_page(zone, zone->current_unfetched_entry);
+	zone->outstanding++;
+	vdo_get_page(((struct vdo_page_completion *) completion), zone->block_map_zone, pbn,
+		     true, zone, zone_page_loaded, handle_zone_page_load_error, false);
+}
+
+static void recover_ready_zone_pages(struct replay_zone *zone, struct vdo_completion *completion)
+{
+	struct vdo_page_completion *page_completion = (struct vdo_page_completion *) completion;
+
+	if (finish_zone_if_done(zone))
+		return;
+
+	if (zone->pbn != page_completion->pbn)
+		return;
+
+	while (page_completion->ready) {
+		size_t start_of_next_page;
+		struct block_map_page *page;
+		int result;
+
+		result = vdo_get_cached_page(completion, &page);
+		if (result != VDO_SUCCESS) {
+			abort_zone_replay(zone, result);
+			return;
+		}
+
+		start_of_next_page = find_zone_entry_starting_next_page(zone, zone->current_entry);
+		apply_zone_entries_to_page(page, zone, zone->current_entry, start_of_next_page);
+		zone->current_entry = start_of_next_page;
+		vdo_request_page_write(completion);
+		vdo_release_page_completion(completion);
+
+		if (finish_zone_if_done(zone))
+			return;
+
+		zone->pbn = get_sorted_pbn(zone, zone->current_entry);
+		fetch_zone_page(zone, completion);
+		page_completion++;
+		if (page_completion == &zone->page_completions[zone->page_count])
+			page_completion = &zone->page_completions[0];
+		completion = &page_completion->completion;
+	}
+}
+
+/**
+ * replay_zone_entries() - Sort a zone's share of the journal entries and apply them to its block
+ *                         map pages.
+ * @completion: The zone's completion.
+ */
+static void replay_zone_entries(struct vdo_completion *completion)
+{
+	struct replay_zone *zone = as_replay_zone(completion);
+	struct vdo *vdo = completion->vdo;
+	page_count_t i;
+	int result;
+
+	vdo_assert_on_logical_zone_thread(vdo, zone->block_map_zone->zone_number, __func__);
+
+	/* Suppress block map errors. */
+	zone->block_map_zone->page_cache.rebuilding =
+		vdo_state_requires_read_only_rebuild(vdo->load_state);
+
+	if (zone->entry_count == 0) {
+		finish_zone_if_done(zone);
+		return;
+	}
+
+	result = uds_radix_sort(zone->sorter, zone->keys, zone->entry_count,
+				SORTABLE_MAPPING_KEY_SIZE);
+	if (result != VDO_SUCCESS) {
+		abort_zone_replay(zone, result);
+		return;
+	}
+
+	/* Prevent any page from being processed until all pages have been launched. */
+	zone->launching = true;
+	zone->pbn = get_sorted_pbn(zone, 0);
+	for (i = 0; i < zone->page_count; i++) {
+		if (zone->current_unfetched_entry >= zone->entry_count)
+			break;
+
+		fetch_zone_page(zone, &zone->page_completions[i].completion);
+	}
+	zone->launching = false;
+
+	/* Process any ready pages. */
+	recover_ready_zone_pages(zone, &zone->page_completions[0].completion);
+}
+
+static inline zone_count_t get_replay_zone(physical_block_number_t pbn, zone_count_t zone_count)
+{
+	return pbn % zone_count;
+}
+
+/**
+ * replay_in_parallel() - Partition the journal entries among the logical zones, and have every
+ *                        zone sort and apply its share concurrently.
+ * @repair: The repair completion.
+ *
+ * Journal entries record the block map page and slot they change, not the logical block, so the
+ * pages are assigned to zones by pbn. Each page is therefore replayed through exactly one zone's
+ * cache. The entries are rewritten in place as sortable mappings while they are partitioned,
+ * leaving the sorting, which dominates, to the zones.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+static int replay_in_parallel(struct repair_completion *repair)
+{
+	struct vdo *vdo = repair->completion.vdo;
+	zone_count_t zone_count = vdo->thread_config.logical_zone_count;
+	page_count_t pages_per_zone = repair->page_count / zone_count;
+	const u8 **next_key;
+	zone_count_t z;
+	size_t i;
+	int result;
+
+	BUILD_BUG_ON(sizeof(struct sortable_block_mapping) !=
+		     sizeof(struct numbered_block_mapping));
+
+	result = uds_allocate(zone_count, struct replay_zone, __func__, &repair->replay_zones);
+	if (result != VDO_SUCCESS)
+		return result;
+
+	repair->replay_zone_count = zone_count;
+	result = uds_allocate(repair->block_map_entry_count, const u8 *, __func__,
+			      &repair->sort_keys);
+	if (result != VDO_SUCCESS)
+		return result;
+
+	for (i = 0; i < repair->block_map_entry_count; i++) {
+		physical_block_number_t pbn = repair->entries[i].block_map_slot.pbn;
+
+		repair->replay_zones[get_replay_zone(pbn, zone_count)].entry_count++;
+	}
+
+	next_key = repair->sort_keys;
+	for (z = 0; z < zone_count; z++) {
+		struct replay_zone *zone = &repair->replay_zones[z];
+
+		result = uds_make_radix_sorter(zone->entry_count, &zone->sorter);
+		if (result != VDO_SUCCESS)
+			return result;
+
+		zone->repair = repair;
+		zone->block_map_zone = &vdo->block_map->zones[z];
+		zone->keys = next_key;
+		next_key += zone->entry_count;
+		zone->entry_count = 0;
+		zone->page_count = pages_per_zone;
+		zone->page_completions = &repair->page_completions[z * pages_per_zone];
+		vdo_initialize_completion(&zone->completion, vdo, VDO_REPAIR_ZONE_COMPLETION);
+	}
+
+	for (i = 0; i < repair->block_map_entry_count; i++) {
+		struct numbered_block_mapping mapping = repair->entries[i];
+		struct sortable_block_mapping *sortable =
+			(struct sortable_block_mapping *) &repair->entries[i];
+		struct replay_zone *zone =
+			&repair->replay_zones[get_replay_zone(mapping.block_map_slot.pbn,
+							      zone_count)];
+
+		put_unaligned_be64(mapping.block_map_slot.pbn,
+				   &sortable->key[SORTABLE_MAPPING_PBN_OFFSET]);
+		put_unaligned_be16(mapping.block_map_slot.slot,
+				   &sortable->key[SORTABLE_MAPPING_SLOT_OFFSET]);
+		put_unaligned_be32(mapping.number, &sortable->key[SORTABLE_MAPPING_NUMBER_OFFSET]);
+		sortable->block_map_entry = mapping.block_map_entry;
+		zone->keys[zone->entry_count++] = sortable->key;
+	}
+
+	/* Requeue every zone, including zone 0, so that no zone waits for another's sort. */
+	repair->replay_zones_active = zone_count;
+	for (z = 0; z < zone_count; z++) {
+		struct replay_zone *zone = &repair->replay_zones[z];
+
+		vdo_prepare_completion_for_requeue(&zone->completion, replay_zone_entries,
+						   finish_zone_replay,
+						   vdo->thread_config.logical_threads[z], NULL);
+		vdo_launch_completion(&zone->completion);
+	}
+
+	return VDO_SUCCESS;
+}
+
 STATIC void recover_block_map(struct vdo_completion *completion)
 {
 	struct repair_completion *repair = as_repair_completion(completion);
 	struct vdo *vdo = completion->vdo;
 	struct numbered_block_mapping *first_sorted_entry;
+	zone_count_t zone_count;
 	page_count_t i;
+	int result;
 
 	vdo_assert_on_logical_zone_thread(vdo, 0, __func__);
 
@@ -1116,6 +1501,25 @@ STATIC void recover_block_map(struct vdo_completion *completion)
 		return;
 	}
 
+#ifdef INTERNAL
+	/* This message must be in sync with VDOTest::RebuildBase. */
+#endif /* INTERNAL */
+	uds_log_info("Replaying %zu recovery entries into block map",
+		     repair->block_map_entry_count);
+
+	/*
+	 * With several logical zones, and enough page completions to give each some, each zone
+	 * sorts and replays the entries for its own pages.
+	 */
+	zone_count = vdo->thread_config.logical_zone_count;
+	if ((zone_count > 1) && (repair->page_count >= zone_count)) {
+		result = replay_in_parallel(repair);
+		if (result != VDO_SUCCESS)
+			vdo_continue_completion(completion, result);
+
+		return;
+	}
+
 	/*
 	 * Organize the journal entries into a binary heap so we can iterate over them in sorted
 	 * order incrementally, avoiding an expensive sort call.
@@ -1127,12 +1531,6 @@ STATIC void recover_block_map(struct vdo_completion *completion)
 	};
 	min_heapify_all(&repair->replay_heap, &repair_min_heap);
 
-#ifdef INTERNAL
-	/* This message must be in sync with VDOTest::RebuildBase. */
-#endif /* INTERNAL */
-	uds_log_info("Replaying %zu recovery entries into block map",
-		     repair->block_map_entry_count);
-
 	repair->current_entry = &repair->entries[repair->block_map_entry_count - 1];
 	first_sorted_entry = sort_next_heap_element(repair);
 	ASSERT_LOG_ONLY(first_sorted_entry == repair->current_entry,
@@ -7,7 +7,9 @@
 
 #include <linux/atomic.h>
 #include <linux/bio.h>
+#include <linux/bitops.h>
 #include <linux/err.h>
+#include <linux/jiffies.h>
 #include <linux/log2.h>
 #include <linux/min_heap.h>
 #include <linux/minmax.h>
@@ -20,6 +22,7 @@
 
 #include "action-manager.h"
 #include "admin-state.h"
+#include "block-compare.h"
 #include "completion.h"
 #include "constants.h"
 #include "data-vio.h"
@@ -38,6 +41,10 @@
 static const u64 BYTES_PER_WORD = sizeof(u64);
 static const bool NORMAL_OPERATION = true;
 
+unsigned int vdo_slab_scrub_concurrency = MAX_CONCURRENT_SCRUBS;
+bool vdo_lazy_refcount_load;
+bool vdo_compact_slab_journal;
+
 /**
  * get_lock() - Get the lock object for a slab journal block by sequence number.
  * @journal: vdo_slab journal to retrieve from.
@@ -91,6 +98,7 @@ static void initialize_tail_block(struct slab_journal *journal)
 	header->sequence_number = journal->tail;
 	header->entry_count = 0;
 	header->has_block_map_increments = false;
+	memset(&journal->tail_cursor, 0, sizeof(journal->tail_cursor));
 }
 
 /**
@@ -116,6 +124,10 @@ static bool __must_check block_is_full(struct slab_journal *journal)
 {
 	journal_entry_count_t count = journal->tail_header.entry_count;
 
+	if ((journal->tail_header.metadata_type == VDO_METADATA_SLAB_JOURNAL_2) &&
+	    !vdo_slab_journal_run_block_has_room(&journal->tail_cursor))
+		return true;
+
 	return (journal->tail_header.has_block_map_increments ?
 		(journal->full_entries_per_block == count) :
 		(journal->entries_per_block == count));
@@ -925,8 +937,14 @@ static void add_entry(struct slab_journal *journal, physical_block_number_t pbn,
 		}
 	}
 
-	encode_slab_journal_entry(&journal->tail_header, &block->payload,
-				  pbn - journal->slab->start, operation, increment);
+	if (journal->tail_header.metadata_type == VDO_METADATA_SLAB_JOURNAL_2) {
+		vdo_encode_slab_journal_run_entry(&journal->tail_header, &journal->tail_cursor,
+						  &block->payload, pbn - journal->slab->start,
+						  operation, increment);
+	} else {
+		encode_slab_journal_entry(&journal->tail_header, &block->payload,
+					  pbn - journal->slab->start, operation, increment);
+	}
 	journal->tail_header.recovery_point = recovery_point;
 	if (block_is_full(journal))
 		commit_tail(journal);
@@ -1399,6 +1417,83 @@ static void adjust_free_block_count(struct vdo_slab *slab, bool increment)
 	prioritize_slab(slab);
 }
 
+/**
+ * update_free_group() - Recount the free counters in one group of a slab.
+ * @slab: The slab.
+ * @group: The group of counters to count.
+ */
+static void update_free_group(struct vdo_slab *slab, u32 group)
+{
+	slab_block_number start = group * COUNTS_PER_FREE_GROUP;
+	slab_block_number end = min_t(slab_block_number, start + COUNTS_PER_FREE_GROUP,
+				      slab->block_count);
+	slab_block_number i;
+	u8 free = 0;
+
+	for (i = start; i < end; i++) {
+		if (slab->counters[i] == EMPTY_REFERENCE_COUNT)
+			free++;
+	}
+
+	slab->free_group_counts[group] = free;
+	if (free > 0)
+		__set_bit(group, slab->free_group_map);
+	else
+		__clear_bit(group, slab->free_group_map);
+}
+
+/**
+ * update_free_group_map() - Recount the groups of free counters which cover a range of counters.
+ * @slab: The slab.
+ * @start: The index of the first counter in the range.
+ * @end: The index just past the last counter in the range.
+ *
+ * This is used whenever counters have been changed in bulk.
+ */
+STATIC void update_free_group_map(struct vdo_slab *slab, slab_block_number start,
+				  slab_block_number end)
+{
+	u32 group;
+	u32 end_group = DIV_ROUND_UP(min(end, slab->block_count), COUNTS_PER_FREE_GROUP);
+
+	for (group = start / COUNTS_PER_FREE_GROUP; group < end_group; group++)
+		update_free_group(slab, group);
+}
+
+/**
+ * note_counter_allocated() - Account for a counter which is no longer free.
+ * @slab: The slab which owns the counter.
+ * @block: The reference block which contains the counter.
+ * @block_number: The index of the counter.
+ */
+static void note_counter_allocated(struct vdo_slab *slab, struct reference_block *block,
+				   slab_block_number block_number)
+{
+	u32 group = block_number / COUNTS_PER_FREE_GROUP;
+
+	block->allocated_count++;
+	slab->free_blocks--;
+	if (--slab->free_group_counts[group] == 0)
+		__clear_bit(group, slab->free_group_map);
+}
+
+/**
+ * note_counter_freed() - Account for a counter which has become free.
+ * @slab: The slab which owns the counter.
+ * @block: The reference block which contains the counter.
+ * @block_number: The index of the counter.
+ */
+static void note_counter_freed(struct vdo_slab *slab, struct reference_block *block,
+			       slab_block_number block_number)
+{
+	u32 group = block_number / COUNTS_PER_FREE_GROUP;
+
+	block->allocated_count--;
+	slab->free_blocks++;
+	if (slab->free_group_counts[group]++ == 0)
+		__set_bit(group, slab->free_group_map);
+}
+
 /**
  * increment_for_data() - Increment the reference count for a data block.
  * @slab: The slab which owns the block.
@@ -1420,8 +1515,7 @@ static int increment_for_data(struct vdo_slab *slab, struct reference_block *blo
 	switch (old_status) {
 	case RS_FREE:
 		*counter_ptr = 1;
-		block->allocated_count++;
-		slab->free_blocks--;
+		note_counter_allocated(slab, block, block_number);
 		if (adjust_block_count)
 			adjust_free_block_count(slab, false);
 
@@ -1489,8 +1583,7 @@ static int decrement_for_data(struct vdo_slab *slab, struct reference_block *blo
 		}
 
 		*counter_ptr = EMPTY_REFERENCE_COUNT;
-		block->allocated_count--;
-		slab->free_blocks++;
+		note_counter_freed(slab, block, block_number);
 		if (adjust_block_count)
 			adjust_free_block_count(slab, true);
 
@@ -1537,8 +1630,7 @@ static int increment_for_block_map(struct vdo_slab *slab, struct reference_block
 		}
 
 		*counter_ptr = MAXIMUM_REFERENCE_COUNT;
-		block->allocated_count++;
-		slab->free_blocks--;
+		note_counter_allocated(slab, block, block_number);
 		if (adjust_block_count)
 			adjust_free_block_count(slab, false);
 
@@ -1894,16 +1986,20 @@ static void reset_search_cursor(struct vdo_slab *slab)
 }
 
 /**
- * advance_search_cursor() - Advance the search cursor to the start of the next reference block in
- *                           a slab,
+ * advance_search_cursor() - Advance the search cursor to the next reference block in a slab which
+ *                           has a free counter.
  *
- * Wraps around to the first reference block if the current block is the last reference block.
+ * The free group map is used to skip over full reference blocks, and over the full counters at the
+ * start of the next one. Wraps around to the first reference block if there are no free counters
+ * past the current block.
  *
- * Return: true unless the cursor was at the last reference block.
+ * Return: true unless the cursor was at the last reference block with a free counter.
  */
 static bool advance_search_cursor(struct vdo_slab *slab)
 {
 	struct search_cursor *cursor = &slab->search_cursor;
+	slab_block_number block_index;
+	u32 group;
 
 	/*
 	 * If we just finished searching the last reference block, then wrap back around to the
@@ -1914,15 +2010,22 @@ static bool advance_search_cursor(struct vdo_slab *slab)
 		return false;
 	}
 
-	/* We're not already at the end, so advance to cursor to the next block. */
-	cursor->block++;
-	cursor->index = cursor->end_index;
+	group = find_next_bit(slab->free_group_map, slab->free_group_count,
+			      cursor->end_index / COUNTS_PER_FREE_GROUP);
+	if (group >= slab->free_group_count) {
+		reset_search_cursor(slab);
+		return false;
+	}
 
+	/* Move the cursor to the first group with a free counter. */
+	cursor->index = group * COUNTS_PER_FREE_GROUP;
+	block_index = cursor->index / COUNTS_PER_BLOCK;
+	cursor->block = cursor->first_block + block_index;
 	if (cursor->block == cursor->last_block) {
 		/* The last reference block will usually be a runt. */
 		cursor->end_index = slab->block_count;
 	} else {
-		cursor->end_index += COUNTS_PER_BLOCK;
+		cursor->end_index = (block_index + 1) * COUNTS_PER_BLOCK;
 	}
 
 	return true;
@@ -2035,6 +2138,8 @@ static inline slab_block_number find_zero_byte_in_word(const u8 *word_ptr,
  * @slab: The slab counters to scan.
  * @index_ptr: A pointer to hold the array index of the free block.
  *
+ * Only the groups of counters which the free group map says have a free counter are searched.
+ *
  * Exposed for unit testing.
  *
  * Return: true if a free block was found in the specified range.
@@ -2044,44 +2149,38 @@ STATIC bool find_free_block(const struct vdo_slab *slab, slab_block_number *inde
 	slab_block_number zero_index;
 	slab_block_number next_index = slab->search_cursor.index;
 	slab_block_number end_index = slab->search_cursor.end_index;
-	u8 *next_counter = &slab->counters[next_index];
-	u8 *end_counter = &slab->counters[end_index];
+	u32 end_group = DIV_ROUND_UP(end_index, COUNTS_PER_FREE_GROUP);
+	u32 group;
 
 	/*
 	 * Search every byte of the first unaligned word. (Array is padded so reading past end is
-	 * safe.)
+	 * safe.) A free block is often found here, right after the previous allocation.
 	 */
-	zero_index = find_zero_byte_in_word(next_counter, next_index, end_index);
+	zero_index = find_zero_byte_in_word(&slab->counters[next_index], next_index, end_index);
 	if (zero_index < end_index) {
 		*index_ptr = zero_index;
 		return true;
 	}
 
-	/*
-	 * On architectures where unaligned word access is expensive, this would be a good place to
-	 * advance to an alignment boundary.
-	 */
 	next_index += BYTES_PER_WORD;
-	next_counter += BYTES_PER_WORD;
+	if (next_index >= end_index)
+		return false;
 
-	/*
-	 * Now we're word-aligned; check an word at a time until we find a word containing a zero.
-	 * (Array is padded so reading past end is safe.)
-	 */
-	while (next_counter < end_counter) {
-		/*
-		 * The following code is currently an exact copy of the code preceding the loop,
-		 * but if you try to merge them by using a do loop, it runs slower because a jump
-		 * instruction gets added at the start of the iteration.
-		 */
-		zero_index = find_zero_byte_in_word(next_counter, next_index, end_index);
-		if (zero_index < end_index) {
+	for (group = find_next_bit(slab->free_group_map, end_group,
+				   next_index / COUNTS_PER_FREE_GROUP);
+	     group < end_group;
+	     group = find_next_bit(slab->free_group_map, end_group, group + 1)) {
+		slab_block_number start = max_t(slab_block_number, next_index,
+						group * COUNTS_PER_FREE_GROUP);
+		slab_block_number end = min_t(slab_block_number, end_index,
+					      (group + 1) * COUNTS_PER_FREE_GROUP);
+
+		/* The free counter in the first group may be before the start of the search. */
+		zero_index = start + vdo_find_zero_byte(&slab->counters[start], end - start);
+		if (zero_index < end) {
 			*index_ptr = zero_index;
 			return true;
 		}
-
-		next_index += BYTES_PER_WORD;
-		next_counter += BYTES_PER_WORD;
 	}
 
 	return false;
@@ -2146,8 +2245,7 @@ static void make_provisional_reference(struct vdo_slab *slab,
 	slab->counters[block_number] = PROVISIONAL_REFERENCE_COUNT;
 
 	/* Account for the allocation. */
-	block->allocated_count++;
-	slab->free_blocks--;
+	note_counter_allocated(slab, block, block_number);
 }
 
 /**
@@ -2227,7 +2325,22 @@ static void unpack_reference_block(struct packed_reference_block *packed,
 }
 
 /**
- * finish_reference_block_load() - After a reference block has been read, unpack it.
+ * get_load_group_size() - Get the number of reference blocks loaded by a single read.
+ * @block: The first reference block of the group.
+ *
+ * Return: The number of reference blocks in the group.
+ */
+static block_count_t get_load_group_size(struct reference_block *block)
+{
+	struct vdo_slab *slab = block->slab;
+	block_count_t offset = block - slab->reference_blocks;
+
+	return min_t(block_count_t, slab->reference_block_count - offset,
+		     slab->allocator->refcount_blocks_per_vio);
+}
+
+/**
+ * finish_reference_block_load() - After a group of reference blocks has been read, unpack them.
  * @completion: The VIO that just finished reading.
  */
 static void finish_reference_block_load(struct vdo_completion *completion)
@@ -2236,13 +2349,20 @@ static void finish_reference_block_load(struct vdo_completion *completion)
 	struct pooled_vio *pooled = vio_as_pooled_vio(vio);
 	struct reference_block *block = completion->parent;
 	struct vdo_slab *slab = block->slab;
+	block_count_t count = get_load_group_size(block);
+	slab_block_number start = (block - slab->reference_blocks) * COUNTS_PER_BLOCK;
+	char *data = vio->data;
+	block_count_t i;
 
-	unpack_reference_block((struct packed_reference_block *) vio->data, block);
-	return_vio_to_pool(slab->allocator->vio_pool, pooled);
-	slab->active_count--;
-	clear_provisional_references(block);
+	for (i = 0; i < count; i++, block++, data += VDO_BLOCK_SIZE) {
+		unpack_reference_block((struct packed_reference_block *) data, block);
+		clear_provisional_references(block);
+		slab->free_blocks -= block->allocated_count;
+	}
 
-	slab->free_blocks -= block->allocated_count;
+	return_vio_to_pool(slab->allocator->refcount_vio_pool, pooled);
+	slab->active_count -= count;
+	update_free_group_map(slab, start, start + (count * COUNTS_PER_BLOCK));
 	check_if_slab_drained(slab);
 }
 
@@ -2256,12 +2376,30 @@ static void load_reference_block_endio(struct bio *bio)
 }
 
 /**
- * load_reference_block() - After a block waiter has gotten a VIO from the VIO pool, load the
- *                          block.
- * @waiter: The waiter of the block to load.
+ * handle_reference_load_error() - Handle an I/O error reading a group of reference blocks.
+ * @completion: The VIO doing the I/O as a completion.
+ */
+static void handle_reference_load_error(struct vdo_completion *completion)
+{
+	int result = completion->result;
+	struct vio *vio = as_vio(completion);
+	struct reference_block *block = completion->parent;
+	struct vdo_slab *slab = block->slab;
+
+	vio_record_metadata_io_error(vio);
+	return_vio_to_pool(slab->allocator->refcount_vio_pool, vio_as_pooled_vio(vio));
+	slab->active_count -= get_load_group_size(block);
+	vdo_enter_read_only_mode(slab->allocator->depot->vdo, result);
+	check_if_slab_drained(slab);
+}
+
+/**
+ * load_reference_block_group() - After a block waiter has gotten a VIO from the refcount VIO
+ *                                pool, load the group of blocks starting with its block.
+ * @waiter: The waiter of the first block to load.
  * @context: The VIO returned by the pool.
  */
-static void load_reference_block(struct vdo_waiter *waiter, void *context)
+static void load_reference_block_group(struct vdo_waiter *waiter, void *context)
 {
 	struct pooled_vio *pooled = context;
 	struct vio *vio = &pooled->vio;
@@ -2270,14 +2408,18 @@ static void load_reference_block(struct vdo_waiter *waiter, void *context)
 	size_t block_offset = (block - block->slab->reference_blocks);
 
 	vio->completion.parent = block;
-	vdo_submit_metadata_vio(vio, block->slab->ref_counts_origin + block_offset,
-				load_reference_block_endio, handle_io_error,
-				REQ_OP_READ);
+	vdo_submit_metadata_vio_with_size(vio, block->slab->ref_counts_origin + block_offset,
+					  load_reference_block_endio,
+					  handle_reference_load_error, REQ_OP_READ,
+					  get_load_group_size(block) * VDO_BLOCK_SIZE);
 }
 
 /**
  * load_reference_blocks() - Load a slab's reference blocks from the underlying storage into a
  *                           pre-allocated reference counter.
+ *
+ * The reference blocks of a slab are contiguous, so they are read in groups, each with a single
+ * large vio.
  */
 static void load_reference_blocks(struct vdo_slab *slab)
 {
@@ -2285,11 +2427,12 @@ static void load_reference_blocks(struct vdo_slab *slab)
 
 	slab->free_blocks = slab->block_count;
 	slab->active_count = slab->reference_block_count;
-	for (i = 0; i < slab->reference_block_count; i++) {
+	for (i = 0; i < slab->reference_block_count;
+	     i += slab->allocator->refcount_blocks_per_vio) {
 		struct vdo_waiter *waiter = &slab->reference_blocks[i].waiter;
 
-		waiter->callback = load_reference_block;
-		acquire_vio_from_pool(slab->allocator->vio_pool, waiter);
+		waiter->callback = load_reference_block_group;
+		acquire_vio_from_pool(slab->allocator->refcount_vio_pool, waiter);
 	}
 }
 
@@ -2372,13 +2515,36 @@ STATIC int allocate_slab_counters(struct vdo_slab *slab)
 	 * so we can word-search even at the very end.
 	 */
 	bytes = (slab->reference_block_count * COUNTS_PER_BLOCK) + (2 * BYTES_PER_WORD);
-	result = uds_allocate(bytes, vdo_refcount_t, "ref counts array",
-			      &slab->counters);
+	result = uds_allocate_arena(bytes * sizeof(vdo_refcount_t),
+				    vdo_get_zone_node(slab->allocator->depot->vdo,
+						      slab->allocator->zone_number),
+				    "ref counts array", &slab->counters);
+	if (result != UDS_SUCCESS) {
+		uds_free(uds_forget(slab->reference_blocks));
+		return result;
+	}
+
+	slab->free_group_count = DIV_ROUND_UP(slab->block_count, COUNTS_PER_FREE_GROUP);
+	result = uds_allocate(BITS_TO_LONGS(slab->free_group_count), unsigned long,
+			      "free group map", &slab->free_group_map);
 	if (result != UDS_SUCCESS) {
+		uds_free(uds_forget(slab->counters));
 		uds_free(uds_forget(slab->reference_blocks));
 		return result;
 	}
 
+	result = uds_allocate(slab->free_group_count, u8, "free group counts",
+			      &slab->free_group_counts);
+	if (result != UDS_SUCCESS) {
+		uds_free(uds_forget(slab->free_group_map));
+		uds_free(uds_forget(slab->counters));
+		uds_free(uds_forget(slab->reference_blocks));
+		return result;
+	}
+
+	/* Every counter starts out free. */
+	update_free_group_map(slab, 0, slab->block_count);
+
 	slab->search_cursor.first_block = slab->reference_blocks;
 	slab->search_cursor.last_block = &slab->reference_blocks[slab->reference_block_count - 1];
 	reset_search_cursor(slab);
@@ -2394,10 +2560,28 @@ STATIC int allocate_slab_counters(struct vdo_slab *slab)
 
 static int allocate_counters_if_clean(struct vdo_slab *slab)
 {
-	if (vdo_is_state_clean_load(&slab->state))
-		return allocate_slab_counters(slab);
+	struct block_allocator *allocator = slab->allocator;
 
-	return VDO_SUCCESS;
+	if (!vdo_is_state_clean_load(&slab->state))
+		return VDO_SUCCESS;
+
+	/* Counters which will be loaded in the background are allocated when they are loaded. */
+	if (allocator->depot->load_counters_lazily &&
+	    allocator->summary_entries[slab->slab_number].load_ref_counts)
+		return VDO_SUCCESS;
+
+	return allocate_slab_counters(slab);
+}
+
+/**
+ * is_slab_journal_metadata_type() - Check whether a metadata type is that of a slab journal block.
+ * @type: The metadata type from a block header.
+ *
+ * Return: true if the type is either version of the slab journal block format.
+ */
+static inline bool is_slab_journal_metadata_type(enum vdo_metadata_type type)
+{
+	return ((type == VDO_METADATA_SLAB_JOURNAL) || (type == VDO_METADATA_SLAB_JOURNAL_2));
 }
 
 static void finish_loading_journal(struct vdo_completion *completion)
@@ -2407,11 +2591,12 @@ static void finish_loading_journal(struct vdo_completion *completion)
 	struct vdo_slab *slab = journal->slab;
 	struct packed_slab_journal_block *block = (struct packed_slab_journal_block *) vio->data;
 	struct slab_journal_block_header header;
+	enum vdo_metadata_type format = journal->tail_header.metadata_type;
 
 	vdo_unpack_slab_journal_block_header(&block->header, &header);
 
 	/* FIXME: should it be an error if the following conditional fails? */
-	if ((header.metadata_type == VDO_METADATA_SLAB_JOURNAL) &&
+	if (is_slab_journal_metadata_type(header.metadata_type) &&
 	    (header.nonce == slab->allocator->nonce)) {
 		journal->tail = header.sequence_number + 1;
 
@@ -2422,6 +2607,8 @@ static void finish_loading_journal(struct vdo_completion *completion)
 		journal->head = (slab->allocator->summary_entries[slab->slab_number].is_dirty ?
 				 header.head : journal->tail);
 		journal->tail_header = header;
+		/* New blocks are written in this journal's format, whatever the old tail was. */
+		journal->tail_header.metadata_type = format;
 		initialize_journal_state(journal);
 	}
 
@@ -2510,9 +2697,45 @@ static void load_slab_journal(struct vdo_slab *slab)
 	acquire_vio_from_pool(slab->allocator->vio_pool, &journal->resource_waiter);
 }
 
+static bool slab_status_is_less_than(const void *item1, const void *item2);
+
+/**
+ * get_slab_status() - Get the summary status of a slab.
+ * @slab: The slab.
+ *
+ * Return: The slab's status, by which slabs are ordered for allocation and scrubbing.
+ */
+static struct slab_status get_slab_status(const struct vdo_slab *slab)
+{
+	const struct slab_summary_entry *entry =
+		&slab->allocator->summary_entries[slab->slab_number];
+
+	return (struct slab_status) {
+		.slab_number = slab->slab_number,
+		.is_clean = !entry->is_dirty,
+		.emptiness = entry->fullness_hint,
+	};
+}
+
+/**
+ * scrubs_before() - Check whether one slab should be scrubbed before another.
+ *
+ * Slabs which are clean in the summary are scrubbed first since they have no journal to replay,
+ * and then the emptiest slabs, since they give the allocator the most room soonest.
+ */
+static bool scrubs_before(const struct vdo_slab *slab1, const struct vdo_slab *slab2)
+{
+	struct slab_status status1 = get_slab_status(slab1);
+	struct slab_status status2 = get_slab_status(slab2);
+
+	return slab_status_is_less_than(&status1, &status2);
+}
+
 STATIC void register_slab_for_scrubbing(struct vdo_slab *slab, bool high_priority)
 {
 	struct slab_scrubber *scrubber = &slab->allocator->scrubber;
+	struct list_head *position = &scrubber->slabs;
+	struct vdo_slab *queued;
 
 	ASSERT_LOG_ONLY((slab->status != VDO_SLAB_REBUILT),
 			"slab to be scrubbed is unrecovered");
@@ -2532,7 +2755,18 @@ STATIC void register_slab_for_scrubbing(struct vdo_slab *slab, bool high_priorit
 		return;
 	}
 
-	list_add_tail(&slab->allocq_entry, &scrubber->slabs);
+	/*
+	 * Keep the queue in scrubbing order. Slabs are usually registered in that order, so this
+	 * rarely looks past the tail.
+	 */
+	list_for_each_entry_reverse(queued, &scrubber->slabs, allocq_entry) {
+		if (!scrubs_before(slab, queued))
+			break;
+
+		position = &queued->allocq_entry;
+	}
+
+	list_add_tail(&slab->allocq_entry, position);
 }
 
 /* Queue a slab for allocation or scrubbing. */
@@ -2648,13 +2882,17 @@ static bool __must_check has_slabs_to_scrub(struct slab_scrubber *scrubber)
 }
 
 /**
- * uninitialize_scrubber_vio() - Clean up the slab_scrubber's vio.
+ * uninitialize_scrubber_vios() - Clean up the slab_scrubber's vios.
  * @scrubber: The scrubber.
  */
-static void uninitialize_scrubber_vio(struct slab_scrubber *scrubber)
+static void uninitialize_scrubber_vios(struct slab_scrubber *scrubber)
 {
-	uds_free(uds_forget(scrubber->vio.data));
-	free_vio_components(&scrubber->vio);
+	u8 i;
+
+	for (i = 0; i < MAX_CONCURRENT_SCRUBS; i++) {
+		uds_free(uds_forget(scrubber->scrubs[i].vio.data));
+		free_vio_components(&scrubber->scrubs[i].vio);
+	}
 }
 
 /**
@@ -2670,11 +2908,11 @@ static void finish_scrubbing(struct slab_scrubber *scrubber, int result)
 		container_of(scrubber, struct block_allocator, scrubber);
 
 	if (done)
-		uninitialize_scrubber_vio(scrubber);
+		uninitialize_scrubber_vios(scrubber);
 
 	if (scrubber->high_priority_only) {
 		scrubber->high_priority_only = false;
-		vdo_fail_completion(uds_forget(scrubber->vio.completion.parent), result);
+		vdo_fail_completion(uds_forget(scrubber->parent), result);
 	} else if (done && (atomic_add_return(-1, &allocator->depot->zones_to_scrub) == 0)) {
 		/* All of our slabs were scrubbed, and we're the last allocator to finish. */
 		enum vdo_state prior_state =
@@ -2714,7 +2952,31 @@ static void finish_scrubbing(struct slab_scrubber *scrubber, int result)
 		vdo_waitq_notify_all_waiters(&scrubber->waiters, NULL, NULL);
 }
 
-static void scrub_next_slab(struct slab_scrubber *scrubber);
+static void scrub_next_slabs(struct slab_scrubber *scrubber);
+
+/**
+ * as_slab_scrub() - Convert a vio completion to the slab_scrub which owns it.
+ * @completion: The completion to convert.
+ *
+ * Return: The completion as a slab_scrub.
+ */
+static inline struct slab_scrub *as_slab_scrub(struct vdo_completion *completion)
+{
+	return container_of(as_vio(completion), struct slab_scrub, vio);
+}
+
+/**
+ * finish_scrub() - Make a slab_scrub available for another slab, and scrub more slabs if possible.
+ * @scrub: The slab_scrub which is done with its slab.
+ */
+static void finish_scrub(struct slab_scrub *scrub)
+{
+	struct slab_scrubber *scrubber = scrub->scrubber;
+
+	scrub->slab = NULL;
+	scrubber->active_scrubs--;
+	scrub_next_slabs(scrubber);
+}
 
 /**
  * slab_scrubbed() - Notify the scrubber that a slab has been scrubbed.
@@ -2724,26 +2986,34 @@ static void scrub_next_slab(struct slab_scrubber *scrubber);
  */
 static void slab_scrubbed(struct vdo_completion *completion)
 {
-	struct slab_scrubber *scrubber =
-		container_of(as_vio(completion), struct slab_scrubber, vio);
-	struct vdo_slab *slab = scrubber->slab;
+	struct slab_scrub *scrub = as_slab_scrub(completion);
+	struct slab_scrubber *scrubber = scrub->scrubber;
+	struct vdo_slab *slab = scrub->slab;
 
 	slab->status = VDO_SLAB_REBUILT;
 	queue_slab(slab);
 	reopen_slab_journal(slab);
 	WRITE_ONCE(scrubber->slab_count, scrubber->slab_count - 1);
-	scrub_next_slab(scrubber);
+	WRITE_ONCE(scrubber->slabs_scrubbed, scrubber->slabs_scrubbed + 1);
+	finish_scrub(scrub);
 }
 
 /**
  * abort_scrubbing() - Abort scrubbing due to an error.
- * @scrubber: The slab scrubber.
+ * @scrub: The slab_scrub which encountered the error.
  * @result: The error.
+ *
+ * Any other slabs being scrubbed are allowed to finish before the scrubber stops.
  */
-static void abort_scrubbing(struct slab_scrubber *scrubber, int result)
+static void abort_scrubbing(struct slab_scrub *scrub, int result)
 {
-	vdo_enter_read_only_mode(scrubber->vio.completion.vdo, result);
-	finish_scrubbing(scrubber, result);
+	struct slab_scrubber *scrubber = scrub->scrubber;
+
+	vdo_enter_read_only_mode(scrub->vio.completion.vdo, result);
+	if (scrubber->result == VDO_SUCCESS)
+		scrubber->result = result;
+
+	finish_scrub(scrub);
 }
 
 /**
@@ -2755,8 +3025,7 @@ static void handle_scrubber_error(struct vdo_completion *completion)
 	struct vio *vio = as_vio(completion);
 
 	vio_record_metadata_io_error(vio);
-	abort_scrubbing(container_of(vio, struct slab_scrubber, vio),
-			completion->result);
+	abort_scrubbing(as_slab_scrub(completion), completion->result);
 }
 
 /**
@@ -2776,12 +3045,21 @@ static int apply_block_entries(struct packed_slab_journal_block *block,
 		.sequence_number = block_number,
 		.entry_count = 0,
 	};
+	struct slab_journal_block_cursor cursor;
 	int result;
 	slab_block_number max_sbn = slab->end - slab->start;
 
+	memset(&cursor, 0, sizeof(cursor));
 	while (entry_point.entry_count < entry_count) {
-		struct slab_journal_entry entry =
-			vdo_decode_slab_journal_entry(block, entry_point.entry_count);
+		struct slab_journal_entry entry;
+
+		result = vdo_decode_next_slab_journal_entry(block, &cursor, &entry);
+		if (result != VDO_SUCCESS) {
+			return uds_log_error_strerror(result,
+						      "vdo_slab journal entry (%llu, %u) could not be decoded",
+						      (unsigned long long) block_number,
+						      entry_point.entry_count);
+		}
 
 		if (entry.sbn > max_sbn) {
 			/* This entry is out of bounds. */
@@ -2808,6 +3086,39 @@ static int apply_block_entries(struct packed_slab_journal_block *block,
 	return VDO_SUCCESS;
 }
 
+/**
+ * is_valid_block_format() - Check whether a slab journal block header has a valid type and entry
+ *                           count.
+ * @journal: The journal the block was read from.
+ * @header: The unpacked block header.
+ *
+ * A block in the journal's own format is checked against the journal's limits, which unit tests
+ * may lower, and a block in the other format against that format's limits.
+ *
+ * Return: true if the block may be applied.
+ */
+static bool __must_check is_valid_block_format(const struct slab_journal *journal,
+					       const struct slab_journal_block_header *header)
+{
+	bool own_format = (header->metadata_type == journal->tail_header.metadata_type);
+
+	if (header->metadata_type == VDO_METADATA_SLAB_JOURNAL_2)
+		return (header->entry_count <= (own_format ? journal->entries_per_block :
+						VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK));
+
+	if (header->metadata_type != VDO_METADATA_SLAB_JOURNAL)
+		return false;
+
+	if (!own_format)
+		return (header->entry_count <= (header->has_block_map_increments ?
+						VDO_SLAB_JOURNAL_FULL_ENTRIES_PER_BLOCK :
+						VDO_SLAB_JOURNAL_ENTRIES_PER_BLOCK));
+
+	return ((header->entry_count <= journal->entries_per_block) &&
+		(!header->has_block_map_increments ||
+		 (header->entry_count <= journal->full_entries_per_block)));
+}
+
 /**
  * apply_journal_entries() - Find the relevant vio of the slab journal and apply all valid entries.
  * @completion: The metadata read vio completion.
@@ -2817,15 +3128,14 @@ static int apply_block_entries(struct packed_slab_journal_block *block,
 static void apply_journal_entries(struct vdo_completion *completion)
 {
 	int result;
-	struct slab_scrubber *scrubber
-		= container_of(as_vio(completion), struct slab_scrubber, vio);
-	struct vdo_slab *slab = scrubber->slab;
+	struct slab_scrub *scrub = as_slab_scrub(completion);
+	struct vdo_slab *slab = scrub->slab;
 	struct slab_journal *journal = &slab->journal;
 
 	/* Find the boundaries of the useful part of the journal. */
 	sequence_number_t tail = journal->tail;
 	tail_block_offset_t end_index = (tail - 1) % journal->size;
-	char *end_data = scrubber->vio.data + (end_index * VDO_BLOCK_SIZE);
+	char *end_data = scrub->vio.data + (end_index * VDO_BLOCK_SIZE);
 	struct packed_slab_journal_block *end_block =
 		(struct packed_slab_journal_block *) end_data;
 
@@ -2838,7 +3148,7 @@ static void apply_journal_entries(struct vdo_completion *completion)
 	sequence_number_t sequence;
 
 	for (sequence = head; sequence < tail; sequence++) {
-		char *block_data = scrubber->vio.data + (index * VDO_BLOCK_SIZE);
+		char *block_data = scrub->vio.data + (index * VDO_BLOCK_SIZE);
 		struct packed_slab_journal_block *block =
 			(struct packed_slab_journal_block *) block_data;
 		struct slab_journal_block_header header;
@@ -2846,21 +3156,18 @@ static void apply_journal_entries(struct vdo_completion *completion)
 		vdo_unpack_slab_journal_block_header(&block->header, &header);
 
 		if ((header.nonce != slab->allocator->nonce) ||
-		    (header.metadata_type != VDO_METADATA_SLAB_JOURNAL) ||
 		    (header.sequence_number != sequence) ||
-		    (header.entry_count > journal->entries_per_block) ||
-		    (header.has_block_map_increments &&
-		     (header.entry_count > journal->full_entries_per_block))) {
+		    !is_valid_block_format(journal, &header)) {
 			/* The block is not what we expect it to be. */
 			uds_log_error("vdo_slab journal block for slab %u was invalid",
 				      slab->slab_number);
-			abort_scrubbing(scrubber, VDO_CORRUPT_JOURNAL);
+			abort_scrubbing(scrub, VDO_CORRUPT_JOURNAL);
 			return;
 		}
 
 		result = apply_block_entries(block, header.entry_count, sequence, slab);
 		if (result != VDO_SUCCESS) {
-			abort_scrubbing(scrubber, result);
+			abort_scrubbing(scrub, result);
 			return;
 		}
 
@@ -2879,7 +3186,7 @@ static void apply_journal_entries(struct vdo_completion *completion)
 						  &ref_counts_point),
 			"Refcounts are not more accurate than the slab journal");
 	if (result != VDO_SUCCESS) {
-		abort_scrubbing(scrubber, result);
+		abort_scrubbing(scrub, result);
 		return;
 	}
 
@@ -2894,41 +3201,101 @@ static void apply_journal_entries(struct vdo_completion *completion)
 static void read_slab_journal_endio(struct bio *bio)
 {
 	struct vio *vio = bio->bi_private;
-	struct slab_scrubber *scrubber = container_of(vio, struct slab_scrubber, vio);
+	struct slab_scrub *scrub = container_of(vio, struct slab_scrub, vio);
 
 	continue_vio_after_io(bio->bi_private, apply_journal_entries,
-			      scrubber->slab->allocator->thread_id);
+			      scrub->slab->allocator->thread_id);
 }
 
 /**
  * start_scrubbing() - Read the current slab's journal from disk now that it has been flushed.
- * @completion: The scrubber's vio completion.
+ * @completion: The slab_scrub's vio completion.
  *
- * This callback is registered in scrub_next_slab().
+ * This callback is registered in drain_slab_for_scrubbing().
  */
 static void start_scrubbing(struct vdo_completion *completion)
 {
-	struct slab_scrubber *scrubber =
-		container_of(as_vio(completion), struct slab_scrubber, vio);
-	struct vdo_slab *slab = scrubber->slab;
+	struct slab_scrub *scrub = as_slab_scrub(completion);
+	struct vdo_slab *slab = scrub->slab;
 
 	if (!slab->allocator->summary_entries[slab->slab_number].is_dirty) {
 		slab_scrubbed(completion);
 		return;
 	}
 
-	vdo_submit_metadata_vio(&scrubber->vio, slab->journal_origin,
+	vdo_submit_metadata_vio(&scrub->vio, slab->journal_origin,
 				read_slab_journal_endio, handle_scrubber_error,
 				REQ_OP_READ);
 }
 
 /**
- * scrub_next_slab() - Scrub the next slab if there is one.
+ * drain_slab_for_scrubbing() - Flush a slab so that its journal can be read.
+ * @completion: The slab_scrub's vio completion.
+ *
+ * This callback is registered in start_scrub().
+ */
+static void drain_slab_for_scrubbing(struct vdo_completion *completion)
+{
+	struct slab_scrub *scrub = as_slab_scrub(completion);
+	struct vdo_slab *slab = scrub->slab;
+
+	if (slab->counters == NULL) {
+		/* This slab's counters were not allocated when it was loaded lazily. */
+		int result = allocate_slab_counters(slab);
+
+		if (result != VDO_SUCCESS) {
+			abort_scrubbing(scrub, result);
+			return;
+		}
+	}
+
+	vdo_prepare_completion(completion, start_scrubbing, handle_scrubber_error,
+			       slab->allocator->thread_id, completion->parent);
+	vdo_start_operation_with_waiter(&slab->state, VDO_ADMIN_STATE_SCRUBBING,
+					completion, initiate_slab_action);
+}
+
+/**
+ * start_scrub() - Start scrubbing a slab with an idle slab_scrub.
+ * @scrubber: The scrubber.
+ * @slab: The slab to scrub.
+ *
+ * The scrub is requeued rather than run directly so that a slab which needs no journal replay
+ * cannot finish, and start the next slabs, while this one is still being started.
+ */
+static void start_scrub(struct slab_scrubber *scrubber, struct vdo_slab *slab)
+{
+	struct slab_scrub *scrub = scrubber->scrubs;
+	struct vdo_completion *completion;
+
+	while (scrub->slab != NULL)
+		scrub++;
+
+	list_del_init(&slab->allocq_entry);
+	/* The slab is no longer queued, so it must not be registered for scrubbing again. */
+	slab->status = VDO_SLAB_REBUILDING;
+	scrub->slab = slab;
+	scrubber->active_scrubs++;
+
+	completion = &scrub->vio.completion;
+	vdo_prepare_completion_for_requeue(completion, drain_slab_for_scrubbing,
+					   handle_scrubber_error, slab->allocator->thread_id,
+					   completion->parent);
+	vdo_launch_completion(completion);
+}
+
+/**
+ * scrub_next_slabs() - Scrub as many of the next slabs as may be scrubbed at once, if there are
+ *                      any.
  * @scrubber: The scrubber.
+ *
+ * Since several slabs are scrubbed at once, the journals of the next slabs are being read while
+ * earlier ones are replayed and their reference counts saved.
  */
-static void scrub_next_slab(struct slab_scrubber *scrubber)
+static void scrub_next_slabs(struct slab_scrubber *scrubber)
 {
-	struct vdo_completion *completion = &scrubber->vio.completion;
+	struct block_allocator *allocator =
+		container_of(scrubber, struct block_allocator, scrubber);
 	struct vdo_slab *slab;
 
 	/*
@@ -2937,27 +3304,35 @@ static void scrub_next_slab(struct slab_scrubber *scrubber)
 	 */
 	vdo_waitq_notify_all_waiters(&scrubber->waiters, NULL, NULL);
 
-	if (vdo_is_read_only(completion->vdo)) {
-		finish_scrubbing(scrubber, VDO_READ_ONLY);
+	if ((scrubber->result != VDO_SUCCESS) || vdo_is_read_only(allocator->depot->vdo)) {
+		if (scrubber->active_scrubs == 0)
+			finish_scrubbing(scrubber,
+					 ((scrubber->result == VDO_SUCCESS) ?
+					  VDO_READ_ONLY : scrubber->result));
 		return;
 	}
 
-	slab = get_next_slab(scrubber);
-	if ((slab == NULL) ||
-	    (scrubber->high_priority_only && list_empty(&scrubber->high_priority_slabs))) {
-		finish_scrubbing(scrubber, VDO_SUCCESS);
-		return;
-	}
+	for (;;) {
+		slab = get_next_slab(scrubber);
+		if ((slab == NULL) ||
+		    (scrubber->high_priority_only &&
+		     list_empty(&scrubber->high_priority_slabs))) {
+			if (scrubber->active_scrubs == 0)
+				finish_scrubbing(scrubber, VDO_SUCCESS);
+			return;
+		}
 
-	if (vdo_finish_draining(&scrubber->admin_state))
-		return;
+		if (vdo_is_state_draining(&scrubber->admin_state)) {
+			if (scrubber->active_scrubs == 0)
+				vdo_finish_draining(&scrubber->admin_state);
+			return;
+		}
 
-	list_del_init(&slab->allocq_entry);
-	scrubber->slab = slab;
-	vdo_prepare_completion(completion, start_scrubbing, handle_scrubber_error,
-			       slab->allocator->thread_id, completion->parent);
-	vdo_start_operation_with_waiter(&slab->state, VDO_ADMIN_STATE_SCRUBBING,
-					completion, initiate_slab_action);
+		if (scrubber->active_scrubs >= READ_ONCE(vdo_slab_scrub_concurrency))
+			return;
+
+		start_scrub(scrubber, slab);
+	}
 }
 
 /**
@@ -2969,20 +3344,23 @@ STATIC void scrub_slabs(struct block_allocator *allocator, struct vdo_completion
 {
 	struct slab_scrubber *scrubber = &allocator->scrubber;
 
-	scrubber->vio.completion.parent = parent;
+	scrubber->parent = parent;
 	scrubber->high_priority_only = (parent != NULL);
 	if (!has_slabs_to_scrub(scrubber)) {
 		finish_scrubbing(scrubber, VDO_SUCCESS);
 		return;
 	}
 
+	if (scrubber->slabs_scrubbed == 0)
+		WRITE_ONCE(scrubber->start_jiffies, jiffies);
+
 	if (scrubber->high_priority_only &&
 	    vdo_is_priority_table_empty(allocator->prioritized_slabs) &&
 	    list_empty(&scrubber->high_priority_slabs))
 		register_slab_for_scrubbing(get_next_slab(scrubber), true);
 
 	vdo_resume_if_quiescent(&scrubber->admin_state);
-	scrub_next_slab(scrubber);
+	scrub_next_slabs(scrubber);
 }
 
 static inline void assert_on_allocator_thread(thread_id_t thread_id,
@@ -3487,15 +3865,8 @@ STATIC int get_slab_statuses(struct block_allocator *allocator,
 
 	*statuses_ptr = statuses;
 
-	while (iterator.next != NULL)  {
-		slab_count_t slab_number = next_slab(&iterator)->slab_number;
-
-		*statuses++ = (struct slab_status) {
-			.slab_number = slab_number,
-			.is_clean = !allocator->summary_entries[slab_number].is_dirty,
-			.emptiness = allocator->summary_entries[slab_number].fullness_hint,
-		};
-	}
+	while (iterator.next != NULL)
+		*statuses++ = get_slab_status(next_slab(&iterator));
 
 	return VDO_SUCCESS;
 }
@@ -3541,8 +3912,14 @@ STATIC int __must_check vdo_prepare_slabs_for_allocation(struct block_allocator
 
 		slab->status = VDO_SLAB_REQUIRES_SCRUBBING;
 		journal = &slab->journal;
+		/*
+		 * Clean slabs must have their counters loaded before the vdo comes online, unless
+		 * they are being loaded lazily, in which case the scrubber loads them in the
+		 * background, emptiest first.
+		 */
 		high_priority = ((current_slab_status.is_clean &&
-				 (depot->load_type == VDO_SLAB_DEPOT_NORMAL_LOAD)) ||
+				  (depot->load_type == VDO_SLAB_DEPOT_NORMAL_LOAD) &&
+				  !depot->load_counters_lazily) ||
 				 (journal_length(journal) >= journal->scrubbing_threshold));
 		register_slab_for_scrubbing(slab, high_priority);
 	}
@@ -3642,8 +4019,8 @@ void vdo_dump_block_allocator(const struct block_allocator *allocator)
 		}
 	}
 
-	uds_log_info("slab_scrubber slab_count %u waiters %zu %s%s",
-		     READ_ONCE(scrubber->slab_count),
+	uds_log_info("slab_scrubber slab_count %u active %u waiters %zu %s%s",
+		     READ_ONCE(scrubber->slab_count), scrubber->active_scrubs,
 		     vdo_waitq_num_waiters(&scrubber->waiters),
 		     vdo_get_admin_state_code(&scrubber->admin_state)->name,
 		     scrubber->high_priority_only ? ", high_priority_only " : "");
@@ -3657,6 +4034,8 @@ STATIC void free_slab(struct vdo_slab *slab)
 	list_del(&slab->allocq_entry);
 	uds_free(uds_forget(slab->journal.block));
 	uds_free(uds_forget(slab->journal.locks));
+	uds_free(uds_forget(slab->free_group_counts));
+	uds_free(uds_forget(slab->free_group_map));
 	uds_free(uds_forget(slab->counters));
 	uds_free(uds_forget(slab->reference_blocks));
 	uds_free(slab);
@@ -3683,8 +4062,16 @@ static int initialize_slab_journal(struct vdo_slab *slab)
 	journal->flushing_threshold = slab_config->slab_journal_flushing_threshold;
 	journal->blocking_threshold = slab_config->slab_journal_blocking_threshold;
 	journal->scrubbing_threshold = slab_config->slab_journal_scrubbing_threshold;
-	journal->entries_per_block = VDO_SLAB_JOURNAL_ENTRIES_PER_BLOCK;
-	journal->full_entries_per_block = VDO_SLAB_JOURNAL_FULL_ENTRIES_PER_BLOCK;
+	if (slab->allocator->depot->compact_slab_journals) {
+		/* Version 2 blocks mark block map increments in the entries themselves. */
+		journal->entries_per_block = VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK;
+		journal->full_entries_per_block = VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK;
+		journal->tail_header.metadata_type = VDO_METADATA_SLAB_JOURNAL_2;
+	} else {
+		journal->entries_per_block = VDO_SLAB_JOURNAL_ENTRIES_PER_BLOCK;
+		journal->full_entries_per_block = VDO_SLAB_JOURNAL_FULL_ENTRIES_PER_BLOCK;
+		journal->tail_header.metadata_type = VDO_METADATA_SLAB_JOURNAL;
+	}
 	journal->events = &slab->allocator->slab_journal_statistics;
 	journal->recovery_journal = slab->allocator->depot->vdo->recovery_journal;
 	journal->tail = 1;
@@ -3704,7 +4091,6 @@ static int initialize_slab_journal(struct vdo_slab *slab)
 	INIT_LIST_HEAD(&journal->uncommitted_blocks);
 
 	journal->tail_header.nonce = slab->allocator->nonce;
-	journal->tail_header.metadata_type = VDO_METADATA_SLAB_JOURNAL;
 	initialize_journal_state(journal);
 	return VDO_SUCCESS;
 }
@@ -3938,22 +4324,29 @@ STATIC int initialize_slab_scrubber(struct block_allocator *allocator)
 	struct slab_scrubber *scrubber = &allocator->scrubber;
 	block_count_t slab_journal_size =
 		allocator->depot->slab_config.slab_journal_blocks;
-	char *journal_data;
-	int result;
+	u8 i;
 
-	result = uds_allocate(VDO_BLOCK_SIZE * slab_journal_size,
-			      char, __func__, &journal_data);
-	if (result != VDO_SUCCESS)
-		return result;
+	for (i = 0; i < MAX_CONCURRENT_SCRUBS; i++) {
+		struct slab_scrub *scrub = &scrubber->scrubs[i];
+		char *journal_data;
+		int result;
 
-	result = allocate_vio_components(allocator->completion.vdo,
-					 VIO_TYPE_SLAB_JOURNAL,
-					 VIO_PRIORITY_METADATA,
-					 allocator, slab_journal_size,
-					 journal_data, &scrubber->vio);
-	if (result != VDO_SUCCESS) {
-		uds_free(journal_data);
-		return result;
+		result = uds_allocate(VDO_BLOCK_SIZE * slab_journal_size,
+				      char, __func__, &journal_data);
+		if (result != VDO_SUCCESS)
+			return result;
+
+		result = allocate_vio_components(allocator->completion.vdo,
+						 VIO_TYPE_SLAB_JOURNAL,
+						 VIO_PRIORITY_METADATA,
+						 allocator, slab_journal_size,
+						 journal_data, &scrub->vio);
+		if (result != VDO_SUCCESS) {
+			uds_free(journal_data);
+			return result;
+		}
+
+		scrub->scrubber = scrubber;
 	}
 
 	INIT_LIST_HEAD(&scrubber->high_priority_slabs);
@@ -4017,12 +4410,22 @@ static int __must_check initialize_block_allocator(struct slab_depot *depot,
 		return result;
 
 	vdo_initialize_completion(&allocator->completion, vdo, VDO_BLOCK_ALLOCATOR_COMPLETION);
-	result = make_vio_pool(vdo, BLOCK_ALLOCATOR_VIO_POOL_SIZE, allocator->thread_id,
+	result = make_vio_pool(vdo, BLOCK_ALLOCATOR_VIO_POOL_SIZE, 1, allocator->thread_id,
 			       VIO_TYPE_SLAB_JOURNAL, VIO_PRIORITY_METADATA,
 			       allocator, &allocator->vio_pool);
 	if (result != VDO_SUCCESS)
 		return result;
 
+	allocator->refcount_blocks_per_vio =
+		min_t(block_count_t, depot->slab_config.reference_count_blocks,
+		      MAX_BLOCKS_PER_VIO);
+	result = make_vio_pool(vdo, BLOCK_ALLOCATOR_REFCOUNT_VIO_POOL_SIZE,
+			       allocator->refcount_blocks_per_vio, allocator->thread_id,
+			       VIO_TYPE_SLAB_JOURNAL, VIO_PRIORITY_METADATA,
+			       allocator, &allocator->refcount_vio_pool);
+	if (result != VDO_SUCCESS)
+		return result;
+
 	result = initialize_slab_scrubber(allocator);
 	if (result != VDO_SUCCESS)
 		return result;
@@ -4201,6 +4604,15 @@ int vdo_decode_slab_depot(struct slab_depot_state_2_0 state, struct vdo *vdo,
 	depot->first_block = state.first_block;
 	depot->last_block = state.last_block;
 	depot->slab_size_shift = slab_size_shift;
+	/*
+	 * A volume is only marked as holding version 2 slab journal blocks when the super block is
+	 * saved as it is made dirty. Recovery writes slab journal blocks before that, so a volume
+	 * which is not yet marked must not write them until it is next started cleanly.
+	 */
+	depot->compact_slab_journals =
+		(READ_ONCE(vdo_compact_slab_journal) &&
+		 (vdo->states.compact_slab_journals ||
+		  !vdo_state_requires_recovery(vdo->load_state)));
 
 	result = allocate_components(depot, summary_partition);
 	if (result != VDO_SUCCESS) {
@@ -4247,8 +4659,9 @@ void vdo_free_slab_depot(struct slab_depot *depot)
 			dm_kcopyd_client_destroy(uds_forget(allocator->eraser));
 
 		uninitialize_allocator_summary(allocator);
-		uninitialize_scrubber_vio(&allocator->scrubber);
+		uninitialize_scrubber_vios(&allocator->scrubber);
 		free_vio_pool(uds_forget(allocator->vio_pool));
+		free_vio_pool(uds_forget(allocator->refcount_vio_pool));
 		vdo_free_priority_table(uds_forget(allocator->prioritized_slabs));
 	}
 
@@ -4609,6 +5022,8 @@ void vdo_load_slab_depot(struct slab_depot *depot,
 	if (!vdo_assert_load_operation(operation, parent))
 		return;
 
+	depot->load_counters_lazily = ((operation == VDO_ADMIN_STATE_LOADING) &&
+				       READ_ONCE(vdo_lazy_refcount_load));
 	vdo_schedule_operation_with_context(depot->action_manager, operation,
 					    load_slab_summary, load_allocator,
 					    NULL, context, parent);
@@ -4764,7 +5179,7 @@ void vdo_use_new_slabs(struct slab_depot *depot, struct vdo_completion *parent)
 }
 
 /**
- * stop_scrubbing() - Tell the scrubber to stop scrubbing after it finishes the slab it is
+ * stop_scrubbing() - Tell the scrubber to stop scrubbing after it finishes the slabs it is
  *                    currently working on.
  * @scrubber: The scrubber to stop.
  * @parent: The completion to notify when scrubbing has stopped.
@@ -4814,6 +5229,8 @@ static void do_drain_step(struct vdo_completion *completion)
 	case VDO_DRAIN_ALLOCATOR_STEP_FINISHED:
 		ASSERT_LOG_ONLY(!is_vio_pool_busy(allocator->vio_pool),
 				"vio pool not busy");
+		ASSERT_LOG_ONLY(!is_vio_pool_busy(allocator->refcount_vio_pool),
+				"refcount vio pool not busy");
 		vdo_finish_draining_with_result(&allocator->state, completion->result);
 		return;
 
@@ -4885,7 +5302,7 @@ static void resume_scrubbing(struct block_allocator *allocator)
 		return;
 	}
 
-	scrub_next_slab(scrubber);
+	scrub_next_slabs(scrubber);
 	vdo_finish_completion(&allocator->completion);
 }
 
@@ -5075,6 +5492,27 @@ get_slab_journal_statistics(const struct slab_depot *depot)
 	return totals;
 }
 
+/**
+ * get_scrubbing_time_remaining() - Estimate how long an allocator will take to scrub its
+ *                                  unrecovered slabs, from the rate at which it has scrubbed so
+ *                                  far.
+ * @scrubber: The allocator's scrubber.
+ *
+ * Return: The estimated time in seconds, or 0 if there is nothing to scrub or no estimate yet.
+ */
+static u64 get_scrubbing_time_remaining(const struct slab_scrubber *scrubber)
+{
+	slab_count_t remaining = READ_ONCE(scrubber->slab_count);
+	slab_count_t scrubbed = READ_ONCE(scrubber->slabs_scrubbed);
+	u64 elapsed_ms;
+
+	if ((remaining == 0) || (scrubbed == 0))
+		return 0;
+
+	elapsed_ms = jiffies_to_msecs(jiffies - READ_ONCE(scrubber->start_jiffies));
+	return DIV_ROUND_UP(elapsed_ms * remaining, scrubbed * 1000ULL);
+}
+
 /**
  * vdo_get_slab_depot_statistics() - Get all the vdo_statistics fields that are properties of the
  *                                   slab depot.
@@ -5086,14 +5524,20 @@ void vdo_get_slab_depot_statistics(const struct slab_depot *depot,
 {
 	slab_count_t slab_count = READ_ONCE(depot->slab_count);
 	slab_count_t unrecovered = 0;
+	u64 time_remaining = 0;
 	zone_count_t zone;
 
 	for (zone = 0; zone < depot->zone_count; zone++) {
+		const struct slab_scrubber *scrubber = &depot->allocators[zone].scrubber;
+
 		/* The allocators are responsible for thread safety. */
-		unrecovered += READ_ONCE(depot->allocators[zone].scrubber.slab_count);
+		unrecovered += READ_ONCE(scrubber->slab_count);
+		/* The allocators scrub in parallel, so the slowest one determines the estimate. */
+		time_remaining = max(time_remaining, get_scrubbing_time_remaining(scrubber));
 	}
 
 	stats->recovery_percentage = (slab_count - unrecovered) * 100 / slab_count;
+	stats->recovery_time_remaining = time_remaining;
 	stats->allocator = get_block_allocator_statistics(depot);
 	stats->ref_counts = get_ref_counts_statistics(depot);
 	stats->slab_journal = get_slab_journal_statistics(depot);
@@ -39,6 +39,10 @@
 enum {
 	/* The number of vios in the vio pool is proportional to the throughput of the VDO. */
 	BLOCK_ALLOCATOR_VIO_POOL_SIZE = 128,
+	/* The number of multi-block vios each allocator uses to load reference counts. */
+	BLOCK_ALLOCATOR_REFCOUNT_VIO_POOL_SIZE = 4,
+	/* The number of reference counters summarized by each bit of a slab's free group map. */
+	COUNTS_PER_FREE_GROUP = 64,
 };
 
 /*
@@ -121,6 +125,8 @@ struct slab_journal {
 	struct slab_journal_block_header tail_header;
 	/* A pointer to a block-sized buffer holding the packed block data */
 	struct packed_slab_journal_block *block;
+	/* The position of the next entry in the tail block, if it is a version 2 block */
+	struct slab_journal_block_cursor tail_cursor;
 
 	/* The number of blocks in the on-disk journal */
 	block_count_t size;
@@ -237,6 +243,17 @@ struct vdo_slab {
 	/* The array of reference counts */
 	vdo_refcount_t *counters; /* use uds_allocate() to align data ptr */
 
+	/*
+	 * A summary of the counters, with one bit per COUNTS_PER_FREE_GROUP counters, set if any
+	 * of them is free. Together with the allocated count of each reference block, this lets
+	 * the free block search skip straight past full parts of the slab.
+	 */
+	unsigned long *free_group_map;
+	/* The number of free counters in each group, so that its bit changes without a rescan */
+	u8 *free_group_counts;
+	/* The number of groups in the free group map */
+	u32 free_group_count;
+
 	/* The saved block pointer and array indexes for the free block search */
 	struct search_cursor search_cursor;
 
@@ -265,10 +282,47 @@ enum block_allocator_drain_step {
 	VDO_DRAIN_ALLOCATOR_STEP_FINISHED,
 };
 
+enum {
+	/* The most slabs each allocator may scrub at once */
+	MAX_CONCURRENT_SCRUBS = 4,
+};
+
+/*
+ * The number of slabs each allocator scrubs at once, from 1 to MAX_CONCURRENT_SCRUBS. The default
+ * is MAX_CONCURRENT_SCRUBS.
+ */
+extern unsigned int vdo_slab_scrub_concurrency;
+
+/*
+ * Whether a clean load leaves the saved reference counts of most slabs to be loaded in the
+ * background, rather than loading them all before the vdo comes online. The default is false.
+ */
+extern bool vdo_lazy_refcount_load;
+
+/*
+ * Whether slab journals of vdos started from now on write version 2 blocks, which encode entries
+ * as runs rather than singly. A volume is marked with slab depot version 2.1 before any such
+ * block is written, so that older drivers will not load it. The default is false.
+ */
+extern bool vdo_compact_slab_journal;
+
+/* One of the slabs a slab_scrubber is scrubbing at once. */
+struct slab_scrub {
+	/* The scrubber doing the scrubbing */
+	struct slab_scrubber *scrubber;
+	/* The slab being scrubbed, or NULL if this scrub is idle */
+	struct vdo_slab *slab;
+	/* The vio for loading the slab's journal blocks */
+	struct vio vio;
+};
+
 struct slab_scrubber {
 	/* The queue of slabs to scrub first */
 	struct list_head high_priority_slabs;
-	/* The queue of slabs to scrub once there are no high_priority_slabs */
+	/*
+	 * The queue of slabs to scrub once there are no high_priority_slabs, in the order in which
+	 * they should be scrubbed
+	 */
 	struct list_head slabs;
 	/* The queue of VIOs waiting for a slab to be scrubbed */
 	struct vdo_wait_queue waiters;
@@ -278,15 +332,23 @@ struct slab_scrubber {
 	 * the physical zone thread, but is queried by other threads.
 	 */
 	slab_count_t slab_count;
+	/* The number of slabs scrubbed since scrubbing started, queried by other threads */
+	slab_count_t slabs_scrubbed;
+	/* The time at which scrubbing started, in jiffies, queried by other threads */
+	u64 start_jiffies;
 
 	/* The administrative state of the scrubber */
 	struct admin_state admin_state;
 	/* Whether to only scrub high-priority slabs */
 	bool high_priority_only;
-	/* The slab currently being scrubbed */
-	struct vdo_slab *slab;
-	/* The vio for loading slab journal blocks */
-	struct vio vio;
+	/* The completion to notify when the high-priority slabs have been scrubbed */
+	struct vdo_completion *parent;
+	/* The first error encountered while scrubbing */
+	int result;
+	/* The number of slabs being scrubbed */
+	u8 active_scrubs;
+	/* The slabs which may be scrubbed at once, each with a vio to load its journal */
+	struct slab_scrub scrubs[MAX_CONCURRENT_SCRUBS];
 };
 
 /* A sub-structure for applying actions in parallel to all an allocator's slabs. */
@@ -419,6 +481,10 @@ struct block_allocator {
 
 	/* The vio pool for reading and writing block allocator metadata */
 	struct vio_pool *vio_pool;
+	/* The vio pool for reading many reference blocks of a slab at once */
+	struct vio_pool *refcount_vio_pool;
+	/* The number of reference blocks read by each vio in the refcount vio pool */
+	block_count_t refcount_blocks_per_vio;
 	/* The dm_kcopyd client for erasing slab journals */
 	struct dm_kcopyd_client *eraser;
 	/* Iterator over the slabs to be erased */
@@ -457,6 +523,10 @@ struct slab_depot {
 
 	/* Determines how slabs should be queued during load */
 	enum slab_depot_load_type load_type;
+	/* Whether the saved reference counts of slabs are being loaded in the background */
+	bool load_counters_lazily;
+	/* Whether slab journals write version 2 blocks */
+	bool compact_slab_journals;
 
 	/* The state for notifying slab journals to release recovery journal */
 	sequence_number_t active_release_request;
@@ -618,6 +688,8 @@ int __must_check replay_reference_count_change(struct vdo_slab *slab,
 					       struct slab_journal_entry entry);
 bool __must_check find_free_block(const struct vdo_slab *slab,
 				  slab_block_number *index_ptr);
+void update_free_group_map(struct vdo_slab *slab, slab_block_number start,
+			   slab_block_number end);
 void drain_slab(struct vdo_slab *slab);
 int __must_check allocate_slab_counters(struct vdo_slab *slab);
 void register_slab_for_scrubbing(struct vdo_slab *slab, bool high_priority);
@@ -9,6 +9,8 @@
 
 #include "constants.h"
 #include "dedupe.h"
+#include "funnel-workqueue.h"
+#include "slab-depot.h"
 #include "vdo.h"
 
 static int vdo_log_level_show(char *buf, const struct kernel_param *kp)
@@ -75,6 +77,32 @@ static int vdo_min_dedupe_timer_interval_store(const char *buf,
 	return 0;
 }
 
+static int vdo_work_queue_spin_limit_store(const char *buf, const struct kernel_param *kp)
+{
+	int result = param_set_uint(buf, kp);
+
+	if (result != 0)
+		return result;
+
+	if (*(uint *)kp->arg > MAXIMUM_VDO_WORK_QUEUE_SPIN)
+		*(uint *)kp->arg = MAXIMUM_VDO_WORK_QUEUE_SPIN;
+	return 0;
+}
+
+static int vdo_slab_scrub_concurrency_store(const char *buf, const struct kernel_param *kp)
+{
+	int result = param_set_uint(buf, kp);
+
+	if (result != 0)
+		return result;
+
+	if (*(uint *)kp->arg < 1)
+		*(uint *)kp->arg = 1;
+	else if (*(uint *)kp->arg > MAX_CONCURRENT_SCRUBS)
+		*(uint *)kp->arg = MAX_CONCURRENT_SCRUBS;
+	return 0;
+}
+
 static const struct kernel_param_ops log_level_ops = {
 	.set = vdo_log_level_store,
 	.get = vdo_log_level_show,
@@ -97,6 +125,16 @@ static const struct kernel_param_ops dedupe_timer_ops = {
 	.get = param_get_uint,
 };
 
+static const struct kernel_param_ops work_queue_spin_ops = {
+	.set = vdo_work_queue_spin_limit_store,
+	.get = param_get_uint,
+};
+
+static const struct kernel_param_ops slab_scrub_concurrency_ops = {
+	.set = vdo_slab_scrub_concurrency_store,
+	.get = param_get_uint,
+};
+
 module_param_cb(log_level, &log_level_ops, NULL, 0644);
 
 #ifdef VDO_INTERNAL
@@ -108,3 +146,14 @@ module_param_cb(deduplication_timeout_interval, &dedupe_timeout_ops,
 
 module_param_cb(min_deduplication_timer_interval, &dedupe_timer_ops,
 		&vdo_dedupe_index_min_timer_interval, 0644);
+
+module_param_cb(work_queue_spin_limit, &work_queue_spin_ops, &vdo_work_queue_spin_limit, 0644);
+
+module_param_named(work_queue_stealing, vdo_work_queue_stealing, bool, 0644);
+
+module_param_cb(slab_scrub_concurrency, &slab_scrub_concurrency_ops,
+		&vdo_slab_scrub_concurrency, 0644);
+
+module_param_named(lazy_refcount_load, vdo_lazy_refcount_load, bool, 0644);
+
+module_param_named(compact_slab_journal, vdo_compact_slab_journal, bool, 0644);
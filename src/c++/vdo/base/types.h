@@ -136,6 +136,7 @@ enum vdo_metadata_type {
 	VDO_METADATA_RECOVERY_JOURNAL = 1,
 	VDO_METADATA_SLAB_JOURNAL = 2,
 	VDO_METADATA_RECOVERY_JOURNAL_2 = 3,
+	VDO_METADATA_SLAB_JOURNAL_2 = 4,
 } __packed;
 
 /* A position in the block map where a block map entry is stored. */
@@ -194,6 +195,69 @@ struct slab_config {
 } __packed;
 
 #if defined(__KERNEL__) || defined(INTERNAL)
+/*
+ * The compressors which may be used for data blocks. The type of the fragments of a compressed
+ * block is recorded in its header unless it is LZ4, so these values may never change.
+ */
+enum vdo_compression_type {
+	VDO_COMPRESSION_LZ4 = 0,
+	VDO_COMPRESSION_LZ4HC = 1,
+	VDO_COMPRESSION_TYPE_COUNT,
+};
+
+/* The replacement policies which may be used by the block map page cache. */
+enum vdo_cache_policy {
+	VDO_CACHE_POLICY_LRU = 0,
+	VDO_CACHE_POLICY_2Q = 1,
+	VDO_CACHE_POLICY_COUNT,
+};
+
+/* Where the large per-zone arenas (block map cache pages, slab reference counts) are placed. */
+enum vdo_memory_placement {
+	VDO_MEMORY_PLACEMENT_DEFAULT = 0,
+	/* On the NUMA node of each zone, where possible. */
+	VDO_MEMORY_PLACEMENT_NUMA = 1,
+	VDO_MEMORY_PLACEMENT_COUNT,
+};
+
+/* The classes of vdo threads whose CPU affinity can be configured. */
+enum vdo_thread_class {
+	VDO_THREAD_CLASS_LOGICAL,
+	VDO_THREAD_CLASS_PHYSICAL,
+	VDO_THREAD_CLASS_HASH,
+	/* The admin, journal, packer, and dedupe threads */
+	VDO_THREAD_CLASS_JOURNAL,
+	VDO_THREAD_CLASS_CPU,
+	VDO_THREAD_CLASS_BIO,
+	VDO_THREAD_CLASS_ACK,
+	VDO_THREAD_CLASS_COUNT,
+};
+
+enum vdo_affinity_type {
+	/* Let the scheduler place the threads. */
+	VDO_AFFINITY_NONE,
+	/* Run on an explicit list of CPUs. */
+	VDO_AFFINITY_CPUS,
+	/* Run on the CPUs of one NUMA node. */
+	VDO_AFFINITY_NODE,
+	/* Run each zone's thread on the node memoryPlacement=numa uses for that zone. */
+	VDO_AFFINITY_ZONE,
+	/* Run on the NUMA node of the backing device. */
+	VDO_AFFINITY_DEVICE,
+};
+
+enum {
+	VDO_AFFINITY_CPU_LIST_LENGTH = 64,
+};
+
+struct vdo_thread_affinity {
+	enum vdo_affinity_type type;
+	/* The node for VDO_AFFINITY_NODE */
+	int node;
+	/* The CPU list, in cpulist format, for VDO_AFFINITY_CPUS */
+	char cpus[VDO_AFFINITY_CPU_LIST_LENGTH];
+};
+
 /*
  * This structure is memcmp'd for equality. Keep it packed and don't add any fields that are not
  * properly set in both extant and parsed configs.
@@ -226,10 +290,17 @@ struct device_config {
 	unsigned int logical_block_size;
 	unsigned int cache_size;
 	unsigned int block_map_maximum_age;
+	enum vdo_cache_policy cache_policy;
+	enum vdo_memory_placement memory_placement;
 	bool deduplication;
 	bool compression;
+	enum vdo_compression_type compression_type;
+	/* The acceleration for LZ4 or the level for LZ4HC; 0 selects the default */
+	int compression_level;
 	struct thread_count_config thread_counts;
+	struct vdo_thread_affinity thread_affinities[VDO_THREAD_CLASS_COUNT];
 	block_count_t max_discard_blocks;
+	block_count_t packer_bins;
 };
 
 enum vdo_completion_type {
@@ -246,9 +317,12 @@ enum vdo_completion_type {
 	VDO_HASH_ZONE_COMPLETION,
 	VDO_HASH_ZONES_COMPLETION,
 	VDO_LOCK_COUNTER_COMPLETION,
+	VDO_PACKER_COMPLETION,
 	VDO_PAGE_COMPLETION,
 	VDO_READ_ONLY_MODE_COMPLETION,
+	VDO_RECOVERY_JOURNAL_COMPLETION,
 	VDO_REPAIR_COMPLETION,
+	VDO_REPAIR_ZONE_COMPLETION,
 	VDO_SYNC_COMPLETION,
 	VIO_COMPLETION,
 #ifndef __KERNEL__
@@ -190,6 +190,7 @@ static const struct vdo_work_queue_type cpu_q_type = {
 	.finish = NULL,
 	.max_priority = CPU_Q_MAX_PRIORITY,
 	.default_priority = CPU_Q_MAX_PRIORITY,
+	.work_stealing = true,
 };
 
 STATIC void uninitialize_thread_config(struct thread_config *config)
@@ -421,6 +422,117 @@ STATIC void get_thread_name(const struct thread_config *thread_config,
 	snprintf(buffer, buffer_length, "reqQ%d", thread_id);
 }
 
+static bool is_zone_thread(const thread_id_t thread_ids[], zone_count_t count,
+			   thread_id_t id, zone_count_t *zone_ptr)
+{
+	if ((id >= thread_ids[0]) && (id - thread_ids[0] < count)) {
+		*zone_ptr = id - thread_ids[0];
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * get_thread_affinity() - Get the configured affinity of a thread.
+ * @thread_config: The thread configuration.
+ * @affinities: The affinities of each class of thread.
+ * @thread_id: The thread id.
+ * @zone_ptr: A pointer to hold the zone or index of the thread within its class.
+ *
+ * In the single thread configuration, the one request thread has the affinity of the logical
+ * threads.
+ *
+ * Return: The affinity of the thread's class.
+ */
+STATIC const struct vdo_thread_affinity *
+get_thread_affinity(const struct thread_config *thread_config,
+		    const struct vdo_thread_affinity affinities[], thread_id_t thread_id,
+		    zone_count_t *zone_ptr)
+{
+	*zone_ptr = 0;
+	if (is_zone_thread(thread_config->logical_threads, thread_config->logical_zone_count,
+			   thread_id, zone_ptr))
+		return &affinities[VDO_THREAD_CLASS_LOGICAL];
+
+	if (is_zone_thread(thread_config->physical_threads, thread_config->physical_zone_count,
+			   thread_id, zone_ptr))
+		return &affinities[VDO_THREAD_CLASS_PHYSICAL];
+
+	if (is_zone_thread(thread_config->hash_zone_threads, thread_config->hash_zone_count,
+			   thread_id, zone_ptr))
+		return &affinities[VDO_THREAD_CLASS_HASH];
+
+	if (is_zone_thread(thread_config->bio_threads, thread_config->bio_thread_count,
+			   thread_id, zone_ptr))
+		return &affinities[VDO_THREAD_CLASS_BIO];
+
+	if (thread_id == thread_config->cpu_thread)
+		return &affinities[VDO_THREAD_CLASS_CPU];
+
+	if (thread_id == thread_config->bio_ack_thread)
+		return &affinities[VDO_THREAD_CLASS_ACK];
+
+	return &affinities[VDO_THREAD_CLASS_JOURNAL];
+}
+
+/* Get the NUMA node of the backing device, if it has one. */
+static int get_backing_device_node(const struct vdo *vdo __maybe_unused)
+{
+#ifdef __KERNEL__
+	return vdo_get_backing_device(vdo)->bd_disk->node_id;
+#else
+	return NUMA_NO_NODE;
+#endif /* __KERNEL__ */
+}
+
+/**
+ * set_thread_affinity() - Restrict the threads of a newly made vdo thread to the CPUs configured
+ *                         for its class.
+ * @vdo: The vdo.
+ * @thread: The thread.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+static int set_thread_affinity(struct vdo *vdo, struct vdo_thread *thread)
+{
+	const struct vdo_thread_affinity *affinity;
+	zone_count_t zone;
+	int node;
+
+	affinity = get_thread_affinity(&vdo->thread_config,
+				       vdo->device_config->thread_affinities,
+				       thread->thread_id, &zone);
+	switch (affinity->type) {
+	case VDO_AFFINITY_CPUS:
+		return vdo_set_work_queue_affinity(thread->queue, affinity->cpus,
+						   NUMA_NO_NODE);
+
+	case VDO_AFFINITY_NODE:
+		node = affinity->node;
+		break;
+
+	case VDO_AFFINITY_ZONE:
+		/* Zone n of each type shares a node, as with memoryPlacement=numa. */
+		node = uds_get_zone_node(zone);
+		break;
+
+	case VDO_AFFINITY_DEVICE:
+		node = get_backing_device_node(vdo);
+		if (node == NUMA_NO_NODE) {
+			/* The device isn't attached to any one node, so neither are the threads. */
+			return VDO_SUCCESS;
+		}
+
+		break;
+
+	default:
+		return VDO_SUCCESS;
+	}
+
+	return vdo_set_work_queue_affinity(thread->queue, NULL, node);
+}
+
 /**
  * vdo_make_thread() - Construct a single vdo work_queue and its associated thread (or threads for
  *                     round-robin queues).
@@ -442,6 +554,7 @@ int vdo_make_thread(struct vdo *vdo, thread_id_t thread_id,
 {
 	struct vdo_thread *thread = &vdo->threads[thread_id];
 	char queue_name[MAX_VDO_WORK_QUEUE_NAME_LEN];
+	int result;
 
 	if (type == NULL)
 		type = &default_queue_type;
@@ -455,8 +568,12 @@ int vdo_make_thread(struct vdo *vdo, thread_id_t thread_id,
 	thread->vdo = vdo;
 	thread->thread_id = thread_id;
 	get_thread_name(&vdo->thread_config, thread_id, queue_name, sizeof(queue_name));
-	return vdo_make_work_queue(vdo->thread_name_prefix, queue_name, thread,
-				   type, queue_count, contexts, &thread->queue);
+	result = vdo_make_work_queue(vdo->thread_name_prefix, queue_name, thread,
+				     type, queue_count, contexts, &thread->queue);
+	if (result != VDO_SUCCESS)
+		return result;
+
+	return set_thread_affinity(vdo, thread);
 }
 
 /**
@@ -529,9 +646,10 @@ static int initialize_vdo(struct vdo *vdo, struct device_config *config,
 		return result;
 	}
 
+	/* The compression type may be changed at any time, so allow for the larger context. */
 	for (i = 0; i < config->thread_counts.cpu_threads; i++) {
-		result = uds_allocate(LZ4_MEM_COMPRESS, char, "LZ4 context",
-				      &vdo->compression_context[i]);
+		result = uds_allocate(max_t(size_t, LZ4_MEM_COMPRESS, LZ4HC_MEM_COMPRESS),
+				      char, "LZ4 context", &vdo->compression_context[i]);
 		if (result != VDO_SUCCESS) {
 			*reason = "cannot allocate LZ4 context";
 			return result;
@@ -604,7 +722,7 @@ int vdo_make(unsigned int instance, struct device_config *config, char **reason,
 		return result;
 	}
 
-	result = vdo_make_packer(vdo, DEFAULT_PACKER_BINS, &vdo->packer);
+	result = vdo_make_packer(vdo, config->packer_bins, &vdo->packer);
 	if (result != VDO_SUCCESS) {
 		*reason = "Cannot make packer zones";
 		return result;
@@ -1002,6 +1120,9 @@ static void record_vdo(struct vdo *vdo)
 	vdo->states.block_map = vdo_record_block_map(vdo->block_map);
 	vdo->states.recovery_journal = vdo_record_recovery_journal(vdo->recovery_journal);
 	vdo->states.slab_depot = vdo_record_slab_depot(vdo->depot);
+	/* Once version 2 slab journal blocks may have been written, they may remain. */
+	if (vdo->depot->compact_slab_journals)
+		vdo->states.compact_slab_journals = true;
 	vdo->states.layout = vdo->layout;
 }
 
@@ -1516,6 +1637,151 @@ bool vdo_get_compressing(struct vdo *vdo)
 	return READ_ONCE(vdo->compressing);
 }
 
+static const char * const COMPRESSION_TYPE_NAMES[] = {
+	[VDO_COMPRESSION_LZ4] = "lz4",
+	[VDO_COMPRESSION_LZ4HC] = "lz4hc",
+};
+
+/**
+ * vdo_get_compression_type_name() - Get the name of a compression type.
+ * @type: The compression type.
+ *
+ * Return: The name of the type, or NULL if the type is unknown.
+ */
+const char *vdo_get_compression_type_name(enum vdo_compression_type type)
+{
+	BUILD_BUG_ON(ARRAY_SIZE(COMPRESSION_TYPE_NAMES) != VDO_COMPRESSION_TYPE_COUNT);
+
+	if (type >= VDO_COMPRESSION_TYPE_COUNT)
+		return NULL;
+
+	return COMPRESSION_TYPE_NAMES[type];
+}
+
+static const char * const MEMORY_PLACEMENT_NAMES[] = {
+	[VDO_MEMORY_PLACEMENT_DEFAULT] = "default",
+	[VDO_MEMORY_PLACEMENT_NUMA] = "numa",
+};
+
+/**
+ * vdo_get_memory_placement_name() - Get the name of a memory placement mode.
+ * @placement: The placement mode.
+ *
+ * Return: The name of the mode, or NULL if the mode is unknown.
+ */
+const char *vdo_get_memory_placement_name(enum vdo_memory_placement placement)
+{
+	BUILD_BUG_ON(ARRAY_SIZE(MEMORY_PLACEMENT_NAMES) != VDO_MEMORY_PLACEMENT_COUNT);
+
+	if (placement >= VDO_MEMORY_PLACEMENT_COUNT)
+		return NULL;
+
+	return MEMORY_PLACEMENT_NAMES[placement];
+}
+
+static const char * const THREAD_CLASS_NAMES[] = {
+	[VDO_THREAD_CLASS_LOGICAL] = "logical",
+	[VDO_THREAD_CLASS_PHYSICAL] = "physical",
+	[VDO_THREAD_CLASS_HASH] = "hash",
+	[VDO_THREAD_CLASS_JOURNAL] = "journal",
+	[VDO_THREAD_CLASS_CPU] = "cpu",
+	[VDO_THREAD_CLASS_BIO] = "bio",
+	[VDO_THREAD_CLASS_ACK] = "ack",
+};
+
+/**
+ * vdo_get_thread_class_name() - Get the name of a class of threads.
+ * @class: The thread class.
+ *
+ * Return: The name of the class, as used in thread parameter names, or NULL if it is unknown.
+ */
+const char *vdo_get_thread_class_name(enum vdo_thread_class class)
+{
+	BUILD_BUG_ON(ARRAY_SIZE(THREAD_CLASS_NAMES) != VDO_THREAD_CLASS_COUNT);
+
+	if (class >= VDO_THREAD_CLASS_COUNT)
+		return NULL;
+
+	return THREAD_CLASS_NAMES[class];
+}
+
+/**
+ * vdo_get_zone_node() - Get the NUMA node on which to place the large arenas of a zone.
+ * @vdo: The vdo.
+ * @zone_number: The number of the logical or physical zone.
+ *
+ * Logical zone n and physical zone n share a node, and the zones are spread over the online nodes
+ * in turn.
+ *
+ * Return: The node, or NUMA_NO_NODE if the vdo does not place its memory.
+ */
+int vdo_get_zone_node(const struct vdo *vdo, zone_count_t zone_number)
+{
+	if (vdo->device_config->memory_placement != VDO_MEMORY_PLACEMENT_NUMA)
+		return NUMA_NO_NODE;
+
+	return uds_get_zone_node(zone_number);
+}
+
+/**
+ * vdo_supports_compression_type() - Check whether the volume may hold blocks compressed with a
+ *                                   given type.
+ * @vdo: The vdo.
+ * @type: The compression type.
+ *
+ * Return: true if the type is LZ4, or the volume has been upgraded to record compression types.
+ */
+bool vdo_supports_compression_type(const struct vdo *vdo, enum vdo_compression_type type)
+{
+	return ((type == VDO_COMPRESSION_LZ4) ||
+		vdo_are_same_version(vdo->states.volume_version, VDO_VOLUME_VERSION_67_1));
+}
+
+/**
+ * vdo_upgrade_for_compression_type() - Upgrade the volume, if necessary, so that it may hold blocks
+ *                                      compressed with a given type.
+ * @vdo: The vdo.
+ * @type: The compression type.
+ *
+ * The upgrade is recorded when the super block is next saved, which must be done before any block
+ * is compressed with the type. Older versions will then refuse to load the volume, rather than
+ * fail to read those blocks.
+ *
+ * Return: true if the volume was upgraded, and so the super block needs to be saved.
+ */
+bool vdo_upgrade_for_compression_type(struct vdo *vdo, enum vdo_compression_type type)
+{
+	if (vdo_supports_compression_type(vdo, type))
+		return false;
+
+	uds_log_info("upgrading volume to version %u.%u to record compression types",
+		     VDO_VOLUME_VERSION_67_1.major_version,
+		     VDO_VOLUME_VERSION_67_1.minor_version);
+	vdo->states.volume_version = VDO_VOLUME_VERSION_67_1;
+	return true;
+}
+
+/**
+ * vdo_set_compression_type() - Set the compressor for data compressed from now on.
+ * @vdo: The vdo.
+ * @type: The compression type.
+ * @level: The acceleration for LZ4 or the level for LZ4HC; 0 selects the default.
+ *
+ * Fragments already compressed with the previous type will still be packed, but never in the
+ * same compressed block as fragments of the new type.
+ */
+void vdo_set_compression_type(struct vdo *vdo, enum vdo_compression_type type, int level)
+{
+	if ((READ_ONCE(vdo->compression_type) == type) &&
+	    (READ_ONCE(vdo->compression_level) == level))
+		return;
+
+	WRITE_ONCE(vdo->compression_type, type);
+	WRITE_ONCE(vdo->compression_level, level);
+	uds_log_info("compression type is %s, level %d",
+		     vdo_get_compression_type_name(type), level);
+}
+
 static size_t get_block_map_cache_size(const struct vdo *vdo)
 {
 	return ((size_t) vdo->device_config->cache_size) * VDO_BLOCK_SIZE;
@@ -216,6 +216,12 @@ struct vdo {
 	struct packer *packer;
 	/* Whether incoming data should be compressed */
 	bool compressing;
+	/*
+	 * The compressor and its level. They are set separately, so a data_vio may see a new type
+	 * with an old level, but any level is valid for any type.
+	 */
+	enum vdo_compression_type compression_type;
+	int compression_level;
 
 	/* The handler for flush requests */
 	struct flusher *flusher;
@@ -343,6 +349,22 @@ bool vdo_set_compressing(struct vdo *vdo, bool enable);
 
 bool vdo_get_compressing(struct vdo *vdo);
 
+const char * __must_check vdo_get_compression_type_name(enum vdo_compression_type type);
+
+const char * __must_check
+vdo_get_memory_placement_name(enum vdo_memory_placement placement);
+
+int __must_check vdo_get_zone_node(const struct vdo *vdo, zone_count_t zone_number);
+
+const char * __must_check vdo_get_thread_class_name(enum vdo_thread_class class);
+
+bool __must_check vdo_supports_compression_type(const struct vdo *vdo,
+						enum vdo_compression_type type);
+
+bool vdo_upgrade_for_compression_type(struct vdo *vdo, enum vdo_compression_type type);
+
+void vdo_set_compression_type(struct vdo *vdo, enum vdo_compression_type type, int level);
+
 void vdo_fetch_statistics(struct vdo *vdo, struct vdo_statistics *stats);
 
 thread_id_t vdo_get_callback_thread_id(void);
@@ -392,6 +414,10 @@ void get_thread_name(const struct thread_config *thread_config, thread_id_t thre
 		     char *buffer, size_t buffer_length);
 int __must_check initialize_thread_config(struct thread_count_config counts,
 					  struct thread_config *config);
+const struct vdo_thread_affinity *
+get_thread_affinity(const struct thread_config *thread_config,
+		    const struct vdo_thread_affinity affinities[], thread_id_t thread_id,
+		    zone_count_t *zone_ptr);
 block_count_t __must_check vdo_get_physical_blocks_allocated(const struct vdo *vdo);
 block_count_t __must_check vdo_get_physical_blocks_overhead(const struct vdo *vdo);
 #endif /* INTERNAL */
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright 2023 Red Hat
+ */
+
+#include <linux/atomic.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include "funnel-queue.h"
+#include "permassert.h"
+
+#include "completion.h"
+#include "funnel-workqueue-internals.h"
+
+/*
+ * Check whether completions are already waiting on a queue in a work-stealing group. Producers
+ * call this before adding a completion, so that a sibling is only woken when the new completion
+ * would wait behind others as well as behind the one the worker is running. The check races with
+ * the worker and with other producers, so the answer is only a hint.
+ */
+bool vdo_work_queue_has_backlog(struct simple_work_queue *queue)
+{
+	int i;
+
+	if (queue->group == NULL)
+		return false;
+
+	for (i = queue->common.type->max_priority; i >= 0; i--) {
+		if (!uds_is_funnel_queue_idle(queue->priority_lists[i]))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Take a waiting completion from a sibling in the same work-stealing group. Every sibling is
+ * checked at each priority level before moving on to the next lower one, so that stealing keeps
+ * the priority order of the group as a whole. A sibling whose lock is held is skipped rather than
+ * waited for, since its worker (or another thief) is already taking work from it.
+ */
+struct vdo_completion *vdo_steal_completion(struct simple_work_queue *queue)
+{
+	struct round_robin_work_queue *group = queue->group;
+	unsigned int count = group->num_service_queues;
+	int priority;
+	unsigned int i;
+
+	for (priority = queue->common.type->max_priority; priority >= 0; priority--) {
+		for (i = 0; i < count; i++) {
+			struct simple_work_queue *victim = READ_ONCE(group->service_queues[i]);
+			struct funnel_queue_entry *link;
+			struct vdo_completion *completion;
+
+			if ((victim == NULL) || (victim == queue) ||
+			    !spin_trylock(&victim->consumer_lock))
+				continue;
+
+			link = uds_funnel_queue_poll(victim->priority_lists[priority]);
+			spin_unlock(&victim->consumer_lock);
+			if (link == NULL)
+				continue;
+
+			completion = container_of(link, struct vdo_completion,
+						  work_queue_entry_link);
+			ASSERT_LOG_ONLY(completion->my_queue == &victim->common,
+					"stolen completion %px marked as being in its queue (%px)",
+					(void *) completion, (void *) completion->my_queue);
+			completion->my_queue = &queue->common;
+			WRITE_ONCE(queue->steals, queue->steals + 1);
+			return completion;
+		}
+	}
+
+	return NULL;
+}
+
+/* Wake one sleeping worker in the work-stealing group of a busy queue, if there is one. */
+void vdo_wake_idle_sibling(struct simple_work_queue *queue)
+{
+	struct round_robin_work_queue *group = queue->group;
+	unsigned int i;
+
+	for (i = 0; i < group->num_service_queues; i++) {
+		struct simple_work_queue *sibling = READ_ONCE(group->service_queues[i]);
+
+		if ((sibling == NULL) || (sibling == queue) || (atomic_read(&sibling->idle) != 1))
+			continue;
+
+		if (atomic_cmpxchg(&sibling->idle, 1, 0) == 1) {
+			wake_up(&sibling->waiting_worker_threads);
+			return;
+		}
+	}
+}
+
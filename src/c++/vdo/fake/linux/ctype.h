@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright 2023 Red Hat
+ *
+ */
+
+#ifndef LINUX_CTYPE_H
+#define LINUX_CTYPE_H
+
+#include <ctype.h>
+
+#endif // LINUX_CTYPE_H
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright 2023 Red Hat
+ *
+ */
+
+#ifndef LINUX_HRTIMER_H
+#define LINUX_HRTIMER_H
+
+#include <linux/list.h>
+
+#include "time-utils.h"
+
+enum hrtimer_mode {
+	HRTIMER_MODE_ABS = 0x00,
+	HRTIMER_MODE_REL = 0x01,
+};
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+struct hrtimer {
+	struct list_head entry;
+	/* The expiration time on the CLOCK_MONOTONIC clock, in nanoseconds */
+	ktime_t expires;
+	enum hrtimer_restart (*function)(struct hrtimer *);
+};
+
+void hrtimer_init(struct hrtimer *timer, clockid_t which_clock, enum hrtimer_mode mode);
+
+void hrtimer_start(struct hrtimer *timer, ktime_t time, enum hrtimer_mode mode);
+
+int hrtimer_cancel(struct hrtimer *timer);
+
+static inline ktime_t ns_to_ktime(u64 ns)
+{
+	return ns;
+}
+
+#endif /* LINUX_HRTIMER_H */
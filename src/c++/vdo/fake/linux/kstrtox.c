@@ -11,6 +11,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * kstrtouint - convert a string to an unsigned int
@@ -69,8 +70,13 @@ int __must_check kstrtouint(const char *string,
     return -EINVAL;
   }
 
-  tmp = strtoll(string, NULL, base);
-  if (tmp == 0) {
+  char *endPtr;
+  errno = 0;
+  tmp = strtoll(string, &endPtr, base);
+  // Like the kernel, accept zero but require digits, allowing only a single
+  // trailing newline after them.
+  if ((endPtr == string)
+      || ((*endPtr != '\0') && (strcmp(endPtr, "\n") != 0))) {
     return -EINVAL;
   }
 
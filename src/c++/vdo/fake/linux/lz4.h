@@ -11,6 +11,12 @@
 #include "../../tests/lz4.h"
 
 #define LZ4_MEM_COMPRESS LZ4_context_size()
+#define LZ4HC_MEM_COMPRESS LZ4_context_size()
+
+#define LZ4_ACCELERATION_DEFAULT 1
+#define LZ4HC_MIN_CLEVEL 3
+#define LZ4HC_DEFAULT_CLEVEL 9
+#define LZ4HC_MAX_CLEVEL 16
 
 /**********************************************************************/
 int LZ4_compress_default(const char *source,
@@ -19,6 +25,22 @@ int LZ4_compress_default(const char *source,
                          int maxOutputSize,
                          void *context);
 
+/**********************************************************************/
+int LZ4_compress_fast(const char *source,
+                      char *dest,
+                      int isize,
+                      int maxOutputSize,
+                      int acceleration,
+                      void *context);
+
+/**********************************************************************/
+int LZ4_compress_HC(const char *source,
+                    char *dest,
+                    int isize,
+                    int maxOutputSize,
+                    int compressionLevel,
+                    void *context);
+
 /**********************************************************************/
 int LZ4_decompress_safe(const char *source,
                         char *dest,
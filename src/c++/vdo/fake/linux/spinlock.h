@@ -21,6 +21,7 @@ typedef struct mutex spinlock_t;
 	ASSERT_LOG_ONLY(uds_init_mutex(lock) == UDS_SUCCESS, \
 			"spinlock init succeeds")
 #define spin_lock(lock) uds_lock_mutex(lock)
+#define spin_trylock(lock) (pthread_mutex_trylock(&(lock)->mutex) == 0)
 #define spin_unlock(lock) uds_unlock_mutex(lock)
 #define spin_lock_bh(lock) uds_lock_mutex(lock)
 #define spin_unlock_bh(lock) uds_unlock_mutex(lock)
@@ -44,4 +44,6 @@ void finish_wait(wait_queue_head_t *queue, struct wait_queue_entry *entry);
 /**********************************************************************/
 void wake_up_nr(wait_queue_head_t *head, int32_t count);
 
+#define wake_up(head) wake_up_nr(head, 1)
+
 #endif // LINUX_WAIT_H
@@ -11,6 +11,7 @@
 #include "albtest.h"
 
 #include "memory-alloc.h"
+#include "time-utils.h"
 
 #include "data-vio.h"
 #include "encodings.h"
@@ -147,16 +148,13 @@ static void addSlabJournalEntryAction(struct vdo_completion *completion)
 }
 
 /**
- * Allocate a block, increment its reference count, and make an appropriate
- * slab journal entry to use it.
+ * Increment the reference count of an allocated block and make an
+ * appropriate slab journal entry to use it.
  *
- * @return the block which was allocated
+ * @param allocatedBlock  The block which was allocated
  **/
-static physical_block_number_t useNextBlock(void)
+static void useBlock(physical_block_number_t allocatedBlock)
 {
-  physical_block_number_t allocatedBlock;
-  VDO_ASSERT_SUCCESS(vdo_allocate_block(allocator, &allocatedBlock));
-
   struct data_vio dataVIO = {
     .vio = {
       .type = VIO_TYPE_DATA,
@@ -177,6 +175,19 @@ static physical_block_number_t useNextBlock(void)
   struct vdo_completion *completion = &dataVIO.vio.completion;
   vdo_initialize_completion(completion, vdo, VIO_COMPLETION);
   VDO_ASSERT_SUCCESS(performWrappedAction(addSlabJournalEntryAction, completion));
+}
+
+/**
+ * Allocate a block, increment its reference count, and make an appropriate
+ * slab journal entry to use it.
+ *
+ * @return the block which was allocated
+ **/
+static physical_block_number_t useNextBlock(void)
+{
+  physical_block_number_t allocatedBlock;
+  VDO_ASSERT_SUCCESS(vdo_allocate_block(allocator, &allocatedBlock));
+  useBlock(allocatedBlock);
   return allocatedBlock;
 }
 
@@ -318,12 +329,30 @@ static void verifyCoding(void)
   struct slab_depot_state_2_0 state = vdo_record_slab_depot(depot);
   u8 buffer[SLAB_DEPOT_COMPONENT_ENCODED_SIZE];
   size_t offset = 0;
-  encode_slab_depot_state_2_0(buffer, &offset, state);
+  encode_slab_depot_state_2_0(buffer, &offset, state, false);
 
   struct slab_depot_state_2_0 decoded;
+  bool compact = true;
   offset = 0;
-  VDO_ASSERT_SUCCESS(decode_slab_depot_state_2_0(buffer, &offset, &decoded));
+  VDO_ASSERT_SUCCESS(decode_slab_depot_state_2_0(buffer, &offset, &decoded,
+                                                 &compact));
+  CU_ASSERT_FALSE(compact);
+  assertSameStates(state, decoded);
 
+  // A depot whose slab journals may hold version 2 blocks is version 2.1,
+  // which a decoder expecting only version 2.0 would refuse.
+  offset = 0;
+  encode_slab_depot_state_2_0(buffer, &offset, state, true);
+  struct header header;
+  offset = 0;
+  vdo_decode_header(buffer, &offset, &header);
+  CU_ASSERT_EQUAL(vdo_validate_header(&VDO_SLAB_DEPOT_HEADER_2_0, &header,
+                                      true, __func__),
+                  VDO_UNSUPPORTED_VERSION);
+  offset = 0;
+  VDO_ASSERT_SUCCESS(decode_slab_depot_state_2_0(buffer, &offset, &decoded,
+                                                 &compact));
+  CU_ASSERT_TRUE(compact);
   assertSameStates(state, decoded);
   struct partition *slabSummaryPartition = vdo_get_known_partition(&vdo->layout,
                                                                    VDO_SLAB_SUMMARY_PARTITION);
@@ -569,6 +598,43 @@ static void testUnrecoveredSlabs(void)
   CU_ASSERT_PTR_NULL(chopSlab(&allocator->scrubber.slabs));
 }
 
+/**
+ * Test that slabs registered for scrubbing out of order are queued in the
+ * same order as when the queue is populated from the slab summary: clean
+ * slabs first, then the emptiest.
+ **/
+static void testScrubbingOrder(void)
+{
+  initializeAllocatorT1(SLAB_SIZE, BLOCK_COUNT);
+  CU_ASSERT_TRUE(allocator->slab_count > 5);
+  vdo_reset_priority_table(allocator->prioritized_slabs);
+  for (slab_count_t i = 0; i < depot->slab_count; i++) {
+    struct vdo_slab *slab = depot->slabs[i];
+    INIT_LIST_HEAD(&slab->allocq_entry);
+  }
+
+  setSlabSummaryEntry(0, false, SLAB_SIZE / 4);
+  setSlabSummaryEntry(1, true,  0);
+  setSlabSummaryEntry(2, false, SLAB_SIZE / 2);
+  setSlabSummaryEntry(3, true,  SLAB_SIZE);
+  setSlabSummaryEntry(4, false, 0);
+  setSlabSummaryEntry(5, false, SLAB_SIZE / 2);
+
+  for (slab_count_t i = 0; i < 6; i++) {
+    depot->slabs[i]->status = VDO_SLAB_REQUIRES_SCRUBBING;
+    register_slab_for_scrubbing(depot->slabs[i], false);
+  }
+
+  CU_ASSERT_EQUAL(READ_ONCE(allocator->scrubber.slab_count), 6);
+  CU_ASSERT_EQUAL(chopSlab(&allocator->scrubber.slabs)->slab_number, 3);
+  CU_ASSERT_EQUAL(chopSlab(&allocator->scrubber.slabs)->slab_number, 1);
+  CU_ASSERT_EQUAL(chopSlab(&allocator->scrubber.slabs)->slab_number, 2);
+  CU_ASSERT_EQUAL(chopSlab(&allocator->scrubber.slabs)->slab_number, 5);
+  CU_ASSERT_EQUAL(chopSlab(&allocator->scrubber.slabs)->slab_number, 0);
+  CU_ASSERT_EQUAL(chopSlab(&allocator->scrubber.slabs)->slab_number, 4);
+  CU_ASSERT_PTR_NULL(chopSlab(&allocator->scrubber.slabs));
+}
+
 /**
  * Check that the block allocator avoids opening a new slab if there is a free
  * block still available in a previously-open slab.
@@ -634,6 +700,56 @@ static void testAllocationPolicy(void)
   CU_ASSERT_EQUAL(slabOneStart, useNextBlock());
 }
 
+/**
+ * Fill an allocator to a given percentage of its data blocks, then measure
+ * the time spent in the block allocator finding the remaining free blocks.
+ *
+ * @param percentFull  The percentage of data blocks to leave in use
+ **/
+static void benchmarkAllocation(unsigned int percentFull)
+{
+  initializeAllocatorT1(LARGE_SLAB_SIZE, LARGE_BLOCK_COUNT);
+  block_count_t dataBlocks = getDataBlockCount(LARGE_BLOCK_COUNT);
+  allocateSimply(0, dataBlocks);
+
+  srand(42);
+  for (size_t dbn = 0; dbn < dataBlocks; dbn++) {
+    if (((unsigned int) (random() % 100)) >= percentFull) {
+      decRef(dataBlockNumberToPBN(dbn));
+    }
+  }
+
+  // Only the allocations are timed, not the slab journal entries.
+  block_count_t freeBlocks = getPhysicalBlocksFree();
+  ktime_t       elapsed    = 0;
+  for (block_count_t i = 0; i < freeBlocks; i++) {
+    physical_block_number_t allocatedBlock;
+    ktime_t start = current_time_ns(CLOCK_MONOTONIC);
+    VDO_ASSERT_SUCCESS(vdo_allocate_block(allocator, &allocatedBlock));
+    elapsed += current_time_ns(CLOCK_MONOTONIC) - start;
+    useBlock(allocatedBlock);
+  }
+
+  assertNoSpace();
+  printf("\n%u%% full: %llu blocks in %lld usec (%.0f ns/block) ",
+         percentFull, (unsigned long long) freeBlocks,
+         (long long) (elapsed / NSEC_PER_USEC),
+         (freeBlocks == 0) ? 0.0 : ((double) elapsed / freeBlocks));
+}
+
+/**
+ * Measure allocation throughput on allocators which are 50%, 90%, and 99%
+ * full.
+ **/
+static void testAllocationThroughput(void)
+{
+  benchmarkAllocation(50);
+  tearDownVDOTest();
+  benchmarkAllocation(90);
+  tearDownVDOTest();
+  benchmarkAllocation(99);
+}
+
 /**********************************************************************/
 static CU_TestInfo allocatorTests[] = {
   { "allocation with no freed blocks",       testSimpleAllocation },
@@ -642,7 +758,9 @@ static CU_TestInfo allocatorTests[] = {
   { "grow then shrink an allocator",         testUndoResize       },
   { "no runt slabs",                         testNoRuntSlabs      },
   { "unrecovered slab ring population",      testUnrecoveredSlabs },
+  { "unrecovered slabs queued in order",     testScrubbingOrder   },
   { "allocation policy",                     testAllocationPolicy },
+  { "allocation throughput",                 testAllocationThroughput },
   CU_TEST_INFO_NULL,
 };
 
@@ -0,0 +1,111 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * Performance testing of the block comparison kernels.
+ *
+ * $Id$
+ */
+
+#include "assertions.h"
+#include "block-compare.h"
+#include "constants.h"
+#include "status-codes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+  // Should be larger than CPU cache size.
+  TESTSIZE   = 40 * 1024 * 1024,
+  BLOCKS     = TESTSIZE / VDO_BLOCK_SIZE,
+  ITERATIONS = 20,
+};
+
+static const char *VARIANTS[] = { "scalar", "sse2", "avx2", "avx512" };
+
+static char buffer1[TESTSIZE] __attribute__((aligned(64)));
+static char buffer2[TESTSIZE] __attribute__((aligned(64)));
+
+typedef bool Operation(const char *block1, const char *block2);
+
+/**********************************************************************/
+static uint64_t nanoTime(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+/**********************************************************************/
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  return nanoTime();
+#endif
+}
+
+/**********************************************************************/
+static bool isZero(const char *block1, const char *block2 __attribute__((unused)))
+{
+  return vdo_is_zero_block(block1);
+}
+
+/**********************************************************************/
+static bool areEqual(const char *block1, const char *block2)
+{
+  return vdo_blocks_equal(block1, block2);
+}
+
+
+/**
+ * Time an operation over every block of the test buffers. The buffers are
+ * all zero, so every operation must examine the whole block.
+ **/
+static void test(const char *variant, const char *label, Operation *operation,
+                 size_t bytesPerBlock)
+{
+  // Run once before timing to make sure the code is cached.
+  CU_ASSERT_TRUE(operation(buffer1, buffer2));
+
+  uint64_t startTime = nanoTime();
+  uint64_t startCycles = cycles();
+  for (unsigned int i = 0; i < ITERATIONS; i++) {
+    for (unsigned int b = 0; b < BLOCKS; b++) {
+      size_t offset = (size_t) b * VDO_BLOCK_SIZE;
+      CU_ASSERT_TRUE(operation(buffer1 + offset, buffer2 + offset));
+    }
+  }
+  uint64_t elapsedCycles = cycles() - startCycles;
+  uint64_t elapsed = nanoTime() - startTime;
+
+  double bytes = (double) bytesPerBlock * BLOCKS * ITERATIONS;
+  printf("%-8s %-16s %6.2f B/cycle %8.1f MB/s %7.1f ns/block\n",
+         variant, label, bytes / elapsedCycles,
+         (bytes * 1.0e9) / (elapsed * 1024.0 * 1024.0),
+         (double) elapsed / ((double) BLOCKS * ITERATIONS));
+}
+
+/**********************************************************************/
+int main(void)
+{
+  memset(buffer1, 0, sizeof(buffer1));
+  memset(buffer2, 0, sizeof(buffer2));
+
+  for (unsigned int i = 0; i < ARRAY_SIZE(VARIANTS); i++) {
+    if (vdo_set_block_compare_variant(VARIANTS[i]) != VDO_SUCCESS) {
+      printf("%-8s not supported\n", VARIANTS[i]);
+      continue;
+    }
+
+    test(VARIANTS[i], "zero check", isZero, VDO_BLOCK_SIZE);
+    test(VARIANTS[i], "equality", areEqual, 2 * VDO_BLOCK_SIZE);
+  }
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include <linux/random.h>
+#include <string.h>
+
+#include "albtest.h"
+#include "assertions.h"
+#include "block-compare.h"
+#include "constants.h"
+#include "status-codes.h"
+
+#include "vdoAsserts.h"
+
+static const char *VARIANTS[] = { "scalar", "sse2", "avx2", "avx512" };
+
+static char block1[VDO_BLOCK_SIZE] __attribute__((aligned(64)));
+static char block2[VDO_BLOCK_SIZE] __attribute__((aligned(64)));
+static const char zeroBlock[VDO_BLOCK_SIZE] __attribute__((aligned(64)));
+
+/**
+ * Check that every supported variant agrees with memcmp() on the current
+ * contents of the two blocks.
+ **/
+static void checkAllVariants(void)
+{
+  const char *original = vdo_get_block_compare_variant();
+  bool expectEqual = (memcmp(block1, block2, VDO_BLOCK_SIZE) == 0);
+
+  for (unsigned int i = 0; i < ARRAY_SIZE(VARIANTS); i++) {
+    if (vdo_set_block_compare_variant(VARIANTS[i]) != VDO_SUCCESS) {
+      continue;
+    }
+
+    CU_ASSERT_EQUAL(vdo_blocks_equal(block1, block2), expectEqual);
+    CU_ASSERT_EQUAL(vdo_blocks_equal(block2, block1), expectEqual);
+
+    // A batch must give the same answers as individual comparisons.
+    vdo_start_block_compare_batch();
+    CU_ASSERT_EQUAL(vdo_blocks_equal(block1, block2), expectEqual);
+    CU_ASSERT_EQUAL(vdo_blocks_equal(block2, block1), expectEqual);
+    CU_ASSERT_EQUAL(vdo_is_zero_block(block1),
+                    vdo_blocks_equal(block1, zeroBlock));
+    vdo_finish_block_compare_batch();
+  }
+
+  VDO_ASSERT_SUCCESS(vdo_set_block_compare_variant(original));
+}
+
+/**********************************************************************/
+static void testUnknownVariant(void)
+{
+  CU_ASSERT_EQUAL(vdo_set_block_compare_variant("mmx"), VDO_NOT_IMPLEMENTED);
+}
+
+/**********************************************************************/
+static void testEqualBlocks(void)
+{
+  memset(block1, 0, VDO_BLOCK_SIZE);
+  memset(block2, 0, VDO_BLOCK_SIZE);
+  checkAllVariants();
+
+  get_random_bytes(block1, VDO_BLOCK_SIZE);
+  memcpy(block2, block1, VDO_BLOCK_SIZE);
+  checkAllVariants();
+}
+
+/**********************************************************************/
+static void testSingleByteDifferences(void)
+{
+  get_random_bytes(block1, VDO_BLOCK_SIZE);
+  memcpy(block2, block1, VDO_BLOCK_SIZE);
+  for (unsigned int i = 0; i < VDO_BLOCK_SIZE; i++) {
+    block2[i] ^= 0x01;
+    checkAllVariants();
+    block2[i] = block1[i];
+  }
+}
+
+/**********************************************************************/
+static void testMultipleDifferences(void)
+{
+  get_random_bytes(block1, VDO_BLOCK_SIZE);
+  memcpy(block2, block1, VDO_BLOCK_SIZE);
+
+  // Later differences must not hide earlier ones.
+  block2[VDO_BLOCK_SIZE - 1] ^= 0xff;
+  checkAllVariants();
+  block2[2049] ^= 0x10;
+  checkAllVariants();
+  block2[255] ^= 0x80;
+  checkAllVariants();
+  block2[0] ^= 0x01;
+  checkAllVariants();
+}
+
+/**
+ * Check that the search finds the first zero byte in each range of block1
+ * starting at a given offset, leaving room for the padding the search may
+ * read.
+ **/
+static void checkZeroByteSearch(unsigned int start)
+{
+  const u8 *data = (const u8 *) &block1[start];
+  unsigned int maxSize = VDO_BLOCK_SIZE - start - sizeof(u64);
+  unsigned int expected = 0;
+
+  for (unsigned int size = 0; size <= maxSize; size += 61) {
+    while ((expected < size) && (data[expected] != 0)) {
+      expected++;
+    }
+    CU_ASSERT_EQUAL(vdo_find_zero_byte(data, size), expected);
+  }
+}
+
+/**********************************************************************/
+static void testFindZeroByte(void)
+{
+  // No zero bytes at all.
+  memset(block1, 0x01, VDO_BLOCK_SIZE);
+  checkZeroByteSearch(0);
+  checkZeroByteSearch(5);
+
+  // Bytes above a zero byte can be misreported by word-at-a-time searches.
+  for (unsigned int position = 0; position < 3000; position += 7) {
+    memset(block1, 0xff, VDO_BLOCK_SIZE);
+    block1[position] = 0;
+    block1[position + 1] = 0x01;
+    block1[position + 2] = (char) 0x80;
+    block1[position + 63] = 0;
+    checkZeroByteSearch(0);
+    checkZeroByteSearch(position % 16);
+  }
+}
+
+/**********************************************************************/
+static CU_TestInfo theTestInfo[] = {
+  { "unknown variant",          testUnknownVariant        },
+  { "equal blocks",             testEqualBlocks           },
+  { "single byte differences",  testSingleByteDifferences },
+  { "multiple differences",     testMultipleDifferences   },
+  { "find zero byte",           testFindZeroByte          },
+  CU_TEST_INFO_NULL
+};
+
+static CU_SuiteInfo theSuiteInfo = {
+  .name                     = "Block comparison kernels (BlockCompare_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = NULL,
+  .cleaner                  = NULL,
+  .tests                    = theTestInfo
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &theSuiteInfo;
+}
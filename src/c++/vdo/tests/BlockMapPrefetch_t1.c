@@ -0,0 +1,123 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "block-map.h"
+#include "statistics.h"
+
+#include "ioRequest.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  LEAF_PAGES = 64,
+};
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeBlockMapPrefetchT1(void)
+{
+  const TestParameters parameters = {
+    .logicalBlocks = LEAF_PAGES * VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
+    .slabSize      = 1024,
+    .cacheSize     = 16,
+  };
+  initializeVDOTest(&parameters);
+}
+
+/**
+ * Write one block at the start of each leaf page so that every leaf page and
+ * the tree pages above them are allocated.
+ **/
+static void populateLeafPages(void)
+{
+  for (page_number_t page = 0; page < LEAF_PAGES; page++) {
+    writeData(page * VDO_BLOCK_MAP_ENTRIES_PER_PAGE, page, 1, VDO_SUCCESS);
+  }
+}
+
+/**
+ * Test that sequential reads from a cold block map prefetch the leaf pages
+ * ahead of them, and that the prefetched pages are then used.
+ **/
+static void testSequentialPrefetch(void)
+{
+  populateLeafPages();
+  restartVDO(false);
+
+  struct block_map_statistics before = vdo_get_block_map_statistics(vdo->block_map);
+  ktime_t elapsed = -current_time_us();
+  for (page_number_t page = 0; page < LEAF_PAGES; page++) {
+    logical_block_number_t lbn = page * VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+    verifyData(lbn, page, 1);
+    verifyZeros(lbn + 1, VDO_BLOCK_MAP_ENTRIES_PER_PAGE - 1);
+  }
+  elapsed += current_time_us();
+
+  struct block_map_statistics after = vdo_get_block_map_statistics(vdo->block_map);
+  u64 prefetched = after.pages_prefetched - before.pages_prefetched;
+  u64 hits = after.prefetch_hits - before.prefetch_hits;
+  u64 loaded = after.pages_loaded - before.pages_loaded;
+  printf("(%llu pages loaded, %llu prefetched, %llu prefetch hits, %llu ms) ",
+         (unsigned long long) loaded, (unsigned long long) prefetched,
+         (unsigned long long) hits, (unsigned long long) (elapsed / 1000));
+
+  // Once the scan is detected, nearly every leaf page is read ahead.
+  CU_ASSERT_TRUE(prefetched > 0);
+  CU_ASSERT_TRUE(hits > 0);
+  CU_ASSERT_TRUE(hits <= prefetched);
+  CU_ASSERT_TRUE(hits >= LEAF_PAGES / 2);
+
+  // The prefetched pages are still valid after another restart.
+  restartVDO(false);
+  for (page_number_t page = 0; page < LEAF_PAGES; page++) {
+    verifyData(page * VDO_BLOCK_MAP_ENTRIES_PER_PAGE, page, 1);
+  }
+}
+
+/**
+ * Test that random reads do not trigger prefetching.
+ **/
+static void testRandomNoPrefetch(void)
+{
+  populateLeafPages();
+  restartVDO(false);
+
+  struct block_map_statistics before = vdo_get_block_map_statistics(vdo->block_map);
+  for (page_number_t i = 0; i < LEAF_PAGES; i++) {
+    // 37 is coprime to LEAF_PAGES, so this visits every page out of order.
+    page_number_t page = (i * 37) % LEAF_PAGES;
+    verifyData(page * VDO_BLOCK_MAP_ENTRIES_PER_PAGE, page, 1);
+  }
+
+  struct block_map_statistics after = vdo_get_block_map_statistics(vdo->block_map);
+  CU_ASSERT_EQUAL(after.pages_prefetched, before.pages_prefetched);
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "sequential reads prefetch", testSequentialPrefetch },
+  { "random reads do not",       testRandomNoPrefetch   },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "block map page prefetch (BlockMapPrefetch_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeBlockMapPrefetchT1,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
@@ -500,6 +500,7 @@ static void testBlockMapTreeWritesWithExhaustedVIOPool(void)
   /* Replace the zone's vio pool with one which only has 1 vio */
   free_vio_pool(uds_forget(zone->vio_pool));
   VDO_ASSERT_SUCCESS(make_vio_pool(vdo,
+                                   1,
                                    1,
                                    zone->thread_id,
                                    VIO_TYPE_BLOCK_MAP_INTERIOR,
@@ -0,0 +1,156 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include <linux/bio.h>
+
+#include "block-map.h"
+#include "vdo.h"
+#include "vio.h"
+
+#include "ioRequest.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  INJECTED_ERROR = -1,
+  LEAF_PAGES     = 240,
+};
+
+static block_count_t writebackBios;
+static block_count_t writebackBlocks;
+static block_count_t largestWriteback;
+static bool          injectWriteError;
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeBlockMapWritebackT1(void)
+{
+  const TestParameters parameters = {
+    .logicalBlocks = LEAF_PAGES * VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
+    .slabSize      = 1024,
+    .cacheSize     = 512,
+    // Long enough that no dirty page ages out before the VDO is saved.
+    .journalBlocks = 64,
+  };
+  initializeVDOTest(&parameters);
+  writebackBios = 0;
+  writebackBlocks = 0;
+  largestWriteback = 0;
+  injectWriteError = false;
+}
+
+/**
+ * Record the size of each block map page write, optionally failing the
+ * first one which covers more than one page.
+ *
+ * Implements BIOSubmitHook.
+ **/
+static bool recordWriteback(struct bio *bio)
+{
+  struct vio *vio = bio->bi_private;
+  if ((bio_op(bio) != REQ_OP_WRITE) || (vio->type != VIO_TYPE_BLOCK_MAP)
+      || (bio->bi_iter.bi_size == 0)) {
+    return true;
+  }
+
+  block_count_t blocks = bio->bi_iter.bi_size / VDO_BLOCK_SIZE;
+  writebackBios++;
+  writebackBlocks += blocks;
+  largestWriteback = max(largestWriteback, blocks);
+  if (!injectWriteError || (blocks == 1)) {
+    return true;
+  }
+
+  injectWriteError = false;
+  bio->bi_status = INJECTED_ERROR;
+  bio->bi_end_io(bio);
+  return false;
+}
+
+/**
+ * Allocate the whole block map tree so that the leaf pages are laid out
+ * contiguously, then dirty every leaf page.
+ **/
+static void dirtyLeafPages(void)
+{
+  populateBlockMapTree();
+  restartVDO(false);
+  for (page_number_t page = 0; page < LEAF_PAGES; page++) {
+    writeData(page * VDO_BLOCK_MAP_ENTRIES_PER_PAGE, page, 1, VDO_SUCCESS);
+  }
+}
+
+/**
+ * Test that saving a cache full of dirty, adjacent leaf pages issues
+ * multi-block writes.
+ **/
+static void testCoalescedWriteback(void)
+{
+  dirtyLeafPages();
+  setBIOSubmitHook(recordWriteback);
+  ktime_t elapsed = -current_time_us();
+  restartVDO(false);
+  elapsed += current_time_us();
+  clearBIOSubmitHook();
+
+  printf("(%llu pages in %llu bios, largest %llu, %llu ms) ",
+         (unsigned long long) writebackBlocks,
+         (unsigned long long) writebackBios,
+         (unsigned long long) largestWriteback,
+         (unsigned long long) (elapsed / 1000));
+  CU_ASSERT_TRUE(writebackBlocks >= LEAF_PAGES);
+  CU_ASSERT_TRUE(largestWriteback > 1);
+  CU_ASSERT_TRUE(largestWriteback <= BLOCK_MAP_WRITEBACK_BLOCKS);
+  CU_ASSERT_TRUE(writebackBios < writebackBlocks / 2);
+
+  for (page_number_t page = 0; page < LEAF_PAGES; page++) {
+    logical_block_number_t lbn = page * VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+    verifyData(lbn, page, 1);
+    verifyZeros(lbn + 1, 1);
+  }
+}
+
+/**
+ * Test that a failed multi-block write puts the VDO in read-only mode rather
+ * than leaving the pages it covered outstanding.
+ **/
+static void testWritebackError(void)
+{
+  dirtyLeafPages();
+  injectWriteError = true;
+  setBIOSubmitHook(recordWriteback);
+  CU_ASSERT_EQUAL(VDO_READ_ONLY, suspendVDO(true));
+  clearBIOSubmitHook();
+  CU_ASSERT_FALSE(injectWriteError);
+  assertVDOState(VDO_READ_ONLY_MODE);
+  setStartStopExpectation(VDO_READ_ONLY);
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "dirty pages are written in runs", testCoalescedWriteback },
+  { "writeback error enters read-only", testWritebackError    },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "block map page writeback (BlockMapWriteback_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeBlockMapWritebackT1,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
@@ -38,10 +38,12 @@ static void testEmptyBlock(void)
 {
   for (enum block_mapping_state i = VDO_MAPPING_STATE_UNMAPPED;
        i < VDO_MAPPING_STATE_COMPRESSED_BASE; i++) {
+    enum vdo_compression_type type;
     uint16_t fragmentOffset, fragmentSize;
     CU_ASSERT_EQUAL(VDO_INVALID_FRAGMENT,
                     vdo_get_compressed_block_fragment(i,
                                                       &compressedBlock,
+                                                      &type,
                                                       &fragmentOffset,
                                                       &fragmentSize));
   }
@@ -54,15 +56,61 @@ static void testInvalidBlock(void)
     = __cpu_to_le32(INVALID_VERSION);
 
   for (unsigned int i = 0; i < VDO_MAX_COMPRESSION_SLOTS; ++i) {
+    enum vdo_compression_type type;
     uint16_t fragmentOffset, fragmentSize;
     CU_ASSERT_EQUAL(VDO_INVALID_FRAGMENT,
                     vdo_get_compressed_block_fragment(getStateForSlot(i),
                                                       &compressedBlock,
+                                                      &type,
                                                       &fragmentOffset,
                                                       &fragmentSize));
   }
 }
 
+/**********************************************************************/
+static void testInvalidType(void)
+{
+  initialize_compressed_block(&compressedBlock, 101);
+  record_compression_type(&compressedBlock, 101, VDO_COMPRESSION_TYPE_COUNT);
+
+  enum vdo_compression_type type;
+  uint16_t fragmentOffset, fragmentSize;
+  CU_ASSERT_EQUAL(VDO_INVALID_FRAGMENT,
+                  vdo_get_compressed_block_fragment(getStateForSlot(0),
+                                                    &compressedBlock,
+                                                    &type,
+                                                    &fragmentOffset,
+                                                    &fragmentSize));
+}
+
+/**
+ * Check that a block with a version 1.0 header, which does not record the
+ * compression type, is read as LZ4.
+ **/
+static void testVersion1Block(void)
+{
+  enum {
+    HEADER_1_0_SIZE = 4 + 4 + (2 * VDO_MAX_COMPRESSION_SLOTS),
+  };
+
+  char *raw = (char *) &compressedBlock;
+  __le32 major = __cpu_to_le32(1);
+  memcpy(raw, &major, sizeof(major));
+  __le16 sizes[2] = { __cpu_to_le16(100), __cpu_to_le16(50) };
+  memcpy(raw + 8, sizes, sizeof(sizes));
+
+  enum vdo_compression_type type = VDO_COMPRESSION_LZ4HC;
+  uint16_t fragmentOffset, fragmentSize;
+  VDO_ASSERT_SUCCESS(vdo_get_compressed_block_fragment(getStateForSlot(1),
+                                                       &compressedBlock,
+                                                       &type,
+                                                       &fragmentOffset,
+                                                       &fragmentSize));
+  CU_ASSERT_EQUAL(VDO_COMPRESSION_LZ4, type);
+  CU_ASSERT_EQUAL(HEADER_1_0_SIZE + 100, fragmentOffset);
+  CU_ASSERT_EQUAL(50, fragmentSize);
+}
+
 /**********************************************************************/
 static void testAbsurdBlock(void)
 {
@@ -71,10 +119,12 @@ static void testAbsurdBlock(void)
     compressedBlock.header.sizes[i] = __cpu_to_le16(VDO_BLOCK_SIZE + i * 101);
   }
 
+  enum vdo_compression_type type;
   uint16_t fragmentOffset, fragmentSize;
   CU_ASSERT_EQUAL(VDO_SUCCESS,
                   vdo_get_compressed_block_fragment(getStateForSlot(0),
                                                     &compressedBlock,
+                                                    &type,
                                                     &fragmentOffset,
                                                     &fragmentSize));
 
@@ -82,13 +132,19 @@ static void testAbsurdBlock(void)
     CU_ASSERT_EQUAL(VDO_INVALID_FRAGMENT,
                     vdo_get_compressed_block_fragment(getStateForSlot(i),
                                                       &compressedBlock,
+                                                      &type,
                                                       &fragmentOffset,
                                                       &fragmentSize));
   }
 }
 
-/**********************************************************************/
-static void testValidFragments(void)
+/**
+ * Pack a block full of fragments of a given compression type and check that
+ * each can be found.
+ *
+ * @param type  The compression type of the fragments
+ **/
+static void checkValidFragments(enum vdo_compression_type type)
 {
   char originalData[VDO_BLOCK_SIZE];
 
@@ -100,11 +156,17 @@ static void testValidFragments(void)
     originalData[i] = (char) j;
   }
 
+  // A block which records its compression type has a longer header.
+  size_t headerSize = sizeof(struct compressed_block_header);
+  if (type != VDO_COMPRESSION_LZ4) {
+    headerSize++;
+  }
+
   unsigned int offsets[VDO_MAX_COMPRESSION_SLOTS + 1] = {
        0,
        200,  400,  440,  960, 1130, 1131, 1131,
        1290, 2055, 3012, 3994, 3994, 4050,
-       (VDO_BLOCK_SIZE - sizeof(struct compressed_block_header))
+       (VDO_BLOCK_SIZE - headerSize)
   };
 
   for (unsigned int i = 0; i < VDO_MAX_COMPRESSION_SLOTS; ++i) {
@@ -131,30 +193,61 @@ static void testValidFragments(void)
                                   &compressedBlock));
   }
 
+  if (type != VDO_COMPRESSION_LZ4) {
+    record_compression_type(&compressedBlock,
+                            offsets[VDO_MAX_COMPRESSION_SLOTS],
+                            type);
+  }
+
   for (unsigned int i = 0; i < VDO_MAX_COMPRESSION_SLOTS; ++i) {
+    enum vdo_compression_type foundType;
     uint16_t fragmentOffset, fragmentSize;
     CU_ASSERT_EQUAL(VDO_SUCCESS,
                     vdo_get_compressed_block_fragment(getStateForSlot(i),
                                                       &compressedBlock,
+                                                      &foundType,
                                                       &fragmentOffset,
                                                       &fragmentSize));
-    CU_ASSERT_EQUAL(fragmentOffset, offsets[i]);
+    CU_ASSERT_EQUAL(type, foundType);
+    CU_ASSERT_EQUAL(fragmentOffset, headerSize + offsets[i]);
 
     size_t expectedSize = offsets[i + 1] - offsets[i];
     CU_ASSERT_EQUAL(fragmentSize, expectedSize);
 
-    UDS_ASSERT_EQUAL_BYTES(compressedBlock.data + fragmentOffset,
+    UDS_ASSERT_EQUAL_BYTES((char *) &compressedBlock + fragmentOffset,
                            originalData + offsets[i],
                            fragmentSize);
   }
 }
 
+/**********************************************************************/
+static void testValidFragments(void)
+{
+  checkValidFragments(VDO_COMPRESSION_LZ4);
+  CU_ASSERT_EQUAL(1,
+                  __le32_to_cpu(compressedBlock.header.version.major_version));
+}
+
+/**
+ * Check that fragments of any type but LZ4 are found in a block with a
+ * version 2.0 header.
+ **/
+static void testTypedFragments(void)
+{
+  checkValidFragments(VDO_COMPRESSION_LZ4HC);
+  CU_ASSERT_EQUAL(2,
+                  __le32_to_cpu(compressedBlock.header.version.major_version));
+}
+
 /**********************************************************************/
 static CU_TestInfo compressedBlockTests[] = {
   { "empty block",     testEmptyBlock     },
   { "invalid block",   testInvalidBlock   },
+  { "invalid type",    testInvalidType    },
+  { "version 1 block", testVersion1Block  },
   { "absurd block",    testAbsurdBlock    },
   { "valid fragments", testValidFragments },
+  { "typed fragments", testTypedFragments },
   CU_TEST_INFO_NULL
 };
 
@@ -8,6 +8,9 @@
 
 #include "albtest.h"
 
+#include <linux/lz4.h>
+#include <stdlib.h>
+
 #include "memory-alloc.h"
 #include "permassert.h"
 
@@ -22,6 +25,7 @@
 #include "mutexUtils.h"
 #include "packerUtils.h"
 #include "testBIO.h"
+#include "testTimer.h"
 #include "vdoAsserts.h"
 #include "vdoTestBase.h"
 
@@ -83,6 +87,196 @@ static void testCompressedDataReadWrite(void)
   CU_ASSERT_EQUAL(blocksFree, getPhysicalBlocksFree());
 }
 
+/**
+ * Test that blocks which look incompressible are written without an attempt
+ * to compress them, while compressible blocks are still compressed.
+ **/
+static void testIncompressibleDataSkipped(void)
+{
+  enum { INCOMPRESSIBLE_BLOCKS = 4 };
+  char *data;
+  VDO_ASSERT_SUCCESS(uds_allocate(INCOMPRESSIBLE_BLOCKS * VDO_BLOCK_SIZE, char,
+                                  __func__, &data));
+  for (size_t i = 0; i < INCOMPRESSIBLE_BLOCKS * VDO_BLOCK_SIZE; i++) {
+    data[i] = random();
+  }
+
+  struct packer_statistics before = vdo_get_packer_statistics(vdo->packer);
+  VDO_ASSERT_SUCCESS(performWrite(0, INCOMPRESSIBLE_BLOCKS, data));
+  struct packer_statistics after = vdo_get_packer_statistics(vdo->packer);
+  CU_ASSERT_EQUAL(before.skipped_as_incompressible + INCOMPRESSIBLE_BLOCKS,
+                  after.skipped_as_incompressible);
+  CU_ASSERT_EQUAL(before.compressed_fragments_written,
+                  after.compressed_fragments_written);
+  CU_ASSERT_EQUAL(blocksFree - INCOMPRESSIBLE_BLOCKS, getPhysicalBlocksFree());
+
+  char *buffer;
+  VDO_ASSERT_SUCCESS(uds_allocate(INCOMPRESSIBLE_BLOCKS * VDO_BLOCK_SIZE, char,
+                                  __func__, &buffer));
+  VDO_ASSERT_SUCCESS(performRead(0, INCOMPRESSIBLE_BLOCKS, buffer));
+  UDS_ASSERT_EQUAL_BYTES(data, buffer, INCOMPRESSIBLE_BLOCKS * VDO_BLOCK_SIZE);
+  uds_free(buffer);
+  uds_free(data);
+
+  // A full bin of compressible blocks is compressed and packed.
+  writeData(INCOMPRESSIBLE_BLOCKS, 1, VDO_MAX_COMPRESSION_SLOTS, VDO_SUCCESS);
+  before = after;
+  after = vdo_get_packer_statistics(vdo->packer);
+  CU_ASSERT_EQUAL(before.skipped_as_incompressible,
+                  after.skipped_as_incompressible);
+  CU_ASSERT_EQUAL(before.compressed_fragments_written
+                  + VDO_MAX_COMPRESSION_SLOTS,
+                  after.compressed_fragments_written);
+  verifyData(INCOMPRESSIBLE_BLOCKS, 1, VDO_MAX_COMPRESSION_SLOTS);
+}
+
+/**
+ * Send a compression-type message to the VDO.
+ *
+ * @param value  The compression type and level
+ *
+ * @return The result of the message
+ **/
+static int setCompressionType(const char *value)
+{
+  char *argv[2];
+  VDO_ASSERT_SUCCESS(uds_duplicate_string("compression-type", __func__,
+                                          &argv[0]));
+  VDO_ASSERT_SUCCESS(uds_duplicate_string(value, __func__, &argv[1]));
+  int result = vdoTargetType->message(vdo->device_config->owning_target, 2,
+                                      argv, NULL, 0);
+  uds_free(argv[0]);
+  uds_free(argv[1]);
+  return result;
+}
+
+/**
+ * Write a batch of distinct blocks which fill a compressed block.
+ *
+ * @param batch  The number of the batch, which determines where it is written
+ **/
+static void writeBatch(block_count_t batch)
+{
+  writeData(batch * VDO_MAX_COMPRESSION_SLOTS,
+            (batch * VDO_MAX_COMPRESSION_SLOTS) + 1,
+            VDO_MAX_COMPRESSION_SLOTS,
+            VDO_SUCCESS);
+}
+
+/**
+ * Read the compressed block holding a batch written by writeBatch(), and
+ * check the version of its header and the compression type it records, if any.
+ *
+ * @param batch  The number of the batch
+ * @param type   The expected compression type
+ **/
+static void checkCompressedBlock(block_count_t batch,
+                                 enum vdo_compression_type type)
+{
+  struct zoned_pbn mapping = lookupLBN(batch * VDO_MAX_COMPRESSION_SLOTS);
+  CU_ASSERT_TRUE(vdo_is_state_compressed(mapping.state));
+
+  char *block;
+  VDO_ASSERT_SUCCESS(uds_allocate(VDO_BLOCK_SIZE, char, __func__, &block));
+  PhysicalLayer *syncLayer = getSynchronousLayer();
+  VDO_ASSERT_SUCCESS(syncLayer->reader(syncLayer, mapping.pbn, 1, block));
+
+  // Only blocks of types other than LZ4 have the version 2.0 header.
+  struct packed_version_number *version
+    = (struct packed_version_number *) block;
+  if (type == VDO_COMPRESSION_LZ4) {
+    CU_ASSERT_EQUAL(1, __le32_to_cpu(version->major_version));
+  } else {
+    CU_ASSERT_EQUAL(2, __le32_to_cpu(version->major_version));
+    CU_ASSERT_EQUAL(type, (u8) block[sizeof(*version)]);
+  }
+
+  uds_free(block);
+}
+
+/**
+ * Check which compressor was last used, and with what acceleration or level.
+ *
+ * @param type   The expected compressor
+ * @param level  The expected acceleration or level
+ **/
+static void assertLastCompressor(enum vdo_compression_type type, int level)
+{
+  int lastLevel;
+  CU_ASSERT_EQUAL(type, getLastCompressor(&lastLevel));
+  CU_ASSERT_EQUAL(level, lastLevel);
+}
+
+/**
+ * Test that the compression type and level reach the compressor, that types
+ * other than LZ4 are recorded in the compressed blocks written and require the
+ * volume to be upgraded, and that the table's type is restored on resume.
+ **/
+static void testCompressionType(void)
+{
+  CU_ASSERT_EQUAL(VDO_COMPRESSION_LZ4, vdo->compression_type);
+  CU_ASSERT_EQUAL(-EINVAL, setCompressionType("zstd"));
+  CU_ASSERT_EQUAL(-EINVAL, setCompressionType("lz4hc:99"));
+  CU_ASSERT_EQUAL(-EINVAL, setCompressionType("lz4:fast"));
+  CU_ASSERT_EQUAL(-EINVAL, setCompressionType("lz4:1:2"));
+
+  // LZ4HC needs a volume upgrade, which only a table load may do.
+  CU_ASSERT_EQUAL(-EINVAL, setCompressionType("lz4hc:12"));
+  CU_ASSERT_EQUAL(VDO_COMPRESSION_LZ4, vdo->compression_type);
+  CU_ASSERT_TRUE(vdo_are_same_version(VDO_VOLUME_VERSION_67_0,
+                                      vdo->states.volume_version));
+
+  writeBatch(0);
+  assertLastCompressor(VDO_COMPRESSION_LZ4, LZ4_ACCELERATION_DEFAULT);
+  checkCompressedBlock(0, VDO_COMPRESSION_LZ4);
+
+  VDO_ASSERT_SUCCESS(setCompressionType("lz4:5"));
+  writeBatch(1);
+  assertLastCompressor(VDO_COMPRESSION_LZ4, 5);
+  checkCompressedBlock(1, VDO_COMPRESSION_LZ4);
+
+  struct device_config deviceConfig = getTestConfig().deviceConfig;
+  deviceConfig.compression_type = VDO_COMPRESSION_LZ4HC;
+  deviceConfig.compression_level = 12;
+  reloadVDO(deviceConfig);
+  CU_ASSERT_EQUAL(VDO_COMPRESSION_LZ4HC, vdo->compression_type);
+  CU_ASSERT_EQUAL(12, vdo->compression_level);
+  CU_ASSERT_TRUE(vdo_are_same_version(VDO_VOLUME_VERSION_67_1,
+                                      vdo->states.volume_version));
+
+  writeBatch(2);
+  assertLastCompressor(VDO_COMPRESSION_LZ4HC, 12);
+  checkCompressedBlock(2, VDO_COMPRESSION_LZ4HC);
+
+  // Once the volume is upgraded, the type may be changed by message.
+  VDO_ASSERT_SUCCESS(setCompressionType("lz4hc"));
+  CU_ASSERT_EQUAL(0, vdo->compression_level);
+  writeBatch(3);
+  assertLastCompressor(VDO_COMPRESSION_LZ4HC, LZ4HC_DEFAULT_CLEVEL);
+
+  // Resuming restores the type from the table.
+  VDO_ASSERT_SUCCESS(setCompressionType("lz4"));
+  VDO_ASSERT_SUCCESS(modifyCompressDedupe(true, true));
+  CU_ASSERT_EQUAL(VDO_COMPRESSION_LZ4HC, vdo->compression_type);
+  CU_ASSERT_EQUAL(12, vdo->compression_level);
+
+  // LZ4 blocks written after the upgrade still have the old header.
+  deviceConfig.compression_type = VDO_COMPRESSION_LZ4;
+  deviceConfig.compression_level = 0;
+  reloadVDO(deviceConfig);
+  CU_ASSERT_TRUE(vdo_are_same_version(VDO_VOLUME_VERSION_67_1,
+                                      vdo->states.volume_version));
+  writeBatch(4);
+  checkCompressedBlock(4, VDO_COMPRESSION_LZ4);
+
+  // Blocks of all types can be read.
+  for (unsigned int batch = 0; batch < 5; batch++) {
+    verifyData(batch * VDO_MAX_COMPRESSION_SLOTS,
+               (batch * VDO_MAX_COMPRESSION_SLOTS) + 1,
+               VDO_MAX_COMPRESSION_SLOTS);
+  }
+}
+
 /**
  * Test that writes which duplicate blocks that are waiting in the packer.
  **/
@@ -299,6 +493,67 @@ static void testReadOnlyModeWithBlocksInPackerNoAssert(void)
   testReadOnlyModeWithBlocksInPacker();
 }
 
+/**
+ * An action which does nothing, used to wait for the packer thread to process
+ * everything enqueued before it.
+ *
+ * @param completion  The action completion
+ **/
+static void finishAction(struct vdo_completion *completion)
+{
+  vdo_finish_completion(completion);
+}
+
+/**
+ * Test that a bin which never fills is written once it reaches the age
+ * deadline, without waiting for a flush, and that the time its fragments
+ * spent in the packer is counted.
+ **/
+static void testAgeDeadline(void)
+{
+  struct packer_statistics before = vdo_get_packer_statistics(vdo->packer);
+  writeCompressableData(2, 1, requests);
+
+  // Make sure both data_vios are in a bin, which starts the timer.
+  performSuccessfulActionOnThread(finishAction, vdo->packer->thread_id);
+  ktime_t deadline = getNextHRTimeout();
+  CU_ASSERT_NOT_EQUAL(S64_MAX, deadline);
+  CU_ASSERT_TRUE(fireHRTimers(deadline));
+  for (block_count_t i = 0; i < 2; i++) {
+    awaitAndFreeSuccessfulRequest(uds_forget(requests[i]));
+  }
+
+  struct packer_statistics after = vdo_get_packer_statistics(vdo->packer);
+  CU_ASSERT_EQUAL(before.compressed_blocks_written + 1,
+                  after.compressed_blocks_written);
+  CU_ASSERT_EQUAL(before.bins_written_at_deadline + 1,
+                  after.bins_written_at_deadline);
+  CU_ASSERT_EQUAL(0, after.compressed_fragments_in_packer);
+  CU_ASSERT(after.bin_age_deadline > 0);
+  CU_ASSERT(after.bin_age_deadline <= PACKER_MAXIMUM_AGE_MS * 1000);
+  CU_ASSERT(after.bin_fill_target >= 50);
+  CU_ASSERT(after.bin_fill_target <= 100);
+
+  u64 held = ((after.fragments_held_under_500us
+               - before.fragments_held_under_500us)
+              + (after.fragments_held_under_1ms
+                 - before.fragments_held_under_1ms)
+              + (after.fragments_held_under_2ms
+                 - before.fragments_held_under_2ms)
+              + (after.fragments_held_under_5ms
+                 - before.fragments_held_under_5ms)
+              + (after.fragments_held_under_10ms
+                 - before.fragments_held_under_10ms)
+              + (after.fragments_held_under_20ms
+                 - before.fragments_held_under_20ms)
+              + (after.fragments_held_longer - before.fragments_held_longer));
+  CU_ASSERT_EQUAL(2, held);
+
+  CU_ASSERT_TRUE(vdo_is_state_compressed(lookupLBN(0).state));
+  CU_ASSERT_TRUE(vdo_is_state_compressed(lookupLBN(1).state));
+  verifyData(0, 1, 2);
+}
+
 /**
  * Test that reading a damaged or invalid compressed block returns an I/O
  * error and does not put the VDO into read-only mode. Data blocks can be
@@ -340,6 +595,8 @@ static void testInvalidFragment(void)
 
 static CU_TestInfo tests[] = {
   { "compressed data read write",        testCompressedDataReadWrite         },
+  { "incompressible data skipped",       testIncompressibleDataSkipped       },
+  { "compression type",                  testCompressionType                 },
   { "dedupe block in packer",            testDedupeBlocksInPacker            },
   { "dedupe block in compressor",        testDedupeBlocksInCompressor        },
   { "compressed block reference",        testCompressedBlockReference        },
@@ -348,6 +605,7 @@ static CU_TestInfo tests[] = {
   { "test entering read-only mode with blocks in the packer doesn't assert",
                                   testReadOnlyModeWithBlocksInPackerNoAssert },
   { "handling of invalid fragment errors", testInvalidFragment               },
+  { "bins written at the age deadline",  testAgeDeadline                     },
   CU_TEST_INFO_NULL,
 };
 
@@ -77,6 +77,10 @@ static bool blockDataVIOLocked(void *context)
 {
   struct data_vio *dataVIO = context;
   CU_ASSERT_EQUAL(dataVIO->logical.lbn, nextLBNExpected++);
+  // Relaunched writes of zero blocks must still have been checked for zeros.
+  CU_ASSERT_EQUAL(dataVIO->is_zero,
+                  ((dataVIO->logical.lbn < REQUEST_COUNT)
+                   && !REQUEST_TYPES[dataVIO->logical.lbn]));
   blocked[dataVIO->logical.lbn] = dataVIO;
   blockedCount++;
   return true;
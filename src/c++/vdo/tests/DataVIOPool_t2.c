@@ -0,0 +1,314 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "memory-alloc.h"
+#include "uds-threads.h"
+
+#include "data-vio.h"
+
+#include "asyncVIO.h"
+#include "ioRequest.h"
+#include "mutexUtils.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  DATA_VIO_COUNT = 4,
+  REQUEST_COUNT  = 8,
+  // Long enough that no waiter in these tests ages past it.
+  LONG_DEADLINE  = 60 * 1000,
+};
+
+static const bool READ_REQUEST = true;
+
+static struct data_vio *blocked[REQUEST_COUNT + DATA_VIO_COUNT];
+static uint8_t          blockedCount;
+static uint8_t          nextLBNExpected;
+static struct thread   *threads[REQUEST_COUNT];
+static bool             isRead[REQUEST_COUNT];
+static uint32_t         targetBlockedThreadCount;
+
+/**
+ * Test-specific initialization.
+ **/
+static void initialize(void)
+{
+  const TestParameters parameters = {
+    .mappableBlocks = 64,
+  };
+
+  // Drastically reduce the data_vio_count so we can consume them all easily.
+  data_vio_count           = DATA_VIO_COUNT;
+  blockedCount             = 0;
+  targetBlockedThreadCount = 0;
+  initializeVDOTest(&parameters);
+}
+
+/**********************************************************************/
+static bool blockDataVIOLocked(void *context)
+{
+  struct data_vio *dataVIO = context;
+  CU_ASSERT_EQUAL(dataVIO->logical.lbn, nextLBNExpected++);
+  blocked[dataVIO->logical.lbn] = dataVIO;
+  blockedCount++;
+  return true;
+}
+
+/**
+ * Block any data_vio which is just launching, and assert that the launches
+ * occur in the order we expect, which is the order of their LBNs.
+ **/
+static bool blockAllLaunches(struct vdo_completion *completion)
+{
+  if (!lastAsyncOperationIs(completion, VIO_ASYNC_OP_LAUNCH)) {
+    return true;
+  }
+
+  runLocked(blockDataVIOLocked, as_data_vio(completion));
+  return false;
+}
+
+/**********************************************************************/
+static bool waitForBlockedCount(void *context)
+{
+  return (blockedCount == *((uint8_t *) context));
+}
+
+/**********************************************************************/
+static void launchRequestOnThread(void *arg)
+{
+  logical_block_number_t lbn = *((logical_block_number_t *) arg);
+  if (isRead[lbn]) {
+    char buffer[VDO_BLOCK_SIZE];
+    VDO_ASSERT_SUCCESS(performRead(lbn, 1, buffer));
+  } else {
+    zeroData(lbn, 1, VDO_SUCCESS);
+  }
+}
+
+/**
+ * Launch a request on its own thread.
+ *
+ * @param lbn      The LBN of the request
+ * @param read     Whether the request is a read
+ * @param blocks   Whether the request is expected to block in the pool
+ **/
+static void launchRequest(logical_block_number_t lbn, bool read, bool blocks)
+{
+  char name[16];
+  sprintf(name, "thread %" PRIu64, lbn);
+  isRead[lbn] = read;
+  uint8_t expected = blockedCount + 1;
+  VDO_ASSERT_SUCCESS(uds_create_thread(launchRequestOnThread,
+                                       &lbn,
+                                       name,
+                                       &threads[lbn]));
+  if (blocks) {
+    targetBlockedThreadCount++;
+    waitForCondition(checkBlockedThreadCount, &targetBlockedThreadCount);
+  } else {
+    waitForCondition(waitForBlockedCount, &expected);
+  }
+}
+
+/**********************************************************************/
+static void releaseBlockedDataVIO(logical_block_number_t lbn)
+{
+  struct data_vio *data_vio = uds_forget(blocked[lbn]);
+  CU_ASSERT_PTR_NOT_NULL(data_vio);
+  reallyEnqueueVIO(&data_vio->vio);
+}
+
+/**
+ * Release blocked data_vios, and wait for the same number of waiters to be
+ * launched in their place.
+ *
+ * @param start  The first LBN to release
+ * @param count  The number of data_vios to release
+ **/
+static void releaseAndRelaunch(logical_block_number_t start, uint8_t count)
+{
+  uint8_t expected = blockedCount;
+  blockedCount -= count;
+  targetBlockedThreadCount -= count;
+  for (logical_block_number_t lbn = start; lbn < start + count; lbn++) {
+    releaseBlockedDataVIO(lbn);
+  }
+
+  waitForCondition(waitForBlockedCount, &expected);
+}
+
+/**********************************************************************/
+static void joinThreads(void)
+{
+  for (uint8_t i = 0; i < REQUEST_COUNT; i++) {
+    if (threads[i] != NULL) {
+      uds_join_threads(uds_forget(threads[i]));
+    }
+  }
+}
+
+/**
+ * Fill the pool with a write whose data_vios are all blocked at launch.
+ *
+ * @return The request
+ **/
+static IORequest *fillPool(void)
+{
+  nextLBNExpected = REQUEST_COUNT;
+  setCompletionEnqueueHook(blockAllLaunches);
+  IORequest *request = launchIndexedWrite(REQUEST_COUNT, DATA_VIO_COUNT, 1);
+  waitForCondition(waitForBlockedCount, &data_vio_count);
+  nextLBNExpected = 0;
+  return request;
+}
+
+/**
+ * Release the data_vios which filled the pool, and wait for their request.
+ **/
+static void releaseFill(IORequest *request)
+{
+  releaseAndRelaunch(REQUEST_COUNT, DATA_VIO_COUNT);
+  awaitAndFreeRequest(request);
+}
+
+/**
+ * Test that writes may not take the data_vios reserved for reads.
+ **/
+static void testReadReserve(void)
+{
+  CU_ASSERT_EQUAL(set_data_vio_pool_read_reserve(vdo->data_vio_pool,
+                                                 DATA_VIO_COUNT),
+                  -EINVAL);
+  VDO_ASSERT_SUCCESS(set_data_vio_pool_read_reserve(vdo->data_vio_pool, 2));
+  CU_ASSERT_EQUAL(get_data_vio_pool_read_reserve(vdo->data_vio_pool), 2);
+
+  nextLBNExpected = 0;
+  setCompletionEnqueueHook(blockAllLaunches);
+
+  // Two writes may start, but a third would leave less than the reserve free.
+  launchRequest(0, !READ_REQUEST, false);
+  launchRequest(1, !READ_REQUEST, false);
+  launchRequest(4, !READ_REQUEST, true);
+
+  // Reads may still use the reserved data_vios.
+  launchRequest(2, READ_REQUEST, false);
+  launchRequest(3, READ_REQUEST, false);
+
+  // Freeing the reads is not enough for the write, but freeing a write is.
+  blockedCount -= 2;
+  releaseBlockedDataVIO(2);
+  releaseBlockedDataVIO(3);
+  uds_join_threads(uds_forget(threads[2]));
+  uds_join_threads(uds_forget(threads[3]));
+  CU_ASSERT_TRUE(checkBlockedThreadCount(&targetBlockedThreadCount));
+  releaseAndRelaunch(0, 1);
+  CU_ASSERT_EQUAL(blockedCount, 2);
+
+  blockedCount = 0;
+  releaseBlockedDataVIO(1);
+  releaseBlockedDataVIO(4);
+  joinThreads();
+}
+
+/**
+ * Launch four writes and then four reads which all wait for data_vios, in the
+ * order given by launchOrder[], which is not the order of their LBNs.
+ **/
+static void launchWritesThenReads(const logical_block_number_t *launchOrder)
+{
+  for (uint8_t i = 0; i < REQUEST_COUNT; i++) {
+    launchRequest(launchOrder[i], (i >= (REQUEST_COUNT / 2)), true);
+  }
+}
+
+/**
+ * Test that waiting writes get only their share of the data_vios when reads
+ * are also waiting.
+ **/
+static void testWriteShare(void)
+{
+  CU_ASSERT_EQUAL(set_data_vio_pool_write_share(vdo->data_vio_pool, 0),
+                  -EINVAL);
+  CU_ASSERT_EQUAL(set_data_vio_pool_write_share(vdo->data_vio_pool, 101),
+                  -EINVAL);
+  VDO_ASSERT_SUCCESS(set_data_vio_pool_write_share(vdo->data_vio_pool, 25));
+  set_data_vio_pool_admission_deadline(vdo->data_vio_pool, LONG_DEADLINE);
+
+  /*
+   * With one write for every three reads, the writes and reads are launched
+   * in the order of the LBNs here, and the writes only catch up once there
+   * are no more reads.
+   */
+  static const logical_block_number_t launchOrder[REQUEST_COUNT] = {
+    0, 4, 6, 7, 1, 2, 3, 5,
+  };
+
+  IORequest *request = fillPool();
+  launchWritesThenReads(launchOrder);
+  releaseFill(request);
+  releaseAndRelaunch(0, DATA_VIO_COUNT);
+  blockedCount = 0;
+  for (logical_block_number_t lbn = DATA_VIO_COUNT; lbn < REQUEST_COUNT;
+       lbn++) {
+    releaseBlockedDataVIO(lbn);
+  }
+
+  joinThreads();
+}
+
+/**
+ * Test that waiters which have passed the admission deadline are launched in
+ * the order they arrived, regardless of the write share.
+ **/
+static void testAdmissionDeadline(void)
+{
+  VDO_ASSERT_SUCCESS(set_data_vio_pool_write_share(vdo->data_vio_pool, 25));
+  set_data_vio_pool_admission_deadline(vdo->data_vio_pool, 0);
+  CU_ASSERT_EQUAL(get_data_vio_pool_admission_deadline(vdo->data_vio_pool), 0);
+
+  static const logical_block_number_t launchOrder[REQUEST_COUNT] = {
+    0, 1, 2, 3, 4, 5, 6, 7,
+  };
+
+  IORequest *request = fillPool();
+  launchWritesThenReads(launchOrder);
+  releaseFill(request);
+  releaseAndRelaunch(0, DATA_VIO_COUNT);
+  blockedCount = 0;
+  for (logical_block_number_t lbn = DATA_VIO_COUNT; lbn < REQUEST_COUNT;
+       lbn++) {
+    releaseBlockedDataVIO(lbn);
+  }
+
+  joinThreads();
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "writes may not use the read reserve", testReadReserve       },
+  { "waiting writes get their share",      testWriteShare        },
+  { "aged waiters launch in order",        testAdmissionDeadline },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "data vio pool admission (DataVIOPool_t2)",
+  .initializerWithArguments = NULL,
+  .initializer              = initialize,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests,
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
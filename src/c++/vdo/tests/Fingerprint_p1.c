@@ -0,0 +1,120 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * Performance testing of the record name fingerprints.
+ *
+ * $Id$
+ */
+
+#include "assertions.h"
+#include "constants.h"
+#include "encodings.h"
+#include "fingerprint.h"
+#include "murmurhash3.h"
+#include "status-codes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+  // Should be larger than CPU cache size.
+  TESTSIZE    = 40 * 1024 * 1024,
+  BLOCKS      = TESTSIZE / VDO_BLOCK_SIZE,
+  // Small enough to stay in the L1 or L2 cache.
+  CACHED      = 16,
+  ITERATIONS  = 20,
+  // The number of blocks each CPU thread hashes at once.
+  BATCH       = MURMURHASH3_LANES,
+};
+
+static char buffer[TESTSIZE] __attribute__((aligned(64)));
+
+/**********************************************************************/
+static uint64_t nanoTime(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+/**********************************************************************/
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  return nanoTime();
+#endif
+}
+
+/**
+ * Time naming the blocks of a buffer in batches, as the CPU threads do.
+ **/
+static void test(const char           *label,
+                 enum vdo_fingerprint  fingerprint,
+                 unsigned int          blocks,
+                 unsigned int          iterations)
+{
+  struct uds_record_name names[BATCH];
+  void *outs[BATCH];
+  for (unsigned int i = 0; i < BATCH; i++) {
+    outs[i] = &names[i];
+  }
+
+  uint64_t startTime = nanoTime();
+  uint64_t startCycles = cycles();
+  for (unsigned int i = 0; i < iterations; i++) {
+    for (unsigned int b = 0; b < blocks; b += BATCH) {
+      const void *keys[BATCH];
+      for (unsigned int k = 0; k < BATCH; k++) {
+        keys[k] = buffer + ((size_t) (b + k) * VDO_BLOCK_SIZE);
+      }
+
+      vdo_compute_fingerprints(fingerprint, keys, BATCH, outs);
+    }
+  }
+  uint64_t elapsedCycles = cycles() - startCycles;
+  uint64_t elapsed = nanoTime() - startTime;
+
+  double bytes = (double) VDO_BLOCK_SIZE * blocks * iterations;
+  printf("%-20s %6.2f B/cycle %8.1f MB/s %7.1f ns/block\n",
+         label, bytes / elapsedCycles,
+         (bytes * 1.0e9) / (elapsed * 1024.0 * 1024.0),
+         (double) elapsed / ((double) blocks * iterations));
+}
+
+/**********************************************************************/
+static void testAll(const char *size, unsigned int blocks,
+                    unsigned int iterations)
+{
+  char label[64];
+  snprintf(label, sizeof(label), "murmur3 %s", size);
+  test(label, VDO_FINGERPRINT_MURMUR3, blocks, iterations);
+
+  const char *variants[] = { "software", "aesni" };
+  for (unsigned int i = 0; i < ARRAY_SIZE(variants); i++) {
+    snprintf(label, sizeof(label), "aes/%s %s", variants[i], size);
+    if (vdo_set_fingerprint_variant(variants[i]) != VDO_SUCCESS) {
+      printf("%-20s not supported\n", label);
+      continue;
+    }
+
+    test(label, VDO_FINGERPRINT_AES, blocks, iterations);
+  }
+}
+
+/**********************************************************************/
+int main(void)
+{
+  for (size_t i = 0; i < TESTSIZE; i++) {
+    buffer[i] = random();
+  }
+
+  testAll("cached", CACHED, (BLOCKS / CACHED) * ITERATIONS);
+  testAll("uncached", BLOCKS, ITERATIONS);
+  return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include <linux/random.h>
+#include <string.h>
+
+#include "albtest.h"
+#include "memory-alloc.h"
+#include "murmurhash3.h"
+
+#include "constants.h"
+#include "encodings.h"
+#include "fingerprint.h"
+#include "status-codes.h"
+
+#include "dataBlocks.h"
+#include "ioRequest.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  DATA_BLOCKS = 64,
+  HASH_SIZE   = 16,
+  SEED        = 0x62ea60be,
+};
+
+static const char *VARIANTS[] = { "software", "aesni" };
+
+static const char *input1 = "The quick brown fox jumps over the lazy dog";
+static const char *input2 = "The quick brown fox jumps over the lazy cog";
+
+/**
+ * Check the fingerprint of a key with every supported variant.
+ **/
+static void checkAllVariants(const void   *key,
+                             unsigned int  length,
+                             u32           seed,
+                             const u8      expected[HASH_SIZE])
+{
+  const char *original = vdo_get_fingerprint_variant();
+  for (unsigned int i = 0; i < ARRAY_SIZE(VARIANTS); i++) {
+    if (vdo_set_fingerprint_variant(VARIANTS[i]) != VDO_SUCCESS) {
+      continue;
+    }
+
+    u8 hash[HASH_SIZE];
+    vdo_aes_fingerprint_128(key, length, seed, hash);
+    UDS_ASSERT_EQUAL_BYTES(expected, hash, HASH_SIZE);
+  }
+
+  VDO_ASSERT_SUCCESS(vdo_set_fingerprint_variant(original));
+}
+
+/**
+ * Check the fingerprints of known inputs. The aes fingerprint names data on
+ * disk, so these values must never change. They were computed by an
+ * independent implementation of the AES round.
+ **/
+static void testKnownAnswers(void)
+{
+  const u8 result1[] = {
+    0xb9, 0xca, 0x47, 0xdd, 0x39, 0x87, 0xc0, 0x1c,
+    0xd8, 0xd2, 0x61, 0x90, 0xc1, 0xf5, 0x54, 0xdb,
+  };
+  checkAllVariants(input1, strlen(input1), 0, result1);
+
+  const u8 result2[] = {
+    0xd0, 0x09, 0xbd, 0xb4, 0xd0, 0x9c, 0x5c, 0xd1,
+    0x73, 0xd7, 0xab, 0x9b, 0xcf, 0x7a, 0x29, 0x99,
+  };
+  checkAllVariants(input2, strlen(input2), 0, result2);
+
+  const u8 result3[] = {
+    0x54, 0xd9, 0x52, 0x68, 0x02, 0xb2, 0xe5, 0x70,
+    0x4e, 0x3f, 0x30, 0x17, 0x34, 0x85, 0x01, 0x68,
+  };
+  checkAllVariants(NULL, 0, 0, result3);
+
+  // A whole block, as VDO names it.
+  u8 *block;
+  VDO_ASSERT_SUCCESS(uds_allocate(VDO_BLOCK_SIZE, u8, __func__, &block));
+  for (unsigned int i = 0; i < VDO_BLOCK_SIZE; i++) {
+    block[i] = i * 7;
+  }
+
+  const u8 result4[] = {
+    0x61, 0x11, 0xa7, 0xfd, 0xa8, 0x72, 0xd6, 0x48,
+    0x09, 0x84, 0x1c, 0x9d, 0x9b, 0xf2, 0x2f, 0x4f,
+  };
+  checkAllVariants(block, VDO_BLOCK_SIZE, SEED, result4);
+  uds_free(block);
+}
+
+/**
+ * Check that the AES-NI rounds and the software rounds agree on random data
+ * of every length up to a few chunks, and at every alignment.
+ **/
+static void testVariantsAgree(void)
+{
+  if (vdo_set_fingerprint_variant("aesni") != VDO_SUCCESS) {
+    return;
+  }
+
+  u8 *data;
+  VDO_ASSERT_SUCCESS(uds_allocate(VDO_BLOCK_SIZE + 16, u8, __func__, &data));
+  get_random_bytes(data, VDO_BLOCK_SIZE + 16);
+  for (unsigned int length = 0; length <= VDO_BLOCK_SIZE; length++) {
+    if ((length > 300) && (length < VDO_BLOCK_SIZE - 300)) {
+      continue;
+    }
+
+    u8 *key = data + (length % 16);
+    u32 seed = random();
+    u8 expected[HASH_SIZE], hash[HASH_SIZE];
+    VDO_ASSERT_SUCCESS(vdo_set_fingerprint_variant("software"));
+    vdo_aes_fingerprint_128(key, length, seed, expected);
+    VDO_ASSERT_SUCCESS(vdo_set_fingerprint_variant("aesni"));
+    vdo_aes_fingerprint_128(key, length, seed, hash);
+    UDS_ASSERT_EQUAL_BYTES(expected, hash, HASH_SIZE);
+  }
+
+  uds_free(data);
+}
+
+/**
+ * Check that every length of a key and every single bit flip in a block
+ * produce distinct fingerprints, and that a bit flip changes about half of
+ * the bits of the fingerprint.
+ **/
+static void testSensitivity(void)
+{
+  u8 *block;
+  VDO_ASSERT_SUCCESS(uds_allocate(VDO_BLOCK_SIZE, u8, __func__, &block));
+  get_random_bytes(block, VDO_BLOCK_SIZE);
+
+  // Zero padding of the final chunk must not let prefixes collide.
+  u8 previous[HASH_SIZE];
+  memset(block, 0, 256);
+  vdo_aes_fingerprint_128(block, 0, 0, previous);
+  for (unsigned int length = 1; length <= 256; length++) {
+    u8 hash[HASH_SIZE];
+    vdo_aes_fingerprint_128(block, length, 0, hash);
+    CU_ASSERT_NOT_EQUAL(0, memcmp(previous, hash, HASH_SIZE));
+    memcpy(previous, hash, HASH_SIZE);
+  }
+
+  u8 original[HASH_SIZE];
+  vdo_aes_fingerprint_128(block, VDO_BLOCK_SIZE, 0, original);
+  unsigned int totalChanged = 0;
+  unsigned int flips = 0;
+  for (unsigned int bit = 0; bit < VDO_BLOCK_SIZE * 8; bit += 13) {
+    u8 hash[HASH_SIZE];
+    block[bit / 8] ^= (1 << (bit % 8));
+    vdo_aes_fingerprint_128(block, VDO_BLOCK_SIZE, 0, hash);
+    block[bit / 8] ^= (1 << (bit % 8));
+
+    unsigned int changed = 0;
+    for (unsigned int i = 0; i < HASH_SIZE; i++) {
+      changed += __builtin_popcount(original[i] ^ hash[i]);
+    }
+    CU_ASSERT(changed > 0);
+    totalChanged += changed;
+    flips++;
+  }
+
+  // On average, half of the 128 bits should change.
+  CU_ASSERT(totalChanged > flips * 56);
+  CU_ASSERT(totalChanged < flips * 72);
+
+  // The seed must matter.
+  u8 seeded[HASH_SIZE];
+  vdo_aes_fingerprint_128(block, VDO_BLOCK_SIZE, 1, seeded);
+  CU_ASSERT_NOT_EQUAL(0, memcmp(original, seeded, HASH_SIZE));
+  uds_free(block);
+}
+
+/**
+ * Check that the batched record name computation matches fingerprinting
+ * each block on its own.
+ **/
+static void testComputeFingerprints(void)
+{
+  enum { COUNT = 5 };
+  char *blocks;
+  VDO_ASSERT_SUCCESS(uds_allocate(COUNT * VDO_BLOCK_SIZE, char, __func__,
+                                  &blocks));
+  get_random_bytes(blocks, COUNT * VDO_BLOCK_SIZE);
+
+  const void *keys[COUNT];
+  struct uds_record_name names[COUNT];
+  void *outs[COUNT];
+  for (unsigned int i = 0; i < COUNT; i++) {
+    keys[i] = blocks + (i * VDO_BLOCK_SIZE);
+    outs[i] = &names[i];
+  }
+
+  struct uds_record_name expected;
+  vdo_compute_fingerprints(VDO_FINGERPRINT_MURMUR3, keys, COUNT, outs);
+  for (unsigned int i = 0; i < COUNT; i++) {
+    murmurhash3_128(keys[i], VDO_BLOCK_SIZE, SEED, &expected);
+    UDS_ASSERT_EQUAL_BYTES(&expected, &names[i], sizeof(expected));
+  }
+
+  vdo_compute_fingerprints(VDO_FINGERPRINT_AES, keys, COUNT, outs);
+  for (unsigned int i = 0; i < COUNT; i++) {
+    vdo_aes_fingerprint_128(keys[i], VDO_BLOCK_SIZE, SEED, &expected);
+    UDS_ASSERT_EQUAL_BYTES(&expected, &names[i], sizeof(expected));
+  }
+
+  uds_free(blocks);
+}
+
+/**********************************************************************/
+static TestConfiguration useAES(TestConfiguration config)
+{
+  config.indexConfig.fingerprint = VDO_FINGERPRINT_AES;
+  return config;
+}
+
+/**
+ * Check that a VDO formatted with the aes fingerprint deduplicates, and
+ * keeps its fingerprint across a restart.
+ **/
+static void testAESDedupe(void)
+{
+  const TestParameters parameters = {
+    .mappableBlocks = 1024,
+    .journalBlocks  = 16,
+    .dataFormatter  = fillWithOffsetPlusOne,
+    .modifier       = useAES,
+  };
+  initializeVDOTest(&parameters);
+  CU_ASSERT_EQUAL(VDO_FINGERPRINT_AES, vdo->geometry.index_config.fingerprint);
+
+  block_count_t freeBlocks = populateBlockMapTree();
+  writeAndVerifyData(0, 0, DATA_BLOCKS, freeBlocks - DATA_BLOCKS, DATA_BLOCKS);
+  writeAndVerifyData(DATA_BLOCKS, 0, DATA_BLOCKS, freeBlocks - DATA_BLOCKS,
+                     DATA_BLOCKS);
+
+  restartVDO(false);
+  CU_ASSERT_EQUAL(VDO_FINGERPRINT_AES, vdo->geometry.index_config.fingerprint);
+  writeAndVerifyData(2 * DATA_BLOCKS, 0, DATA_BLOCKS,
+                     freeBlocks - DATA_BLOCKS, DATA_BLOCKS);
+  tearDownVDOTest();
+}
+
+/**********************************************************************/
+static void testUnknownVariant(void)
+{
+  CU_ASSERT_EQUAL(vdo_set_fingerprint_variant("sha256"), VDO_NOT_IMPLEMENTED);
+}
+
+/**********************************************************************/
+static CU_TestInfo tests[] = {
+  { "known answers",        testKnownAnswers        },
+  { "variants agree",       testVariantsAgree       },
+  { "sensitivity",          testSensitivity         },
+  { "compute fingerprints", testComputeFingerprints },
+  { "dedupe with aes",      testAESDedupe           },
+  { "unknown variant",      testUnknownVariant      },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo suite = {
+  .name                     = "Record name fingerprints (Fingerprint_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = NULL,
+  .cleaner                  = NULL,
+  .tests                    = tests,
+};
+
+/**********************************************************************/
+CU_SuiteInfo *initializeModule(void)
+{
+  return &suite;
+}
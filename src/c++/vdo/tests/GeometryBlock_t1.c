@@ -87,6 +87,36 @@ static u8 EXPECTED_GEOMETRY_5_0_ENCODING[] =
     0xd6, 0x99, 0x9d, 0x04,                         // checksum = 0x049d99d6
   };
 
+/*
+ * A captured encoding of the geometry block version 5.1 created by
+ * encodingTest_5_1(). This is used to check that the encoding format hasn't
+ * changed and is platform-independent.
+ */
+static u8 EXPECTED_GEOMETRY_5_1_ENCODING[] =
+  {
+    0x64, 0x6d, 0x76, 0x64, 0x6f, 0x30, 0x30, 0x31, // magic = "dmvdo001"
+    0x05, 0x00, 0x00, 0x00,                         // header.id = GEOMETRY
+    0x05, 0x00, 0x00, 0x00,                         //   .majorVersion = 5
+    0x01, 0x00, 0x00, 0x00,                         //   .minorVersion = 1
+    0x65, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //   .size = 101
+    0x1d, 0x1c, 0x1b, 0x1a,                         // unused = 0x1a1b1c1d
+    0xb5, 0x1a, 0xf5, 0xee, 0x4b, 0x30, 0x20, 0x10, // nonce = NONCE
+    0x66, 0x61, 0x6b, 0x65, 0x00, 0x75, 0x75, 0x69, // uuid = TEST_UUID
+    0x64, 0x20, 0x68, 0x61, 0x72, 0x65, 0x73, 0x00, //   ...  TEST_UUID
+    0x18, 0x17, 0x16, 0x15, 0x14, 0x13, 0x12, 0x11, // bio_offset = 0x111213...
+                                                    // region
+    0x00, 0x00, 0x00, 0x00,                         //   .id = VDO_INDEX_REGION
+    0x28, 0x27, 0x26, 0x25, 0x24, 0x23, 0x22, 0x21, //   .start  = 0x212223...
+                                                    // region
+    0x01, 0x00, 0x00, 0x00,                         //   .id = VDO_DATA_REGION
+    0x38, 0x37, 0x36, 0x35, 0x34, 0x33, 0x32, 0x31, //   .start  = 0x313233...
+                                                    // index_config
+    0x4d, 0x4c, 0x4b, 0x4a,                         //   mem = 0x4a4b4c4d
+    0x01, 0x00, 0x00, 0x00,                         //   fingerprint = AES
+    0x01,                                           //   sparse = true
+    0x15, 0x73, 0x3c, 0x54,                         // checksum = 0x543c7315
+  };
+
 /**********************************************************************/
 static void encodingTest_4_0(void)
 {
@@ -147,6 +177,93 @@ static void encodingTest_5_0(void)
   UDS_ASSERT_EQUAL_BYTES(&geometry, &decoded, sizeof(decoded));
 }
 
+/**********************************************************************/
+static void encodingTest_5_1(void)
+{
+  struct volume_geometry geometry;
+  VDO_ASSERT_SUCCESS(initializeVolumeGeometry(NONCE, &TEST_UUID, NULL, &geometry));
+
+  // Fill the geometry fields with bogus values that will test endianness.
+  geometry.unused                            = 0x1a1b1c1d;
+  geometry.bio_offset                        = 0x1112131415161718;
+  geometry.regions[0].start_block            = 0x2122232425262728;
+  geometry.regions[1].start_block            = 0x3132333435363738;
+  geometry.index_config.mem                  = 0x4a4b4c4d;
+  geometry.index_config.fingerprint          = VDO_FINGERPRINT_AES;
+  geometry.index_config.sparse               = true;
+
+  // A fingerprint other than murmur3 is written as version 5.1.
+  PhysicalLayer *layer = getSynchronousLayer();
+  VDO_ASSERT_SUCCESS(writeVolumeGeometry(layer, &geometry));
+
+  // Read and compare it to the expected byte sequence for version 5_1.
+  char block[VDO_BLOCK_SIZE];
+  VDO_ASSERT_SUCCESS(layer->reader(layer, 0, 1, block));
+  UDS_ASSERT_EQUAL_BYTES(EXPECTED_GEOMETRY_5_1_ENCODING,
+                         block, sizeof(EXPECTED_GEOMETRY_5_1_ENCODING));
+
+  // Read, decode, and compare the decoded volume_geometry.
+  struct volume_geometry decoded;
+  VDO_ASSERT_SUCCESS(loadVolumeGeometry(getSynchronousLayer(), &decoded));
+  UDS_ASSERT_EQUAL_BYTES(&geometry, &decoded, sizeof(decoded));
+
+  // Version 4 has no way to record the fingerprint.
+  set_exit_on_assertion_failure(false);
+  CU_ASSERT_EQUAL(writeVolumeGeometryWithVersion(layer, &geometry, 4),
+                  UDS_ASSERTION_FAILED);
+  set_exit_on_assertion_failure(true);
+}
+
+/**
+ * Check that the fingerprint field is only honored in version 5.1, and that
+ * a fingerprint this version doesn't know is rejected.
+ **/
+static void fingerprintTest(void)
+{
+  struct volume_geometry geometry;
+  VDO_ASSERT_SUCCESS(initializeVolumeGeometry(NONCE, &TEST_UUID, NULL, &geometry));
+  CU_ASSERT_EQUAL(geometry.index_config.fingerprint, VDO_FINGERPRINT_MURMUR3);
+
+  PhysicalLayer *layer = getSynchronousLayer();
+  char block[VDO_BLOCK_SIZE];
+  struct volume_geometry decoded;
+  u8 *fingerprint = (u8 *) &block[sizeof(EXPECTED_GEOMETRY_5_1_ENCODING) - 9];
+  u8 *minorVersion = (u8 *) &block[MAGIC_NUMBER_SIZE + 8];
+  size_t checksumOffset = sizeof(EXPECTED_GEOMETRY_5_1_ENCODING) - 4;
+
+  // A stray value in the field of a version 5.0 geometry is ignored.
+  VDO_ASSERT_SUCCESS(writeVolumeGeometry(layer, &geometry));
+  VDO_ASSERT_SUCCESS(layer->reader(layer, 0, 1, block));
+  CU_ASSERT_EQUAL(*minorVersion, 0);
+  *fingerprint = VDO_FINGERPRINT_AES;
+  size_t offset = checksumOffset;
+  encode_u32_le((u8 *) block, &offset, vdo_crc32(block, checksumOffset));
+  VDO_ASSERT_SUCCESS(layer->writer(layer, 0, 1, block));
+  VDO_ASSERT_SUCCESS(loadVolumeGeometry(layer, &decoded));
+  CU_ASSERT_EQUAL(decoded.index_config.fingerprint, VDO_FINGERPRINT_MURMUR3);
+
+  // An unknown fingerprint in a version 5.1 geometry is refused.
+  geometry.index_config.fingerprint = VDO_FINGERPRINT_AES;
+  VDO_ASSERT_SUCCESS(writeVolumeGeometry(layer, &geometry));
+  VDO_ASSERT_SUCCESS(layer->reader(layer, 0, 1, block));
+  CU_ASSERT_EQUAL(*minorVersion, 1);
+  *fingerprint = VDO_FINGERPRINT_COUNT;
+  offset = checksumOffset;
+  encode_u32_le((u8 *) block, &offset, vdo_crc32(block, checksumOffset));
+  VDO_ASSERT_SUCCESS(layer->writer(layer, 0, 1, block));
+  CU_ASSERT_EQUAL(loadVolumeGeometry(layer, &decoded), VDO_UNSUPPORTED_VERSION);
+
+  // Names and parsing must agree.
+  enum vdo_fingerprint parsed;
+  for (enum vdo_fingerprint f = 0; f < VDO_FINGERPRINT_COUNT; f++) {
+    VDO_ASSERT_SUCCESS(vdo_parse_fingerprint_name(vdo_get_fingerprint_name(f),
+                                                  &parsed));
+    CU_ASSERT_EQUAL(parsed, f);
+  }
+  CU_ASSERT_EQUAL(vdo_parse_fingerprint_name("md5", &parsed),
+                  VDO_BAD_CONFIGURATION);
+}
+
 /**********************************************************************/
 static void assertRegionIs(struct volume_region  *region,
                            enum volume_region_id  id,
@@ -208,6 +325,8 @@ static CU_TestInfo tests[] = {
   { "Saves and loads", basicTest        },
   { "Encoding v4_0",   encodingTest_4_0 },
   { "Encoding v5_0",   encodingTest_5_0 },
+  { "Encoding v5_1",   encodingTest_5_1 },
+  { "Fingerprint",     fingerprintTest  },
   CU_TEST_INFO_NULL
 };
 
@@ -0,0 +1,138 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "time-utils.h"
+
+#include "vdo.h"
+
+#include "ioRequest.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  // Each request is split into a data_vio per block, all of which are
+  // submitted concurrently and may be merged with their neighbors.
+  REQUEST_COUNT  = 8,
+  REQUEST_BLOCKS = 256,
+  WRITE_BLOCKS   = REQUEST_COUNT * REQUEST_BLOCKS,
+  PASSES         = 2,
+};
+
+static thread_count_t bioThreads;
+static thread_count_t cpuThreads;
+
+/**********************************************************************/
+static TestConfiguration setThreadCounts(TestConfiguration config)
+{
+  config.deviceConfig.thread_counts.bio_threads = bioThreads;
+  config.deviceConfig.thread_counts.cpu_threads = cpuThreads;
+  return config;
+}
+
+/**
+ * Write every logical block from several concurrent requests, check that each
+ * data bio was submitted exactly once, and that every block reads back with
+ * the data written to it.
+ *
+ * @param pass  The number of the pass, which selects the data to write
+ **/
+static void writeAndCheck(block_count_t pass)
+{
+  uint64_t writesBefore = atomic64_read(&vdo->stats.bios_out.write);
+  block_count_t index = 1 + (pass * WRITE_BLOCKS);
+  IORequest *requests[REQUEST_COUNT];
+  for (block_count_t i = 0; i < REQUEST_COUNT; i++) {
+    // Interleave the requests so neighboring blocks come from different ones.
+    block_count_t start = ((i % 2) * (WRITE_BLOCKS / 2)) + ((i / 2) * REQUEST_BLOCKS);
+    requests[i] = launchIndexedWrite(start, REQUEST_BLOCKS, index + start);
+  }
+
+  for (block_count_t i = 0; i < REQUEST_COUNT; i++) {
+    awaitAndFreeSuccessfulRequest(requests[i]);
+  }
+
+  CU_ASSERT_EQUAL(writesBefore + WRITE_BLOCKS,
+                  atomic64_read(&vdo->stats.bios_out.write));
+  verifyData(0, index, WRITE_BLOCKS);
+}
+
+/**
+ * Write through a VDO with the given numbers of bio and CPU threads, and
+ * report the write throughput.
+ *
+ * @param bio  The number of bio submission threads
+ * @param cpu  The number of CPU threads
+ **/
+static void testThreadCounts(thread_count_t bio, thread_count_t cpu)
+{
+  bioThreads = bio;
+  cpuThreads = cpu;
+  const TestParameters parameters = {
+    .mappableBlocks = WRITE_BLOCKS * (PASSES + 1),
+    .logicalBlocks  = WRITE_BLOCKS,
+    .journalBlocks  = 64,
+    .dataFormatter  = fillWithOffsetPlusOne,
+    .modifier       = setThreadCounts,
+    // Separate zone threads, so that data bios are submitted from several.
+    .logicalThreadCount  = 1,
+    .physicalThreadCount = 1,
+    .hashZoneThreadCount = 1,
+  };
+  initializeVDOTest(&parameters);
+  CU_ASSERT_EQUAL(bio, vdo->thread_config.bio_thread_count);
+
+  // Allocate the tree pages first so that only data writes are timed.
+  populateBlockMapTree();
+  ktime_t elapsed = -current_time_us();
+  for (block_count_t pass = 0; pass < PASSES; pass++) {
+    writeAndCheck(pass);
+  }
+  elapsed += current_time_us();
+
+  printf("(bio %u cpu %u: %llu blocks/s) ", bio, cpu,
+         (unsigned long long) ((WRITE_BLOCKS * PASSES * 1000000ULL)
+                               / max_t(ktime_t, elapsed, 1)));
+  tearDownVDOTest();
+}
+
+/**********************************************************************/
+static void testOneBioThread(void)
+{
+  testThreadCounts(1, 1);
+  testThreadCounts(1, 4);
+}
+
+/**********************************************************************/
+static void testFourBioThreads(void)
+{
+  testThreadCounts(4, 1);
+  testThreadCounts(4, 4);
+}
+
+/**********************************************************************/
+static CU_TestInfo tests[] = {
+  { "merge and submit with one bio thread", testOneBioThread   },
+  { "merge and submit with four bio threads", testFourBioThreads },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo suite = {
+  .name                     = "Bio merging in the I/O submitter (IOSubmitter_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = NULL,
+  .cleaner                  = NULL,
+  .tests                    = tests,
+};
+
+/**********************************************************************/
+CU_SuiteInfo *initializeModule(void)
+{
+  return &suite;
+}
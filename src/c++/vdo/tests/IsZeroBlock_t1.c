@@ -11,12 +11,18 @@
 
 #include "albtest.h"
 #include "assertions.h"
-#include "data-vio.h"
+#include "block-compare.h"
+#include "constants.h"
+#include "status-codes.h"
+
+#include "vdoAsserts.h"
+
+static const char *VARIANTS[] = { "scalar", "sse2", "avx2", "avx512" };
 
 /**********************************************************************/
-static void isZeroTest(void)
+static void checkZeroBlocks(void)
 {
-  static char testBlock[VDO_BLOCK_SIZE];
+  static char testBlock[VDO_BLOCK_SIZE] __attribute__((aligned(64)));
   static char dataBlock[VDO_BLOCK_SIZE];
 
   get_random_bytes(dataBlock, sizeof(dataBlock));
@@ -30,20 +36,44 @@ static void isZeroTest(void)
 
   // All zeros
   memset(testBlock, 0, sizeof(testBlock));
-  CU_ASSERT_TRUE(is_zero_block(testBlock));
+  CU_ASSERT_TRUE(vdo_is_zero_block(testBlock));
 
   // A run of zeros at the beginning
   for (int i = VDO_BLOCK_SIZE - 1; i >= 0; i--) {
     testBlock[i] = dataBlock[i];
-    CU_ASSERT_FALSE(is_zero_block(testBlock));
+    CU_ASSERT_FALSE(vdo_is_zero_block(testBlock));
   }
   // A run of zeros at the end
   for (int i = VDO_BLOCK_SIZE - 1; i > 0; i -= 1) {
     testBlock[i] = 0;
-    CU_ASSERT_FALSE(is_zero_block(testBlock));
+    CU_ASSERT_FALSE(vdo_is_zero_block(testBlock));
+  }
+
+  // A single non-zero byte anywhere
+  memset(testBlock, 0, sizeof(testBlock));
+  for (int i = 0; i < VDO_BLOCK_SIZE; i++) {
+    testBlock[i] = 0x40;
+    CU_ASSERT_FALSE(vdo_is_zero_block(testBlock));
+    testBlock[i] = 0;
   }
 }
 
+/**********************************************************************/
+static void isZeroTest(void)
+{
+  const char *original = vdo_get_block_compare_variant();
+  for (unsigned int i = 0; i < ARRAY_SIZE(VARIANTS); i++) {
+    if (vdo_set_block_compare_variant(VARIANTS[i]) != VDO_SUCCESS) {
+      // Not supported on this processor.
+      continue;
+    }
+
+    checkZeroBlocks();
+  }
+
+  VDO_ASSERT_SUCCESS(vdo_set_block_compare_variant(original));
+}
+
 /**********************************************************************/
 static CU_TestInfo theTestInfo[] = {
   { "zero block", isZeroTest },
@@ -51,7 +81,7 @@ static CU_TestInfo theTestInfo[] = {
 };
 
 static CU_SuiteInfo theSuiteInfo = {
-  .name                     = "Test is_zero_block (IsZero_t1)",
+  .name                     = "Test vdo_is_zero_block (IsZeroBlock_t1)",
   .initializerWithArguments = NULL,
   .initializer              = NULL,
   .cleaner                  = NULL,
@@ -0,0 +1,208 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "recovery-journal.h"
+#include "vdo.h"
+
+#include "asyncVIO.h"
+#include "ioRequest.h"
+#include "mutexUtils.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  BURST_SIZE = 32,
+  // Long enough that no hold in these tests expires, even at its shortest.
+  LONG_WINDOW_US = 10 * 1000 * 1000,
+};
+
+static struct data_vio *held[BURST_SIZE];
+static block_count_t    heldCount;
+static u64              batchesBefore[RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS];
+static u64              writesBefore;
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeJournalGroupCommitT1(void)
+{
+  const TestParameters parameters = {
+    .mappableBlocks      = 256,
+    // Give the journal its own thread so that data_vios are enqueued to it.
+    .logicalThreadCount  = 1,
+    .physicalThreadCount = 1,
+    .hashZoneThreadCount = 1,
+  };
+  initializeVDOTest(&parameters);
+  heldCount = 0;
+}
+
+/**
+ * Note the commit sizes and journal writes so far, so that later checks only
+ * see the commits made after this.
+ **/
+static void noteCommits(void)
+{
+  vdo_get_recovery_journal_commit_batch_sizes(vdo->recovery_journal,
+                                              batchesBefore);
+  writesBefore
+    = vdo_get_recovery_journal_statistics(vdo->recovery_journal).blocks.written;
+}
+
+/**
+ * Get the number of commits in each size bucket since noteCommits(), and
+ * check that every journal write was counted.
+ *
+ * @param batches  An array to hold the counts
+ **/
+static void getCommits(u64 *batches)
+{
+  u64 total = 0;
+  vdo_get_recovery_journal_commit_batch_sizes(vdo->recovery_journal, batches);
+  for (unsigned int i = 0; i < RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS; i++) {
+    batches[i] -= batchesBefore[i];
+    total += batches[i];
+  }
+
+  u64 writes
+    = vdo_get_recovery_journal_statistics(vdo->recovery_journal).blocks.written;
+  CU_ASSERT_EQUAL(total, writes - writesBefore);
+}
+
+/**********************************************************************/
+static bool holdDataVIOLocked(void *context)
+{
+  held[heldCount++] = context;
+  return true;
+}
+
+/**
+ * Hold each data_vio as it moves to the journal thread to make its entry.
+ *
+ * Implements CompletionHook.
+ **/
+static bool holdJournalEntries(struct vdo_completion *completion)
+{
+  if (!lastAsyncOperationIs(completion, VIO_ASYNC_OP_GET_MAPPED_BLOCK_FOR_WRITE)
+      || (completion->callback_thread_id
+          != vdo->thread_config.journal_thread)) {
+    return true;
+  }
+
+  runLocked(holdDataVIOLocked, as_data_vio(completion));
+  return false;
+}
+
+/**********************************************************************/
+static bool checkHeldCount(void *context)
+{
+  return (heldCount == *((block_count_t *) context));
+}
+
+/**
+ * Let all the held data_vios make their journal entries. This runs on the
+ * journal thread so that they all arrive before the journal runs again.
+ **/
+static void releaseHeldDataVIOs(struct vdo_completion *completion)
+{
+  for (block_count_t i = 0; i < heldCount; i++) {
+    reallyEnqueueVIO(&held[i]->vio);
+  }
+
+  vdo_finish_completion(completion);
+}
+
+/**
+ * Test that in latency mode, each entry is committed as soon as the journal
+ * is idle.
+ **/
+static void testLatencyMode(void)
+{
+  vdo_set_recovery_journal_commit_window(vdo->recovery_journal, 0);
+  CU_ASSERT_EQUAL(vdo_get_recovery_journal_commit_window(vdo->recovery_journal),
+                  0);
+
+  // Allocate the block map tree first, so that its entries don't interfere.
+  writeData(0, 0, 1, VDO_SUCCESS);
+  noteCommits();
+  for (logical_block_number_t lbn = 1; lbn <= 8; lbn++) {
+    writeData(lbn, lbn, 1, VDO_SUCCESS);
+  }
+
+  u64 batches[RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS];
+  getCommits(batches);
+  CU_ASSERT_EQUAL(batches[0], 8);
+}
+
+/**
+ * Test that when many writes reach the journal together, the first entries
+ * are held for the rest rather than being committed alone, and that a single
+ * write is not held.
+ **/
+static void testGroupCommit(void)
+{
+  vdo_set_recovery_journal_commit_window(vdo->recovery_journal,
+                                         LONG_WINDOW_US);
+  writeData(0, 0, 1, VDO_SUCCESS);
+
+  // Gather a burst of writes just before the journal, then let them all in.
+  noteCommits();
+  setCompletionEnqueueHook(holdJournalEntries);
+  IORequest *request = launchIndexedWrite(1, BURST_SIZE, 1);
+  block_count_t burst = BURST_SIZE;
+  waitForCondition(checkHeldCount, &burst);
+  clearCompletionEnqueueHooks();
+  ktime_t elapsed = -current_time_us();
+  performSuccessfulActionOnThread(releaseHeldDataVIOs,
+                                  vdo->thread_config.journal_thread);
+  awaitAndFreeRequest(request);
+  elapsed += current_time_us();
+
+  u64 batches[RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS];
+  getCommits(batches);
+  u64 commits = 0;
+  for (unsigned int i = 0; i < RECOVERY_JOURNAL_COMMIT_BATCH_BUCKETS; i++) {
+    commits += batches[i];
+  }
+
+  printf("(%llu entries in %llu commits, %llu ms) ",
+         (unsigned long long) BURST_SIZE, (unsigned long long) commits,
+         (unsigned long long) (elapsed / 1000));
+  CU_ASSERT_EQUAL(batches[0], 0);
+  CU_ASSERT_EQUAL(commits, 2);
+
+  // A lone write is committed at once rather than waiting out the window.
+  noteCommits();
+  writeData(BURST_SIZE + 1, BURST_SIZE + 1, 1, VDO_SUCCESS);
+  getCommits(batches);
+  CU_ASSERT_EQUAL(batches[0], 1);
+  verifyData(1, 1, BURST_SIZE);
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "latency mode commits each entry", testLatencyMode },
+  { "bursts of entries are grouped",   testGroupCommit },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "recovery journal group commit (JournalGroupCommit_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeJournalGroupCommitT1,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
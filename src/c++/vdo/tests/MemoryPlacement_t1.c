@@ -0,0 +1,106 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "block-map.h"
+#include "slab-depot.h"
+#include "vdo.h"
+
+#include "ioRequest.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  // Enough cache pages that each zone's pages fill at least one huge page.
+  CACHE_SIZE     = 2048,
+  HUGE_PAGE_SIZE = 2 * 1024 * 1024,
+  ZONES          = 2,
+};
+
+/**********************************************************************/
+static TestConfiguration placeOnNodes(TestConfiguration config)
+{
+  config.deviceConfig.memory_placement = VDO_MEMORY_PLACEMENT_NUMA;
+  return config;
+}
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeMemoryPlacementT1(void)
+{
+  const TestParameters parameters = {
+    .logicalBlocks       = 64 * VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
+    .mappableBlocks      = 4096,
+    .slabSize            = 1024,
+    .cacheSize           = CACHE_SIZE,
+    .logicalThreadCount  = ZONES,
+    .physicalThreadCount = ZONES,
+    .modifier            = placeOnNodes,
+  };
+  initializeVDOTest(&parameters);
+}
+
+/**
+ * Check that each zone's block map cache was allocated as an arena.
+ **/
+static void assertCachesPlaced(void)
+{
+  for (zone_count_t zone = 0; zone < vdo->block_map->zone_count; zone++) {
+    struct vdo_page_cache *cache = &vdo->block_map->zones[zone].page_cache;
+    CU_ASSERT_EQUAL(vdo_get_zone_node(vdo, zone), 0);
+    CU_ASSERT_EQUAL((uintptr_t) cache->pages % HUGE_PAGE_SIZE, 0);
+  }
+}
+
+/**
+ * Test that a vdo with its memory placed on nodes works normally, across
+ * a restart.
+ **/
+static void testPlacedMemory(void)
+{
+  CU_ASSERT_EQUAL(vdo->device_config->memory_placement,
+                  VDO_MEMORY_PLACEMENT_NUMA);
+  assertCachesPlaced();
+
+  for (logical_block_number_t lbn = 0; lbn < 64; lbn++) {
+    writeData(lbn * VDO_BLOCK_MAP_ENTRIES_PER_PAGE, lbn, 1, VDO_SUCCESS);
+  }
+
+  restartVDO(false);
+  assertCachesPlaced();
+  for (logical_block_number_t lbn = 0; lbn < 64; lbn++) {
+    verifyData(lbn * VDO_BLOCK_MAP_ENTRIES_PER_PAGE, lbn, 1);
+  }
+
+  // Every slab's reference counts were allocated on its allocator's node.
+  for (slab_count_t i = 0; i < vdo->depot->slab_count; i++) {
+    CU_ASSERT_PTR_NOT_NULL(vdo->depot->slabs[i]->counters);
+  }
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "zone memory placed on nodes", testPlacedMemory },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "memory placement (MemoryPlacement_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeMemoryPlacementT1,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
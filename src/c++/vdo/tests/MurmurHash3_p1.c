@@ -14,6 +14,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 
@@ -82,6 +83,59 @@ static void test(size_t        startingOffset,
          (1.0e6 / (1024 * 1024)) / perByte);
 }
 
+/**
+ * Compare the throughput of hashing 4K blocks one at a time and in batches,
+ * checking that both produce the same names.
+ *
+ * @param batchSize   The number of blocks to hash together
+ * @param iterations  The number of batches to hash
+ **/
+static void testBatched(unsigned int batchSize, unsigned int iterations)
+{
+  enum { BLOCK_SIZE = 4096, MAX_BATCH = 16 };
+  const void *blocks[MAX_BATCH];
+  struct uds_record_name names[MAX_BATCH];
+  struct uds_record_name expected[MAX_BATCH];
+  void *outs[MAX_BATCH];
+  size_t stride = BLOCK_SIZE + PREFETCH_AVOIDANCE_GAP;
+  size_t blockCount = sizeof(buffer) / stride;
+  size_t next = 0;
+
+  CU_ASSERT_TRUE(batchSize <= MAX_BATCH);
+  for (unsigned int i = 0; i < batchSize; i++) {
+    outs[i] = &names[i];
+  }
+
+  uint64_t singleTime = 0;
+  uint64_t batchTime = 0;
+  for (unsigned int i = 0; i < iterations; i++) {
+    for (unsigned int j = 0; j < batchSize; j++) {
+      blocks[j] = buffer + (next * stride);
+      next = (next + 1) % blockCount;
+    }
+
+    uint64_t startTime = cpuTime();
+    for (unsigned int j = 0; j < batchSize; j++) {
+      murmurhash3_128(blocks[j], BLOCK_SIZE, 0x62ea60be, &expected[j]);
+    }
+    uint64_t middleTime = cpuTime();
+    murmurhash3_128_multi(blocks, batchSize, BLOCK_SIZE, 0x62ea60be, outs);
+    uint64_t endTime = cpuTime();
+
+    singleTime += middleTime - startTime;
+    batchTime += endTime - middleTime;
+    CU_ASSERT_EQUAL(0, memcmp(expected, names, batchSize * sizeof(names[0])));
+  }
+
+  double blocksHashed = (double) iterations * batchSize;
+  printf("%8u batches of %2u: single %.3fus/hash (%5.1fMB/s), batched %.3fus/hash (%5.1fMB/s)\n",
+         iterations, batchSize,
+         singleTime / blocksHashed,
+         (blocksHashed * BLOCK_SIZE) / (singleTime * 1.048576),
+         batchTime / blocksHashed,
+         (blocksHashed * BLOCK_SIZE) / (batchTime * 1.048576));
+}
+
 int main(void)
 {
   unsigned int baseIterationCount = 200;
@@ -119,5 +173,11 @@ int main(void)
   test(0, 256-10, smallIterations);
   printf("Small, unaligned:\n");
   test(3, 256, smallIterations);
+
+  printf("Batched 4K blocks:\n");
+  testBatched(1, medium4KIterations);
+  testBatched(4, medium4KIterations / 4);
+  testBatched(8, medium4KIterations / 8);
+  testBatched(16, medium4KIterations / 16);
   return 0;
 }
@@ -6,9 +6,17 @@
  * $Id$
  */
 
+#include <stdlib.h>
+
 #include "albtest.h"
 #include "murmurhash3.h"
 #include "assertions.h"
+#include "memory-alloc.h"
+
+enum {
+  MAX_KEYS   = 3 * MURMURHASH3_LANES + 1,
+  MAX_LENGTH = 4096,
+};
 
 static const char *input1 = "The quick brown fox jumps over the lazy dog";
 static const char *input2 = "The quick brown fox jumps over the lazy cog";
@@ -65,10 +73,68 @@ static void testChunkName(void)
   checkChunkName(input2, result2);
 }
 
+/**
+ * Check that hashing a set of keys together produces the same results as
+ * hashing them one at a time.
+ *
+ * @param keys    The keys to hash
+ * @param count   The number of keys
+ * @param length  The length of each key
+ **/
+static void checkMultiHash(const void *const keys[],
+                           unsigned int      count,
+                           int               length)
+{
+  struct uds_record_name names[MAX_KEYS];
+  void *outs[MAX_KEYS];
+  for (unsigned int i = 0; i < count; i++) {
+    outs[i] = &names[i];
+  }
+
+  murmurhash3_128_multi(keys, count, length, 0x62ea60be, outs);
+  for (unsigned int i = 0; i < count; i++) {
+    struct uds_record_name expected;
+    murmurhash3_128(keys[i], length, 0x62ea60be, &expected);
+    UDS_ASSERT_BLOCKNAME_EQUAL(expected.name, names[i].name);
+  }
+}
+
+/**********************************************************************/
+static void testMultiHash(void)
+{
+  static const int lengths[] = { 0, 1, 15, 16, 17, 255, 4095, MAX_LENGTH };
+  const void *keys[MAX_KEYS];
+  u8 *buffers;
+
+  UDS_ASSERT_SUCCESS(uds_allocate(MAX_KEYS * MAX_LENGTH, u8, __func__, &buffers));
+  for (unsigned int i = 0; i < MAX_KEYS * MAX_LENGTH; i++) {
+    buffers[i] = random() & 0xff;
+  }
+
+  for (unsigned int i = 0; i < MAX_KEYS; i++) {
+    keys[i] = &buffers[i * MAX_LENGTH];
+  }
+
+  for (unsigned int l = 0; l < ARRAY_SIZE(lengths); l++) {
+    for (unsigned int count = 0; count <= MAX_KEYS; count++) {
+      checkMultiHash(keys, count, lengths[l]);
+    }
+  }
+
+  // Keys need not be aligned, nor distinct.
+  for (unsigned int i = 0; i < MAX_KEYS; i++) {
+    keys[i] = &buffers[(i % 3) * MAX_LENGTH + i];
+  }
+  checkMultiHash(keys, MAX_KEYS, MAX_LENGTH - MAX_KEYS);
+
+  uds_free(buffers);
+}
+
 /**********************************************************************/
 static CU_TestInfo murmurTests[] = {
   {"murmurhash3_128",     testHash128 },
   {"murmurHashChunkName", testChunkName },
+  {"murmurhash3_128_multi", testMultiHash },
   CU_TEST_INFO_NULL,
 };
 
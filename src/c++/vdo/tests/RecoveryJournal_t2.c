@@ -392,6 +392,8 @@ static void attemptRebuild(CorruptionType  corruption,
     // Free all the refcounts, so the expected amount of the slab depot is
     // allocated before rebuild/recovery allocates the rest.
     for (slab_count_t i = 0; i < vdo->depot->slab_count; i++) {
+      uds_free(uds_forget(vdo->depot->slabs[i]->free_group_counts));
+      uds_free(uds_forget(vdo->depot->slabs[i]->free_group_map));
       uds_free(uds_forget(vdo->depot->slabs[i]->counters));
       uds_free(uds_forget(vdo->depot->slabs[i]->reference_blocks));
     }
@@ -8,6 +8,7 @@
 
 #include "albtest.h"
 
+#include <linux/bitops.h>
 #include <stdlib.h>
 
 #include "assertions.h"
@@ -230,6 +231,58 @@ static void testAllSmallArrays(void)
   }
 }
 
+/**
+ * Assert that each group's free count matches its counters, and that its bit
+ * of the free group map is set exactly when the group has a free counter.
+ **/
+static void assertFreeGroupMapConsistent(void)
+{
+  for (u32 group = 0; group < slab->free_group_count; group++) {
+    u8 free = 0;
+    for (slab_block_number i = group * COUNTS_PER_FREE_GROUP;
+         (i < (group + 1) * COUNTS_PER_FREE_GROUP) && (i < slab->block_count);
+         i++) {
+      if (slab->counters[i] == EMPTY_REFERENCE_COUNT) {
+        free++;
+      }
+    }
+    CU_ASSERT_EQUAL(free, slab->free_group_counts[group]);
+    CU_ASSERT_EQUAL((free > 0), test_bit(group, slab->free_group_map));
+  }
+}
+
+/**
+ * Check that the free group map tracks reference count changes, and that
+ * the allocator uses it to skip over allocated blocks.
+ **/
+static void testFreeGroupMap(void)
+{
+  assertFreeGroupMapConsistent();
+  for (size_t k = 0; k < COUNT; k++) {
+    setReferenceCount(k, random() % 4);
+  }
+  assertFreeGroupMapConsistent();
+
+  for (size_t k = 0; k < COUNT / 2; k++) {
+    setReferenceCount(random() % COUNT, random() % 2);
+  }
+  assertFreeGroupMapConsistent();
+
+  performanceTest(COUNT);
+  assertFreeGroupMapConsistent();
+
+  // Every block before the first free one is now in use, so the next
+  // allocation must skip straight to it.
+  slab_block_number firstFree = 0;
+  while (slab->counters[firstFree] != EMPTY_REFERENCE_COUNT) {
+    firstFree++;
+  }
+  physical_block_number_t pbn;
+  VDO_ASSERT_SUCCESS(allocate_slab_block(slab, &pbn));
+  CU_ASSERT_EQUAL(slab->start + firstFree, pbn);
+  assertFreeGroupMapConsistent();
+}
+
 /**********************************************************************/
 static CU_TestInfo tests[] = {
   { "0% full array",           testEmptyArray      },
@@ -238,6 +291,7 @@ static CU_TestInfo tests[] = {
   { "99.6% full array",        testVeryFullArray   },
   { "100% full slab",          testFullArray       },
   { "all small arrays",        testAllSmallArrays  },
+  { "free group map",          testFreeGroupMap    },
   CU_TEST_INFO_NULL,
 };
 
@@ -277,6 +277,8 @@ static void testWaitForSlabJournalSpace(void)
   vdo_reset_priority_table(allocator->prioritized_slabs);
 
   for (slab_count_t i = 0; i < vdo->depot->slab_count; i++) {
+    uds_free(uds_forget(vdo->depot->slabs[i]->free_group_counts));
+    uds_free(uds_forget(vdo->depot->slabs[i]->free_group_map));
     uds_free(uds_forget(vdo->depot->slabs[i]->counters));
     uds_free(uds_forget(vdo->depot->slabs[i]->reference_blocks));
   }
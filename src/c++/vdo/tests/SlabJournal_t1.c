@@ -196,6 +196,7 @@ static void slabJournalTestInitialization(block_count_t vioPoolSize)
     slab->counters[slabBlockNumber] = 1;
     slab->free_blocks--;
   }
+  update_free_group_map(slab, 0, slab->block_count);
 
   if (vioPoolSize != BLOCK_ALLOCATOR_VIO_POOL_SIZE) {
     reserveVIOsFromPool(&depot->allocators[0], BLOCK_ALLOCATOR_VIO_POOL_SIZE - vioPoolSize);
@@ -0,0 +1,288 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "encodings.h"
+#include "slab-depot.h"
+#include "vdo.h"
+
+#include "adminUtils.h"
+#include "ioRequest.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  DATA_BLOCKS = 192,
+  // The number of entries of a sequential run which fit in one record
+  RUN_LENGTH  = VDO_SLAB_JOURNAL_RUN_LENGTH_MASK + 1,
+};
+
+typedef struct {
+  slab_block_number     sbn;
+  enum journal_operation operation;
+  bool                  increment;
+} Entry;
+
+static Entry                             entries[VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK];
+static struct packed_slab_journal_block  block;
+static struct slab_journal_block_header  header;
+static struct slab_journal_block_cursor  cursor;
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeSlabJournalT4(void)
+{
+  const TestParameters parameters = {
+    .mappableBlocks      = DATA_BLOCKS,
+    .slabSize            = 64,
+    .slabJournalBlocks   = 8,
+    .journalBlocks       = 16,
+    .physicalThreadCount = 1,
+  };
+  initializeVDOTest(&parameters);
+}
+
+/**
+ * Start encoding a new version 2 block.
+ **/
+static void startBlock(void)
+{
+  memset(&block, 0, sizeof(block));
+  memset(&cursor, 0, sizeof(cursor));
+  header = (struct slab_journal_block_header) {
+    .metadata_type = VDO_METADATA_SLAB_JOURNAL_2,
+  };
+}
+
+/**
+ * Append an entry to the block if it has room, and remember it.
+ *
+ * @return <code>true</code> if the entry was added
+ **/
+static bool addEntry(slab_block_number      sbn,
+                     enum journal_operation operation,
+                     bool                   increment)
+{
+  if (!vdo_slab_journal_run_block_has_room(&cursor)
+      || (header.entry_count == VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK)) {
+    return false;
+  }
+
+  entries[header.entry_count] = (Entry) {
+    .sbn       = sbn,
+    .operation = operation,
+    .increment = increment,
+  };
+  vdo_encode_slab_journal_run_entry(&header, &cursor, &block.payload, sbn,
+                                    operation, increment);
+  return true;
+}
+
+/**
+ * Pack the block header and check that every entry decodes as it was
+ * encoded.
+ **/
+static void verifyBlock(void)
+{
+  vdo_pack_slab_journal_block_header(&header, &block.header);
+
+  struct slab_journal_block_cursor decoder;
+  memset(&decoder, 0, sizeof(decoder));
+  for (journal_entry_count_t i = 0; i < header.entry_count; i++) {
+    struct slab_journal_entry entry;
+    VDO_ASSERT_SUCCESS(vdo_decode_next_slab_journal_entry(&block, &decoder,
+                                                          &entry));
+    CU_ASSERT_EQUAL(entry.sbn, entries[i].sbn);
+    CU_ASSERT_EQUAL(entry.operation, entries[i].operation);
+    CU_ASSERT_EQUAL(entry.increment, entries[i].increment);
+  }
+
+  CU_ASSERT_EQUAL(decoder.offset, cursor.offset);
+}
+
+/**
+ * Test that runs of sequential increments take a byte per run.
+ **/
+static void testSequentialRuns(void)
+{
+  startBlock();
+  for (slab_block_number sbn = 100; addEntry(sbn, VDO_JOURNAL_DATA_REMAPPING, true); sbn++);
+
+  CU_ASSERT_EQUAL(header.entry_count, VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK);
+  CU_ASSERT_FALSE(header.has_block_map_increments);
+  // The first record gives its start as a byte delta; the rest continue it.
+  CU_ASSERT_EQUAL(cursor.offset,
+                  1 + DIV_ROUND_UP(VDO_SLAB_JOURNAL_2_ENTRIES_PER_BLOCK,
+                                   RUN_LENGTH));
+  verifyBlock();
+}
+
+/**
+ * Test that the interleaved increments and decrements of an overwrite of
+ * sequentially written data each take a single byte, and that block map
+ * increments are kept distinct from data increments.
+ **/
+static void testInterleavedRuns(void)
+{
+  startBlock();
+  CU_ASSERT_TRUE(addEntry(0, VDO_JOURNAL_BLOCK_MAP_REMAPPING, true));
+  for (slab_block_number sbn = 1; sbn <= 2000; sbn++) {
+    CU_ASSERT_TRUE(addEntry(sbn, VDO_JOURNAL_DATA_REMAPPING, true));
+    CU_ASSERT_TRUE(addEntry(sbn - 1, VDO_JOURNAL_DATA_REMAPPING, false));
+  }
+
+  CU_ASSERT_TRUE(header.has_block_map_increments);
+  CU_ASSERT_EQUAL(cursor.offset, 4001);
+  verifyBlock();
+}
+
+/**
+ * Test that scattered entries use each form of record, and that a full block
+ * still holds a block's worth of the largest records.
+ **/
+static void testScatteredEntries(void)
+{
+  startBlock();
+  slab_block_number sbn = 0;
+  for (unsigned int i = 0; ; i++) {
+    // Step forwards and backwards by distances which need every form.
+    static const int STEPS[] = { 5, -100, 1000, -20000, 3000000, -2000000 };
+    sbn = (sbn + STEPS[i % ARRAY_SIZE(STEPS)]) & 0x7FFFFF;
+    if (!addEntry(sbn,
+                  (((i % 7) == 0)
+                   ? VDO_JOURNAL_BLOCK_MAP_REMAPPING
+                   : VDO_JOURNAL_DATA_REMAPPING),
+                  ((i % 7) == 0) || ((i % 3) != 0))) {
+      break;
+    }
+  }
+
+  CU_ASSERT_TRUE(header.entry_count
+                 >= (VDO_SLAB_JOURNAL_PAYLOAD_SIZE
+                     / VDO_SLAB_JOURNAL_MAX_RECORD_SIZE));
+  verifyBlock();
+}
+
+/**
+ * Test that a record which runs off the end of the block is reported as
+ * corrupt rather than read past the block.
+ **/
+static void testTruncatedRecord(void)
+{
+  startBlock();
+  header.entry_count = 2;
+  vdo_pack_slab_journal_block_header(&header, &block.header);
+  block.payload.space[VDO_SLAB_JOURNAL_PAYLOAD_SIZE - 2]
+    = VDO_SLAB_JOURNAL_RUN_CONTINUES;
+  block.payload.space[VDO_SLAB_JOURNAL_PAYLOAD_SIZE - 1]
+    = VDO_SLAB_JOURNAL_RUN_ABSOLUTE;
+
+  struct slab_journal_entry entry;
+  cursor.offset = VDO_SLAB_JOURNAL_PAYLOAD_SIZE - 2;
+  VDO_ASSERT_SUCCESS(vdo_decode_next_slab_journal_entry(&block, &cursor,
+                                                        &entry));
+  CU_ASSERT_EQUAL(vdo_decode_next_slab_journal_entry(&block, &cursor, &entry),
+                  VDO_CORRUPT_JOURNAL);
+}
+
+/**
+ * Test that a vdo writing version 2 slab journal blocks recovers from a
+ * crash, and that it may then go back to writing the original format.
+ **/
+static void testCompactJournalRecovery(void)
+{
+  vdo_compact_slab_journal = true;
+  restartVDO(false);
+  CU_ASSERT_EQUAL(vdo->depot->slabs[0]->journal.tail_header.metadata_type,
+                  VDO_METADATA_SLAB_JOURNAL_2);
+  CU_ASSERT_TRUE(vdo->states.compact_slab_journals);
+
+  writeData(0, 1, DATA_BLOCKS / 2, VDO_SUCCESS);
+  // Overwrite half, and discard a quarter, of what was written.
+  writeData(0, DATA_BLOCKS, DATA_BLOCKS / 4, VDO_SUCCESS);
+  discardData(DATA_BLOCKS / 4, DATA_BLOCKS / 8, VDO_SUCCESS);
+  block_count_t free = getPhysicalBlocksFree();
+
+  // Write the slab journal tail blocks, so that the scrubber must read them.
+  performSuccessfulDepotAction(VDO_ADMIN_STATE_RECOVERING);
+  crashVDO();
+  vdo_compact_slab_journal = false;
+  startVDO(VDO_DIRTY);
+  waitForRecoveryDone();
+  CU_ASSERT_EQUAL(vdo->depot->slabs[0]->journal.tail_header.metadata_type,
+                  VDO_METADATA_SLAB_JOURNAL);
+  // The volume may still hold version 2 blocks, so it stays marked.
+  CU_ASSERT_TRUE(vdo->states.compact_slab_journals);
+  CU_ASSERT_EQUAL(getPhysicalBlocksFree(), free);
+  verifyData(0, DATA_BLOCKS, DATA_BLOCKS / 4);
+  verifyZeros(DATA_BLOCKS / 4, DATA_BLOCKS / 8);
+  verifyData((DATA_BLOCKS / 4) + (DATA_BLOCKS / 8),
+             1 + (DATA_BLOCKS / 4) + (DATA_BLOCKS / 8), DATA_BLOCKS / 8);
+
+  // Crash again, having written blocks in the original format.
+  writeData(DATA_BLOCKS, DATA_BLOCKS * 2, DATA_BLOCKS / 8, VDO_SUCCESS);
+  free -= DATA_BLOCKS / 8;
+  performSuccessfulDepotAction(VDO_ADMIN_STATE_RECOVERING);
+  crashVDO();
+  startVDO(VDO_DIRTY);
+  waitForRecoveryDone();
+  CU_ASSERT_EQUAL(getPhysicalBlocksFree(), free);
+  verifyData(DATA_BLOCKS, DATA_BLOCKS * 2, DATA_BLOCKS / 8);
+}
+
+/**
+ * Test that a volume which is not yet marked as holding version 2 slab
+ * journal blocks does not write them while it recovers, but is marked and
+ * writes them once it is next started cleanly.
+ **/
+static void testMarkingVolume(void)
+{
+  CU_ASSERT_FALSE(vdo->states.compact_slab_journals);
+  writeData(0, 1, DATA_BLOCKS / 2, VDO_SUCCESS);
+  crashVDO();
+  vdo_compact_slab_journal = true;
+  startVDO(VDO_DIRTY);
+  waitForRecoveryDone();
+  CU_ASSERT_EQUAL(vdo->depot->slabs[0]->journal.tail_header.metadata_type,
+                  VDO_METADATA_SLAB_JOURNAL);
+  CU_ASSERT_FALSE(vdo->states.compact_slab_journals);
+
+  restartVDO(false);
+  CU_ASSERT_EQUAL(vdo->depot->slabs[0]->journal.tail_header.metadata_type,
+                  VDO_METADATA_SLAB_JOURNAL_2);
+  CU_ASSERT_TRUE(vdo->states.compact_slab_journals);
+  vdo_compact_slab_journal = false;
+  verifyData(0, 1, DATA_BLOCKS / 2);
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "sequential runs",                 testSequentialRuns         },
+  { "interleaved runs",                testInterleavedRuns        },
+  { "scattered entries",               testScatteredEntries       },
+  { "truncated record",                testTruncatedRecord        },
+  { "recovery from compact journals",  testCompactJournalRecovery },
+  { "volume marked before use",        testMarkingVolume          },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "version 2 slab journal blocks (SlabJournal_t4)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeSlabJournalT4,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests,
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
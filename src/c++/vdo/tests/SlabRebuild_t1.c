@@ -41,6 +41,8 @@ static struct slab_journal   *journal            = NULL;
 static vdo_refcount_t        *expectedReferences = NULL;
 
 static bool                   latchRead;
+static block_count_t          referenceReads;
+static block_count_t          referenceBlocksRead;
 
 static block_count_t          expectedBlocksFree;
 static struct slab_config     slabConfig;
@@ -526,9 +528,58 @@ static void testRebuild(void)
   verifyReferences();
 }
 
+/**
+ * Count the reads of the slab's reference blocks, and the blocks they read.
+ *
+ * Implements BIOSubmitHook.
+ **/
+static bool countReferenceReads(struct bio *bio)
+{
+  physical_block_number_t pbn = pbn_from_vio_bio(bio);
+  if ((bio_op(bio) == REQ_OP_READ)
+      && (pbn >= slab->ref_counts_origin) && (pbn < slab->journal_origin)) {
+    referenceReads++;
+    referenceBlocksRead += bio->bi_iter.bi_size / VDO_BLOCK_SIZE;
+  }
+
+  return true;
+}
+
+/**
+ * Load the reference counts and check how many reads it took.
+ *
+ * @param expectedReads  The number of reads expected
+ **/
+static void loadAndCountReads(block_count_t expectedReads)
+{
+  referenceReads      = 0;
+  referenceBlocksRead = 0;
+  setBIOSubmitHook(countReferenceReads);
+  performSuccessfulAction(loadRefCounts);
+  clearBIOSubmitHook();
+  CU_ASSERT_EQUAL(referenceReads, expectedReads);
+  CU_ASSERT_EQUAL(referenceBlocksRead, slab->reference_block_count);
+  verifyReferences();
+}
+
+/**
+ * Test that a slab's reference blocks are read in large groups rather than
+ * one at a time.
+ **/
+static void testGroupedLoad(void)
+{
+  initializeReferenceCounts();
+  loadAndCountReads(1);
+
+  // Reading a few blocks at a time leaves a short group at the end.
+  slab->allocator->refcount_blocks_per_vio = 2;
+  loadAndCountReads(DIV_ROUND_UP(slab->reference_block_count, 2));
+}
+
 /**********************************************************************/
 static CU_TestInfo slabRebuildTests[] = {
   { "rebuild reference counts from slab journal", testRebuild },
+  { "reference blocks loaded in groups",          testGroupedLoad },
   CU_TEST_INFO_NULL
 };
 
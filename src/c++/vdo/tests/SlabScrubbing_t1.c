@@ -0,0 +1,168 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "slab-depot.h"
+#include "vdo.h"
+
+#include "ioRequest.h"
+#include "recoveryModeUtils.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  DATA_SLABS = 8,
+};
+
+static slab_count_t  totalSlabs;
+static block_count_t dataBlocks;
+static slab_count_t  slabsToLoad;
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeSlabScrubbingT1(void)
+{
+  const TestParameters parameters = {
+    .mappableBlocks      = 16,
+    .journalBlocks       = 32,
+    .slabSize            = 32,
+    .slabJournalBlocks   = 8,
+    .logicalThreadCount  = 1,
+    .physicalThreadCount = 1,
+    .hashZoneThreadCount = 1,
+    .logicalBlocks       = 2500,
+  };
+  initializeRecoveryModeTest(&parameters);
+  vdo_slab_scrub_concurrency = MAX_CONCURRENT_SCRUBS;
+
+  // Fill out the block map tree so that all the slabs added hold data.
+  populateBlockMapTree();
+  addSlabs(DATA_SLABS);
+  restartVDO(false);
+  totalSlabs = vdo->depot->slab_count;
+  dataBlocks = getPhysicalBlocksFree();
+}
+
+/**
+ * Check that the allocator is scrubbing as many slabs as it may at once.
+ **/
+static void assertScrubsActive(struct vdo_completion *completion)
+{
+  CU_ASSERT_EQUAL(vdo->depot->allocators[0].scrubber.active_scrubs,
+                  MAX_CONCURRENT_SCRUBS);
+  vdo_finish_completion(completion);
+}
+
+/**
+ * Test that each allocator scrubs several slabs at once, and reports its
+ * progress as it does so.
+ **/
+static void testConcurrentScrubbing(void)
+{
+  writeData(0, 1, dataBlocks, VDO_SUCCESS);
+  crashVDO();
+
+  // Hold the reference count writes of every slab being scrubbed.
+  latchAnyScrubbingSlab(totalSlabs);
+  startVDO(VDO_DIRTY);
+  waitForSlabLatches(totalSlabs, MAX_CONCURRENT_SCRUBS);
+  performSuccessfulActionOnThread(assertScrubsActive,
+                                  vdo->depot->allocators[0].thread_id);
+
+  struct vdo_statistics stats;
+  vdo_fetch_statistics(vdo, &stats);
+  CU_ASSERT_TRUE(stats.recovery_percentage < 100);
+
+  releaseAllSlabLatches(totalSlabs);
+  waitForRecoveryDone();
+  vdo_fetch_statistics(vdo, &stats);
+  CU_ASSERT_EQUAL(stats.recovery_percentage, 100);
+  CU_ASSERT_EQUAL(stats.recovery_time_remaining, 0);
+  CU_ASSERT_EQUAL(vdo->depot->allocators[0].scrubber.slabs_scrubbed,
+                  totalSlabs);
+  verifyData(0, 1, dataBlocks);
+}
+
+/**
+ * Check whether an allocator has slabs left to load.
+ **/
+static void checkSlabsToLoad(struct vdo_completion *completion)
+{
+  slabsToLoad = READ_ONCE(vdo->depot->allocators[0].scrubber.slab_count);
+  vdo_finish_completion(completion);
+}
+
+/**
+ * Wait for the allocator to load all of its slabs.
+ **/
+static void waitForSlabsLoaded(void)
+{
+  do {
+    performSuccessfulActionOnThread(checkSlabsToLoad,
+                                    vdo->depot->allocators[0].thread_id);
+  } while (slabsToLoad > 0);
+}
+
+/**
+ * Test that a clean load with lazy reference count loading comes online
+ * before every slab's reference counts are loaded, and that the rest are
+ * loaded in the background.
+ **/
+static void testLazyLoad(void)
+{
+  writeData(0, 1, dataBlocks, VDO_SUCCESS);
+  stopVDO();
+
+  // Load one slab at a time, and hold the second as its counters are read.
+  vdo_lazy_refcount_load     = true;
+  vdo_slab_scrub_concurrency = 1;
+  setupSlabLoadingLatch(1);
+  startVDO(VDO_CLEAN);
+  waitForSlabLatch(1);
+
+  struct vdo_slab *lastSlab = vdo->depot->slabs[totalSlabs - 1];
+  CU_ASSERT_EQUAL(lastSlab->status, VDO_SLAB_REQUIRES_SCRUBBING);
+  CU_ASSERT_PTR_NULL(lastSlab->counters);
+  verifyData(0, 1, dataBlocks);
+
+  releaseSlabLatch(1);
+  waitForSlabsLoaded();
+  CU_ASSERT_EQUAL(lastSlab->status, VDO_SLAB_REBUILT);
+  CU_ASSERT_PTR_NOT_NULL(lastSlab->counters);
+  CU_ASSERT_EQUAL(getPhysicalBlocksFree(), 0);
+
+  // The loaded counters are correct, so freed space can be reused.
+  discardData(0, 1, VDO_SUCCESS);
+  CU_ASSERT_EQUAL(getPhysicalBlocksFree(), 1);
+  writeData(0, dataBlocks + 1, 1, VDO_SUCCESS);
+  verifyData(0, dataBlocks + 1, 1);
+  verifyData(1, 2, dataBlocks - 1);
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "several slabs scrubbed at once", testConcurrentScrubbing },
+  { "reference counts loaded lazily", testLazyLoad            },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "concurrent slab scrubbing (SlabScrubbing_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeSlabScrubbingT1,
+  .cleaner                  = tearDownRecoveryModeTest,
+  .tests                    = vdoTests,
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
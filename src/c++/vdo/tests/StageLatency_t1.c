@@ -0,0 +1,114 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "data-vio.h"
+#include "vdo.h"
+
+#include "ioRequest.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  BLOCK_COUNT = 16,
+};
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeStageLatencyT1(void)
+{
+  const TestParameters parameters = {
+    .mappableBlocks = 64,
+  };
+  initializeVDOTest(&parameters);
+}
+
+/**
+ * Get the latencies recorded for an operation, and check that the histogram
+ * buckets account for every sample.
+ *
+ * @param operation  The operation
+ *
+ * @return The number of samples recorded
+ **/
+static u64 getSamples(enum async_operation_number operation)
+{
+  struct data_vio_stage_latencies latencies;
+  get_data_vio_pool_stage_latencies(vdo->data_vio_pool, operation,
+                                    &latencies);
+  u64 bucketed = 0;
+  for (unsigned int i = 0; i < DATA_VIO_STAGE_LATENCY_BUCKETS; i++) {
+    bucketed += latencies.buckets[i];
+  }
+
+  CU_ASSERT_EQUAL(bucketed, latencies.samples);
+  return latencies.samples;
+}
+
+/**
+ * Test that sampled data_vios record the time spent in each stage.
+ **/
+static void testSampledStages(void)
+{
+  // Sampling is off by default.
+  writeData(0, 1, 1, VDO_SUCCESS);
+  for (enum async_operation_number operation = MIN_VIO_ASYNC_OPERATION_NUMBER;
+       operation < MAX_VIO_ASYNC_OPERATION_NUMBER;
+       operation++) {
+    CU_ASSERT_EQUAL(getSamples(operation), 0);
+  }
+
+  // Sample one write in four.
+  set_data_vio_pool_stage_sample_interval(vdo->data_vio_pool, 4);
+  CU_ASSERT_EQUAL(get_data_vio_pool_stage_sample_interval(vdo->data_vio_pool),
+                  4);
+  for (logical_block_number_t lbn = 0; lbn < BLOCK_COUNT; lbn++) {
+    writeData(lbn, lbn + 1, 1, VDO_SUCCESS);
+  }
+
+  // Every sampled data_vio starts with a launch and ends with a cleanup.
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_LAUNCH), BLOCK_COUNT / 4);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_CLEANUP), BLOCK_COUNT / 4);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_WRITE_DATA_VIO), BLOCK_COUNT / 4);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_JOURNAL_REMAPPING), BLOCK_COUNT / 4);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_READ_DATA_VIO), 0);
+
+  // Changing the interval discards the old samples, and reads are sampled too.
+  set_data_vio_pool_stage_sample_interval(vdo->data_vio_pool, 1);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_LAUNCH), 0);
+  verifyData(0, 1, BLOCK_COUNT);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_LAUNCH), BLOCK_COUNT);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_CLEANUP), BLOCK_COUNT);
+
+  // Turning sampling off discards the samples and stops recording.
+  set_data_vio_pool_stage_sample_interval(vdo->data_vio_pool, 0);
+  writeData(0, 1, 1, VDO_SUCCESS);
+  CU_ASSERT_EQUAL(getSamples(VIO_ASYNC_OP_LAUNCH), 0);
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "sampled data_vio stage latencies", testSampledStages },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "data_vio stage latencies (StageLatency_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeStageLatencyT1,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
@@ -0,0 +1,188 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * $Id$
+ */
+
+#include "albtest.h"
+
+#include "memory-alloc.h"
+
+#include "types.h"
+#include "vdo.h"
+
+#include "asyncLayer.h"
+#include "vdoAsserts.h"
+#include "vdoTestBase.h"
+
+enum {
+  ZONES = 2,
+};
+
+/**********************************************************************/
+static TestConfiguration pinThreads(TestConfiguration config)
+{
+  struct vdo_thread_affinity *affinities
+    = config.deviceConfig.thread_affinities;
+  affinities[VDO_THREAD_CLASS_LOGICAL].type = VDO_AFFINITY_ZONE;
+  affinities[VDO_THREAD_CLASS_PHYSICAL].type = VDO_AFFINITY_ZONE;
+  affinities[VDO_THREAD_CLASS_HASH] = (struct vdo_thread_affinity) {
+    .type = VDO_AFFINITY_NODE,
+    .node = 0,
+  };
+  affinities[VDO_THREAD_CLASS_CPU] = (struct vdo_thread_affinity) {
+    .type = VDO_AFFINITY_CPUS,
+    .cpus = "0-1,3",
+  };
+  affinities[VDO_THREAD_CLASS_BIO].type = VDO_AFFINITY_DEVICE;
+  return config;
+}
+
+/**
+ * Test-specific initialization.
+ **/
+static void initializeThreadAffinityT1(void)
+{
+  const TestParameters parameters = {
+    .mappableBlocks      = 4096,
+    .slabSize            = 1024,
+    .logicalThreadCount  = ZONES,
+    .physicalThreadCount = ZONES,
+    .hashZoneThreadCount = 1,
+    .modifier            = pinThreads,
+  };
+  initializeVDOTest(&parameters);
+}
+
+/**
+ * Assert the affinity requested for a thread.
+ *
+ * @param threadID      The thread
+ * @param expectedCPUs  The expected CPU list, or NULL
+ * @param expectedNode  The expected node
+ **/
+static void assertAffinity(thread_id_t  threadID,
+                           const char  *expectedCPUs,
+                           int          expectedNode)
+{
+  const char *cpus;
+  int node;
+  getWorkQueueAffinity(vdo->threads[threadID].queue, &cpus, &node);
+  if (expectedCPUs == NULL) {
+    CU_ASSERT_PTR_NULL(cpus);
+  } else {
+    CU_ASSERT_STRING_EQUAL(cpus, expectedCPUs);
+  }
+  CU_ASSERT_EQUAL(node, expectedNode);
+}
+
+/**
+ * Test that each class of thread is given the affinity configured for it.
+ **/
+static void testThreadAffinity(void)
+{
+  const struct thread_config *config = &vdo->thread_config;
+  for (zone_count_t zone = 0; zone < ZONES; zone++) {
+    assertAffinity(config->logical_threads[zone], NULL,
+                   uds_get_zone_node(zone));
+    assertAffinity(config->physical_threads[zone], NULL,
+                   uds_get_zone_node(zone));
+  }
+
+  assertAffinity(config->hash_zone_threads[0], NULL, 0);
+  assertAffinity(config->cpu_thread, "0-1,3", NUMA_NO_NODE);
+
+  // The test device has no node, and nothing else was configured.
+  assertAffinity(config->bio_threads[0], NULL, NUMA_NO_NODE);
+  assertAffinity(config->journal_thread, NULL, NUMA_NO_NODE);
+  assertAffinity(config->packer_thread, NULL, NUMA_NO_NODE);
+  assertAffinity(config->dedupe_thread, NULL, NUMA_NO_NODE);
+  assertAffinity(config->bio_ack_thread, NULL, NUMA_NO_NODE);
+
+  // Restarting reapplies the affinities.
+  restartVDO(false);
+  config = &vdo->thread_config;
+  assertAffinity(config->logical_threads[1], NULL, uds_get_zone_node(1));
+  assertAffinity(config->cpu_thread, "0-1,3", NUMA_NO_NODE);
+}
+
+/**
+ * Attempt to load a table with one affinity changed.
+ *
+ * @param class     The class of threads whose affinity to change
+ * @param affinity  The new affinity
+ *
+ * @return The result of loading the table
+ **/
+static int loadWithAffinity(enum vdo_thread_class       class,
+                            struct vdo_thread_affinity  affinity)
+{
+  TestConfiguration newConfiguration = getTestConfig();
+  newConfiguration.deviceConfig.thread_affinities[class] = affinity;
+
+  struct dm_target *target;
+  VDO_ASSERT_SUCCESS(uds_allocate(1, struct dm_target, __func__, &target));
+  int result = loadTable(newConfiguration, target);
+  uds_free(target);
+  return result;
+}
+
+/**
+ * Test that affinities which don't apply to a class of threads, malformed
+ * CPU lists, and changes to the affinity of a running VDO are rejected.
+ **/
+static void testInvalidAffinity(void)
+{
+  const struct vdo_thread_affinity device = {
+    .type = VDO_AFFINITY_DEVICE,
+  };
+  CU_ASSERT_NOT_EQUAL(loadWithAffinity(VDO_THREAD_CLASS_LOGICAL, device),
+                      VDO_SUCCESS);
+
+  const struct vdo_thread_affinity zone = {
+    .type = VDO_AFFINITY_ZONE,
+  };
+  CU_ASSERT_NOT_EQUAL(loadWithAffinity(VDO_THREAD_CLASS_CPU, zone),
+                      VDO_SUCCESS);
+
+  const char *badLists[] = { "3-1", "1,", "-2", "1-", "a", "0 1" };
+  for (unsigned int i = 0; i < ARRAY_SIZE(badLists); i++) {
+    struct vdo_thread_affinity cpus = {
+      .type = VDO_AFFINITY_CPUS,
+    };
+    strcpy(cpus.cpus, badLists[i]);
+    CU_ASSERT_NOT_EQUAL(loadWithAffinity(VDO_THREAD_CLASS_ACK, cpus),
+                        VDO_SUCCESS);
+  }
+
+  // A well-formed affinity still can't be changed on a running VDO.
+  const struct vdo_thread_affinity node = {
+    .type = VDO_AFFINITY_NODE,
+    .node = 0,
+  };
+  CU_ASSERT_NOT_EQUAL(loadWithAffinity(VDO_THREAD_CLASS_JOURNAL, node),
+                      VDO_SUCCESS);
+}
+
+/**********************************************************************/
+
+static CU_TestInfo vdoTests[] = {
+  { "threads get their class's affinity", testThreadAffinity  },
+  { "invalid affinities are rejected",    testInvalidAffinity },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo vdoSuite = {
+  .name                     = "thread affinity (ThreadAffinity_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = initializeThreadAffinityT1,
+  .cleaner                  = tearDownVDOTest,
+  .tests                    = vdoTests
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &vdoSuite;
+}
@@ -12,6 +12,7 @@
 #include "albtest.h"
 #include "memory-alloc.h"
 #include "syscalls.h"
+#include "time-utils.h"
 
 #include "block-map.h"
 #include "completion.h"
@@ -41,11 +42,21 @@ static physical_block_number_t  firstPBN;
 static sequence_number_t        period;
 static struct vdo_page_cache   *cache;
 static struct block_map_zone   *zone;
+static enum vdo_cache_policy    cachePolicy;
 
 enum {
   SMALL_CACHE_SIZE = 4,
   LARGE_CACHE_SIZE = 8,
   PAGE_DATA_SIZE   = VDO_BLOCK_SIZE - sizeof(struct block_map_page),
+  // The page cache benchmark's cache, hot set, and scan sizes
+  BENCHMARK_CACHE_SIZE = 64,
+  HOT_PAGES            = 32,
+  SCAN_PAGES           = 256,
+  // The number of rounds of hot accesses followed by a scan
+  ROUNDS               = 16,
+  HOT_ACCESSES         = 64,
+  // The number of times a scan references each page it reads
+  SCAN_REFERENCES      = 4,
 };
 
 typedef struct {
@@ -107,20 +118,27 @@ static void validatePage(struct vdo_completion *completion)
  **/
 static void checkPageWritten(struct vdo_completion *completion)
 {
-  struct vio              *vio  = as_vio(completion);
-  struct block_map_page   *page = (struct block_map_page *) vio->data;
-  physical_block_number_t  pbn  = vdo_get_block_map_page_pbn(page);
-
-  CU_ASSERT_EQUAL(pbn, pbn_from_vio_bio(vio->bio));
-  maxPBN = max(pbn, maxPBN);
-
-  void *oldPage;
-  if (!page->header.initialized) {
-    VDO_ASSERT_SUCCESS(vdo_int_map_put(pageMap, pbn, pageMap, false, &oldPage));
-    CU_ASSERT_PTR_NULL(oldPage);
-  } else {
-    VDO_ASSERT_SUCCESS(vdo_int_map_put(pageMap, pbn, cache, true, &oldPage));
-    CU_ASSERT_PTR_NOT_NULL(oldPage);
+  struct vio              *vio   = as_vio(completion);
+  physical_block_number_t  start = pbn_from_vio_bio(vio->bio);
+
+  // Adjacent pages may be written together in a single multi-block bio.
+  block_count_t blocks = vio->bio->bi_iter.bi_size / VDO_BLOCK_SIZE;
+  for (block_count_t i = 0; i < blocks; i++) {
+    struct block_map_page *page
+      = (struct block_map_page *) (vio->data + (i * VDO_BLOCK_SIZE));
+    physical_block_number_t pbn = vdo_get_block_map_page_pbn(page);
+
+    CU_ASSERT_EQUAL(pbn, start + i);
+    maxPBN = max(pbn, maxPBN);
+
+    void *oldPage;
+    if (!page->header.initialized) {
+      VDO_ASSERT_SUCCESS(vdo_int_map_put(pageMap, pbn, pageMap, false, &oldPage));
+      CU_ASSERT_PTR_NULL(oldPage);
+    } else {
+      VDO_ASSERT_SUCCESS(vdo_int_map_put(pageMap, pbn, cache, true, &oldPage));
+      CU_ASSERT_PTR_NOT_NULL(oldPage);
+    }
   }
 
   runSavedCallback(completion);
@@ -156,6 +174,13 @@ static void initializeJournalLocks(struct vdo_completion *completion)
   vdo_finish_completion(completion);
 }
 
+/**********************************************************************/
+static TestConfiguration setCachePolicy(TestConfiguration config)
+{
+  config.deviceConfig.cache_policy = cachePolicy;
+  return config;
+}
+
 /**
  * Initialize test.
  *
@@ -173,6 +198,7 @@ static void initialize(page_count_t cacheSize, sequence_number_t maximumAge)
     .blockMapMaximumAge   = maximumAge,
     .noIndexRegion        = true,
     .disableDeduplication = true,
+    .modifier             = setCachePolicy,
   };
 
   initializeVDOTest(&parameters);
@@ -905,6 +931,97 @@ static void testAgeDirtyPages(void)
   }
 }
 
+/**
+ * Choose a hot page with a Zipfian distribution, so that the page of rank k
+ * is chosen in proportion to 1/k.
+ *
+ * @param seed  The state of the random number generator
+ *
+ * @return The number of the page
+ **/
+static page_number_t chooseHotPage(uint64_t *seed)
+{
+  static uint64_t cumulative[HOT_PAGES];
+  if (cumulative[HOT_PAGES - 1] == 0) {
+    uint64_t total = 0;
+    for (page_number_t page = 0; page < HOT_PAGES; page++) {
+      total += 1000000 / (page + 1);
+      cumulative[page] = total;
+    }
+  }
+
+  // A fixed sequence, so that each policy sees the same accesses.
+  *seed = (*seed * 6364136223846793005ULL) + 1442695040888963407ULL;
+  uint64_t choice = (*seed >> 33) % cumulative[HOT_PAGES - 1];
+  page_number_t page = 0;
+  while (cumulative[page] <= choice) {
+    page++;
+  }
+
+  return page;
+}
+
+/**
+ * Alternate Zipfian accesses to a hot set of pages with sequential scans
+ * through many more pages than the cache holds, using the given replacement
+ * policy, and report how often the hot accesses hit the cache.
+ *
+ * @param policy  The replacement policy of the page cache
+ *
+ * @return The number of hot accesses which hit the cache
+ **/
+static uint64_t measureHotHits(enum vdo_cache_policy policy)
+{
+  cachePolicy = policy;
+  initialize(BENCHMARK_CACHE_SIZE, 1);
+  CU_ASSERT_EQUAL(policy, cache->policy);
+
+  uint64_t seed = 1;
+  uint64_t hotHits = 0;
+  ktime_t elapsed = -current_time_us();
+  for (unsigned int round = 0; round < ROUNDS; round++) {
+    uint64_t hitsBefore = READ_ONCE(cache->stats.cache_hits);
+    for (unsigned int i = 0; i < HOT_ACCESSES; i++) {
+      accessPage(chooseHotPage(&seed));
+    }
+    hotHits += READ_ONCE(cache->stats.cache_hits) - hitsBefore;
+
+    for (page_number_t page = HOT_PAGES; page < HOT_PAGES + SCAN_PAGES; page++) {
+      for (unsigned int i = 0; i < SCAN_REFERENCES; i++) {
+        accessPage(page);
+      }
+    }
+  }
+  elapsed += current_time_us();
+
+  uint64_t accesses = ROUNDS * (HOT_ACCESSES + (SCAN_PAGES * SCAN_REFERENCES));
+  CU_ASSERT_EQUAL(accesses,
+                  READ_ONCE(cache->stats.cache_hits) + READ_ONCE(cache->stats.cache_misses));
+  printf("(%s: %llu%% hot hits, %llu ghost hits, %llu gets/s) ",
+         vdo_get_cache_policy_name(policy),
+         (unsigned long long) ((hotHits * 100) / (ROUNDS * HOT_ACCESSES)),
+         (unsigned long long) READ_ONCE(cache->stats.ghost_hits),
+         (unsigned long long) ((accesses * 1000000) / max_t(ktime_t, elapsed, 1)));
+  return hotHits;
+}
+
+/**
+ * Test that the 2Q policy keeps a hot set of pages in the cache through
+ * scans which evict them with the LRU policy.
+ **/
+static void testScanResistance(void)
+{
+  uint64_t lruHits = measureHotHits(VDO_CACHE_POLICY_LRU);
+  finishVDOPageCacheT1();
+
+  uint64_t twoQHits = measureHotHits(VDO_CACHE_POLICY_2Q);
+  CU_ASSERT_TRUE(twoQHits > lruHits);
+  // Once the hot pages have been promoted, scans no longer evict them, so
+  // only the coldest of them, which are rarely reused, still miss.
+  CU_ASSERT_TRUE((twoQHits * 100) >= (ROUNDS * HOT_ACCESSES * 80));
+  cachePolicy = VDO_CACHE_POLICY_LRU;
+}
+
 /**********************************************************************/
 
 static CU_TestInfo vdoPageCacheTests[] = {
@@ -913,6 +1030,7 @@ static CU_TestInfo vdoPageCacheTests[] = {
   { "busy cache page",     testBusyCachePage },
   { "access mode",         testAccessMode    },
   { "age dirty eras",      testAgeDirtyPages },
+  { "scan resistance",     testScanResistance },
   CU_TEST_INFO_NULL,
 };
 
@@ -102,6 +102,7 @@ static void testVIOPool(void)
   static const size_t poolSize = 5;
   VDO_ASSERT_SUCCESS(make_vio_pool(vdo,
                                    poolSize,
+                                   1,
                                    0,
                                    VIO_TYPE_TEST,
                                    VIO_PRIORITY_METADATA,
@@ -223,6 +224,7 @@ static void testReuseCompletions(void)
   struct vio_pool *pool;
   VDO_ASSERT_SUCCESS(make_vio_pool(vdo,
                                    POOL_SIZE,
+                                   1,
                                    0,
                                    VIO_TYPE_TEST,
                                    VIO_PRIORITY_METADATA,
@@ -0,0 +1,227 @@
+/*
+ * %COPYRIGHT%
+ *
+ * %LICENSE%
+ *
+ * Tests of the work stealing protocol shared by the service queues of a
+ * round-robin work queue. The group is built directly from the queue
+ * structures, with no worker threads, so that each step of the protocol can
+ * be checked.
+ *
+ * $Id$
+ */
+
+#include <string.h>
+
+#include "albtest.h"
+#include "assertions.h"
+#include "funnel-queue.h"
+
+#include "funnel-workqueue-internals.h"
+
+#include "vdoAsserts.h"
+
+enum {
+  WORKERS = 4,
+};
+
+static const struct vdo_work_queue_type stealingType = {
+  .max_priority     = VDO_WORK_Q_MAX_PRIORITY,
+  .default_priority = 0,
+  .work_stealing    = true,
+};
+
+static struct simple_work_queue      queues[WORKERS];
+static struct simple_work_queue     *serviceQueues[WORKERS];
+static struct round_robin_work_queue group;
+
+/**********************************************************************/
+static void initializeGroup(void)
+{
+  memset(queues, 0, sizeof(queues));
+  group = (struct round_robin_work_queue) {
+    .common             = {
+      .round_robin_mode = true,
+      .type             = &stealingType,
+    },
+    .service_queues     = serviceQueues,
+    .num_service_queues = WORKERS,
+    .work_stealing      = true,
+  };
+
+  for (unsigned int i = 0; i < WORKERS; i++) {
+    struct simple_work_queue *queue = &queues[i];
+    queue->common.type = &stealingType;
+    queue->group = &group;
+    for (int priority = 0; priority <= VDO_WORK_Q_MAX_PRIORITY; priority++) {
+      struct funnel_queue **list = &queue->priority_lists[priority];
+      UDS_ASSERT_SUCCESS(uds_make_funnel_queue(list));
+    }
+    init_waitqueue_head(&queue->waiting_worker_threads);
+    atomic_set(&queue->idle, 0);
+    spin_lock_init(&queue->consumer_lock);
+    serviceQueues[i] = queue;
+  }
+}
+
+/**********************************************************************/
+static void tearDownGroup(void)
+{
+  for (unsigned int i = 0; i < WORKERS; i++) {
+    for (int priority = 0; priority <= VDO_WORK_Q_MAX_PRIORITY; priority++) {
+      struct funnel_queue *list = queues[i].priority_lists[priority];
+      CU_ASSERT_PTR_NULL(uds_funnel_queue_poll(list));
+      uds_free_funnel_queue(list);
+    }
+  }
+}
+
+/**
+ * Put a completion on one of the queues of the group, as
+ * vdo_enqueue_work_queue() would.
+ **/
+static void enqueue(struct vdo_completion *completion,
+                    unsigned int           worker,
+                    int                    priority)
+{
+  memset(completion, 0, sizeof(*completion));
+  completion->priority = priority;
+  completion->my_queue = &queues[worker].common;
+  uds_funnel_queue_put(queues[worker].priority_lists[priority],
+                       &completion->work_queue_entry_link);
+}
+
+/**
+ * Check that a thief gets the expected completion and that the completion
+ * is now marked as being in the thief's queue.
+ **/
+static void assertStolen(unsigned int           thief,
+                         struct vdo_completion *expected)
+{
+  u64 steals = queues[thief].steals;
+  CU_ASSERT_PTR_EQUAL(vdo_steal_completion(&queues[thief]), expected);
+  CU_ASSERT_PTR_EQUAL(expected->my_queue, &queues[thief].common);
+  CU_ASSERT_EQUAL(queues[thief].steals, steals + 1);
+}
+
+/**********************************************************************/
+static void testStealInPriorityOrder(void)
+{
+  struct vdo_completion own, low, high, medium;
+
+  initializeGroup();
+  enqueue(&own, 0, VDO_WORK_Q_MAX_PRIORITY);
+  enqueue(&low, 1, 0);
+  enqueue(&high, 3, VDO_WORK_Q_MAX_PRIORITY);
+  enqueue(&medium, 2, 1);
+
+  // Every sibling is checked at a priority before moving to a lower one, and
+  // the thief never takes from its own queue.
+  assertStolen(0, &high);
+  assertStolen(0, &medium);
+  assertStolen(0, &low);
+  CU_ASSERT_PTR_NULL(vdo_steal_completion(&queues[0]));
+  CU_ASSERT_EQUAL(queues[0].steals, 3);
+
+  // The thief's own completion is left for another sibling.
+  assertStolen(1, &own);
+  tearDownGroup();
+}
+
+/**********************************************************************/
+static void testSkipLockedSibling(void)
+{
+  struct vdo_completion locked, unlocked;
+
+  initializeGroup();
+  enqueue(&locked, 1, VDO_WORK_Q_MAX_PRIORITY);
+  enqueue(&unlocked, 2, 0);
+
+  // A sibling being polled by its worker is passed over, even for a
+  // completion of higher priority.
+  spin_lock(&queues[1].consumer_lock);
+  assertStolen(0, &unlocked);
+  CU_ASSERT_PTR_NULL(vdo_steal_completion(&queues[0]));
+  spin_unlock(&queues[1].consumer_lock);
+
+  assertStolen(0, &locked);
+  tearDownGroup();
+}
+
+/**********************************************************************/
+static void testBacklog(void)
+{
+  struct vdo_completion first, second;
+
+  initializeGroup();
+  CU_ASSERT_FALSE(vdo_work_queue_has_backlog(&queues[0]));
+
+  // Waiting work at any priority is a backlog.
+  enqueue(&first, 0, 0);
+  CU_ASSERT_TRUE(vdo_work_queue_has_backlog(&queues[0]));
+  CU_ASSERT_FALSE(vdo_work_queue_has_backlog(&queues[1]));
+  enqueue(&second, 1, VDO_WORK_Q_MAX_PRIORITY);
+  CU_ASSERT_TRUE(vdo_work_queue_has_backlog(&queues[1]));
+
+  // A queue which is not in a work-stealing group never has one.
+  queues[0].group = NULL;
+  CU_ASSERT_FALSE(vdo_work_queue_has_backlog(&queues[0]));
+  queues[0].group = &group;
+
+  assertStolen(2, &second);
+  assertStolen(2, &first);
+  CU_ASSERT_FALSE(vdo_work_queue_has_backlog(&queues[0]));
+  CU_ASSERT_FALSE(vdo_work_queue_has_backlog(&queues[1]));
+  tearDownGroup();
+}
+
+/**********************************************************************/
+static void testWakeIdleSibling(void)
+{
+  initializeGroup();
+
+  // The busy queue's own flag is never claimed, nor is a missing sibling's.
+  atomic_set(&queues[0].idle, 1);
+  serviceQueues[1] = NULL;
+  atomic_set(&queues[2].idle, 1);
+  atomic_set(&queues[3].idle, 1);
+
+  // Each call wakes exactly one sleeping sibling.
+  vdo_wake_idle_sibling(&queues[0]);
+  CU_ASSERT_EQUAL(atomic_read(&queues[2].idle), 0);
+  CU_ASSERT_EQUAL(atomic_read(&queues[3].idle), 1);
+
+  vdo_wake_idle_sibling(&queues[0]);
+  CU_ASSERT_EQUAL(atomic_read(&queues[3].idle), 0);
+
+  vdo_wake_idle_sibling(&queues[0]);
+  CU_ASSERT_EQUAL(atomic_read(&queues[0].idle), 1);
+  for (unsigned int i = 1; i < WORKERS; i++) {
+    CU_ASSERT_EQUAL(atomic_read(&queues[i].idle), 0);
+  }
+
+  serviceQueues[1] = &queues[1];
+  tearDownGroup();
+}
+
+/**********************************************************************/
+static CU_TestInfo workStealingTests[] = {
+  { "steal in priority order", testStealInPriorityOrder },
+  { "skip locked sibling",     testSkipLockedSibling    },
+  { "backlog",                 testBacklog              },
+  { "wake idle sibling",       testWakeIdleSibling      },
+  CU_TEST_INFO_NULL,
+};
+
+static CU_SuiteInfo workStealingSuite = {
+  .name                     = "Work stealing (WorkStealing_t1)",
+  .initializerWithArguments = NULL,
+  .initializer              = NULL,
+  .cleaner                  = NULL,
+  .tests                    = workStealingTests,
+};
+
+CU_SuiteInfo *initializeModule(void)
+{
+  return &workStealingSuite;
+}
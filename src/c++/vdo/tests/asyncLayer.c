@@ -26,6 +26,7 @@
 #include "funnel-workqueue.h"
 #include "io-submitter.h"
 #include "lz4.h"
+#include "recovery-journal.h"
 #include "status-codes.h"
 #include "vdo.h"
 
@@ -289,17 +290,18 @@ static int processBIO(struct bio *bio)
   physical_block_number_t pbn = pbn_from_vio_bio(bio);
   assertNotInIndexRegion(pbn);
 
+  // The bio may be smaller than its vio, so only transfer what it holds.
   int result;
-  struct vio *vio = bio->bi_private;
+  block_count_t blocks = DIV_ROUND_UP(bio->bi_iter.bi_size, VDO_BLOCK_SIZE);
   if (bio_data_dir(bio) == WRITE) {
     result = ramLayer->writer(ramLayer,
                               pbn,
-                              vio->block_count,
+                              blocks,
                               (char *) bio->bi_io_vec->bv_page);
   } else {
     result = ramLayer->reader(ramLayer,
                               pbn,
-                              vio->block_count,
+                              blocks,
                               (char *) bio->bi_io_vec->bv_page);
   }
 
@@ -403,6 +405,11 @@ void startAsyncLayer(TestConfiguration configuration, bool loadVDO)
 
   asyncLayer->state = VDO_LOADED;
   vdoTargetType->resume(target);
+
+  // Held journal blocks are only released early by the arrival of other
+  // writes, or by a timer which the tests never fire, so commit immediately
+  // unless a test asks for a commit window.
+  vdo_set_recovery_journal_commit_window(vdo->recovery_journal, 0);
 }
 
 /**********************************************************************/
@@ -227,4 +227,17 @@ void enqueueBIO(struct bio *bio);
  **/
 bool onBIOThread(void);
 
+/**
+ * Get the CPU affinity which was requested for a work queue's thread. The
+ * test work queues record the affinity but do not apply it.
+ *
+ * @param [in]  queue    The work queue
+ * @param [out] cpusPtr  A pointer to hold the requested CPU list, or NULL
+ * @param [out] nodePtr  A pointer to hold the requested NUMA node, or
+ *                       NUMA_NO_NODE
+ **/
+void getWorkQueueAffinity(struct vdo_work_queue *queue,
+                          const char **cpusPtr,
+                          int *nodePtr);
+
 #endif // ASYNC_LAYER_H
@@ -146,6 +146,7 @@ void resetReferenceCounts(struct vdo_slab *slab)
   size_t i;
 
   memset(slab->counters, 0, slab->block_count * sizeof(vdo_refcount_t));
+  update_free_group_map(slab, 0, slab->block_count);
   slab->free_blocks = slab->block_count;
   slab->slab_journal_point = (struct journal_point) {
     .sequence_number = 0,
@@ -22,6 +22,8 @@
 
 static bool packingPrevented = false;
 static bool reachedPacker;
+static enum vdo_compression_type lastCompressor;
+static int lastCompressionLevel;
 
 /**
  * Action to flush the packer
@@ -146,6 +148,46 @@ int LZ4_compress_default(const char *source,
                                            maxOutputSize));
 }
 
+/**
+ * The user space lz4 compressor has no acceleration, so this is the default
+ * compressor. The acceleration is recorded for getLastCompressor().
+ **/
+int LZ4_compress_fast(const char *source,
+                      char *dest,
+                      int isize,
+                      int maxOutputSize,
+                      int acceleration,
+                      void *context)
+{
+  WRITE_ONCE(lastCompressor, VDO_COMPRESSION_LZ4);
+  WRITE_ONCE(lastCompressionLevel, acceleration);
+  return LZ4_compress_default(source, dest, isize, maxOutputSize, context);
+}
+
+/**
+ * The user space lz4 has no high compression mode, so this is also the
+ * default compressor, which produces the same format. The level is recorded
+ * for getLastCompressor().
+ **/
+int LZ4_compress_HC(const char *source,
+                    char *dest,
+                    int isize,
+                    int maxOutputSize,
+                    int compressionLevel,
+                    void *context)
+{
+  WRITE_ONCE(lastCompressor, VDO_COMPRESSION_LZ4HC);
+  WRITE_ONCE(lastCompressionLevel, compressionLevel);
+  return LZ4_compress_default(source, dest, isize, maxOutputSize, context);
+}
+
+/**********************************************************************/
+enum vdo_compression_type getLastCompressor(int *levelPtr)
+{
+  *levelPtr = READ_ONCE(lastCompressionLevel);
+  return READ_ONCE(lastCompressor);
+}
+
 /**********************************************************************/
 int LZ4_decompress_safe(const char *source,
                         char *dest,
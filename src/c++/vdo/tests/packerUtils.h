@@ -75,4 +75,13 @@ void preventPacking(void);
  **/
 void restorePacking(void);
 
+/**
+ * Get the compressor most recently used to compress a data block.
+ *
+ * @param levelPtr  A pointer to hold the acceleration or level it was given
+ *
+ * @return The type of the compressor
+ **/
+enum vdo_compression_type getLastCompressor(int *levelPtr);
+
 #endif /* not PACKER_UTILS_H */
@@ -36,6 +36,8 @@ void initializeRecoveryModeTest(const TestParameters *testParameters)
   VDO_ASSERT_SUCCESS(uds_init_mutex(&mutex));
   VDO_ASSERT_SUCCESS(uds_init_cond(&condition));
   VDO_ASSERT_SUCCESS(vdo_int_map_create(8, &latchedVIOs));
+  // Latching slabs as they are scrubbed is simplest one slab at a time.
+  vdo_slab_scrub_concurrency = 1;
   initializeVDOTest(testParameters);
 }
 
@@ -200,6 +202,27 @@ slab_count_t waitForAnySlabToLatch(slab_count_t slabs)
   return latchedSlab;
 }
 
+/**********************************************************************/
+void waitForSlabLatches(slab_count_t slabs, slab_count_t count)
+{
+  uds_lock_mutex(&mutex);
+  for (;;) {
+    slab_count_t latched = 0;
+    for (slab_count_t i = 0; i < slabs; i++) {
+      if (isSlabLatched(i, NULL)) {
+        latched++;
+      }
+    }
+
+    if (latched >= count) {
+      break;
+    }
+
+    uds_wait_cond(&condition, &mutex);
+  }
+  uds_unlock_mutex(&mutex);
+}
+
 /**********************************************************************/
 void releaseSlabLatch(slab_count_t slabNumber)
 {
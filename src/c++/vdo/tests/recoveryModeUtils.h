@@ -16,7 +16,8 @@
 #include "testParameters.h"
 
 /**
- * Initialize a VDO test with the recovery utilities.
+ * Initialize a VDO test with the recovery utilities. Each allocator will
+ * scrub only one slab at a time.
  *
  * @param parameters  The test parameters (may be NULL)
  **/
@@ -68,6 +69,14 @@ void waitForSlabLatch(slab_count_t slabNumber);
  **/
 slab_count_t waitForAnySlabToLatch(slab_count_t slabs);
 
+/**
+ * Block until a number of slabs have latched at once.
+ *
+ * @param slabs  the total number of slabs
+ * @param count  the number of slabs to wait for
+ **/
+void waitForSlabLatches(slab_count_t slabs, slab_count_t count);
+
 /**
  * Release the latched reference count write.
  *
@@ -10,16 +10,21 @@
 
 #include <linux/timer.h>
 
+#include <linux/hrtimer.h>
 #include <linux/jiffies.h>
 #include <linux/list.h>
+#include <unistd.h>
+
+#include "time-utils.h"
 
 #include "mutexUtils.h"
 
-// Mocks of timer.h and jiffies.h
+// Mocks of timer.h, hrtimer.h, and jiffies.h
 
 unsigned long unitTestJiffies;
 
 static LIST_HEAD(timers);
+static LIST_HEAD(hrtimers);
 
 /**
  * Get the current mock jiffies, and increment for the next call.
@@ -113,3 +118,81 @@ bool fireTimers(unsigned long at)
 
   return fired;
 }
+
+/**********************************************************************/
+void hrtimer_init(struct hrtimer   *timer,
+                  clockid_t         which_clock __attribute__((unused)),
+                  enum hrtimer_mode mode __attribute__((unused)))
+{
+  INIT_LIST_HEAD(&timer->entry);
+  timer->function = NULL;
+}
+
+/**********************************************************************/
+void hrtimer_start(struct hrtimer *timer, ktime_t time, enum hrtimer_mode mode)
+{
+  if (mode == HRTIMER_MODE_REL) {
+    time += current_time_ns(CLOCK_MONOTONIC);
+  }
+
+  lockMutex();
+  list_del_init(&timer->entry);
+  timer->expires = time;
+  list_add_tail(&timer->entry, &hrtimers);
+  unlockMutex();
+}
+
+/**********************************************************************/
+int hrtimer_cancel(struct hrtimer *timer)
+{
+  int result;
+
+  lockMutex();
+  result = !list_empty(&timer->entry);
+  list_del_init(&timer->entry);
+  unlockMutex();
+
+  return result;
+}
+
+/**********************************************************************/
+ktime_t getNextHRTimeout(void)
+{
+  ktime_t result = S64_MAX;
+
+  lockMutex();
+  struct hrtimer *timer;
+  list_for_each_entry(timer, &hrtimers, entry) {
+    result = min(result, timer->expires);
+  }
+  unlockMutex();
+
+  return result;
+}
+
+/**********************************************************************/
+bool fireHRTimers(ktime_t at)
+{
+  bool fired = false;
+
+  // The code under test checks the clock itself, so wait for it to catch up.
+  ktime_t now;
+  while ((now = current_time_ns(CLOCK_MONOTONIC)) < at) {
+    usleep(((at - now) / NSEC_PER_USEC) + 1);
+  }
+
+  lockMutex();
+  struct hrtimer *timer, *tmp;
+  list_for_each_entry_safe(timer, tmp, &hrtimers, entry) {
+    if (timer->expires <= at) {
+      list_del_init(&timer->entry);
+      if (timer->function(timer) == HRTIMER_RESTART) {
+        list_add_tail(&timer->entry, &hrtimers);
+      }
+      fired = true;
+    }
+  }
+  unlockMutex();
+
+  return fired;
+}
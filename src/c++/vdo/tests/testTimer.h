@@ -9,10 +9,27 @@
 #ifndef TEST_TIMER_H
 #define TEST_TIMER_H
 
+#include "time-utils.h"
 #include "types.h"
 
 unsigned long getNextTimeout(void);
 bool fireTimers(unsigned long at);
 
+/**
+ * Get the earliest expiration of any pending hrtimer.
+ *
+ * @return The expiration time in nanoseconds, or S64_MAX if none are pending
+ **/
+ktime_t getNextHRTimeout(void);
+
+/**
+ * Wait until the given time, then fire every hrtimer which has expired by it.
+ *
+ * @param at  The time, in nanoseconds on the monotonic clock
+ *
+ * @return <code>true</code> if any timer fired
+ **/
+bool fireHRTimers(ktime_t at);
+
 #endif // TEST_TIMER_H
 
@@ -350,13 +350,16 @@ void tearDownVDOTest(void)
   tearDownDataBlocks();
 
   /*
-   * Since data_vio_count is a global variable, changes to it can bleed across
-   * tests when running with --no-fork. Therefore, we always reset it to the
-   * default at the end of a test so that future test writers needn't remember
-   * to do so. This is especially important since tracking down the resulting
-   * hangs is tricky.
+   * Since data_vio_count and the slab scrubbing parameters are global
+   * variables, changes to them can bleed across tests when running with
+   * --no-fork. Therefore, we always reset them to the defaults at the end of
+   * a test so that future test writers needn't remember to do so. This is
+   * especially important since tracking down the resulting hangs is tricky.
    */
-  data_vio_count = MAXIMUM_VDO_USER_VIOS;
+  data_vio_count             = MAXIMUM_VDO_USER_VIOS;
+  vdo_slab_scrub_concurrency = MAX_CONCURRENT_SCRUBS;
+  vdo_lazy_refcount_load     = false;
+  vdo_compact_slab_journal   = false;
 }
 
 /**********************************************************************/
@@ -575,6 +578,46 @@ static TestConfiguration fixThreadCounts(TestConfiguration configuration)
   return configuration;
 }
 
+/**
+ * Add the key and value for the affinity of a class of threads to a table
+ * line.
+ *
+ * @param argv      The table line arguments
+ * @param class     The thread class
+ * @param affinity  The affinity of the class
+ *
+ * @return the number of arguments added
+ **/
+static int addThreadAffinity(char                             **argv,
+                             enum vdo_thread_class              class,
+                             const struct vdo_thread_affinity  *affinity)
+{
+  if (affinity->type == VDO_AFFINITY_NONE) {
+    return 0;
+  }
+
+  CU_ASSERT(asprintf(&argv[0], "%sAffinity",
+                     vdo_get_thread_class_name(class)) != -1);
+  switch (affinity->type) {
+  case VDO_AFFINITY_CPUS:
+    addString(&argv[1], affinity->cpus);
+    break;
+
+  case VDO_AFFINITY_NODE:
+    CU_ASSERT(asprintf(&argv[1], "node:%d", affinity->node) != -1);
+    break;
+
+  case VDO_AFFINITY_ZONE:
+    addString(&argv[1], "zone");
+    break;
+
+  default:
+    addString(&argv[1], "device");
+  }
+
+  return 2;
+}
+
 /**********************************************************************/
 static int makeTableLine(TestConfiguration configuration, char **argv)
 {
@@ -587,13 +630,17 @@ static int makeTableLine(TestConfiguration configuration, char **argv)
   addUInt32(&argv[argc++], configuration.deviceConfig.cache_size);
   addUInt64(&argv[argc++], configuration.deviceConfig.block_map_maximum_age);
   addString(&argv[argc++], "ack");
-  addUInt32(&argv[argc++], 1);
+  addUInt32(&argv[argc++],
+            configuration.deviceConfig.thread_counts.bio_ack_threads);
   addString(&argv[argc++], "bio");
-  addUInt32(&argv[argc++], DEFAULT_VDO_BIO_SUBMIT_QUEUE_COUNT);
+  addUInt32(&argv[argc++],
+            configuration.deviceConfig.thread_counts.bio_threads);
   addString(&argv[argc++], "bioRotationInterval");
-  addUInt32(&argv[argc++], DEFAULT_VDO_BIO_SUBMIT_QUEUE_ROTATE_INTERVAL);
+  addUInt32(&argv[argc++],
+            configuration.deviceConfig.thread_counts.bio_rotation_interval);
   addString(&argv[argc++], "cpu");
-  addUInt32(&argv[argc++], 1);
+  addUInt32(&argv[argc++],
+            configuration.deviceConfig.thread_counts.cpu_threads);
   if (configuration.deviceConfig.thread_counts.hash_zones > 0) {
     addString(&argv[argc++], "hash");
     addUInt32(&argv[argc++],
@@ -615,6 +662,39 @@ static int makeTableLine(TestConfiguration configuration, char **argv)
   addString(&argv[argc++], "maxDiscard");
   addUInt32(&argv[argc++], 1500);
 
+  if (configuration.deviceConfig.packer_bins > 0) {
+    addString(&argv[argc++], "packerBins");
+    addUInt32(&argv[argc++], configuration.deviceConfig.packer_bins);
+  }
+
+  if (configuration.deviceConfig.cache_policy != VDO_CACHE_POLICY_LRU) {
+    addString(&argv[argc++], "blockMapCachePolicy");
+    addString(&argv[argc++],
+              vdo_get_cache_policy_name(configuration.deviceConfig.cache_policy));
+  }
+
+  if (configuration.deviceConfig.memory_placement
+      != VDO_MEMORY_PLACEMENT_DEFAULT) {
+    addString(&argv[argc++], "memoryPlacement");
+    addString(&argv[argc++],
+              vdo_get_memory_placement_name(configuration.deviceConfig.memory_placement));
+  }
+
+  if ((configuration.deviceConfig.compression_type != VDO_COMPRESSION_LZ4)
+      || (configuration.deviceConfig.compression_level != 0)) {
+    addString(&argv[argc++], "compressionType");
+    CU_ASSERT(asprintf(&argv[argc++], "%s:%d",
+                       vdo_get_compression_type_name(configuration.deviceConfig.compression_type),
+                       configuration.deviceConfig.compression_level) != -1);
+  }
+
+  for (enum vdo_thread_class class = 0;
+       class < VDO_THREAD_CLASS_COUNT;
+       class++) {
+    argc += addThreadAffinity(&argv[argc], class,
+                              &configuration.deviceConfig.thread_affinities[class]);
+  }
+
   addString(&argv[argc++], "deduplication");
   addString(&argv[argc++],
             (configuration.deviceConfig.deduplication ? "on" : "off"));
@@ -636,7 +716,7 @@ int loadTable(TestConfiguration configuration, struct dm_target *target)
 
   target->len = configuration.config.logical_blocks * VDO_SECTORS_PER_BLOCK;
 
-  char *argv[32];
+  char *argv[56];
   int argc = makeTableLine(fixThreadCounts(configuration), argv);
   int result = vdoTargetType->ctr(target, argc, argv);
   while (argc-- > 0) {
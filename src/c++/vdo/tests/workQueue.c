@@ -37,6 +37,14 @@ struct vdo_work_queue {
   const struct vdo_work_queue_type  *type;
   void                             **context;
   struct vdo_thread                 *vdo_thread;
+  // The CPU affinity requested for this queue's thread, which is not applied
+  char                              *affinityCPUs;
+  int                                affinityNode;
+  // Completions held back by an open enqueue batch on this queue's thread
+  unsigned int                       batchDepth;
+  unsigned int                       batchCount;
+  struct vdo_completion             *batch[VDO_ENQUEUE_BATCH_SIZE];
+  enum vdo_completion_priority       batchPriorities[VDO_ENQUEUE_BATCH_SIZE];
   struct funnel_queue               *queues[];
 };
 
@@ -179,9 +187,10 @@ int vdo_make_work_queue(const char *thread_name_prefix,
     VDO_ASSERT_SUCCESS(uds_make_funnel_queue(&queue->queues[i]));
   }
 
-  queue->vdo_thread = owner;
-  queue->type       = type;
-  queue->context    = privates;
+  queue->vdo_thread   = owner;
+  queue->type         = type;
+  queue->context      = privates;
+  queue->affinityNode = NUMA_NO_NODE;
   WRITE_ONCE(queue->running, true);
 
   VDO_ASSERT_SUCCESS(uds_create_thread(queueRunner,
@@ -208,11 +217,62 @@ void vdo_free_work_queue(struct vdo_work_queue *queue)
   }
 
   free_event_count(queue->wakeEvent);
+  uds_free(queue->affinityCPUs);
   uds_free(queue->threadName);
   uds_free(queue->name);
   uds_free(queue);
 }
 
+/**
+ * Get the work queue of the current thread without the side effect of
+ * vdo_get_current_work_queue() of looking up the VDO.
+ *
+ * @return the current thread's work queue or NULL if it is not a VDO thread
+ **/
+static struct vdo_work_queue *getCurrentQueue(void)
+{
+  return ((vdo == NULL) ? NULL : vdo_get_current_work_queue());
+}
+
+/**
+ * Publish the completions held back by an enqueue batch, putting those bound
+ * for each priority of each queue on it as a single chain.
+ *
+ * @param currentQueue  the queue of the thread which enqueued the completions
+ **/
+static void flushEnqueueBatch(struct vdo_work_queue *currentQueue)
+{
+  for (unsigned int i = 0; i < currentQueue->batchCount; i++) {
+    struct vdo_completion *first = currentQueue->batch[i];
+    if (first == NULL) {
+      continue;
+    }
+
+    enum vdo_completion_priority priority = currentQueue->batchPriorities[i];
+    struct vdo_completion *last = first;
+    for (unsigned int j = i + 1; j < currentQueue->batchCount; j++) {
+      struct vdo_completion *completion = currentQueue->batch[j];
+      if ((completion == NULL)
+          || (completion->my_queue != first->my_queue)
+          || (currentQueue->batchPriorities[j] != priority)) {
+        continue;
+      }
+
+      last->work_queue_entry_link.next = &completion->work_queue_entry_link;
+      last = completion;
+      currentQueue->batch[j] = NULL;
+    }
+
+    struct vdo_work_queue *queue = first->my_queue;
+    uds_funnel_queue_put_chain(queue->queues[priority],
+                               &first->work_queue_entry_link,
+                               &last->work_queue_entry_link);
+    event_count_broadcast(queue->wakeEvent);
+  }
+
+  currentQueue->batchCount = 0;
+}
+
 /*****************************************************************************/
 void vdo_enqueue_work_queue(struct vdo_work_queue *queue,
                             struct vdo_completion *completion)
@@ -228,11 +288,69 @@ void vdo_enqueue_work_queue(struct vdo_work_queue *queue,
 
   CU_ASSERT(priority <= queue->type->max_priority);
   completion->my_queue = queue;
+
+  struct vdo_work_queue *currentQueue = getCurrentQueue();
+  if ((currentQueue != NULL) && (currentQueue->batchDepth > 0)) {
+    currentQueue->batch[currentQueue->batchCount] = completion;
+    currentQueue->batchPriorities[currentQueue->batchCount++] = priority;
+    if (currentQueue->batchCount == VDO_ENQUEUE_BATCH_SIZE) {
+      flushEnqueueBatch(currentQueue);
+    }
+    return;
+  }
+
   uds_funnel_queue_put(queue->queues[priority],
                        &completion->work_queue_entry_link);
   event_count_broadcast(queue->wakeEvent);
 }
 
+/*****************************************************************************/
+void vdo_start_enqueue_batch(void)
+{
+  struct vdo_work_queue *currentQueue = getCurrentQueue();
+  if (currentQueue != NULL) {
+    currentQueue->batchDepth++;
+  }
+}
+
+/*****************************************************************************/
+void vdo_finish_enqueue_batch(void)
+{
+  struct vdo_work_queue *currentQueue = getCurrentQueue();
+  if (currentQueue == NULL) {
+    return;
+  }
+
+  CU_ASSERT(currentQueue->batchDepth > 0);
+  if (--currentQueue->batchDepth == 0) {
+    flushEnqueueBatch(currentQueue);
+  }
+}
+
+/*****************************************************************************/
+int vdo_set_work_queue_affinity(struct vdo_work_queue *queue,
+                                const char *cpus,
+                                int node)
+{
+  uds_free(uds_forget(queue->affinityCPUs));
+  queue->affinityNode = node;
+  if (cpus == NULL) {
+    return VDO_SUCCESS;
+  }
+
+  return uds_duplicate_string(cpus, "work queue affinity",
+                              &queue->affinityCPUs);
+}
+
+/*****************************************************************************/
+void getWorkQueueAffinity(struct vdo_work_queue *queue,
+                          const char **cpusPtr,
+                          int *nodePtr)
+{
+  *cpusPtr = queue->affinityCPUs;
+  *nodePtr = queue->affinityNode;
+}
+
 /*****************************************************************************/
 void vdo_finish_work_queue(struct vdo_work_queue *queue)
 {
@@ -165,6 +165,17 @@ int parseIndexConfig(UdsConfigStrings    *configStrings,
     config.sparse = (strcmp(configStrings->sparse, "0") != 0);
   }
 
+  config.fingerprint = VDO_FINGERPRINT_MURMUR3;
+  if (configStrings->fingerprint != NULL) {
+    enum vdo_fingerprint fingerprint;
+    int result = vdo_parse_fingerprint_name(configStrings->fingerprint,
+                                            &fingerprint);
+    if (result != VDO_SUCCESS) {
+      return result;
+    }
+    config.fingerprint = fingerprint;
+  }
+
   *configPtr = config;
   return VDO_SUCCESS;
 }
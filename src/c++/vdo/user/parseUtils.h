@@ -15,6 +15,7 @@
 typedef struct {
   char *sparse;
   char *memorySize;
+  char *fingerprint;
 } UdsConfigStrings;
 
 /**
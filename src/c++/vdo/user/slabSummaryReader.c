@@ -25,10 +25,12 @@ int readSlabSummary(UserVDO *vdo, struct slab_summary_entry **entriesPtr)
     return VDO_SUCCESS;
   }
 
+  // The zones' summaries are contiguous, so read them all at once.
   struct slab_summary_entry *entries;
   block_count_t summary_blocks = VDO_SLAB_SUMMARY_BLOCKS_PER_ZONE;
   int result = vdo->layer->allocateIOBuffer(vdo->layer,
-                                            summary_blocks * VDO_BLOCK_SIZE,
+                                            zones * summary_blocks
+                                            * VDO_BLOCK_SIZE,
                                             "slab summary entries",
                                             (char **) &entries);
   if (result != VDO_SUCCESS) {
@@ -42,50 +44,26 @@ int readSlabSummary(UserVDO *vdo, struct slab_summary_entry **entriesPtr)
                              &slab_summary_partition);
   if (result != VDO_SUCCESS) {
     warnx("Could not find slab summary partition");
+    uds_free(entries);
     return result;
   }
 
-  physical_block_number_t origin = slab_summary_partition->offset;
-  result = vdo->layer->reader(vdo->layer, origin, summary_blocks, (char *) entries);
+  result = vdo->layer->reader(vdo->layer, slab_summary_partition->offset,
+                              zones * summary_blocks, (char *) entries);
   if (result != VDO_SUCCESS) {
     warnx("Could not read summary data");
     uds_free(entries);
     return result;
   }
 
-  // If there is more than one zone, read and combine the other zone's data
-  // with the data already read from the first zone.
-  if (zones > 1) {
-    struct slab_summary_entry *buffer;
-    result = vdo->layer->allocateIOBuffer(vdo->layer,
-                                          summary_blocks * VDO_BLOCK_SIZE,
-                                          "slab summary entries",
-                                          (char **) &buffer);
-    if (result != VDO_SUCCESS) {
-      warnx("Could not create slab summary buffer");
-      uds_free(entries);
-      return result;
+  // Combine the other zones' data with the data read from the first zone.
+  for (zone_count_t zone = 1; zone < zones; zone++) {
+    struct slab_summary_entry *zone_summary = entries + (zone * MAX_VDO_SLABS);
+    for (slab_count_t entry_number = zone; entry_number < MAX_VDO_SLABS;
+         entry_number += zones) {
+      memcpy(entries + entry_number, zone_summary + entry_number,
+             sizeof(struct slab_summary_entry));
     }
-
-    for (zone_count_t zone = 1; zone < zones; zone++) {
-      origin += summary_blocks;
-      result = vdo->layer->reader(vdo->layer, origin, summary_blocks,
-                                  (char *) buffer);
-      if (result != VDO_SUCCESS) {
-        warnx("Could not read summary data");
-        uds_free(buffer);
-        uds_free(entries);
-        return result;
-      }
-
-      for (slab_count_t entry_number = zone; entry_number < MAX_VDO_SLABS;
-           entry_number += zones) {
-        memcpy(entries + entry_number, buffer + entry_number,
-               sizeof(struct slab_summary_entry));
-      }
-    }
-
-    uds_free(buffer);
   }
 
   *entriesPtr = entries;
@@ -445,11 +445,19 @@ static void findSlabJournalEntries(physical_block_number_t pbn)
       = slabs[slabNumber].slabJournalBlocks[i];
     journal_entry_count_t entryCount
       = __le16_to_cpu(block->header.entry_count);
+    struct slab_journal_block_cursor cursor;
+    memset(&cursor, 0, sizeof(cursor));
     for (journal_entry_count_t entryIndex = 0;
          entryIndex < entryCount;
          entryIndex++) {
-      struct slab_journal_entry entry
-        = vdo_decode_slab_journal_entry(block, entryIndex);
+      struct slab_journal_entry entry;
+      int result = vdo_decode_next_slab_journal_entry(block, &cursor, &entry);
+      if (result != VDO_SUCCESS) {
+        printf("slab journal block %llu of slab %d is corrupt at entry %d\n",
+               (unsigned long long) i, slabNumber, entryIndex);
+        break;
+      }
+
       if (slabOffset == entry.sbn) {
         printf("PBN %llu (%llu, %d) %s\n",
                (unsigned long long) pbn,
@@ -156,5 +156,7 @@ int main(int argc, char *argv[])
   printf("IndexConfig:\n");
   printf("  memory: %u\n", geometry.index_config.mem);
   printf("  sparse: %s\n", geometry.index_config.sparse ? "true" : "false");
+  printf("  fingerprint: %s\n",
+         vdo_get_fingerprint_name(geometry.index_config.fingerprint));
   exit(0);
 }
@@ -22,6 +22,9 @@
 #include "murmurhash3.h"
 #include "uds.h"
 
+#include "encodings.h"
+#include "status-codes.h"
+
 #define BLOCK_SIZE 4096
 
 struct query {
@@ -49,6 +52,7 @@ static uds_memory_config_size_t mem_size = UDS_MEMORY_CONFIG_256MB;
 static uint64_t nonce = 0;
 static off_t offset = 0;
 static bool use_sparse = false;
+static uint32_t fingerprint = 0;
 static bool force_rebuild = false;
 static unsigned int poll_interval;
 /*
@@ -169,6 +173,8 @@ static void usage(char *prog)
          "Fill a UDS index with synthetic data.\n"
          "\n"
          "Options:\n"
+         "  --fingerprint=Name  The record name fingerprint the index was\n"
+         "                      created with, default murmur3\n"
          "  --help              Print this help message and exit\n"
          "  --force-rebuild     Cause the index to rebuild on next load\n"
          "  --memory-size=Size  Optional index memory size, default 0.25\n"
@@ -215,6 +221,21 @@ static uint64_t parse_nonce(char *optarg)
   return (uint64_t) n;
 }
 
+static uint32_t parse_fingerprint(char *optarg)
+{
+  enum vdo_fingerprint named;
+  if (vdo_parse_fingerprint_name(optarg, &named) == VDO_SUCCESS) {
+    return named;
+  }
+
+  char *endptr = NULL;
+  unsigned long n = strtoul(optarg, &endptr, 10);
+  if ((*endptr != '\0') || (n > UINT32_MAX)) {
+    errx(1, "Fingerprint must be murmur3, aes, or a non-negative integer");
+  }
+  return (uint32_t) n;
+}
+
 static off_t parse_offset(char *optarg)
 {
   char *endptr = NULL;
@@ -258,6 +279,7 @@ static void parse_args(int argc, char *argv[])
 {
   static const char *optstring = "hn:o:";
   static const struct option longopts[] = {
+    {"fingerprint",     required_argument, 0,    'F'},
     {"force-rebuild",   no_argument,       0,    'f'},
     {"help",            no_argument,       0,    'h'},
     {"nonce",           required_argument, 0,    'n'},
@@ -269,6 +291,9 @@ static void parse_args(int argc, char *argv[])
   int opt;
   while ((opt = getopt_long(argc, argv, optstring, longopts, NULL)) != -1) {
     switch(opt) {
+    case 'F':
+      fingerprint = parse_fingerprint(optarg);
+      break;
     case 'f':
       force_rebuild = true;
       break;
@@ -326,6 +351,7 @@ int main(int argc, char *argv[])
     .sparse      = use_sparse,
     .nonce       = nonce,
     .zone_count  = 1,
+    .fingerprint = fingerprint,
   };
 
   result = uds_open_index(UDS_LOAD, &params, session);
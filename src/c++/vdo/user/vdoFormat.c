@@ -24,6 +24,7 @@
 #include "time-utils.h"
 
 #include "constants.h"
+#include "fingerprint.h"
 #include "status-codes.h"
 #include "types.h"
 #include "vdoConfig.h"
@@ -57,6 +58,15 @@ static const char helpString[] =
   "  vdoformat can also modify some of the formatting parameters.\n"
   "\n"
   "OPTIONS\n"
+  "    --fingerprint=<name>\n"
+  "       Select the function used to compute the fingerprint (record name)\n"
+  "       of each data block for deduplication. Accepted values are\n"
+  "       murmur3 (the default) and aes, which is several times faster on\n"
+  "       processors with the AES-NI instructions. The choice is recorded\n"
+  "       in the volume and its index, and can not be changed without\n"
+  "       reformatting. Older versions of VDO will refuse to load a volume\n"
+  "       formatted with aes.\n"
+  "\n"
   "    --force\n"
   "       Format the block device, even if there is already a VDO formatted\n"
   "       thereupon.\n"
@@ -102,6 +112,7 @@ static const char helpString[] =
 
 // N.B. the option array must be in sync with the option string.
 static struct option options[] = {
+  { "fingerprint",     required_argument, NULL, 'F' },
   { "force",           no_argument,       NULL, 'f' },
   { "help",            no_argument,       NULL, 'h' },
   { "logical-size",    required_argument, NULL, 'l' },
@@ -112,7 +123,7 @@ static struct option options[] = {
   { "version",         no_argument,       NULL, 'V' },
   { NULL,              0,                 NULL,  0  },
 };
-static char optionString[] = "fhil:S:m:svV";
+static char optionString[] = "F:fhil:S:m:svV";
 
 static void usage(const char *progname, const char *usageOptionsString)
 {
@@ -414,6 +425,10 @@ int main(int argc, char *argv[])
 
   while ((c = getopt_long(argc, argv, optionString, options, NULL)) != -1) {
     switch (c) {
+    case 'F':
+      configStrings.fingerprint = optarg;
+      break;
+
     case 'f':
       force = true;
       break;
@@ -545,11 +560,23 @@ int main(int argc, char *argv[])
 
   struct index_config indexConfig;
   result = parseIndexConfig(&configStrings, &indexConfig);
+  if ((result == VDO_BAD_CONFIGURATION)
+      && (configStrings.fingerprint != NULL)) {
+    errx(result, "unknown fingerprint '%s', must be murmur3 or aes",
+         configStrings.fingerprint);
+  }
   if (result != UDS_SUCCESS) {
     errx(result, "parseIndexConfig failed: %s",
          uds_string_error(result, errorBuffer, sizeof(errorBuffer)));
   }
 
+  vdo_initialize_fingerprints();
+  if (!vdo_is_fingerprint_accelerated(indexConfig.fingerprint)) {
+    warnx("this processor lacks the AES-NI instructions, so deduplication "
+          "with the %s fingerprint will be slow",
+          vdo_get_fingerprint_name(indexConfig.fingerprint));
+  }
+
   // Zero out the UDS superblock in case there's already a UDS there.
   char *zeroBuffer;
   result = layer->allocateIOBuffer(layer, VDO_BLOCK_SIZE,
@@ -576,6 +603,8 @@ int main(int argc, char *argv[])
              filename, (unsigned long long) config.physical_blocks,
              VDO_BLOCK_SIZE);
     }
+    printf("Using the %s fingerprint for deduplication.\n",
+           vdo_get_fingerprint_name(indexConfig.fingerprint));
   }
 
   result = formatVDO(&config, &indexConfig, layer);
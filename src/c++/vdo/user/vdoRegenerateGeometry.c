@@ -24,13 +24,15 @@
 #include "vdoVolumeUtils.h"
 
 static const char usageString[]
-  = "[--help] [--version] [--offset <offset>] <filename>";
+  = "[--help] [--version] [--offset <offset>] [--fingerprint <name>]"
+    " <filename>";
 
 static const char helpString[] =
   "vdoRegenerateGeometry - regenerate a VDO whose first few blocks have been wiped\n"
   "\n"
   "SYNOPSIS\n"
-  "  vdoRegenerateGeometry [--offset <offset>] <filename>\n"
+  "  vdoRegenerateGeometry [--offset <offset>] [--fingerprint <name>]"
+  " <filename>\n"
   "\n"
   "DESCRIPTION\n"
   "  vdoRegenerateGeometry will attempt to regenerate the geometry block of a\n"
@@ -43,6 +45,10 @@ static const char helpString[] =
   "  super blocks in the event that multiple candidates were found, the\n"
   "  --offset option can be used to specify the location (in bytes) of the\n"
   "  super block on the backing store.\n"
+  "\n"
+  "  The fingerprint the VDO was formatted with can not be recovered from the\n"
+  "  super block. If it was not the default (murmur3), the --fingerprint\n"
+  "  option must be used to name it, or the index will refuse to load.\n"
   "\n";
 
 enum {
@@ -52,10 +58,11 @@ enum {
 };
 
 static struct option options[] = {
-  { "help",    no_argument,       NULL, 'h' },
-  { "version", no_argument,       NULL, 'V' },
-  { "offset",  required_argument, NULL, 'o' },
-  { NULL,      0,                 NULL,  0  },
+  { "help",        no_argument,       NULL, 'h' },
+  { "version",     no_argument,       NULL, 'V' },
+  { "offset",      required_argument, NULL, 'o' },
+  { "fingerprint", required_argument, NULL, 'F' },
+  { NULL,          0,                 NULL,  0  },
 };
 
 typedef struct {
@@ -73,8 +80,9 @@ static char           errorBuffer[UDS_MAX_ERROR_MESSAGE_SIZE];
 static Candidate      candidates[UDS_CONFIGURATIONS];
 static int            candidateCount = 0;
 
-static char   *fileName = NULL;
-static size_t  offset   = 0;
+static char   *fileName    = NULL;
+static size_t  offset      = 0;
+static char   *fingerprint = NULL;
 
 /**
  * Explain how this command-line tool is used.
@@ -102,7 +110,8 @@ static void processArgs(int argc, char *argv[])
   }
 
   int c;
-  while ((c = getopt_long(argc, argv, "hV", options, NULL)) != -1) {
+  enum vdo_fingerprint parsedFingerprint;
+  while ((c = getopt_long(argc, argv, "F:hV", options, NULL)) != -1) {
     switch (c) {
     case 'h':
       printf("%s", helpString);
@@ -122,6 +131,16 @@ static void processArgs(int argc, char *argv[])
       offset /= VDO_BLOCK_SIZE;
       break;
 
+    case 'F':
+      result = vdo_parse_fingerprint_name(optarg, &parsedFingerprint);
+      if (result != VDO_SUCCESS) {
+        warnx("unknown fingerprint '%s', must be murmur3 or aes", optarg);
+        usage(argv[0]);
+      }
+
+      fingerprint = optarg;
+      break;
+
     case 'V':
       printf("%s version is: %s\n", argv[0], CURRENT_VERSION);
       exit(0);
@@ -176,6 +195,7 @@ static int generateGeometry(const uds_memory_config_size_t memory, bool sparse)
   UdsConfigStrings configStrings;
   memset(&configStrings, 0, sizeof(configStrings));
   configStrings.memorySize = candidate->memoryString;
+  configStrings.fingerprint = fingerprint;
   if (sparse) {
     configStrings.sparse = "1";
   }
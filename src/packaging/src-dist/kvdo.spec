@@ -63,6 +63,7 @@ AUTOINSTALL="yes"
 BUILT_MODULE_NAME[0]="kvdo"
 DEST_MODULE_LOCATION[0]=/kernel/drivers/md
 BUILD_DEPENDS[0]=LZ4_COMPRESS
+BUILD_DEPENDS[0]=LZ4HC_COMPRESS
 BUILD_DEPENDS[0]=LZ4_DECOMPRESS
 STRIP[0]="no"
 EOF